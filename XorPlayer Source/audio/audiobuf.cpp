@@ -1,144 +1,217 @@
 // audiobuf.cpp
 
-#include "audiobuf.h"
-
-#define SAMPLE_SIZE_LPB 576 // Max number of audio samples stored in circular buffer. Should be no less than SAMPLE_SIZE. Expected sampling rate is 44100 Hz or 48000 Hz (samples per second).
-
-std::mutex pcmLpbMutex;
-unsigned char pcmLeftLpb[SAMPLE_SIZE_LPB]; // Circular buffer (left channel)
-unsigned char pcmRightLpb[SAMPLE_SIZE_LPB]; // Circular buffer (right channel)
-bool pcmBufDrained = false; // Buffer drained by visualization thread and holds no new samples
-signed int pcmLen = 0; // Actual number of samples the buffer holds. Can be less than SAMPLE_SIZE_LPB
-signed int pcmPos = 0; // Position to write new data
+#include "common.h"
+#include <new>
+
+// Single-producer / single-consumer lock-free ring buffer.
+// The capture thread is the only writer and the render thread the only reader.
+// Every sample is stored twice (at pos and pos + AUDIOBUF_CAPACITY), so the latest
+// N samples are always contiguous in memory and can be handed out without copying.
+#define AUDIOBUF_CAPACITY 4096 // Power of two. ~85 ms at 48000 Hz, so a 576 sample view survives ~73 ms of capture
+#define AUDIOBUF_MASK (AUDIOBUF_CAPACITY - 1)
+
+float pcmLeftLpb[AUDIOBUF_CAPACITY * 2]; // Mirrored circular buffer (left channel)
+float pcmRightLpb[AUDIOBUF_CAPACITY * 2]; // Mirrored circular buffer (right channel)
+float pcmSilence[AUDIOBUF_CAPACITY]; // Returned on underrun
+
+// Sequence counters count samples ever written (never wrap in practice)
+std::atomic<unsigned long long> pcmWriteSeq(0); // Samples published to the reader
+std::atomic<unsigned long long> pcmPendingSeq(0); // Samples the writer may be touching right now (>= pcmWriteSeq)
+std::atomic<unsigned long long> pcmValidSeq(0); // First sample still valid after the last ResetAudioBuf
+unsigned long long pcmReadSeq = 0; // Reader side only: pcmWriteSeq at the last successful read (buffer drained)
+
+// Writer side only: conversion kernel picked for the current stream format
+WAVEFORMATEXTENSIBLE pcmLastWfx = { 0 }; // Room for the extensible part: channel mask and sub format decide the kernel and downmix
+AudioConvFormat pcmConvFormat = { AUDIO_SAMPLE_UNSUPPORTED };
+AudioConvFunc pcmConvFunc = NULL;
+CResampler pcmResampler;
+
+// Writer side only: staging buffers when the device rate has to be resampled
+#define AUDIOBUF_CHUNK 1024 // Device frames converted and resampled at a time
+float pcmConvLeft[AUDIOBUF_CHUNK];
+float pcmConvRight[AUDIOBUF_CHUNK];
+float *pcmResLeft = NULL; // Sized by pcmResampler.GetMaxOutput(AUDIOBUF_CHUNK)
+float *pcmResRight = NULL;
 
 void ResetAudioBuf() {
-    std::unique_lock<std::mutex> lock(pcmLpbMutex);
-    memset(pcmLeftLpb, 0, SAMPLE_SIZE_LPB);
-    memset(pcmRightLpb, 0, SAMPLE_SIZE_LPB);
-    pcmBufDrained = false;
-    pcmLen = 0;
+    // Discontinuity in the stream, don't filter across it
+    pcmResampler.Reset();
+    ResetSpectrum();
+    // Samples already in the ring become unreadable, no need to clear the storage
+    pcmValidSeq.store(pcmWriteSeq.load(std::memory_order_relaxed), std::memory_order_release);
 }
 
-void GetAudioBuf(unsigned char *pWaveL, unsigned char *pWaveR, int SamplesCount) {
-    std::unique_lock<std::mutex> lock(pcmLpbMutex);
-    if ((pcmLen < SamplesCount) || (pcmBufDrained)) {
-        // Buffer underrun. Insufficient new samples in circular buffer (pcmLeftLpb, pcmRightLpb)
-        memset(pWaveL, 0, SamplesCount);
-        memset(pWaveR, 0, SamplesCount);
+bool GetAudioBufView(AudioBufView *pView, int SamplesCount) {
+    if (SamplesCount > AUDIOBUF_CAPACITY) {
+        SamplesCount = AUDIOBUF_CAPACITY;
     }
-    else {
-        // Circular buffer (pcmLeftLpb, pcmRightLpb) hold enough samples in it
-        for (int i = 0; i < SAMPLE_SIZE_LPB; i++) {
-            // int8_t [-128 .. +127] stored into uint8_t [0..255]
-            pWaveL[i % SamplesCount] = pcmLeftLpb[(pcmPos + i) % SAMPLE_SIZE_LPB];
-            pWaveR[i % SamplesCount] = pcmRightLpb[(pcmPos + i) % SAMPLE_SIZE_LPB];
-        }
-        pcmBufDrained = true;
+
+    unsigned long long seq = pcmWriteSeq.load(std::memory_order_acquire);
+    unsigned long long validSeq = pcmValidSeq.load(std::memory_order_acquire);
+
+    pView->SamplesCount = SamplesCount;
+    pView->nSeq = seq;
+
+    if ((seq - validSeq < (unsigned long long)SamplesCount) || (seq == pcmReadSeq)) {
+        // Buffer underrun. Insufficient new samples in circular buffer (pcmLeftLpb, pcmRightLpb)
+        pView->pWaveL = pcmSilence;
+        pView->pWaveR = pcmSilence;
+        return false;
     }
+
+    // Circular buffer (pcmLeftLpb, pcmRightLpb) hold enough samples in it
+    unsigned int start = (unsigned int)(seq - SamplesCount) & AUDIOBUF_MASK;
+    pView->pWaveL = &pcmLeftLpb[start];
+    pView->pWaveR = &pcmRightLpb[start];
+    pcmReadSeq = seq;
+    return true;
 }
 
-int8_t FltToInt(float flt) {
-    if (flt >= 1.0f) {
-        return +127; // 0x7f
-    }
-    if (flt < -1.0f) {
-        return -128; // 0x80
-    }
-    return (int8_t)(flt * 128);
-};
-
-// Union type for sample conversion
-union u_type
-{
-    int32_t IntVar;
-    float FltVar;
-    uint8_t Bytes[4];
-};
-
-int8_t GetChannelSample(const BYTE *pData, int BlockOffset, int ChannelOffset, const bool bInt16) {
-    u_type sample;
-
-    sample.IntVar = 0;
-    sample.Bytes[0] = pData[BlockOffset + ChannelOffset + 0];
-    sample.Bytes[1] = pData[BlockOffset + ChannelOffset + 1];
-    if (!bInt16) {
-        sample.Bytes[2] = pData[BlockOffset + ChannelOffset + 2];
-        sample.Bytes[3] = pData[BlockOffset + ChannelOffset + 3];
+bool IsAudioBufViewValid(const AudioBufView *pView) {
+    if ((pView->pWaveL == pcmSilence) || (pView->SamplesCount <= 0)) {
+        return true;
     }
+    // Order the reads of the viewed samples before the check (seqlock style)
+    std::atomic_thread_fence(std::memory_order_acquire);
+    unsigned long long pendingSeq = pcmPendingSeq.load(std::memory_order_relaxed);
+    // The writer overwrites the oldest viewed sample once it reaches nSeq + CAPACITY - SamplesCount
+    return (pendingSeq - pView->nSeq) <= (unsigned long long)(AUDIOBUF_CAPACITY - pView->SamplesCount);
+}
 
-    if (!bInt16) {
-        return FltToInt(sample.FltVar); //float [-1.0f .. +1.0f] range converted to int8_t [-128 .. +127] and later stored into uint8_t [0 .. 255]
-    }
-    else {
-        return (signed char)(sample.IntVar / 256); //int16_t [-32768 .. +32767] range converted to int8_t [-128 .. +127] and later stored into uint8_t [0..255]
+void GetAudioBuf(float *pWaveL, float *pWaveR, int SamplesCount) {
+    AudioBufView view;
+    if (GetAudioBufView(&view, SamplesCount)) {
+        memcpy(pWaveL, view.pWaveL, view.SamplesCount * sizeof(float));
+        memcpy(pWaveR, view.pWaveR, view.SamplesCount * sizeof(float));
+        if (IsAudioBufViewValid(&view)) {
+            return;
+        }
     }
+    memset(pWaveL, 0, SamplesCount * sizeof(float));
+    memset(pWaveR, 0, SamplesCount * sizeof(float));
 }
 
-// Expecting pData holds:
-//   signed 16-bit (2 bytes) PCM, Little Endian
+// Expecting pData holds any format accepted by GetAudioConvFormat():
+//   signed 16-bit, 24-bit or 32-bit PCM, Little Endian
 //   or
-//   32-bit float (4 bytes) PCM
+//   32-bit float PCM
 // Supported audio formats:
 //   pwfx->nChannels;          /* ANY number of channels (i.e. mono, stereo...) */
-//   pwfx->nSamplesPerSec;     /* 44100 or 48000 sample rate */
+//   pwfx->nSamplesPerSec;     /* ANY sample rate, resampled to AUDIOBUF_SAMPLE_RATE (44100 and 48000 are the usual ones, 88200, 96000 and 192000 work too) */
 //   pwfx->nBlockAlign;        /* ANY block size of data */
-//   pwfx->wBitsPerSample;     /* 16 or 32 number of bits per sample of mono data */
+//   pwfx->wBitsPerSample;     /* 16, 24 or 32 number of bits per sample of mono data */
+
+// Copy analysis rate samples into the ring and its mirror. Writer side only
+static void WriteAudioBuf(const float *pLeft, const float *pRight, UINT32 nFrames, unsigned long long &seq) {
+    for (UINT32 i = 0; i < nFrames; ) {
+        unsigned int pos = (unsigned int)seq & AUDIOBUF_MASK;
+        UINT32 len = min(nFrames - i, (UINT32)(AUDIOBUF_CAPACITY - pos));
 
-void SetAudioBuf(const BYTE *pData, const UINT32 nNumFramesToRead, const WAVEFORMATEX *pwfx, const bool bInt16) {
-    int BlockOffset;
+        memcpy(&pcmLeftLpb[pos], pLeft + i, len * sizeof(float));
+        memcpy(&pcmRightLpb[pos], pRight + i, len * sizeof(float));
+        memcpy(&pcmLeftLpb[pos + AUDIOBUF_CAPACITY], pLeft + i, len * sizeof(float));
+        memcpy(&pcmRightLpb[pos + AUDIOBUF_CAPACITY], pRight + i, len * sizeof(float));
 
-    int8_t LeftSample8;
-    int8_t RightSample8;
+        i += len;
+        seq += len;
+    }
+}
 
+// Bytes of the stream format that are compared and kept, the extensible part included (cbSize capped to pcmLastWfx)
+static size_t AudioBufWfxSize(const WAVEFORMATEX *pwfx) {
+    return min(sizeof(WAVEFORMATEX) + pwfx->cbSize, sizeof(WAVEFORMATEXTENSIBLE));
+}
 
-    std::unique_lock<std::mutex> lock(pcmLpbMutex);
-    //memset(pcmLeftLpb, 0, SAMPLE_SIZE_LPB);
-    //memset(pcmRightLpb, 0, SAMPLE_SIZE_LPB);
+static void RememberAudioBufFormat(const WAVEFORMATEX *pwfx) {
+    memset(&pcmLastWfx, 0, sizeof(pcmLastWfx));
+    memcpy(&pcmLastWfx, pwfx, AudioBufWfxSize(pwfx));
+}
 
-    int i = 0;
-    int n = 0;
+// Stream format changed: pick the conversion kernel and set up the resampler
+static void SetAudioBufFormat(const WAVEFORMATEX *pwfx) {
+    pcmConvFunc = GetAudioConvFormat(pwfx, &pcmConvFormat) ? GetAudioConvFunc(&pcmConvFormat) : NULL;
+    if (pcmConvFunc == NULL) {
+        ERR(L"Unsupported audio format for visualizer: wFormatTag = 0x%04x, %u bits, %u channels", pwfx->wFormatTag, pwfx->wBitsPerSample, pwfx->nChannels);
+        // Retrying won't help, remember it so the error isn't logged for every packet
+        RememberAudioBufFormat(pwfx);
+        return;
+    }
 
-    int start = 0;
-    int len = 0;
-    if (nNumFramesToRead >= SAMPLE_SIZE_LPB) {
-        n = 0;
-        start = nNumFramesToRead - SAMPLE_SIZE_LPB;
-        len = SAMPLE_SIZE_LPB;
+    delete[] pcmResLeft;
+    delete[] pcmResRight;
+    pcmResLeft = pcmResRight = NULL;
+
+    if (!pcmResampler.Init(pwfx->nSamplesPerSec, AUDIOBUF_SAMPLE_RATE)) {
+        // Analysis runs on the device rate as it is, band edges will be off
+        pcmResampler.Init(AUDIOBUF_SAMPLE_RATE, AUDIOBUF_SAMPLE_RATE);
     }
-    else {
-        n = SAMPLE_SIZE_LPB - nNumFramesToRead;
-        start = 0;
-        len = nNumFramesToRead;
+    if (pcmResampler.IsActive()) {
+        UINT32 nMaxOut = pcmResampler.GetMaxOutput(AUDIOBUF_CHUNK);
+        pcmResLeft = new (std::nothrow) float[nMaxOut];
+        pcmResRight = new (std::nothrow) float[nMaxOut];
+        if (!pcmResLeft || !pcmResRight) {
+            // Forget the format, whatever comes next (even the previous one) sets up again
+            memset(&pcmLastWfx, 0, sizeof(pcmLastWfx));
+            pcmConvFunc = NULL;
+            return;
+        }
     }
+    RememberAudioBufFormat(pwfx);
+}
 
-    for (int i = start; i < len; i++, n++) {
-        BlockOffset = i * pwfx->nBlockAlign;
+void SetAudioBuf(const BYTE *pData, const UINT32 nNumFramesToRead, const WAVEFORMATEX *pwfx) {
+    // Pick the conversion kernel once per stream format instead of branching per sample
+    if (memcmp(&pcmLastWfx, pwfx, AudioBufWfxSize(pwfx)) != 0) {
+        SetAudioBufFormat(pwfx);
+    }
+    if (pcmConvFunc == NULL) {
+        return;
+    }
 
-        // Left channel (number 0)
-        LeftSample8 = 0; // Init with silence
-        if (pwfx->nChannels >= 1) {
-            LeftSample8 = GetChannelSample(pData, BlockOffset, 0 * (pwfx->wBitsPerSample / 8), bInt16);
+    unsigned long long seq = pcmWriteSeq.load(std::memory_order_relaxed);
+
+    if (pcmResampler.IsActive()) {
+        // Device rate differs from AUDIOBUF_SAMPLE_RATE (e.g. 48000, 96000 or 192000 Hz).
+        // Every frame goes through the filter to keep its state continuous
+        pcmPendingSeq.store(seq + pcmResampler.GetMaxOutput(nNumFramesToRead) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (UINT32 i = 0; i < nNumFramesToRead; ) {
+            UINT32 len = min(nNumFramesToRead - i, (UINT32)AUDIOBUF_CHUNK);
+            pcmConvFunc(pData + i * pcmConvFormat.nBlockAlign, len, &pcmConvFormat, pcmConvLeft, pcmConvRight);
+            UINT32 nOut = pcmResampler.Process(pcmConvLeft, pcmConvRight, len, pcmResLeft, pcmResRight);
+            WriteAudioBuf(pcmResLeft, pcmResRight, nOut, seq);
+            UpdateSpectrum(pcmResLeft, pcmResRight, nOut);
+            i += len;
         }
-
-        // Right channel (number 1)
-        RightSample8 = LeftSample8; // Init with left channel value just in case of Mono, 1 channel count
-        if (pwfx->nChannels >= 2) {
-            RightSample8 = GetChannelSample(pData, BlockOffset, 1 * (pwfx->wBitsPerSample / 8), bInt16);
+    }
+    else {
+        // Only the latest AUDIOBUF_CAPACITY frames of a large packet can be kept
+        UINT32 start = 0;
+        if (nNumFramesToRead > AUDIOBUF_CAPACITY) {
+            start = nNumFramesToRead - AUDIOBUF_CAPACITY;
+            seq += start;
         }
 
-        // TODO: add support for 96000 Hz and 192000 Hz sample rates
+        // Announce the region about to be overwritten before touching it
+        pcmPendingSeq.store(seq + (nNumFramesToRead - start), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
 
-        // Ignoring data in all other audio channels (Quadraphonic 4.0, Surround 4.0, Surround 5.1, Surround 7.1, ...)
+        // Convert straight into the ring in runs that don't cross its end, then fill in the mirror
+        for (UINT32 i = start; i < nNumFramesToRead; ) {
+            unsigned int pos = (unsigned int)seq & AUDIOBUF_MASK;
+            UINT32 len = min(nNumFramesToRead - i, (UINT32)(AUDIOBUF_CAPACITY - pos));
 
-        // Saving audio data for visualizer
-        // 8-bit signed integer in Two's Complement Representation stored in unsigned char array
-        // int8_t[-128 .. + 127] stored into uint8_t[0 .. 255]
-        pcmLeftLpb[(pcmPos + n) % SAMPLE_SIZE_LPB] = LeftSample8;
-        pcmRightLpb[(pcmPos + n) % SAMPLE_SIZE_LPB] = RightSample8;
-    }
+            pcmConvFunc(pData + i * pcmConvFormat.nBlockAlign, len, &pcmConvFormat, &pcmLeftLpb[pos], &pcmRightLpb[pos]);
+            memcpy(&pcmLeftLpb[pos + AUDIOBUF_CAPACITY], &pcmLeftLpb[pos], len * sizeof(float));
+            memcpy(&pcmRightLpb[pos + AUDIOBUF_CAPACITY], &pcmRightLpb[pos], len * sizeof(float));
+            UpdateSpectrum(&pcmLeftLpb[pos], &pcmRightLpb[pos], len);
 
-    pcmBufDrained = false;
-    pcmLen = (pcmLen + len <= SAMPLE_SIZE_LPB) ? (pcmLen + len) : (SAMPLE_SIZE_LPB);
-    pcmPos = (pcmPos + len) % SAMPLE_SIZE_LPB;
+            i += len;
+            seq += len;
+        }
+    }
 
+    // Publish new samples to the reader
+    pcmWriteSeq.store(seq, std::memory_order_release);
 }
@@ -1,13 +1,34 @@
 // audiobuf.h
 
-#include <mutex>
+#include <atomic>
 #include <windows.h>
 
-// Reset audio buffer discarding stored audio data
+#define AUDIOBUF_SAMPLE_RATE 44100 // Analysis sample rate. Band edges in AnalyzeNewSound() assume it
+
+// Read-only view of the latest samples held in the audio ring buffer.
+// Pointers reference the ring storage directly (no copy). The capture thread
+// keeps writing behind the view; use IsAudioBufViewValid() to check that it
+// did not lap the viewed region before the samples were consumed.
+struct AudioBufView {
+    const float *pWaveL; // SamplesCount samples in [-1.0f .. +1.0f] range, oldest first
+    const float *pWaveR;
+    int SamplesCount;
+    unsigned long long nSeq; // Write sequence number the view was taken at
+};
+
+// Reset audio buffer discarding stored audio data (capture thread only)
 void ResetAudioBuf();
 
-// Return previously saved audio data for visualizer
-void GetAudioBuf(unsigned char *pWaveL, unsigned char *pWaveR, int SamplesCount);
+// Return view of the latest SamplesCount samples for visualizer (render thread only).
+// Returns false and points the view at silence on underrun or when no new samples arrived.
+bool GetAudioBufView(AudioBufView *pView, int SamplesCount);
+
+// Check that samples referenced by the view were not overwritten in the meantime
+bool IsAudioBufViewValid(const AudioBufView *pView);
+
+// Return previously saved audio data for visualizer (copy of GetAudioBufView)
+void GetAudioBuf(float *pWaveL, float *pWaveR, int SamplesCount);
 
-// Save audio data for visualizer
-void SetAudioBuf(const BYTE *pData, const UINT32 nNumFramesToRead, const WAVEFORMATEX *pwfx, const bool bInt16);
+// Save audio data for visualizer (capture thread only).
+// Any format accepted by GetAudioConvFormat() is converted to float samples at AUDIOBUF_SAMPLE_RATE.
+void SetAudioBuf(const BYTE *pData, const UINT32 nNumFramesToRead, const WAVEFORMATEX *pwfx);
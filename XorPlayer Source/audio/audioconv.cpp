@@ -0,0 +1,453 @@
+// audioconv.cpp
+
+#include "common.h"
+#include <intrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#define INT16_SCALE (1.0f / 32768.0f)
+#define INT24_SCALE (1.0f / 8388608.0f)
+#define INT32_SCALE (1.0f / 2147483648.0f)
+
+#define MIX_SIDE 0.7071068f // -3 dB for center and surround channels
+#define MIX_BACK_CENTER 0.5f
+
+static inline float ClampSample(float flt) {
+    if (flt > 1.0f) {
+        return 1.0f;
+    }
+    if (flt < -1.0f) {
+        return -1.0f;
+    }
+    return flt;
+}
+
+// Read one sample of the given type as float. Int samples are not clamped since they can't exceed the range
+template <AudioSampleType Type>
+static inline float ReadSample(const BYTE *p);
+
+template <>
+inline float ReadSample<AUDIO_SAMPLE_INT16>(const BYTE *p) {
+    return (float)*(const int16_t *)p * INT16_SCALE;
+}
+
+template <>
+inline float ReadSample<AUDIO_SAMPLE_INT24>(const BYTE *p) {
+    // Place the 3 bytes in the upper part of an int32 and shift back for sign extension
+    return (float)((int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8) * INT24_SCALE;
+}
+
+template <>
+inline float ReadSample<AUDIO_SAMPLE_INT32>(const BYTE *p) {
+    return (float)*(const int32_t *)p * INT32_SCALE;
+}
+
+template <>
+inline float ReadSample<AUDIO_SAMPLE_FLOAT32>(const BYTE *p) {
+    return *(const float *)p;
+}
+
+// Scalar kernels: any block size, one sample type each
+
+// Mono or stereo. Right channel takes the left one in case of Mono
+template <AudioSampleType Type>
+static void ConvertScalar(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight) {
+    const UINT32 nRightOffset = (pFmt->nChannels >= 2) ? pFmt->nBytesPerSample : 0;
+    for (UINT32 i = 0; i < nFrames; i++, pData += pFmt->nBlockAlign) {
+        pLeft[i] = ClampSample(ReadSample<Type>(pData));
+        pRight[i] = ClampSample(ReadSample<Type>(pData + nRightOffset));
+    }
+}
+
+// Any number of channels downmixed to stereo in one pass over the frame
+template <AudioSampleType Type>
+static void ConvertDownmixScalar(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight) {
+    const UINT32 nChannels = min(pFmt->nChannels, (UINT32)AUDIOCONV_MAX_CHANNELS);
+    for (UINT32 i = 0; i < nFrames; i++, pData += pFmt->nBlockAlign) {
+        float l = 0.0f;
+        float r = 0.0f;
+        for (UINT32 ch = 0; ch < nChannels; ch++) {
+            float s = ReadSample<Type>(pData + ch * pFmt->nBytesPerSample);
+            l += s * pFmt->fMixL[ch];
+            r += s * pFmt->fMixR[ch];
+        }
+        pLeft[i] = ClampSample(l);
+        pRight[i] = ClampSample(r);
+    }
+}
+
+// SSE2 kernels for packed stereo streams (nBlockAlign == 2 samples), 4 frames per iteration
+
+static void ConvertInt16Stereo_SSE2(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight) {
+    const __m128 scale = _mm_set1_ps(INT16_SCALE);
+    const int16_t *pSrc = (const int16_t *)pData;
+    UINT32 i = 0;
+    for (; i + 4 <= nFrames; i += 4, pSrc += 8) {
+        // L0 R0 L1 R1 L2 R2 L3 R3
+        __m128i lr = _mm_loadu_si128((const __m128i *)pSrc);
+        // Sign extend the low (left) and high (right) halves of each 32-bit frame
+        __m128i l = _mm_srai_epi32(_mm_slli_epi32(lr, 16), 16);
+        __m128i r = _mm_srai_epi32(lr, 16);
+        _mm_storeu_ps(pLeft + i, _mm_mul_ps(_mm_cvtepi32_ps(l), scale));
+        _mm_storeu_ps(pRight + i, _mm_mul_ps(_mm_cvtepi32_ps(r), scale));
+    }
+    if (i < nFrames) {
+        ConvertScalar<AUDIO_SAMPLE_INT16>(pData + i * pFmt->nBlockAlign, nFrames - i, pFmt, pLeft + i, pRight + i);
+    }
+}
+
+static void ConvertFloat32Stereo_SSE2(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const float *pSrc = (const float *)pData;
+    UINT32 i = 0;
+    for (; i + 4 <= nFrames; i += 4, pSrc += 8) {
+        __m128 a = _mm_loadu_ps(pSrc);     // L0 R0 L1 R1
+        __m128 b = _mm_loadu_ps(pSrc + 4); // L2 R2 L3 R3
+        __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(pLeft + i, _mm_max_ps(_mm_min_ps(l, one), minusOne));
+        _mm_storeu_ps(pRight + i, _mm_max_ps(_mm_min_ps(r, one), minusOne));
+    }
+    if (i < nFrames) {
+        ConvertScalar<AUDIO_SAMPLE_FLOAT32>(pData + i * pFmt->nBlockAlign, nFrames - i, pFmt, pLeft + i, pRight + i);
+    }
+}
+
+// AVX2 kernels, 8 frames per iteration. Only called after GetAudioConvIsa() reported AVX2
+
+static void ConvertInt16Stereo_AVX2(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight) {
+    const __m256 scale = _mm256_set1_ps(INT16_SCALE);
+    const int16_t *pSrc = (const int16_t *)pData;
+    UINT32 i = 0;
+    for (; i + 8 <= nFrames; i += 8, pSrc += 16) {
+        __m256i lr = _mm256_loadu_si256((const __m256i *)pSrc);
+        __m256i l = _mm256_srai_epi32(_mm256_slli_epi32(lr, 16), 16);
+        __m256i r = _mm256_srai_epi32(lr, 16);
+        _mm256_storeu_ps(pLeft + i, _mm256_mul_ps(_mm256_cvtepi32_ps(l), scale));
+        _mm256_storeu_ps(pRight + i, _mm256_mul_ps(_mm256_cvtepi32_ps(r), scale));
+    }
+    _mm256_zeroupper();
+    if (i < nFrames) {
+        ConvertInt16Stereo_SSE2(pData + i * pFmt->nBlockAlign, nFrames - i, pFmt, pLeft + i, pRight + i);
+    }
+}
+
+static void ConvertFloat32Stereo_AVX2(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minusOne = _mm256_set1_ps(-1.0f);
+    const float *pSrc = (const float *)pData;
+    UINT32 i = 0;
+    for (; i + 8 <= nFrames; i += 8, pSrc += 16) {
+        __m256 a = _mm256_loadu_ps(pSrc);     // L0 R0 L1 R1 | L2 R2 L3 R3
+        __m256 b = _mm256_loadu_ps(pSrc + 8); // L4 R4 L5 R5 | L6 R6 L7 R7
+        // Shuffle works per 128-bit lane: L0 L1 L4 L5 | L2 L3 L6 L7, then restore the order of the 64-bit pairs
+        __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0)));
+        r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_ps(pLeft + i, _mm256_max_ps(_mm256_min_ps(l, one), minusOne));
+        _mm256_storeu_ps(pRight + i, _mm256_max_ps(_mm256_min_ps(r, one), minusOne));
+    }
+    _mm256_zeroupper();
+    if (i < nFrames) {
+        ConvertFloat32Stereo_SSE2(pData + i * pFmt->nBlockAlign, nFrames - i, pFmt, pLeft + i, pRight + i);
+    }
+}
+
+// Gather one sample of 8 consecutive frames as float
+template <AudioSampleType Type>
+static inline __m256 GatherSamples_AVX2(const BYTE *p, __m256i offsets) {
+    if (Type == AUDIO_SAMPLE_FLOAT32) {
+        return _mm256_i32gather_ps((const float *)p, offsets, 1);
+    }
+    // Gather 32 bits and sign extend the sample from the low bytes
+    __m256i v = _mm256_i32gather_epi32((const int *)p, offsets, 1);
+    if (Type == AUDIO_SAMPLE_INT16) {
+        return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16)), _mm256_set1_ps(INT16_SCALE));
+    }
+    if (Type == AUDIO_SAMPLE_INT24) {
+        return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(v, 8), 8)), _mm256_set1_ps(INT24_SCALE));
+    }
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(INT32_SCALE));
+}
+
+// Any number of channels and sample type: downmix of 8 frames at a time using gathers
+template <AudioSampleType Type>
+static void ConvertDownmix_AVX2(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight) {
+    const UINT32 nChannels = min(pFmt->nChannels, (UINT32)AUDIOCONV_MAX_CHANNELS);
+    const int nBlockAlign = (int)pFmt->nBlockAlign;
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(nBlockAlign));
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minusOne = _mm256_set1_ps(-1.0f);
+
+    // Gathers read 4 bytes per sample, so keep one spare frame after the block for 16 and 24 bit samples
+    const UINT32 nSpare = (pFmt->nBytesPerSample < 4) ? 1 : 0;
+    UINT32 i = 0;
+    for (; i + 8 + nSpare <= nFrames; i += 8, pData += 8 * nBlockAlign) {
+        __m256 l = _mm256_setzero_ps();
+        __m256 r = _mm256_setzero_ps();
+        for (UINT32 ch = 0; ch < nChannels; ch++) {
+            __m256 s = GatherSamples_AVX2<Type>(pData + ch * pFmt->nBytesPerSample, offsets);
+            l = _mm256_add_ps(l, _mm256_mul_ps(s, _mm256_set1_ps(pFmt->fMixL[ch])));
+            r = _mm256_add_ps(r, _mm256_mul_ps(s, _mm256_set1_ps(pFmt->fMixR[ch])));
+        }
+        _mm256_storeu_ps(pLeft + i, _mm256_max_ps(_mm256_min_ps(l, one), minusOne));
+        _mm256_storeu_ps(pRight + i, _mm256_max_ps(_mm256_min_ps(r, one), minusOne));
+    }
+    _mm256_zeroupper();
+    if (i < nFrames) {
+        ConvertDownmixScalar<Type>(pData, nFrames - i, pFmt, pLeft + i, pRight + i);
+    }
+}
+
+// Fill downmix weights from the speaker positions in dwChannelMask (ITU-R BS.775 style, LFE dropped)
+static void SetDownmixWeights(AudioConvFormat *pFmt, DWORD dwChannelMask) {
+    memset(pFmt->fMixL, 0, sizeof(pFmt->fMixL));
+    memset(pFmt->fMixR, 0, sizeof(pFmt->fMixR));
+
+    if (pFmt->nChannels == 1) {
+        pFmt->fMixL[0] = pFmt->fMixR[0] = 1.0f;
+        return;
+    }
+
+    if (dwChannelMask == 0) {
+        // No layout given, assume the usual one for the channel count
+        switch (pFmt->nChannels) {
+            case 2: dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT; break;
+            case 3: dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER; break;
+            case 4: dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT; break;
+            case 5: dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT; break;
+            case 6: dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT; break;
+            default: dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT; break;
+        }
+    }
+
+    // Channels are interleaved in the order of the set bits of the mask
+    UINT32 ch = 0;
+    for (DWORD speaker = 1; speaker != 0 && ch < pFmt->nChannels && ch < AUDIOCONV_MAX_CHANNELS; speaker <<= 1) {
+        if (!(dwChannelMask & speaker)) {
+            continue;
+        }
+        switch (speaker) {
+            case SPEAKER_FRONT_LEFT:
+                pFmt->fMixL[ch] = 1.0f;
+                break;
+            case SPEAKER_FRONT_RIGHT:
+                pFmt->fMixR[ch] = 1.0f;
+                break;
+            case SPEAKER_FRONT_CENTER:
+                pFmt->fMixL[ch] = pFmt->fMixR[ch] = MIX_SIDE;
+                break;
+            case SPEAKER_FRONT_LEFT_OF_CENTER:
+            case SPEAKER_BACK_LEFT:
+            case SPEAKER_SIDE_LEFT:
+                pFmt->fMixL[ch] = MIX_SIDE;
+                break;
+            case SPEAKER_FRONT_RIGHT_OF_CENTER:
+            case SPEAKER_BACK_RIGHT:
+            case SPEAKER_SIDE_RIGHT:
+                pFmt->fMixR[ch] = MIX_SIDE;
+                break;
+            case SPEAKER_BACK_CENTER:
+                pFmt->fMixL[ch] = pFmt->fMixR[ch] = MIX_BACK_CENTER;
+                break;
+            default:
+                // LFE and top speakers don't contribute
+                break;
+        }
+        ch++;
+    }
+}
+
+bool GetAudioConvFormat(const WAVEFORMATEX *pwfx, AudioConvFormat *pFmt) {
+    pFmt->SampleType = AUDIO_SAMPLE_UNSUPPORTED;
+    pFmt->nChannels = pwfx->nChannels;
+    pFmt->nBlockAlign = pwfx->nBlockAlign;
+    pFmt->nBytesPerSample = pwfx->wBitsPerSample / 8;
+    pFmt->nSamplesPerSec = pwfx->nSamplesPerSec;
+
+    bool bFloat = false;
+    DWORD dwChannelMask = 0;
+    switch (pwfx->wFormatTag) {
+        case WAVE_FORMAT_PCM:
+            break;
+
+        case WAVE_FORMAT_IEEE_FLOAT:
+            bFloat = true;
+            break;
+
+        case WAVE_FORMAT_EXTENSIBLE:
+            {
+                // naked scope for case-local variable
+                const WAVEFORMATEXTENSIBLE *pEx = reinterpret_cast<const WAVEFORMATEXTENSIBLE *>(pwfx);
+                if (IsEqualGUID(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT, pEx->SubFormat)) {
+                    bFloat = true;
+                } else if (!IsEqualGUID(KSDATAFORMAT_SUBTYPE_PCM, pEx->SubFormat)) {
+                    return false;
+                }
+                dwChannelMask = pEx->dwChannelMask;
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    if (bFloat) {
+        if (pwfx->wBitsPerSample == 32) {
+            pFmt->SampleType = AUDIO_SAMPLE_FLOAT32;
+        }
+    } else {
+        // Container size decides the layout. 24 valid bits in a 32-bit container are left-justified and read as int32
+        switch (pwfx->wBitsPerSample) {
+            case 16: pFmt->SampleType = AUDIO_SAMPLE_INT16; break;
+            case 24: pFmt->SampleType = AUDIO_SAMPLE_INT24; break;
+            case 32: pFmt->SampleType = AUDIO_SAMPLE_INT32; break;
+        }
+    }
+
+    if ((pFmt->nChannels == 0) || (pFmt->nBlockAlign < pFmt->nChannels * pFmt->nBytesPerSample)) {
+        pFmt->SampleType = AUDIO_SAMPLE_UNSUPPORTED;
+    }
+
+    SetDownmixWeights(pFmt, dwChannelMask);
+
+    return (pFmt->SampleType != AUDIO_SAMPLE_UNSUPPORTED);
+}
+
+AudioConvIsa GetAudioConvIsa() {
+    static int nIsa = -1;
+    if (nIsa < 0) {
+        // SSE2 is the baseline of the build. AVX2 also needs the OS to save the YMM registers
+        nIsa = AUDIOCONV_ISA_SSE2;
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] >= 7) {
+            __cpuid(info, 1);
+            bool bOsxsaveAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+            if (bOsxsaveAvx && ((_xgetbv(0) & 6) == 6)) {
+                __cpuidex(info, 7, 0);
+                if (info[1] & (1 << 5)) {
+                    nIsa = AUDIOCONV_ISA_AVX2;
+                }
+            }
+        }
+    }
+    return (AudioConvIsa)nIsa;
+}
+
+// Kernel for the format using at most the given instruction set
+static AudioConvFunc SelectAudioConvFunc(const AudioConvFormat *pFmt, AudioConvIsa Isa) {
+    // Packed stereo is by far the most common mix format
+    bool bPackedStereo = (pFmt->nChannels == 2) && (pFmt->nBlockAlign == 2 * pFmt->nBytesPerSample);
+    bool bDownmix = (pFmt->nChannels > 2);
+
+    switch (pFmt->SampleType) {
+        case AUDIO_SAMPLE_INT16:
+            if (bPackedStereo && Isa >= AUDIOCONV_ISA_AVX2) return ConvertInt16Stereo_AVX2;
+            if (bPackedStereo && Isa >= AUDIOCONV_ISA_SSE2) return ConvertInt16Stereo_SSE2;
+            if (bDownmix && Isa >= AUDIOCONV_ISA_AVX2) return ConvertDownmix_AVX2<AUDIO_SAMPLE_INT16>;
+            return bDownmix ? ConvertDownmixScalar<AUDIO_SAMPLE_INT16> : ConvertScalar<AUDIO_SAMPLE_INT16>;
+        case AUDIO_SAMPLE_INT24:
+            if ((bPackedStereo || bDownmix) && Isa >= AUDIOCONV_ISA_AVX2) return ConvertDownmix_AVX2<AUDIO_SAMPLE_INT24>;
+            return bDownmix ? ConvertDownmixScalar<AUDIO_SAMPLE_INT24> : ConvertScalar<AUDIO_SAMPLE_INT24>;
+        case AUDIO_SAMPLE_INT32:
+            if ((bPackedStereo || bDownmix) && Isa >= AUDIOCONV_ISA_AVX2) return ConvertDownmix_AVX2<AUDIO_SAMPLE_INT32>;
+            return bDownmix ? ConvertDownmixScalar<AUDIO_SAMPLE_INT32> : ConvertScalar<AUDIO_SAMPLE_INT32>;
+        case AUDIO_SAMPLE_FLOAT32:
+            if (bPackedStereo && Isa >= AUDIOCONV_ISA_AVX2) return ConvertFloat32Stereo_AVX2;
+            if (bPackedStereo && Isa >= AUDIOCONV_ISA_SSE2) return ConvertFloat32Stereo_SSE2;
+            if (bDownmix && Isa >= AUDIOCONV_ISA_AVX2) return ConvertDownmix_AVX2<AUDIO_SAMPLE_FLOAT32>;
+            return bDownmix ? ConvertDownmixScalar<AUDIO_SAMPLE_FLOAT32> : ConvertScalar<AUDIO_SAMPLE_FLOAT32>;
+        default:
+            return NULL;
+    }
+}
+
+AudioConvFunc GetAudioConvFunc(const AudioConvFormat *pFmt) {
+    return SelectAudioConvFunc(pFmt, GetAudioConvIsa());
+}
+
+void BenchmarkAudioConv() {
+    const UINT32 nFrames = 480; // 10 ms at 48000 Hz
+    const int nPackets = 20000;
+
+    struct {
+        LPCWSTR szName;
+        WORD wFormatTag;
+        WORD nChannels;
+        WORD wBitsPerSample;
+    } formats[] = {
+        { L"stereo int16",   WAVE_FORMAT_PCM,        2, 16 },
+        { L"stereo int24",   WAVE_FORMAT_PCM,        2, 24 },
+        { L"stereo float32", WAVE_FORMAT_IEEE_FLOAT, 2, 32 },
+        { L"5.1 int16",      WAVE_FORMAT_PCM,        6, 16 },
+        { L"5.1 float32",    WAVE_FORMAT_IEEE_FLOAT, 6, 32 },
+        { L"7.1 float32",    WAVE_FORMAT_IEEE_FLOAT, 8, 32 },
+    };
+    LPCWSTR szIsa[] = { L"scalar", L"SSE2", L"AVX2" };
+
+    BYTE *pData = (BYTE *)malloc(nFrames * AUDIOCONV_MAX_CHANNELS * 4);
+    float *pLeft = (float *)malloc(nFrames * sizeof(float));
+    float *pRight = (float *)malloc(nFrames * sizeof(float));
+    if (!pData || !pLeft || !pRight) {
+        free(pData);
+        free(pLeft);
+        free(pRight);
+        return;
+    }
+
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+
+    LOG(L"Audio conversion benchmark, %u frames per packet, best ISA %ls", nFrames, szIsa[GetAudioConvIsa()]);
+    for (int f = 0; f < ARRAYSIZE(formats); f++) {
+        WAVEFORMATEX wfx = { 0 };
+        wfx.wFormatTag = formats[f].wFormatTag;
+        wfx.nChannels = formats[f].nChannels;
+        wfx.nSamplesPerSec = 48000;
+        wfx.wBitsPerSample = formats[f].wBitsPerSample;
+        wfx.nBlockAlign = wfx.nChannels * wfx.wBitsPerSample / 8;
+        wfx.nAvgBytesPerSec = wfx.nBlockAlign * wfx.nSamplesPerSec;
+
+        AudioConvFormat fmt;
+        if (!GetAudioConvFormat(&wfx, &fmt)) {
+            continue;
+        }
+
+        // Quiet pseudo-random signal, valid for every sample type
+        for (UINT32 i = 0; i < nFrames * wfx.nChannels; i++) {
+            BYTE *p = pData + i * fmt.nBytesPerSample;
+            int32_t s = (int32_t)((i * 2654435761u) >> 20) - 2048;
+            if (fmt.SampleType == AUDIO_SAMPLE_FLOAT32) {
+                *(float *)p = s / 4096.0f;
+            } else {
+                memcpy(p, &s, fmt.nBytesPerSample);
+            }
+        }
+
+        AudioConvFunc pLast = NULL;
+        for (int isa = AUDIOCONV_ISA_SCALAR; isa <= GetAudioConvIsa(); isa++) {
+            AudioConvFunc pFunc = SelectAudioConvFunc(&fmt, (AudioConvIsa)isa);
+            if (pFunc == pLast) {
+                continue; // no kernel specific to this instruction set
+            }
+            pLast = pFunc;
+
+            LARGE_INTEGER t0, t1;
+            QueryPerformanceCounter(&t0);
+            for (int n = 0; n < nPackets; n++) {
+                pFunc(pData, nFrames, &fmt, pLeft, pRight);
+            }
+            QueryPerformanceCounter(&t1);
+
+            double ns = (double)(t1.QuadPart - t0.QuadPart) * 1e9 / (double)freq.QuadPart / nPackets;
+            LOG(L"  %-16ls %-6ls %8.1f ns/packet (%.2f%% of the 10 ms budget)", formats[f].szName, szIsa[isa], ns, ns / 1e5);
+        }
+    }
+
+    free(pData);
+    free(pLeft);
+    free(pRight);
+}
@@ -0,0 +1,47 @@
+// audioconv.h
+
+#define AUDIOCONV_MAX_CHANNELS 8 // Channels above 7.1 are ignored by the downmix
+
+// Sample type of the captured stream
+enum AudioSampleType {
+    AUDIO_SAMPLE_UNSUPPORTED = 0,
+    AUDIO_SAMPLE_INT16,   // signed 16-bit PCM, Little Endian
+    AUDIO_SAMPLE_INT24,   // signed 24-bit PCM packed in 3 bytes, Little Endian
+    AUDIO_SAMPLE_INT32,   // signed 32-bit PCM (also 24-bit valid bits in 32-bit container)
+    AUDIO_SAMPLE_FLOAT32  // 32-bit float PCM
+};
+
+// Instruction set used by a conversion kernel
+enum AudioConvIsa {
+    AUDIOCONV_ISA_SCALAR = 0,
+    AUDIOCONV_ISA_SSE2,
+    AUDIOCONV_ISA_AVX2
+};
+
+// Stream format as seen by the conversion kernels. Filled once per stream
+struct AudioConvFormat {
+    AudioSampleType SampleType;
+    UINT32 nChannels;
+    UINT32 nBlockAlign;
+    UINT32 nBytesPerSample;
+    UINT32 nSamplesPerSec;
+    // Downmix weights of every channel into left and right, from the speaker layout
+    float fMixL[AUDIOCONV_MAX_CHANNELS];
+    float fMixR[AUDIOCONV_MAX_CHANNELS];
+};
+
+// Converts nFrames interleaved frames to separate left/right float [-1.0f .. +1.0f] channels.
+// Mono is duplicated into both channels, more than two channels are downmixed to stereo.
+typedef void (*AudioConvFunc)(const BYTE *pData, UINT32 nFrames, const AudioConvFormat *pFmt, float *pLeft, float *pRight);
+
+// Fill pFmt from the stream format. Returns false for formats the kernels can't read
+bool GetAudioConvFormat(const WAVEFORMATEX *pwfx, AudioConvFormat *pFmt);
+
+// Pick the fastest conversion kernel for the format and this CPU. Call once per stream format, not per packet
+AudioConvFunc GetAudioConvFunc(const AudioConvFormat *pFmt);
+
+// Best instruction set supported by this CPU and OS
+AudioConvIsa GetAudioConvIsa();
+
+// Micro-benchmark: log per-packet cost of every kernel for 48 kHz / 10 ms packets
+void BenchmarkAudioConv();
@@ -11,6 +11,10 @@
 
 #include "log.h"
 #include "cleanup.h"
+#include "wavwriter.h"
 #include "prefs.h"
 #include "loopback-capture.h"
+#include "audioconv.h"
+#include "resampler.h"
 #include "audiobuf.h"
+#include "spectrum.h"
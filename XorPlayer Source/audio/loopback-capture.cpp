@@ -5,6 +5,8 @@
 HRESULT LoopbackCapture(
     IMMDevice *pMMDevice,
     HMMIO hFile,
+    WavFlushPolicy FlushPolicy,
+    DWORD dwFlushIntervalMs,
     bool bInt16,
     HANDLE hStartedEvent,
     HANDLE hStopEvent,
@@ -28,6 +30,8 @@ DWORD WINAPI LoopbackCaptureThreadFunction(LPVOID pContext) {
     pArgs->hr = LoopbackCapture(
         pArgs->pMMDevice,
         pArgs->hFile,
+        pArgs->FlushPolicy,
+        pArgs->dwFlushIntervalMs,
         pArgs->bInt16,
         pArgs->hStartedEvent,
         pArgs->hStopEvent,
@@ -40,6 +44,8 @@ DWORD WINAPI LoopbackCaptureThreadFunction(LPVOID pContext) {
 HRESULT LoopbackCapture(
     IMMDevice *pMMDevice,
     HMMIO hFile,
+    WavFlushPolicy FlushPolicy,
+    DWORD dwFlushIntervalMs,
     bool bInt16,
     HANDLE hStartedEvent,
     HANDLE hStopEvent,
@@ -115,12 +121,22 @@ HRESULT LoopbackCapture(
     MMCKINFO ckRIFF = { 0 };
     MMCKINFO ckData = { 0 };
 
+    // the data chunk is written from a background thread, so disk stalls don't hold up capture.
+    // on an early return the destructor still drains and stops it
+    CWavWriter wavWriter;
+
     if (NULL != hFile) {
         hr = WriteWaveHeader(hFile, pwfx, &ckRIFF, &ckData);
         if (FAILED(hr)) {
             // WriteWaveHeader does its own logging
             return hr;
         }
+
+        hr = wavWriter.Start(hFile, pwfx->nBlockAlign, FlushPolicy, dwFlushIntervalMs);
+        if (FAILED(hr)) {
+            // CWavWriter::Start does its own logging
+            return hr;
+        }
     }
 
     // create a periodic waitable timer
@@ -259,16 +275,15 @@ HRESULT LoopbackCapture(
             else
             {
                 // Saving audio data for visualizer
-                SetAudioBuf(pData, nNumFramesToRead, pwfx, bInt16);
+                SetAudioBuf(pData, nNumFramesToRead, pwfx);
                 
                 if (NULL != hFile) {
-                    // Writing the buffer captured to the output .wav file
-                    LONG lBytesToWrite = nNumFramesToRead * nBlockAlign;
-#pragma prefast(suppress: __WARNING_INCORRECT_ANNOTATION, "IAudioCaptureClient::GetBuffer SAL annotation implies a 1-byte buffer")
-                    LONG lBytesWritten = mmioWrite(hFile, reinterpret_cast<PCHAR>(pData), lBytesToWrite);
-                    if (lBytesToWrite != lBytesWritten) {
-                        ERR(L"mmioWrite wrote %u bytes on pass %u after %u frames: expected %u bytes", lBytesWritten, nPasses, *pnFrames, lBytesToWrite);
-                        return E_UNEXPECTED;
+                    // Queue the buffer captured for the output .wav file; the writer thread does the disk I/O
+                    wavWriter.Write(pData, nNumFramesToRead * nBlockAlign);
+                    hr = wavWriter.GetResult();
+                    if (FAILED(hr)) {
+                        ERR(L"Writing the .wav file failed on pass %u after %u frames: hr = 0x%08x", nPasses, *pnFrames, hr);
+                        return hr;
                     }
                 }
                 *pnFrames += nNumFramesToRead;
@@ -306,6 +321,13 @@ HRESULT LoopbackCapture(
     } // capture loop
 
     if (NULL != hFile) {
+        // everything queued has to be on disk before the chunk sizes are fixed up
+        hr = wavWriter.Stop();
+        if (FAILED(hr)) {
+            // CWavWriter does its own logging
+            return hr;
+        }
+
         hr = FinishWaveFile(hFile, &ckData, &ckRIFF);
         if (FAILED(hr)) {
             // FinishWaveFile does it's own logging
@@ -11,6 +11,8 @@ struct LoopbackCaptureThreadFunctionArguments {
     IMMDevice *pMMDevice;
     bool bInt16;
     HMMIO hFile;
+    WavFlushPolicy FlushPolicy;
+    DWORD dwFlushIntervalMs;
     HANDLE hStartedEvent;
     HANDLE hStopEvent;
     UINT32 nFrames;
@@ -14,14 +14,18 @@ void usage(LPCWSTR exe) {
     LOG(
         L"%ls -?\n"
         L"%ls --list-devices\n"
-        L"%ls [--device \"Device long name\"] [--file \"file name\"] [--int-16]\n"
+        L"%ls --benchmark\n"
+        L"%ls [--device \"Device long name\"] [--file \"file name\"] [--int-16] [--flush none|block|<milliseconds>]\n"
         L"\n"
         L"    -? prints this message.\n"
         L"    --list-devices displays the long names of all active playback devices.\n"
+        L"    --benchmark logs the per-packet cost of the sample conversion kernels.\n"
         L"    --device captures from the specified device (default if omitted)\n"
         L"    --file saves the output to a file (%ls if omitted)\n"
-        L"    --int-16 attempts to coerce data to 16-bit integer format",
-        exe, exe, exe, DEFAULT_FILE
+        L"    --int-16 attempts to coerce data to 16-bit integer format\n"
+        L"    --flush sets how often the file is flushed to disk: never until done (default),\n"
+        L"      after every %u KB block, or every so many milliseconds",
+        exe, exe, exe, exe, DEFAULT_FILE, WAVWRITER_BLOCK_SIZE / 1024
     );
 }
 
@@ -29,6 +33,8 @@ CPrefs::CPrefs(int argc, LPCWSTR argv[], HRESULT &hr)
 : m_pMMDevice(NULL)
 , m_hFile(NULL)
 , m_bInt16(false)
+, m_FlushPolicy(WAVWRITER_FLUSH_NONE)
+, m_dwFlushIntervalMs(WAVWRITER_FLUSH_MS)
 , m_pwfx(NULL)
 , m_szFilename(NULL)
 {
@@ -48,6 +54,11 @@ CPrefs::CPrefs(int argc, LPCWSTR argv[], HRESULT &hr)
                     hr = S_FALSE;
                     return;
                 }
+            } else if (0 == _wcsicmp(argv[1], L"--benchmark")) {
+                // time the sample conversion kernels but don't actually capture
+                BenchmarkAudioConv();
+                hr = S_FALSE;
+                return;
             }
         // intentional fallthrough
         
@@ -63,7 +74,7 @@ CPrefs::CPrefs(int argc, LPCWSTR argv[], HRESULT &hr)
                         return;
                     }
 
-                    if (i++ == argc) {
+                    if (++i >= argc) {
                         ERR(L"%s", L"--device switch requires an argument");
                         hr = E_INVALIDARG;
                         return;
@@ -85,7 +96,7 @@ CPrefs::CPrefs(int argc, LPCWSTR argv[], HRESULT &hr)
                         return;
                     }
 
-                    if (i++ == argc) {
+                    if (++i >= argc) {
                         ERR(L"%s", L"--file switch requires an argument");
                         hr = E_INVALIDARG;
                         return;
@@ -107,6 +118,31 @@ CPrefs::CPrefs(int argc, LPCWSTR argv[], HRESULT &hr)
                     continue;
                 }
 
+                // --flush
+                if (0 == _wcsicmp(argv[i], L"--flush")) {
+                    if (++i >= argc) {
+                        ERR(L"%s", L"--flush switch requires an argument");
+                        hr = E_INVALIDARG;
+                        return;
+                    }
+
+                    if (0 == _wcsicmp(argv[i], L"none")) {
+                        m_FlushPolicy = WAVWRITER_FLUSH_NONE;
+                    } else if (0 == _wcsicmp(argv[i], L"block")) {
+                        m_FlushPolicy = WAVWRITER_FLUSH_BLOCK;
+                    } else {
+                        int ms = _wtoi(argv[i]);
+                        if (ms <= 0) {
+                            ERR(L"Invalid --flush argument %ls", argv[i]);
+                            hr = E_INVALIDARG;
+                            return;
+                        }
+                        m_FlushPolicy = WAVWRITER_FLUSH_INTERVAL;
+                        m_dwFlushIntervalMs = (DWORD)ms;
+                    }
+                    continue;
+                }
+
                 ERR(L"Invalid argument %ls", argv[i]);
                 hr = E_INVALIDARG;
                 return;
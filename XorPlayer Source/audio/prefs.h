@@ -5,6 +5,8 @@ public:
     IMMDevice *m_pMMDevice;
     HMMIO m_hFile;
     bool m_bInt16;
+    WavFlushPolicy m_FlushPolicy;
+    DWORD m_dwFlushIntervalMs;
     PWAVEFORMATEX m_pwfx;
     LPCWSTR m_szFilename;
 
@@ -0,0 +1,211 @@
+// resampler.cpp
+
+#include "common.h"
+#include <math.h>
+#include <new>
+#include <emmintrin.h>
+
+#define RESAMPLER_ZERO_CROSSINGS 16 // Taps per phase when not decimating; scaled up by the decimation ratio
+#define RESAMPLER_CUTOFF 0.9f       // Pass band edge relative to the lower Nyquist frequency
+#define RESAMPLER_MAX_PHASES 4096   // Refuse odd rate pairs that would need huge coefficient tables
+
+static UINT32 Gcd(UINT32 a, UINT32 b) {
+    while (b != 0) {
+        UINT32 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Dot product of one filter phase with both channels. nTaps is a multiple of 4
+static inline void DotProductStereo(const float *pCoefs, const float *pL, const float *pR, UINT32 nTaps, float *pOutL, float *pOutR) {
+    __m128 accL = _mm_setzero_ps();
+    __m128 accR = _mm_setzero_ps();
+    for (UINT32 k = 0; k < nTaps; k += 4) {
+        __m128 c = _mm_loadu_ps(pCoefs + k);
+        accL = _mm_add_ps(accL, _mm_mul_ps(c, _mm_loadu_ps(pL + k)));
+        accR = _mm_add_ps(accR, _mm_mul_ps(c, _mm_loadu_ps(pR + k)));
+    }
+    // Horizontal sums: (L0+L2, L1+L3, R0+R2, R1+R3), then pairwise
+    __m128 lr = _mm_add_ps(_mm_movelh_ps(accL, accR), _mm_movehl_ps(accR, accL));
+    __m128 sums = _mm_add_ps(lr, _mm_shuffle_ps(lr, lr, _MM_SHUFFLE(2, 3, 0, 1)));
+    _mm_store_ss(pOutL, sums);
+    _mm_store_ss(pOutR, _mm_movehl_ps(sums, sums));
+}
+
+CResampler::CResampler()
+: m_nInRate(0)
+, m_nOutRate(0)
+, m_nL(1)
+, m_nM(1)
+, m_nTaps(0)
+, m_pCoefs(NULL)
+, m_pHistL(NULL)
+, m_pHistR(NULL)
+, m_nHistSize(0)
+, m_nIndex(0)
+, m_nPhase(0)
+{
+}
+
+CResampler::~CResampler() {
+    Free();
+}
+
+void CResampler::Free() {
+    delete[] m_pCoefs;
+    delete[] m_pHistL;
+    delete[] m_pHistR;
+    m_pCoefs = NULL;
+    m_pHistL = NULL;
+    m_pHistR = NULL;
+    m_nHistSize = 0;
+    m_nTaps = 0;
+}
+
+bool CResampler::Init(UINT32 nInRate, UINT32 nOutRate) {
+    Free();
+    m_nInRate = nInRate;
+    m_nOutRate = nOutRate;
+    m_nL = m_nM = 1;
+
+    if ((nInRate == nOutRate) || (nInRate == 0) || (nOutRate == 0)) {
+        // Bypass
+        return true;
+    }
+
+    UINT32 g = Gcd(nInRate, nOutRate);
+    m_nL = nOutRate / g; // e.g. 147 for 48000 -> 44100
+    m_nM = nInRate / g;  // e.g. 160 for 48000 -> 44100
+    if (m_nL > RESAMPLER_MAX_PHASES) {
+        ERR(L"Can't resample %u Hz to %u Hz: %u filter phases needed", nInRate, nOutRate, m_nL);
+        m_nL = m_nM = 1;
+        return false;
+    }
+
+    // Low-pass below the lower of the two Nyquist frequencies. When decimating, the filter has to
+    // span proportionally more input samples to keep the same transition band
+    float fRatio = max(1.0f, (float)nInRate / (float)nOutRate);
+    UINT32 nTaps = ((UINT32)ceilf(RESAMPLER_ZERO_CROSSINGS * fRatio) + 3) & ~3;
+    UINT32 nLen = m_nL * nTaps;
+
+    m_pCoefs = new (std::nothrow) float[nLen];
+    float *pProto = new (std::nothrow) float[nLen];
+    if (!m_pCoefs || !pProto) {
+        delete[] pProto;
+        Free();
+        return false;
+    }
+
+    // Windowed sinc prototype at the upsampled rate (nInRate * L), Blackman window
+    const double pi = 3.14159265358979323846;
+    double wc = RESAMPLER_CUTOFF * 0.5 * min(nInRate, nOutRate) / ((double)nInRate * m_nL); // cycles per upsampled sample
+    double center = (nLen - 1) * 0.5;
+    double sum = 0.0;
+    for (UINT32 i = 0; i < nLen; i++) {
+        double t = i - center;
+        double sinc = (fabs(t) < 1e-9) ? 2.0 * wc : sin(2.0 * pi * wc * t) / (pi * t);
+        double w = 0.42 - 0.5 * cos(2.0 * pi * i / (nLen - 1)) + 0.08 * cos(4.0 * pi * i / (nLen - 1));
+        pProto[i] = (float)(sinc * w);
+        sum += sinc * w;
+    }
+
+    // Split into phases. Zero stuffing drops the gain by L, so each phase sums to ~1.
+    // Taps are stored in input sample order (oldest first) to run the dot product forwards
+    for (UINT32 p = 0; p < m_nL; p++) {
+        for (UINT32 k = 0; k < nTaps; k++) {
+            m_pCoefs[p * nTaps + k] = (float)(pProto[p + (nTaps - 1 - k) * m_nL] * m_nL / sum);
+        }
+    }
+    delete[] pProto;
+
+    m_nTaps = nTaps;
+    if (!Reserve(1024)) {
+        Free();
+        return false;
+    }
+    Reset();
+
+    LOG(L"Resampling %u Hz to %u Hz: L = %u, M = %u, %u taps per phase", nInRate, nOutRate, m_nL, m_nM, m_nTaps);
+    return true;
+}
+
+void CResampler::Reset() {
+    if (m_nTaps == 0) {
+        return;
+    }
+    memset(m_pHistL, 0, (m_nTaps - 1) * sizeof(float));
+    memset(m_pHistR, 0, (m_nTaps - 1) * sizeof(float));
+    m_nIndex = m_nTaps - 1;
+    m_nPhase = 0;
+}
+
+bool CResampler::Reserve(UINT32 nIn) {
+    UINT32 nSize = m_nTaps - 1 + nIn;
+    if (nSize <= m_nHistSize) {
+        return true;
+    }
+
+    float *pHistL = new (std::nothrow) float[nSize];
+    float *pHistR = new (std::nothrow) float[nSize];
+    if (!pHistL || !pHistR) {
+        delete[] pHistL;
+        delete[] pHistR;
+        return false;
+    }
+    if (m_pHistL) {
+        memcpy(pHistL, m_pHistL, (m_nTaps - 1) * sizeof(float));
+        memcpy(pHistR, m_pHistR, (m_nTaps - 1) * sizeof(float));
+    }
+    delete[] m_pHistL;
+    delete[] m_pHistR;
+    m_pHistL = pHistL;
+    m_pHistR = pHistR;
+    m_nHistSize = nSize;
+    return true;
+}
+
+UINT32 CResampler::GetMaxOutput(UINT32 nIn) const {
+    if (m_nTaps == 0) {
+        return nIn;
+    }
+    return (UINT32)(((unsigned long long)nIn * m_nL + m_nM - 1) / m_nM) + 1;
+}
+
+UINT32 CResampler::Process(const float *pInL, const float *pInR, UINT32 nIn, float *pOutL, float *pOutR) {
+    if (m_nTaps == 0) {
+        memcpy(pOutL, pInL, nIn * sizeof(float));
+        memcpy(pOutR, pInR, nIn * sizeof(float));
+        return nIn;
+    }
+    if (!Reserve(nIn)) {
+        return 0;
+    }
+
+    // Append the new input behind the history
+    const UINT32 nHist = m_nTaps - 1;
+    memcpy(m_pHistL + nHist, pInL, nIn * sizeof(float));
+    memcpy(m_pHistR + nHist, pInR, nIn * sizeof(float));
+
+    // Output k sits at upsampled position k * M = Index * L + Phase.
+    // It needs input samples Index - nHist .. Index
+    const UINT32 nEnd = nHist + nIn;
+    UINT32 n = 0;
+    while (m_nIndex < nEnd) {
+        const UINT32 nFirst = m_nIndex - nHist;
+        DotProductStereo(m_pCoefs + m_nPhase * m_nTaps, m_pHistL + nFirst, m_pHistR + nFirst, m_nTaps, &pOutL[n], &pOutR[n]);
+        n++;
+
+        m_nPhase += m_nM;
+        m_nIndex += m_nPhase / m_nL;
+        m_nPhase %= m_nL;
+    }
+
+    // Keep the tail as history for the next packet
+    memmove(m_pHistL, m_pHistL + nIn, nHist * sizeof(float));
+    memmove(m_pHistR, m_pHistR + nIn, nHist * sizeof(float));
+    m_nIndex -= nIn;
+
+    return n;
+}
@@ -0,0 +1,41 @@
+// resampler.h
+
+// Rational polyphase resampler (upsample by L, low-pass, decimate by M) for the
+// stereo capture stream. Filter history is kept between calls, so a stream can
+// be fed packet by packet without clicks at packet boundaries.
+class CResampler {
+public:
+    CResampler();
+    ~CResampler();
+
+    // Set up the filter for the rate pair. Returns false on allocation failure
+    bool Init(UINT32 nInRate, UINT32 nOutRate);
+
+    // Forget the filter history, i.e. after a glitch in the stream
+    void Reset();
+
+    // True when rates differ and Process() has to be used
+    bool IsActive() const { return m_nTaps > 0; }
+
+    // Upper bound of output frames Process() produces for nIn input frames
+    UINT32 GetMaxOutput(UINT32 nIn) const;
+
+    // Resample nIn frames. pOutL/pOutR must hold GetMaxOutput(nIn) frames. Returns number of output frames
+    UINT32 Process(const float *pInL, const float *pInR, UINT32 nIn, float *pOutL, float *pOutR);
+
+private:
+    void Free();
+    bool Reserve(UINT32 nIn);
+
+    UINT32 m_nInRate;
+    UINT32 m_nOutRate;
+    UINT32 m_nL;          // Upsampling factor (number of phases)
+    UINT32 m_nM;          // Decimation factor
+    UINT32 m_nTaps;       // Taps per phase, multiple of 4. Zero when bypassed
+    float *m_pCoefs;      // m_nL phases of m_nTaps taps each, in input sample order
+    float *m_pHistL;      // m_nTaps - 1 samples of history followed by the new input
+    float *m_pHistR;
+    UINT32 m_nHistSize;   // Allocated size of m_pHistL / m_pHistR
+    UINT32 m_nIndex;      // Input sample of the next output, relative to the start of the history
+    UINT32 m_nPhase;      // Phase of the next output
+};
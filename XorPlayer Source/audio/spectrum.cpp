@@ -0,0 +1,191 @@
+// spectrum.cpp
+
+#include "common.h"
+#include "..\vis_milk2\fft.h"
+#include <math.h>
+#include <new>
+
+// Window length the visualizer levels (and the presets built on them) were tuned for.
+// Magnitudes are scaled back to it, so a longer window means finer bins, not louder ones
+#define SPECTRUM_REF_WINDOW 576
+
+#define SPECTRUM_MIN_HOP 64
+#define SPECTRUM_FRESH 4 // Flag in spcMiddle: slot holds a hop the reader has not seen yet
+
+// Requested configuration, (window << 16) | hop. Written by any thread, applied by the capture thread
+std::atomic<int> spcConfig((SPECTRUM_DEFAULT_WINDOW << 16) | SPECTRUM_DEFAULT_HOP);
+
+// Capture thread only
+int spcAppliedConfig = 0;
+int spcWindow = 0;
+int spcHop = 0;
+int spcFill = 0;             // Samples in the history, up to spcWindow
+int spcSinceHop = 0;         // Samples added since the last FFT
+float *spcHistLeft = NULL;   // Last spcWindow samples, oldest first
+float *spcHistRight = NULL;
+float *spcWaveLeft = NULL;   // FFT input / output staging
+float *spcWaveRight = NULL;
+float *spcFreqLeft = NULL;
+float *spcFreqRight = NULL;
+FFT spcFft;
+
+// Triple buffer between the capture thread (writer) and the render thread (reader):
+// each side owns one slot, the third is swapped in and out atomically
+struct SpectrumSlot {
+    float fLeft[SPECTRUM_BINS];
+    float fRight[SPECTRUM_BINS];
+};
+SpectrumSlot spcSlots[3];
+std::atomic<int> spcMiddle(1); // Slot between writer and reader, | SPECTRUM_FRESH
+int spcBack = 0;  // Writer side only
+int spcFront = 2; // Reader side only
+
+void SetSpectrumConfig(int nWindow, int nHop) {
+    // Round the window down to a power of two within range
+    int w = SPECTRUM_MIN_WINDOW;
+    while ((w < SPECTRUM_MAX_WINDOW) && (w * 2 <= nWindow)) {
+        w *= 2;
+    }
+    int h = max(SPECTRUM_MIN_HOP, min(nHop, w));
+    spcConfig.store((w << 16) | h, std::memory_order_relaxed);
+}
+
+static void FreeSpectrum() {
+    delete[] spcHistLeft;
+    delete[] spcHistRight;
+    delete[] spcWaveLeft;
+    delete[] spcWaveRight;
+    delete[] spcFreqLeft;
+    delete[] spcFreqRight;
+    spcHistLeft = spcHistRight = NULL;
+    spcWaveLeft = spcWaveRight = NULL;
+    spcFreqLeft = spcFreqRight = NULL;
+    spcWindow = 0;
+    spcFft.CleanUp();
+}
+
+// (Re)allocate for the requested configuration. Capture thread only
+static bool ApplySpectrumConfig(int config) {
+    spcAppliedConfig = config;
+    int nWindow = config >> 16;
+    int nHop = config & 0xFFFF;
+
+    if (nWindow != spcWindow) {
+        FreeSpectrum();
+        spcHistLeft = new (std::nothrow) float[nWindow];
+        spcHistRight = new (std::nothrow) float[nWindow];
+        spcWaveLeft = new (std::nothrow) float[nWindow];
+        spcWaveRight = new (std::nothrow) float[nWindow];
+        spcFreqLeft = new (std::nothrow) float[nWindow / 2];
+        spcFreqRight = new (std::nothrow) float[nWindow / 2];
+        if (!spcHistLeft || !spcHistRight || !spcWaveLeft || !spcWaveRight || !spcFreqLeft || !spcFreqRight) {
+            ERR(L"Out of memory for a %d sample analysis window", nWindow);
+            FreeSpectrum();
+            return false;
+        }
+        // No zero padding: the window fills the whole transform
+        spcFft.Init(nWindow, nWindow / 2);
+        spcWindow = nWindow;
+        spcFill = 0;
+        LOG(L"Spectrum analysis: %d sample window, %d sample hop", nWindow, nHop);
+    }
+    spcHop = nHop;
+    spcSinceHop = 0;
+    return true;
+}
+
+void ResetSpectrum() {
+    spcFill = 0;
+    spcSinceHop = 0;
+}
+
+// Transform the current window and publish it to the reader
+static void ComputeSpectrum() {
+    // Same conditioning as the per-frame analysis always had: scaled to the old
+    // 8-bit range and damped a bit to reduce high-frequency noise
+    float prevL = spcHistLeft[0] * 128.0f;
+    float prevR = spcHistRight[0] * 128.0f;
+    for (int i = 0; i < spcWindow; i++) {
+        float l = spcHistLeft[i] * 128.0f;
+        float r = spcHistRight[i] * 128.0f;
+        spcWaveLeft[i] = 0.5f * (l + prevL);
+        spcWaveRight[i] = 0.5f * (r + prevR);
+        prevL = l;
+        prevR = r;
+    }
+
+    spcFft.time_to_frequency_domain_stereo(spcWaveLeft, spcWaveRight, spcFreqLeft, spcFreqRight);
+
+    // spcWindow / 2 fine bins cover the same 0 .. Nyquist range as SPECTRUM_BINS output bins.
+    // Combine each group by energy, so a tone keeps its level whatever the window length
+    SpectrumSlot *pSlot = &spcSlots[spcBack];
+    const int nGroup = spcWindow / 2 / SPECTRUM_BINS;
+    const float fScale = (float)SPECTRUM_REF_WINDOW / (float)spcWindow;
+    if (nGroup == 1) {
+        for (int k = 0; k < SPECTRUM_BINS; k++) {
+            pSlot->fLeft[k] = spcFreqLeft[k] * fScale;
+            pSlot->fRight[k] = spcFreqRight[k] * fScale;
+        }
+    } else {
+        for (int k = 0; k < SPECTRUM_BINS; k++) {
+            const float *pL = &spcFreqLeft[k * nGroup];
+            const float *pR = &spcFreqRight[k * nGroup];
+            float sumL = 0.0f, sumR = 0.0f;
+            for (int j = 0; j < nGroup; j++) {
+                sumL += pL[j] * pL[j];
+                sumR += pR[j] * pR[j];
+            }
+            pSlot->fLeft[k] = sqrtf(sumL) * fScale;
+            pSlot->fRight[k] = sqrtf(sumR) * fScale;
+        }
+    }
+
+    // Hand the filled slot over and take back whichever one the reader is not holding
+    spcBack = spcMiddle.exchange(spcBack | SPECTRUM_FRESH, std::memory_order_acq_rel) & ~SPECTRUM_FRESH;
+}
+
+void UpdateSpectrum(const float *pLeft, const float *pRight, UINT32 nFrames) {
+    int config = spcConfig.load(std::memory_order_relaxed);
+    if (config != spcAppliedConfig) {
+        ApplySpectrumConfig(config);
+    }
+    if (spcWindow == 0) {
+        return;
+    }
+
+    while (nFrames > 0) {
+        // Append up to the next hop boundary, sliding the window once it is full
+        int len = (int)min(nFrames, (UINT32)(spcHop - spcSinceHop));
+        if (spcFill + len > spcWindow) {
+            int drop = spcFill + len - spcWindow;
+            memmove(spcHistLeft, spcHistLeft + drop, (spcFill - drop) * sizeof(float));
+            memmove(spcHistRight, spcHistRight + drop, (spcFill - drop) * sizeof(float));
+            spcFill -= drop;
+        }
+        memcpy(spcHistLeft + spcFill, pLeft, len * sizeof(float));
+        memcpy(spcHistRight + spcFill, pRight, len * sizeof(float));
+        spcFill += len;
+        spcSinceHop += len;
+        pLeft += len;
+        pRight += len;
+        nFrames -= len;
+
+        if (spcSinceHop == spcHop) {
+            spcSinceHop = 0;
+            // Wait for a full window after a reset instead of transforming a partial one
+            if (spcFill == spcWindow) {
+                ComputeSpectrum();
+            }
+        }
+    }
+}
+
+bool GetSpectrum(float *pLeft, float *pRight) {
+    if (!(spcMiddle.load(std::memory_order_relaxed) & SPECTRUM_FRESH)) {
+        return false;
+    }
+    spcFront = spcMiddle.exchange(spcFront, std::memory_order_acq_rel) & ~SPECTRUM_FRESH;
+    memcpy(pLeft, spcSlots[spcFront].fLeft, SPECTRUM_BINS * sizeof(float));
+    memcpy(pRight, spcSlots[spcFront].fRight, SPECTRUM_BINS * sizeof(float));
+    return true;
+}
@@ -0,0 +1,26 @@
+// spectrum.h
+
+#define SPECTRUM_BINS 512           // Bins per channel handed to the visualizer, 0 .. AUDIOBUF_SAMPLE_RATE / 2. Matches NUM_FREQUENCIES
+#define SPECTRUM_MIN_WINDOW 1024
+#define SPECTRUM_MAX_WINDOW 8192
+#define SPECTRUM_DEFAULT_WINDOW 2048 // ~46 ms, 21.5 Hz bins
+#define SPECTRUM_DEFAULT_HOP 512     // ~11.6 ms, so several hops land between two rendered frames
+
+// Streaming short-time Fourier transform of the capture stream.
+// The capture thread feeds every analysis rate sample through a window that slides by
+// one hop at a time (overlapping the previous windows) and runs an FFT per hop; the
+// render thread only picks up the latest hop's spectrum.
+
+// Set window length (power of two, SPECTRUM_MIN_WINDOW .. SPECTRUM_MAX_WINDOW) and hop size in samples.
+// Any thread; the capture thread switches over before its next hop
+void SetSpectrumConfig(int nWindow, int nHop);
+
+// Forget the sample history after a discontinuity (capture thread only)
+void ResetSpectrum();
+
+// Feed nFrames samples at AUDIOBUF_SAMPLE_RATE (capture thread only)
+void UpdateSpectrum(const float *pLeft, const float *pRight, UINT32 nFrames);
+
+// Copy the latest hop's spectrum, SPECTRUM_BINS per channel (render thread only).
+// Returns false and leaves the outputs untouched when no hop completed since the last call
+bool GetSpectrum(float *pLeft, float *pRight);
@@ -0,0 +1,244 @@
+// wavwriter.cpp
+
+#include "common.h"
+#include <new>
+
+CWavWriter::CWavWriter()
+: m_hFile(NULL)
+, m_Policy(WAVWRITER_FLUSH_NONE)
+, m_dwFlushIntervalMs(WAVWRITER_FLUSH_MS)
+, m_nBlockSize(0)
+, m_nBlocks(0)
+, m_pPool(NULL)
+, m_pBlockBytes(NULL)
+, m_pQueue(NULL)
+, m_nQueueHead(0)
+, m_nQueueTail(0)
+, m_pFree(NULL)
+, m_nFreeHead(0)
+, m_nFreeTail(0)
+, m_nCurrent(0)
+, m_nHighWater(0)
+, m_nDropped(0)
+, m_hThread(NULL)
+, m_hWakeEvent(NULL)
+, m_bStop(false)
+, m_hr(S_OK)
+{
+}
+
+CWavWriter::~CWavWriter() {
+    Stop();
+}
+
+void CWavWriter::Free() {
+    delete[] m_pPool;
+    delete[] m_pBlockBytes;
+    delete[] m_pQueue;
+    delete[] m_pFree;
+    m_pPool = NULL;
+    m_pBlockBytes = NULL;
+    m_pQueue = NULL;
+    m_pFree = NULL;
+    m_nBlocks = 0;
+    if (NULL != m_hWakeEvent) {
+        CloseHandle(m_hWakeEvent);
+        m_hWakeEvent = NULL;
+    }
+}
+
+HRESULT CWavWriter::Start(HMMIO hFile, UINT32 nBlockAlign, WavFlushPolicy policy, DWORD dwFlushIntervalMs) {
+    m_hFile = hFile;
+    m_Policy = policy;
+    m_dwFlushIntervalMs = dwFlushIntervalMs;
+
+    // Whole frames per block, so dropping whole blocks keeps the file frame aligned
+    m_nBlockSize = WAVWRITER_BLOCK_SIZE - WAVWRITER_BLOCK_SIZE % max(nBlockAlign, (UINT32)1);
+    m_nBlocks = 1;
+    while (m_nBlocks < WAVWRITER_BLOCKS) {
+        m_nBlocks *= 2;
+    }
+
+    m_pPool = new (std::nothrow) BYTE[m_nBlocks * m_nBlockSize];
+    m_pBlockBytes = new (std::nothrow) UINT32[m_nBlocks];
+    m_pQueue = new (std::nothrow) UINT32[m_nBlocks];
+    m_pFree = new (std::nothrow) UINT32[m_nBlocks];
+    if (!m_pPool || !m_pBlockBytes || !m_pQueue || !m_pFree) {
+        ERR(L"Out of memory for %u WAV writer blocks of %u bytes", m_nBlocks, m_nBlockSize);
+        Free();
+        return E_OUTOFMEMORY;
+    }
+
+    // Every block starts out free
+    for (UINT32 i = 0; i < m_nBlocks; i++) {
+        m_pFree[i] = i;
+    }
+    m_nFreeHead.store(0, std::memory_order_relaxed);
+    m_nFreeTail.store(m_nBlocks, std::memory_order_relaxed);
+    m_nQueueHead.store(0, std::memory_order_relaxed);
+    m_nQueueTail.store(0, std::memory_order_relaxed);
+    m_nCurrent = m_nBlocks;
+    m_nHighWater = 0;
+    m_nDropped = 0;
+    m_bStop.store(false, std::memory_order_relaxed);
+    m_hr.store(S_OK, std::memory_order_relaxed);
+
+    m_hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (NULL == m_hWakeEvent) {
+        DWORD dwErr = GetLastError();
+        ERR(L"CreateEvent failed: last error is %u", dwErr);
+        Free();
+        return HRESULT_FROM_WIN32(dwErr);
+    }
+
+    m_hThread = CreateThread(NULL, 0, ThreadFunction, this, 0, NULL);
+    if (NULL == m_hThread) {
+        DWORD dwErr = GetLastError();
+        ERR(L"CreateThread failed: last error is %u", dwErr);
+        Free();
+        return HRESULT_FROM_WIN32(dwErr);
+    }
+
+    return S_OK;
+}
+
+bool CWavWriter::AcquireBlock() {
+    UINT32 head = m_nFreeHead.load(std::memory_order_relaxed);
+    if (head == m_nFreeTail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    m_nCurrent = m_pFree[head % m_nBlocks];
+    m_pBlockBytes[m_nCurrent] = 0;
+    m_nFreeHead.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+void CWavWriter::SubmitBlock() {
+    UINT32 tail = m_nQueueTail.load(std::memory_order_relaxed);
+    m_pQueue[tail % m_nBlocks] = m_nCurrent;
+    m_nQueueTail.store(tail + 1, std::memory_order_release);
+    m_nCurrent = m_nBlocks;
+
+    UINT32 nQueued = tail + 1 - m_nQueueHead.load(std::memory_order_relaxed);
+    if (nQueued > m_nHighWater) {
+        m_nHighWater = nQueued;
+    }
+    SetEvent(m_hWakeEvent);
+}
+
+void CWavWriter::Write(const BYTE *pData, UINT32 nBytes) {
+    if (NULL == m_hThread) {
+        return;
+    }
+
+    while (nBytes > 0) {
+        if (m_nCurrent == m_nBlocks && !AcquireBlock()) {
+            // Writer is behind by the whole pool. Block boundaries are frame boundaries,
+            // so skipping up to a block's worth here keeps the file aligned
+            UINT32 nSkip = min(nBytes, m_nBlockSize);
+            pData += nSkip;
+            nBytes -= nSkip;
+            m_nDropped++;
+            continue;
+        }
+
+        UINT32 nUsed = m_pBlockBytes[m_nCurrent];
+        UINT32 len = min(nBytes, m_nBlockSize - nUsed);
+        memcpy(m_pPool + m_nCurrent * m_nBlockSize + nUsed, pData, len);
+        m_pBlockBytes[m_nCurrent] = nUsed + len;
+        pData += len;
+        nBytes -= len;
+
+        if (m_pBlockBytes[m_nCurrent] == m_nBlockSize) {
+            SubmitBlock();
+        }
+    }
+}
+
+HRESULT CWavWriter::Stop() {
+    if (NULL == m_hThread) {
+        return GetResult();
+    }
+
+    // Partly filled block goes out too
+    if (m_nCurrent != m_nBlocks && m_pBlockBytes[m_nCurrent] > 0) {
+        SubmitBlock();
+    }
+    m_bStop.store(true, std::memory_order_release);
+    SetEvent(m_hWakeEvent);
+
+    DWORD dwWaitResult = WaitForSingleObject(m_hThread, INFINITE);
+    if (WAIT_OBJECT_0 != dwWaitResult) {
+        ERR(L"WaitForSingleObject returned unexpected result 0x%08x, last error is %d", dwWaitResult, GetLastError());
+    }
+    CloseHandle(m_hThread);
+    m_hThread = NULL;
+
+    if (m_nDropped > 0) {
+        ERR(L"WAV writer fell behind: data dropped %u times, the file has gaps", m_nDropped);
+    }
+    LOG(L"WAV writer: at most %u of %u blocks queued, %u dropped", m_nHighWater, m_nBlocks, m_nDropped);
+
+    Free();
+    return GetResult();
+}
+
+DWORD WINAPI CWavWriter::ThreadFunction(LPVOID pContext) {
+    ((CWavWriter*)pContext)->Run();
+    return 0;
+}
+
+void CWavWriter::Run() {
+    DWORD dwLastFlush = GetTickCount();
+    bool bDirty = false;
+
+    for (;;) {
+        UINT32 head = m_nQueueHead.load(std::memory_order_relaxed);
+        if (head == m_nQueueTail.load(std::memory_order_acquire)) {
+            if (m_bStop.load(std::memory_order_acquire)) {
+                // Stop is raised after the last block was queued; look once more before leaving
+                if (head == m_nQueueTail.load(std::memory_order_acquire)) {
+                    break;
+                }
+                continue;
+            }
+            DWORD dwTimeout = (WAVWRITER_FLUSH_INTERVAL == m_Policy && bDirty) ? m_dwFlushIntervalMs : INFINITE;
+            WaitForSingleObject(m_hWakeEvent, dwTimeout);
+        } else {
+            UINT32 nBlock = m_pQueue[head % m_nBlocks];
+
+            // After an error the blocks are still cycled, so the capture thread never runs dry
+            if (SUCCEEDED(GetResult())) {
+                LONG lBytesToWrite = (LONG)m_pBlockBytes[nBlock];
+                LONG lBytesWritten = mmioWrite(m_hFile, reinterpret_cast<PCHAR>(m_pPool + nBlock * m_nBlockSize), lBytesToWrite);
+                if (lBytesToWrite != lBytesWritten) {
+                    ERR(L"mmioWrite wrote %u bytes: expected %u bytes", lBytesWritten, lBytesToWrite);
+                    m_hr.store(E_UNEXPECTED, std::memory_order_relaxed);
+                }
+                bDirty = true;
+            }
+            m_nQueueHead.store(head + 1, std::memory_order_relaxed);
+
+            // Hand the block back to the capture thread
+            UINT32 tail = m_nFreeTail.load(std::memory_order_relaxed);
+            m_pFree[tail % m_nBlocks] = nBlock;
+            m_nFreeTail.store(tail + 1, std::memory_order_release);
+        }
+
+        bool bFlush = false;
+        if (WAVWRITER_FLUSH_BLOCK == m_Policy) {
+            bFlush = bDirty;
+        } else if (WAVWRITER_FLUSH_INTERVAL == m_Policy) {
+            bFlush = bDirty && (GetTickCount() - dwLastFlush >= m_dwFlushIntervalMs);
+        }
+        if (bFlush && SUCCEEDED(GetResult())) {
+            MMRESULT result = mmioFlush(m_hFile, 0);
+            if (MMSYSERR_NOERROR != result) {
+                ERR(L"mmioFlush failed: MMRESULT = 0x%08x", result);
+                m_hr.store(E_FAIL, std::memory_order_relaxed);
+            }
+            dwLastFlush = GetTickCount();
+            bDirty = false;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+// wavwriter.h
+
+#include <atomic>
+#include <windows.h>
+#include <mmsystem.h>
+
+#define WAVWRITER_BLOCK_SIZE (64 * 1024) // Bytes per pool block, rounded down to whole frames
+#define WAVWRITER_BLOCKS 64              // Pool size, rounded up to a power of two. 4 MB is ~10 s of 48 kHz stereo float
+#define WAVWRITER_FLUSH_MS 1000          // Default interval for WAVWRITER_FLUSH_INTERVAL, in milliseconds
+
+// When the writer thread asks mmio to push buffered data to disk
+enum WavFlushPolicy {
+    WAVWRITER_FLUSH_NONE = 0,   // Leave it to mmio and the OS until the file is finished
+    WAVWRITER_FLUSH_INTERVAL,   // At most every dwFlushIntervalMs while data is coming in
+    WAVWRITER_FLUSH_BLOCK       // After every block
+};
+
+// Writes the captured stream to the .wav data chunk on a background thread, so a slow disk
+// can't hold up packet draining. The capture thread copies each packet into blocks from a
+// preallocated pool and queues them; it never blocks and never allocates. When the writer
+// falls so far behind that the pool runs dry, the data is dropped (and counted) instead.
+class CWavWriter {
+public:
+    CWavWriter();
+    ~CWavWriter();
+
+    // Allocate the pool and start the writer thread. hFile must be positioned in the data chunk
+    HRESULT Start(HMMIO hFile, UINT32 nBlockAlign, WavFlushPolicy policy, DWORD dwFlushIntervalMs);
+
+    // Queue nBytes of whole frames for writing (capture thread only)
+    void Write(const BYTE *pData, UINT32 nBytes);
+
+    // Queue what is left, wait until everything is written and stop the thread.
+    // Returns the first write error, if any. Called by the destructor too
+    HRESULT Stop();
+
+    // First write error so far, S_OK if none
+    HRESULT GetResult() const { return m_hr.load(std::memory_order_relaxed); }
+
+    // Most blocks ever waiting in the queue
+    UINT32 GetHighWater() const { return m_nHighWater; }
+
+    // Pieces of data (a packet, or up to a block of a larger one) dropped because the pool was exhausted
+    UINT32 GetDropped() const { return m_nDropped; }
+
+private:
+    static DWORD WINAPI ThreadFunction(LPVOID pContext);
+    void Run();
+    bool AcquireBlock();
+    void SubmitBlock();
+    void Free();
+
+    HMMIO m_hFile;
+    WavFlushPolicy m_Policy;
+    DWORD m_dwFlushIntervalMs;
+    UINT32 m_nBlockSize;
+    UINT32 m_nBlocks;
+    BYTE *m_pPool;              // m_nBlocks blocks of m_nBlockSize bytes
+    UINT32 *m_pBlockBytes;      // Bytes filled in each block
+
+    // Single-producer / single-consumer rings of block indices. Counters only grow,
+    // the slot is counter % m_nBlocks; a ring never holds more than the m_nBlocks blocks there are
+    UINT32 *m_pQueue;                       // Full blocks, capture thread -> writer thread
+    std::atomic<UINT32> m_nQueueHead;
+    std::atomic<UINT32> m_nQueueTail;
+    UINT32 *m_pFree;                        // Written blocks, writer thread -> capture thread
+    std::atomic<UINT32> m_nFreeHead;
+    std::atomic<UINT32> m_nFreeTail;
+
+    // Capture thread only
+    UINT32 m_nCurrent;          // Block being filled, m_nBlocks if none
+    UINT32 m_nHighWater;
+    UINT32 m_nDropped;
+
+    HANDLE m_hThread;
+    HANDLE m_hWakeEvent;        // Set when a block is queued or on stop
+    std::atomic<bool> m_bStop;
+    std::atomic<HRESULT> m_hr;
+};
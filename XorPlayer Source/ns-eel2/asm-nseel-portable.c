@@ -0,0 +1,373 @@
+/*
+  Expression Evaluator Library (NS-EEL) v2
+  portable glue: bytecode templates and the threaded interpreter that runs them
+
+  Used instead of native glue when EEL_TARGET_PORTABLE is defined (see ns-eel.h). Each glue
+  function is a short bytecode template, terminated by EEL_BC_END, that nseel-compiler.c copies
+  and patches exactly like it does the machine code of the other targets, so the compiler
+  doesn't need to know which one it is building. Ops and registers are listed with EEL_BC_OPS
+  in ns-eel-int.h.
+
+  Immediates to be filled in by EEL_GLUE_set_immediate() are ~0, in the order nseel-compiler.c
+  sets them. Results follow the x86 glue: float to int conversions truncate, comparisons treat
+  NaN the way the x87/SSE flags do, and sub-blocks (if, loop, while, && and ||) run on the C stack
+  like the native code calls them.
+
+  With gcc/clang each handler jumps straight to the next one through a label table (computed
+  goto), otherwise it falls back to a switch.
+*/
+
+#include <string.h>
+
+#define BC_IMM (~(INT_PTR)0)
+
+INT_PTR nseel_asm_1pdd_end[1], nseel_asm_1pdd[]={ EEL_BC_CALL1, BC_IMM /* function */, EEL_BC_END };
+INT_PTR nseel_asm_2pdd_end[1], nseel_asm_2pdd[]={ EEL_BC_CALL2, BC_IMM /* function */, EEL_BC_END };
+INT_PTR nseel_asm_2pdds_end[1], nseel_asm_2pdds[]={ EEL_BC_CALL2S, BC_IMM /* function */, EEL_BC_END };
+INT_PTR nseel_asm_1pp_end[1], nseel_asm_1pp[]={ EEL_BC_CALL1P, BC_IMM /* function */, EEL_BC_END };
+INT_PTR nseel_asm_2pp_end[1], nseel_asm_2pp[]={ EEL_BC_CALL2P, BC_IMM /* function */, EEL_BC_END };
+
+INT_PTR nseel_asm_exec2_end[1], nseel_asm_exec2[]={ EEL_BC_END };
+INT_PTR nseel_asm_uplus_end[1], nseel_asm_uplus[]={ EEL_BC_END };
+INT_PTR nseel_asm_uminus_end[1], nseel_asm_uminus[]={ EEL_BC_UMINUS, EEL_BC_END };
+INT_PTR nseel_asm_invsqrt_end[1], nseel_asm_invsqrt[]={ EEL_BC_INVSQRT, BC_IMM /* -0.5 */, BC_IMM /* 1.5 */, EEL_BC_END };
+INT_PTR nseel_asm_sqr_end[1], nseel_asm_sqr[]={ EEL_BC_SQR, EEL_BC_END };
+INT_PTR nseel_asm_sqrt_end[1], nseel_asm_sqrt[]={ EEL_BC_SQRT, EEL_BC_END };
+INT_PTR nseel_asm_abs_end[1], nseel_asm_abs[]={ EEL_BC_ABS, EEL_BC_END };
+INT_PTR nseel_asm_sign_end[1], nseel_asm_sign[]={ EEL_BC_SIGN, BC_IMM /* g_signs */, EEL_BC_END };
+INT_PTR nseel_asm_min_end[1], nseel_asm_min[]={ EEL_BC_MIN, EEL_BC_END };
+INT_PTR nseel_asm_max_end[1], nseel_asm_max[]={ EEL_BC_MAX, EEL_BC_END };
+
+INT_PTR nseel_asm_assign_end[1], nseel_asm_assign[]={ EEL_BC_ASSIGN, EEL_BC_END };
+INT_PTR nseel_asm_add_end[1], nseel_asm_add[]={ EEL_BC_ADD, EEL_BC_END };
+INT_PTR nseel_asm_sub_end[1], nseel_asm_sub[]={ EEL_BC_SUB, EEL_BC_END };
+INT_PTR nseel_asm_mul_end[1], nseel_asm_mul[]={ EEL_BC_MUL, EEL_BC_END };
+INT_PTR nseel_asm_div_end[1], nseel_asm_div[]={ EEL_BC_DIV, EEL_BC_END };
+INT_PTR nseel_asm_mod_end[1], nseel_asm_mod[]={ EEL_BC_MOD, EEL_BC_END };
+INT_PTR nseel_asm_or_end[1], nseel_asm_or[]={ EEL_BC_OR, EEL_BC_END };
+INT_PTR nseel_asm_and_end[1], nseel_asm_and[]={ EEL_BC_AND, EEL_BC_END };
+INT_PTR nseel_asm_add_op_end[1], nseel_asm_add_op[]={ EEL_BC_ADDOP, EEL_BC_END };
+INT_PTR nseel_asm_sub_op_end[1], nseel_asm_sub_op[]={ EEL_BC_SUBOP, EEL_BC_END };
+INT_PTR nseel_asm_mul_op_end[1], nseel_asm_mul_op[]={ EEL_BC_MULOP, EEL_BC_END };
+INT_PTR nseel_asm_div_op_end[1], nseel_asm_div_op[]={ EEL_BC_DIVOP, EEL_BC_END };
+INT_PTR nseel_asm_mod_op_end[1], nseel_asm_mod_op[]={ EEL_BC_MODOP, EEL_BC_END };
+INT_PTR nseel_asm_or_op_end[1], nseel_asm_or_op[]={ EEL_BC_OROP, EEL_BC_END };
+INT_PTR nseel_asm_and_op_end[1], nseel_asm_and_op[]={ EEL_BC_ANDOP, EEL_BC_END };
+
+INT_PTR nseel_asm_bnot_end[1], nseel_asm_bnot[]={ EEL_BC_BNOT, BC_IMM /* g_closefact */, EEL_BC_END };
+INT_PTR nseel_asm_equal_end[1], nseel_asm_equal[]={ EEL_BC_EQUAL, BC_IMM /* g_closefact */, EEL_BC_END };
+INT_PTR nseel_asm_notequal_end[1], nseel_asm_notequal[]={ EEL_BC_NOTEQ, BC_IMM /* g_closefact */, EEL_BC_END };
+INT_PTR nseel_asm_below_end[1], nseel_asm_below[]={ EEL_BC_BELOW, EEL_BC_END };
+INT_PTR nseel_asm_beloweq_end[1], nseel_asm_beloweq[]={ EEL_BC_BELOWEQ, EEL_BC_END };
+INT_PTR nseel_asm_above_end[1], nseel_asm_above[]={ EEL_BC_ABOVE, EEL_BC_END };
+INT_PTR nseel_asm_aboveeq_end[1], nseel_asm_aboveeq[]={ EEL_BC_ABOVEEQ, EEL_BC_END };
+
+INT_PTR nseel_asm_if_end[1], nseel_asm_if[]={ EEL_BC_IF, BC_IMM /* g_closefact */, BC_IMM /* true branch */, BC_IMM /* false branch */, EEL_BC_END };
+INT_PTR nseel_asm_band_end[1], nseel_asm_band[]={ EEL_BC_BAND, BC_IMM /* g_closefact */, BC_IMM /* right hand side */, BC_IMM /* g_closefact */, EEL_BC_END };
+INT_PTR nseel_asm_bor_end[1], nseel_asm_bor[]={ EEL_BC_BOR, BC_IMM /* g_closefact */, BC_IMM /* right hand side */, BC_IMM /* g_closefact */, EEL_BC_END };
+INT_PTR nseel_asm_repeat_end[1], nseel_asm_repeat[]={ EEL_BC_LOOP, BC_IMM /* loop body */, EEL_BC_END };
+INT_PTR nseel_asm_repeatwhile_end[1], nseel_asm_repeatwhile[]={ EEL_BC_WHILE, BC_IMM /* loop body */, BC_IMM /* g_closefact */, EEL_BC_END };
+
+INT_PTR _asm_generic1parm_end[1], _asm_generic1parm[]={ EEL_BC_GEN1, BC_IMM /* context */, BC_IMM /* function */, EEL_BC_END };
+INT_PTR _asm_generic1parm_retd_end[1], _asm_generic1parm_retd[]={ EEL_BC_GEN1D, BC_IMM /* context */, BC_IMM /* function */, EEL_BC_END };
+INT_PTR _asm_generic2parm_end[1], _asm_generic2parm[]={ EEL_BC_GEN2, BC_IMM /* context */, BC_IMM /* function */, EEL_BC_END };
+INT_PTR _asm_generic2parm_retd_end[1], _asm_generic2parm_retd[]={ EEL_BC_GEN2D, BC_IMM /* context */, BC_IMM /* function */, EEL_BC_END };
+INT_PTR _asm_generic3parm_end[1], _asm_generic3parm[]={ EEL_BC_GEN3, BC_IMM /* context */, BC_IMM /* function */, EEL_BC_END };
+INT_PTR _asm_generic3parm_retd_end[1], _asm_generic3parm_retd[]={ EEL_BC_GEN3D, BC_IMM /* context */, BC_IMM /* function */, EEL_BC_END };
+INT_PTR _asm_megabuf_end[1], _asm_megabuf[]={ EEL_BC_MEGABUF, BC_IMM /* context */, BC_IMM /* g_closefact */, BC_IMM /* function */, EEL_BC_END };
+
+
+//---------------------------------------------------------------------------------------------------------------
+typedef double (*eelBcFunc1)(double);
+typedef double (*eelBcFunc2)(double, double);
+typedef EEL_F (NSEEL_CGEN_CALL *eelBcFunc1P)(EEL_F *);
+typedef EEL_F (NSEEL_CGEN_CALL *eelBcFunc2P)(EEL_F *, EEL_F *);
+typedef EEL_F *(NSEEL_CGEN_CALL *eelBcGen1)(void *, EEL_F *);
+typedef EEL_F *(NSEEL_CGEN_CALL *eelBcGen2)(void *, EEL_F *, EEL_F *);
+typedef EEL_F *(NSEEL_CGEN_CALL *eelBcGen3)(void *, EEL_F *, EEL_F *, EEL_F *);
+typedef EEL_F (NSEEL_CGEN_CALL *eelBcGen1D)(void *, EEL_F *);
+typedef EEL_F (NSEEL_CGEN_CALL *eelBcGen2D)(void *, EEL_F *, EEL_F *);
+typedef EEL_F (NSEEL_CGEN_CALL *eelBcGen3D)(void *, EEL_F *, EEL_F *, EEL_F *);
+typedef EEL_F *(NSEEL_CGEN_CALL *eelBcMegabuf)(void *, int);
+
+// sp is kept away from wt: next to each other, gcc copies the pair in and out of nseel_bc_run() through
+// one SSE register, and ends up sending every op through a single shared indirect jump
+typedef struct
+{
+  EEL_F *wt; // temporary work table
+  unsigned int loops; // loop iterations run, see NSEEL_code_getprofile()
+  EEL_F **sp; // operand stack
+} eelBcState;
+
+// denormals, infinities and NaNs are stored as 0, like the glue's assign does
+static EEL_F nseel_bc_fixvalue(EEL_F v)
+{
+#if EEL_F_SIZE == 4
+  unsigned int bits, e;
+  memcpy(&bits,&v,sizeof(bits));
+  e=(bits>>23)&0xff;
+  return (e && e != 0xff) ? v : 0.0f;
+#else
+  unsigned long long bits;
+  unsigned int e;
+  memcpy(&bits,&v,sizeof(bits));
+  e=(unsigned int)(bits>>52)&0x7ff;
+  return (e && e != 0x7ff) ? v : 0.0;
+#endif
+}
+
+// |a| % |b| on 32 bit integers, 0 when dividing by 0
+static EEL_F nseel_bc_mod(EEL_F a, EEL_F b)
+{
+  unsigned int d=(unsigned int)(int)fabs(b);
+  return d ? (EEL_F)(int)((unsigned int)(int)fabs(a) % d) : 0.0;
+}
+
+// same approximation (and results) as the x86 glue
+static EEL_F nseel_bc_invsqrt(EEL_F x, EEL_F m05, EEL_F p15)
+{
+  float f=(float)x;
+  int i;
+  EEL_F y;
+  memcpy(&i,&f,sizeof(i));
+  i=0x5f3759df - (i>>1);
+  memcpy(&f,&i,sizeof(f));
+  y=f;
+  return (x*m05*y*y + p15)*y;
+}
+
+#if defined(__GNUC__)
+  #define BC_DISPATCH goto *s_labels[*ip];
+  #define BC_OP(x) l_##x:
+  #define BC_NEXT(n) ip+=(n); goto *s_labels[*ip]
+  #define BC_LABEL(x) &&l_##x,
+  #define BC_LABEL_DIRECT(x) &&l_##x##_PP, &&l_##x##_RP, &&l_##x##_PR,
+#else
+  #define BC_DISPATCH for (;;) switch (*ip)
+  #define BC_OP(x) case EEL_BC_##x:
+  #define BC_NEXT(n) ip+=(n); continue
+#endif
+
+#define BC_PTR(n) ((EEL_F *)ip[n])
+#define BC_RESULT(v) { *wt=(v); r=wt++; }
+#define BC_SYNC() { st->wt=wt; st->sp=sp; }
+
+// an EEL_BC_BINOPS op and its versions with the parameters built in
+#define BC_BINOP(x, code) \
+  BC_OP(x) code BC_NEXT(1); \
+  BC_OP(x##_PP) a=BC_PTR(1); r=BC_PTR(2); code BC_NEXT(3); \
+  BC_OP(x##_RP) a=r; r=BC_PTR(1); code BC_NEXT(2); \
+  BC_OP(x##_PR) a=BC_PTR(1); code BC_NEXT(2);
+
+// loop()s and while()s nested this deep in one nseel_bc_run() go around without a call per iteration
+#define BC_MAXLOOPS 16
+
+// runs code up to its EEL_BC_RET, returns the result pointer. r is what the caller had in it
+static EEL_F *nseel_bc_run(const INT_PTR *ip, eelBcState *st, EEL_F *r)
+{
+#if defined(__GNUC__)
+  static const void *const s_labels[EEL_BC_NUMOPS]={ EEL_BC_OPS(BC_LABEL) EEL_BC_BINOPS(BC_LABEL) EEL_BC_BINOPS(BC_LABEL_DIRECT) };
+#endif
+  EEL_F *a=0, *c=0;
+  EEL_F *wt=st->wt;
+  EEL_F **sp=st->sp;
+  struct { const INT_PTR *ip; EEL_F *wt; int cnt; } loop[BC_MAXLOOPS]; // the LOOP/WHILE, its work table, iterations left
+  int nloop=0;
+
+  BC_DISPATCH
+  {
+    BC_OP(END)
+    BC_OP(RET)
+      if (nloop)
+      {
+        // the end of a loop body: the counter and the condition are checked here, and it goes around
+        // again or carries on after the LOOP/WHILE
+        const INT_PTR *lp=loop[nloop-1].ip;
+        if (*lp == EEL_BC_LOOP)
+        {
+          if (--loop[nloop-1].cnt)
+          {
+            wt=loop[nloop-1].wt; // every iteration starts over in the work table
+            ip=(const INT_PTR *)lp[1];
+            BC_NEXT(0);
+          }
+          wt=loop[--nloop].wt;
+          ip=lp;
+          BC_NEXT(2);
+        }
+        if (fabs(*r) >= *(EEL_F *)lp[2] && --loop[nloop-1].cnt)
+        {
+          wt=loop[nloop-1].wt;
+          st->loops++;
+          ip=(const INT_PTR *)lp[1];
+          BC_NEXT(0);
+        }
+        r=wt=loop[--nloop].wt;
+        ip=lp;
+        BC_NEXT(3);
+      }
+      BC_SYNC()
+      return r;
+
+    BC_OP(SETWT) wt=BC_PTR(1); BC_NEXT(2);
+    BC_OP(MOV) r=BC_PTR(1); BC_NEXT(2);
+    BC_OP(MOV2) a=BC_PTR(1); r=BC_PTR(2); BC_NEXT(3);
+    BC_OP(MOVA) a=BC_PTR(1); BC_NEXT(2);
+    BC_OP(MOVAR) a=r; r=BC_PTR(1); BC_NEXT(2);
+    BC_OP(PUSH) *sp++=r; BC_NEXT(1);
+    BC_OP(POPA) a=*--sp; BC_NEXT(1);
+    BC_OP(POPC) c=*--sp; BC_NEXT(1);
+
+    BC_BINOP(ASSIGN, *a=nseel_bc_fixvalue(*r);) // the glue leaves the result pointing at the value assigned
+    BC_BINOP(ADD, BC_RESULT(*a + *r))
+    BC_BINOP(SUB, BC_RESULT(*a - *r))
+    BC_BINOP(MUL, BC_RESULT(*a * *r))
+    BC_BINOP(DIV, BC_RESULT(*a / *r))
+    BC_BINOP(MOD, BC_RESULT(nseel_bc_mod(*a,*r)))
+    BC_BINOP(OR, BC_RESULT((EEL_F)((long long)*a | (long long)*r)))
+    BC_BINOP(AND, BC_RESULT((EEL_F)((long long)*a & (long long)*r)))
+    BC_BINOP(ADDOP, *a += *r; r=a;)
+    BC_BINOP(SUBOP, *a -= *r; r=a;)
+    BC_BINOP(MULOP, *a *= *r; r=a;)
+    BC_BINOP(DIVOP, *a /= *r; r=a;)
+    BC_BINOP(MODOP, *a=nseel_bc_mod(*a,*r); r=a;)
+    BC_BINOP(OROP, *a=(EEL_F)((long long)*a | (long long)*r); r=a;)
+    BC_BINOP(ANDOP, *a=(EEL_F)((long long)*a & (long long)*r); r=a;)
+
+    BC_OP(UMINUS) BC_RESULT(-*r) BC_NEXT(1);
+    BC_OP(ABS) BC_RESULT(fabs(*r)) BC_NEXT(1);
+    BC_OP(SQR) BC_RESULT(*r * *r) BC_NEXT(1);
+    BC_OP(SQRT) BC_RESULT(sqrt(fabs(*r))) BC_NEXT(1);
+    BC_OP(INVSQRT) BC_RESULT(nseel_bc_invsqrt(*r,*BC_PTR(1),*BC_PTR(2))) BC_NEXT(3);
+    BC_OP(SIGN) if (*r != 0.0) BC_RESULT(BC_PTR(1)[copysign(1.0,*r) < 0.0]) BC_NEXT(2); // sign(0) is the 0 itself, NaNs go by their sign bit
+    BC_BINOP(MIN, if (!(*a >= *r)) r=a;)
+    BC_BINOP(MAX, if (*a >= *r) r=a;)
+
+    BC_OP(BNOT) BC_RESULT(!(fabs(*r) >= *BC_PTR(1)) ? 1.0 : 0.0) BC_NEXT(2);
+    BC_OP(EQUAL) BC_RESULT(!(fabs(*r - *a) >= *BC_PTR(1)) ? 1.0 : 0.0) BC_NEXT(2);
+    BC_OP(NOTEQ) BC_RESULT(fabs(*r - *a) >= *BC_PTR(1) ? 1.0 : 0.0) BC_NEXT(2);
+    BC_BINOP(BELOW, BC_RESULT(!(*a >= *r) ? 1.0 : 0.0))
+    BC_BINOP(BELOWEQ, BC_RESULT(*r >= *a ? 1.0 : 0.0))
+    BC_BINOP(ABOVE, BC_RESULT(!(*r >= *a) ? 1.0 : 0.0))
+    BC_BINOP(ABOVEEQ, BC_RESULT(*a >= *r ? 1.0 : 0.0))
+
+    BC_OP(IF)
+      BC_SYNC()
+      r=nseel_bc_run((const INT_PTR *)(fabs(*r) >= *BC_PTR(1) ? ip[2] : ip[3]),st,r);
+      wt=st->wt;
+      BC_NEXT(4);
+
+    BC_OP(BAND)
+      {
+        EEL_F v=0.0;
+        if (fabs(*r) >= *BC_PTR(1))
+        {
+          BC_SYNC()
+          r=nseel_bc_run((const INT_PTR *)ip[2],st,r);
+          wt=st->wt;
+          v=fabs(*r) >= *BC_PTR(3) ? 1.0 : 0.0;
+        }
+        BC_RESULT(v)
+      }
+      BC_NEXT(4);
+
+    BC_OP(BOR)
+      {
+        EEL_F v=1.0;
+        if (!(fabs(*r) >= *BC_PTR(1)))
+        {
+          BC_SYNC()
+          r=nseel_bc_run((const INT_PTR *)ip[2],st,r);
+          wt=st->wt;
+          v=fabs(*r) >= *BC_PTR(3) ? 1.0 : 0.0;
+        }
+        BC_RESULT(v)
+      }
+      BC_NEXT(4);
+
+    BC_OP(LOOP)
+      {
+        // like cvttsd2si, counts that don't fit in an int don't loop at all
+        EEL_F n=*r;
+        if (n >= 1.0 && n < 2147483648.0)
+        {
+          int cnt=n < NSEEL_LOOPFUNC_SUPPORT_MAXLEN ? (int)n : NSEEL_LOOPFUNC_SUPPORT_MAXLEN;
+          st->loops+=cnt;
+          if (nloop < BC_MAXLOOPS)
+          {
+            loop[nloop].ip=ip;
+            loop[nloop].wt=wt;
+            loop[nloop++].cnt=cnt;
+            ip=(const INT_PTR *)ip[1];
+            BC_NEXT(0);
+          }
+          BC_SYNC()
+          do
+          {
+            st->wt=wt; // every iteration starts over in the work table
+            r=nseel_bc_run((const INT_PTR *)ip[1],st,r);
+          }
+          while (--cnt);
+        }
+      }
+      BC_NEXT(2);
+
+    BC_OP(WHILE)
+      if (nloop < BC_MAXLOOPS)
+      {
+        loop[nloop].ip=ip;
+        loop[nloop].wt=wt;
+        loop[nloop++].cnt=NSEEL_LOOPFUNC_SUPPORT_MAXLEN;
+        st->loops++;
+        ip=(const INT_PTR *)ip[1];
+        BC_NEXT(0);
+      }
+      else
+      {
+        int cnt=NSEEL_LOOPFUNC_SUPPORT_MAXLEN;
+        BC_SYNC()
+        do
+        {
+          st->wt=wt;
+          st->loops++;
+          r=nseel_bc_run((const INT_PTR *)ip[1],st,r);
+        }
+        while (fabs(*r) >= *BC_PTR(2) && --cnt);
+        r=wt;
+      }
+      BC_NEXT(3);
+
+    BC_OP(CALL1) BC_RESULT((EEL_F)((eelBcFunc1)ip[1])(*r)) BC_NEXT(2);
+    BC_OP(CALL2) BC_RESULT((EEL_F)((eelBcFunc2)ip[1])(*a,*r)) BC_NEXT(2);
+    BC_OP(CALL2S) *a=(EEL_F)((eelBcFunc2)ip[1])(*a,*r); r=a; BC_NEXT(2);
+    BC_OP(CALL1P) BC_RESULT(((eelBcFunc1P)ip[1])(r)) BC_NEXT(2);
+    BC_OP(CALL2P) BC_RESULT(((eelBcFunc2P)ip[1])(a,r)) BC_NEXT(2);
+
+    BC_OP(GEN1) r=((eelBcGen1)ip[2])((void *)ip[1],r); BC_NEXT(3);
+    BC_OP(GEN1D) BC_RESULT(((eelBcGen1D)ip[2])((void *)ip[1],r)) BC_NEXT(3);
+    BC_OP(GEN2) r=((eelBcGen2)ip[2])((void *)ip[1],a,r); BC_NEXT(3);
+    BC_OP(GEN2D) BC_RESULT(((eelBcGen2D)ip[2])((void *)ip[1],a,r)) BC_NEXT(3);
+    BC_OP(GEN3) r=((eelBcGen3)ip[2])((void *)ip[1],c,a,r); BC_NEXT(3);
+    BC_OP(GEN3D) BC_RESULT(((eelBcGen3D)ip[2])((void *)ip[1],c,a,r)) BC_NEXT(3);
+
+    BC_OP(MEGABUF)
+      {
+        const int w=(int)(*r + *BC_PTR(2));
+        EEL_F *p=nseel_ram_lookup((EEL_F ***)ip[1],w);
+        if (!p) p=((eelBcMegabuf)ip[3])((void *)ip[1],w);
+        if (p) r=p;
+        else BC_RESULT(0.0)
+      }
+      BC_NEXT(4);
+  }
+}
+
+unsigned int nseel_bc_exec(const INT_PTR *code, EEL_F **stack)
+{
+  eelBcState st;
+  st.sp=stack;
+  st.wt=0; // set by the EEL_BC_SETWT at the start of every statement
+  st.loops=0;
+  nseel_bc_run(code,&st,0);
+  return st.loops;
+}
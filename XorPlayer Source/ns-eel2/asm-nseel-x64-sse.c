@@ -0,0 +1,887 @@
+/*
+  Expression Evaluator Library (NS-EEL) v2
+  x86-64 glue code (SysV and Win64), SSE2 scalar doubles
+
+  Every glue function is kept as a table of machine code here instead of compiled
+  from inline assembly (MSVC has no inline assembly for x64). nseel-compiler.c copies
+  the tables into code blocks the same way it copies the x86 glue functions.
+
+  Register use, same roles as the x86 glue:
+    rax     pointer to the result of the last expression
+    rdi     pointer to the second to last parameter, rcx to the one before it (3 parm functions)
+    rsi     pointer into the temporary work table, advanced by 8 for each result written
+    r14/r15 kept across C calls (callee-saved on both ABIs, saved by GLUE_CODE_ENTER)
+    xmm0/1  scratch
+
+  rsp is 16 byte aligned inside the code: GLUE_CODE_ENTER aligns it, GLUE_PUSH_EAX pushes twice
+  and every call into a sub-block pushes 8 bytes before the return address. C functions get 32
+  bytes of shadow space (only needed on Win64, harmless on SysV).
+
+  Immediates to be filled in by EEL_GLUE_set_immediate() are 0xFFFFFFFFFFFFFFFF, in the order
+  nseel-compiler.c sets them. Float to int conversions truncate (cvttsd2si), which is what the
+  x86 glue gets from running with _RC_CHOP.
+*/
+
+#define X64_GLUE_END 0x89,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90 // end marker GLUE_realAddress() looks for
+#define X64_IMM32(x) ((x)&0xFF),(((x)>>8)&0xFF),(((x)>>16)&0xFF),(((x)>>24)&0xFF)
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_1pdd_end[1];
+unsigned char nseel_asm_1pdd[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_2pdd_end[1];
+unsigned char nseel_asm_2pdd[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0xF2,0x0F,0x10,0x08,                                 // movsd xmm1, [rax]
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_2pdds_end[1];
+unsigned char nseel_asm_2pdds[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0xF2,0x0F,0x10,0x08,                                 // movsd xmm1, [rax]
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x49,0x89,0xFE,                                      // mov r14, rdi
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+  0xF2,0x41,0x0F,0x11,0x06,                            // movsd [r14], xmm0
+  0x4C,0x89,0xF0,                                      // mov rax, r14
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_2pp_end[1];
+unsigned char nseel_asm_2pp[]={
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+#ifdef _WIN64
+  0x48,0x89,0xF9,                                      // mov rcx, rdi
+  0x48,0x89,0xC2,                                      // mov rdx, rax
+#else
+  0x48,0x89,0xC6,                                      // mov rsi, rax
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_1pp_end[1];
+unsigned char nseel_asm_1pp[]={
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+#ifdef _WIN64
+  0x48,0x89,0xC1,                                      // mov rcx, rax
+#else
+  0x48,0x89,0xC7,                                      // mov rdi, rax
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_exec2_end[1];
+unsigned char nseel_asm_exec2[]={
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_invsqrt_end[1];
+unsigned char nseel_asm_invsqrt[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0xF2,0x0F,0x5A,0xC8,                                 // cvtsd2ss xmm1, xmm0
+  0x66,0x0F,0x7E,0xCA,                                 // movd edx, xmm1
+  0xD1,0xFA,                                           // sar edx, 1
+  0xB9,0xDF,0x59,0x37,0x5F,                            // mov ecx, 0x5f3759df
+  0x29,0xD1,                                           // sub ecx, edx
+  0x66,0x0F,0x6E,0xC9,                                 // movd xmm1, ecx
+  0xF3,0x0F,0x5A,0xC9,                                 // cvtss2sd xmm1, xmm1
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, -0.5
+  0xF2,0x0F,0x59,0x00,                                 // mulsd xmm0, [rax]
+  0xF2,0x0F,0x59,0xC1,                                 // mulsd xmm0, xmm1
+  0xF2,0x0F,0x59,0xC1,                                 // mulsd xmm0, xmm1
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, 1.5
+  0xF2,0x0F,0x58,0x00,                                 // addsd xmm0, [rax]
+  0xF2,0x0F,0x59,0xC1,                                 // mulsd xmm0, xmm1
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_sqr_end[1];
+unsigned char nseel_asm_sqr[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0xF2,0x0F,0x59,0xC0,                                 // mulsd xmm0, xmm0
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_sqrt_end[1];
+unsigned char nseel_asm_sqrt[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0xF2,0x0F,0x51,0xC0,                                 // sqrtsd xmm0, xmm0
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_abs_end[1];
+unsigned char nseel_asm_abs[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0x89,0x16,                                      // mov [rsi], rdx
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_assign_end[1];
+unsigned char nseel_asm_assign[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x89,0xD1,                                      // mov rcx, rdx
+  0x48,0xC1,0xEA,0x34,                                 // shr rdx, 52
+  0x81,0xE2,0xFF,0x07,0x00,0x00,                       // and edx, 0x7ff
+  0x74,0x08,                                           // jz 1f
+  0x81,0xFA,0xFF,0x07,0x00,0x00,                       // cmp edx, 0x7ff
+  0x75,0x02,                                           // jne 0f
+  // 1:
+  0x31,0xC9,                                           // xor ecx, ecx
+  // 0:
+  0x48,0x89,0x0F,                                      // mov [rdi], rcx
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_add_end[1];
+unsigned char nseel_asm_add[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0xF2,0x0F,0x58,0x07,                                 // addsd xmm0, [rdi]
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_add_op_end[1];
+unsigned char nseel_asm_add_op[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0xF2,0x0F,0x58,0x07,                                 // addsd xmm0, [rdi]
+  0x48,0x89,0xF8,                                      // mov rax, rdi
+  0xF2,0x0F,0x11,0x07,                                 // movsd [rdi], xmm0
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_sub_end[1];
+unsigned char nseel_asm_sub[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0xF2,0x0F,0x5C,0x00,                                 // subsd xmm0, [rax]
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_sub_op_end[1];
+unsigned char nseel_asm_sub_op[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0xF2,0x0F,0x5C,0x00,                                 // subsd xmm0, [rax]
+  0x48,0x89,0xF8,                                      // mov rax, rdi
+  0xF2,0x0F,0x11,0x07,                                 // movsd [rdi], xmm0
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_mul_end[1];
+unsigned char nseel_asm_mul[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0xF2,0x0F,0x59,0x00,                                 // mulsd xmm0, [rax]
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_mul_op_end[1];
+unsigned char nseel_asm_mul_op[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0xF2,0x0F,0x59,0x07,                                 // mulsd xmm0, [rdi]
+  0x48,0x89,0xF8,                                      // mov rax, rdi
+  0xF2,0x0F,0x11,0x07,                                 // movsd [rdi], xmm0
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_div_end[1];
+unsigned char nseel_asm_div[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0xF2,0x0F,0x5E,0x00,                                 // divsd xmm0, [rax]
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_div_op_end[1];
+unsigned char nseel_asm_div_op[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0xF2,0x0F,0x5E,0x00,                                 // divsd xmm0, [rax]
+  0x48,0x89,0xF8,                                      // mov rax, rdi
+  0xF2,0x0F,0x11,0x07,                                 // movsd [rdi], xmm0
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_mod_end[1];
+unsigned char nseel_asm_mod[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0xF2,0x0F,0x2C,0xC8,                                 // cvttsd2si ecx, xmm0
+  0x48,0x8B,0x17,                                      // mov rdx, [rdi]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0xF2,0x0F,0x2C,0xC0,                                 // cvttsd2si eax, xmm0
+  0x31,0xD2,                                           // xor edx, edx
+  0x85,0xC9,                                           // test ecx, ecx
+  0x74,0x02,                                           // jz 0f
+  0xF7,0xF1,                                           // div ecx
+  // 0:
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_mod_op_end[1];
+unsigned char nseel_asm_mod_op[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0xF2,0x0F,0x2C,0xC8,                                 // cvttsd2si ecx, xmm0
+  0x48,0x8B,0x17,                                      // mov rdx, [rdi]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0xF2,0x0F,0x2C,0xC0,                                 // cvttsd2si eax, xmm0
+  0x31,0xD2,                                           // xor edx, edx
+  0x85,0xC9,                                           // test ecx, ecx
+  0x74,0x02,                                           // jz 0f
+  0xF7,0xF1,                                           // div ecx
+  // 0:
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF8,                                      // mov rax, rdi
+  0xF2,0x0F,0x11,0x07,                                 // movsd [rdi], xmm0
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_or_end[1];
+unsigned char nseel_asm_or[]={
+  0xF2,0x48,0x0F,0x2C,0x0F,                            // cvttsd2si rcx, [rdi]
+  0xF2,0x48,0x0F,0x2C,0x10,                            // cvttsd2si rdx, [rax]
+  0x48,0x09,0xCA,                                      // or rdx, rcx
+  0xF2,0x48,0x0F,0x2A,0xC2,                            // cvtsi2sd xmm0, rdx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_or_op_end[1];
+unsigned char nseel_asm_or_op[]={
+  0xF2,0x48,0x0F,0x2C,0x0F,                            // cvttsd2si rcx, [rdi]
+  0xF2,0x48,0x0F,0x2C,0x10,                            // cvttsd2si rdx, [rax]
+  0x48,0x09,0xCA,                                      // or rdx, rcx
+  0xF2,0x48,0x0F,0x2A,0xC2,                            // cvtsi2sd xmm0, rdx
+  0x48,0x89,0xF8,                                      // mov rax, rdi
+  0xF2,0x0F,0x11,0x07,                                 // movsd [rdi], xmm0
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_and_end[1];
+unsigned char nseel_asm_and[]={
+  0xF2,0x48,0x0F,0x2C,0x0F,                            // cvttsd2si rcx, [rdi]
+  0xF2,0x48,0x0F,0x2C,0x10,                            // cvttsd2si rdx, [rax]
+  0x48,0x21,0xCA,                                      // and rdx, rcx
+  0xF2,0x48,0x0F,0x2A,0xC2,                            // cvtsi2sd xmm0, rdx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_and_op_end[1];
+unsigned char nseel_asm_and_op[]={
+  0xF2,0x48,0x0F,0x2C,0x0F,                            // cvttsd2si rcx, [rdi]
+  0xF2,0x48,0x0F,0x2C,0x10,                            // cvttsd2si rdx, [rax]
+  0x48,0x21,0xCA,                                      // and rdx, rcx
+  0xF2,0x48,0x0F,0x2A,0xC2,                            // cvtsi2sd xmm0, rdx
+  0x48,0x89,0xF8,                                      // mov rax, rdi
+  0xF2,0x0F,0x11,0x07,                                 // movsd [rdi], xmm0
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_uplus_end[1];
+unsigned char nseel_asm_uplus[]={
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_uminus_end[1];
+unsigned char nseel_asm_uminus[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xFA,0x3F,                            // btc rdx, 63
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0x89,0x16,                                      // mov [rsi], rdx
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_sign_end[1];
+unsigned char nseel_asm_sign[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x89,0xD1,                                      // mov rcx, rdx
+  0x48,0x01,0xC9,                                      // add rcx, rcx
+  0x74,0x1F,                                           // jz 0f
+  0x48,0xC1,0xEA,0x3C,                                 // shr rdx, 60
+  0x83,0xE2,0x08,                                      // and edx, 8
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, g_signs
+  0x48,0x8B,0x0C,0x11,                                 // mov rcx, [rcx+rdx]
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0x89,0x0E,                                      // mov [rsi], rcx
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  // 0:
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_bnot_end[1];
+unsigned char nseel_asm_bnot[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, g_closefact
+  0x31,0xD2,                                           // xor edx, edx
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x0F,0x92,0xC2,                                      // setb dl
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_if_end[1];
+unsigned char nseel_asm_if[]={
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, g_closefact
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, true branch
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, false branch
+  0x48,0x0F,0x42,0xC2,                                 // cmovb rax, rdx
+  0x48,0x83,0xEC,0x08,                                 // sub rsp, 8
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x08,                                 // add rsp, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_repeat_end[1];
+unsigned char nseel_asm_repeat[]={
+  0xF2,0x0F,0x2C,0x08,                                 // cvttsd2si ecx, [rax]
+  0x83,0xF9,0x01,                                      // cmp ecx, 1
+  0x7C,0x29,                                           // jl 1f
+  0x81,0xF9,X64_IMM32(NSEEL_LOOPFUNC_SUPPORT_MAXLEN),  // cmp ecx, NSEEL_LOOPFUNC_SUPPORT_MAXLEN
+  0x7C,0x05,                                           // jl 0f
+  0xB9,X64_IMM32(NSEEL_LOOPFUNC_SUPPORT_MAXLEN),       // mov ecx, NSEEL_LOOPFUNC_SUPPORT_MAXLEN
+  // 0:
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, loop body
+  0x48,0x83,0xEC,0x08,                                 // sub rsp, 8
+  0x56,                                                // push rsi
+  0x51,                                                // push rcx
+  0xFF,0xD2,                                           // call rdx
+  0x59,                                                // pop rcx
+  0x5E,                                                // pop rsi
+  0x48,0x83,0xC4,0x08,                                 // add rsp, 8
+  0xFF,0xC9,                                           // dec ecx
+  0x75,0xE4,                                           // jnz 0b
+  // 1:
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_repeatwhile_end[1];
+unsigned char nseel_asm_repeatwhile[]={
+  0xB9,X64_IMM32(NSEEL_LOOPFUNC_SUPPORT_MAXLEN),       // mov ecx, NSEEL_LOOPFUNC_SUPPORT_MAXLEN
+  // 0:
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, loop body
+  0x48,0x83,0xEC,0x08,                                 // sub rsp, 8
+  0x56,                                                // push rsi
+  0x51,                                                // push rcx
+  0xFF,0xD2,                                           // call rdx
+  0x59,                                                // pop rcx
+  0x5E,                                                // pop rsi
+  0x48,0x83,0xC4,0x08,                                 // add rsp, 8
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, g_closefact
+  0x66,0x0F,0x2F,0x02,                                 // comisd xmm0, [rdx]
+  0x72,0x04,                                           // jb 1f
+  0xFF,0xC9,                                           // dec ecx
+  0x75,0xC7,                                           // jnz 0b
+  // 1:
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_band_end[1];
+unsigned char nseel_asm_band[]={
+  0x31,0xC9,                                           // xor ecx, ecx
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, g_closefact
+  0x66,0x0F,0x2F,0x02,                                 // comisd xmm0, [rdx]
+  0x72,0x34,                                           // jb 0f
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, right hand side
+  0x48,0x83,0xEC,0x08,                                 // sub rsp, 8
+  0xFF,0xD2,                                           // call rdx
+  0x48,0x83,0xC4,0x08,                                 // add rsp, 8
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, g_closefact
+  0x31,0xC9,                                           // xor ecx, ecx
+  0x66,0x0F,0x2F,0x02,                                 // comisd xmm0, [rdx]
+  0x0F,0x93,0xC1,                                      // setae cl
+  // 0:
+  0xF2,0x0F,0x2A,0xC1,                                 // cvtsi2sd xmm0, ecx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_bor_end[1];
+unsigned char nseel_asm_bor[]={
+  0xB9,0x01,0x00,0x00,0x00,                            // mov ecx, 1
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, g_closefact
+  0x66,0x0F,0x2F,0x02,                                 // comisd xmm0, [rdx]
+  0x73,0x34,                                           // jae 0f
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, right hand side
+  0x48,0x83,0xEC,0x08,                                 // sub rsp, 8
+  0xFF,0xD2,                                           // call rdx
+  0x48,0x83,0xC4,0x08,                                 // add rsp, 8
+  0x48,0x8B,0x10,                                      // mov rdx, [rax]
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xBA,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdx, g_closefact
+  0x31,0xC9,                                           // xor ecx, ecx
+  0x66,0x0F,0x2F,0x02,                                 // comisd xmm0, [rdx]
+  0x0F,0x93,0xC1,                                      // setae cl
+  // 0:
+  0xF2,0x0F,0x2A,0xC1,                                 // cvtsi2sd xmm0, ecx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_equal_end[1];
+unsigned char nseel_asm_equal[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0xF2,0x0F,0x5C,0x07,                                 // subsd xmm0, [rdi]
+  0x66,0x48,0x0F,0x7E,0xC2,                            // movq rdx, xmm0
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, g_closefact
+  0x31,0xD2,                                           // xor edx, edx
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x0F,0x92,0xC2,                                      // setb dl
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_notequal_end[1];
+unsigned char nseel_asm_notequal[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0xF2,0x0F,0x5C,0x07,                                 // subsd xmm0, [rdi]
+  0x66,0x48,0x0F,0x7E,0xC2,                            // movq rdx, xmm0
+  0x48,0x0F,0xBA,0xF2,0x3F,                            // btr rdx, 63
+  0x66,0x48,0x0F,0x6E,0xC2,                            // movq xmm0, rdx
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, g_closefact
+  0x31,0xD2,                                           // xor edx, edx
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x0F,0x93,0xC2,                                      // setae dl
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_below_end[1];
+unsigned char nseel_asm_below[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0x31,0xD2,                                           // xor edx, edx
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x0F,0x92,0xC2,                                      // setb dl
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_beloweq_end[1];
+unsigned char nseel_asm_beloweq[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0x31,0xD2,                                           // xor edx, edx
+  0x66,0x0F,0x2F,0x07,                                 // comisd xmm0, [rdi]
+  0x0F,0x93,0xC2,                                      // setae dl
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_above_end[1];
+unsigned char nseel_asm_above[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+  0x31,0xD2,                                           // xor edx, edx
+  0x66,0x0F,0x2F,0x07,                                 // comisd xmm0, [rdi]
+  0x0F,0x92,0xC2,                                      // setb dl
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_aboveeq_end[1];
+unsigned char nseel_asm_aboveeq[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0x31,0xD2,                                           // xor edx, edx
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x0F,0x93,0xC2,                                      // setae dl
+  0xF2,0x0F,0x2A,0xC2,                                 // cvtsi2sd xmm0, edx
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_min_end[1];
+unsigned char nseel_asm_min[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x48,0x0F,0x42,0xC7,                                 // cmovb rax, rdi
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char nseel_asm_max_end[1];
+unsigned char nseel_asm_max[]={
+  0xF2,0x0F,0x10,0x07,                                 // movsd xmm0, [rdi]
+  0x66,0x0F,0x2F,0x00,                                 // comisd xmm0, [rax]
+  0x48,0x0F,0x43,0xC7,                                 // cmovae rax, rdi
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char _asm_generic3parm_end[1];
+unsigned char _asm_generic3parm[]={
+#ifdef _WIN64
+  0x48,0x89,0xCA,                                      // mov rdx, rcx
+  0x49,0x89,0xF8,                                      // mov r8, rdi
+  0x49,0x89,0xC1,                                      // mov r9, rax
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, context
+#else
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0x89,0xCE,                                      // mov rsi, rcx
+  0x48,0x89,0xFA,                                      // mov rdx, rdi
+  0x48,0x89,0xC1,                                      // mov rcx, rax
+  0x48,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdi, context
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+#ifndef _WIN64
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+#endif
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char _asm_generic3parm_retd_end[1];
+unsigned char _asm_generic3parm_retd[]={
+#ifdef _WIN64
+  0x48,0x89,0xCA,                                      // mov rdx, rcx
+  0x49,0x89,0xF8,                                      // mov r8, rdi
+  0x49,0x89,0xC1,                                      // mov r9, rax
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, context
+#else
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0x89,0xCE,                                      // mov rsi, rcx
+  0x48,0x89,0xFA,                                      // mov rdx, rdi
+  0x48,0x89,0xC1,                                      // mov rcx, rax
+  0x48,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdi, context
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+#ifndef _WIN64
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+#endif
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char _asm_generic2parm_end[1];
+unsigned char _asm_generic2parm[]={
+#ifdef _WIN64
+  0x48,0x89,0xFA,                                      // mov rdx, rdi
+  0x49,0x89,0xC0,                                      // mov r8, rax
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, context
+#else
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0x89,0xFE,                                      // mov rsi, rdi
+  0x48,0x89,0xC2,                                      // mov rdx, rax
+  0x48,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdi, context
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+#ifndef _WIN64
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+#endif
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char _asm_generic2parm_retd_end[1];
+unsigned char _asm_generic2parm_retd[]={
+#ifdef _WIN64
+  0x48,0x89,0xFA,                                      // mov rdx, rdi
+  0x49,0x89,0xC0,                                      // mov r8, rax
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, context
+#else
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0x89,0xFE,                                      // mov rsi, rdi
+  0x48,0x89,0xC2,                                      // mov rdx, rax
+  0x48,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdi, context
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+#ifndef _WIN64
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+#endif
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char _asm_generic1parm_end[1];
+unsigned char _asm_generic1parm[]={
+#ifdef _WIN64
+  0x48,0x89,0xC2,                                      // mov rdx, rax
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, context
+#else
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0x89,0xC6,                                      // mov rsi, rax
+  0x48,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdi, context
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+#ifndef _WIN64
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+#endif
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+unsigned char _asm_generic1parm_retd_end[1];
+unsigned char _asm_generic1parm_retd[]={
+#ifdef _WIN64
+  0x48,0x89,0xC2,                                      // mov rdx, rax
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, context
+#else
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0x89,0xC6,                                      // mov rsi, rax
+  0x48,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdi, context
+#endif
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+#ifndef _WIN64
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+#endif
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0xF2,0x0F,0x11,0x06,                                 // movsd [rsi], xmm0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  X64_GLUE_END
+};
+
+//---------------------------------------------------------------------------------------------------------------
+// looks the block up in the table itself (nseel_ram_lookup()), and only calls the allocator when
+// there's no table or block yet, or the index is out of range
+#if NSEEL_RAM_ITEMSPERBLOCK != 65536
+  #error the megabuf lookup below shifts by 16
+#endif
+unsigned char _asm_megabuf_end[1];
+unsigned char _asm_megabuf[]={
+  0xF2,0x0F,0x10,0x00,                                 // movsd xmm0, [rax]
+#ifdef _WIN64
+  0x48,0xB9,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rcx, context
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, g_closefact
+  0xF2,0x0F,0x58,0x00,                                 // addsd xmm0, [rax]
+  0xF2,0x0F,0x2C,0xD0,                                 // cvttsd2si edx, xmm0
+  0x48,0x85,0xC9,                                      // test rcx, rcx
+  0x74,0x2C,                                           // jz 1f
+  0x48,0x8B,0x01,                                      // mov rax, [rcx]
+  0x48,0x85,0xC0,                                      // test rax, rax
+  0x74,0x24,                                           // jz 1f
+  0x81,0xFA,X64_IMM32(NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK), // cmp edx, NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK
+  0x73,0x1C,                                           // jae 1f
+  0x41,0x89,0xD0,                                      // mov r8d, edx
+  0x41,0xC1,0xE8,0x10,                                 // shr r8d, 16
+  0x4A,0x8B,0x04,0xC0,                                 // mov rax, [rax+r8*8]
+  0x48,0x85,0xC0,                                      // test rax, rax
+  0x74,0x0C,                                           // jz 1f
+  0x81,0xE2,X64_IMM32(NSEEL_RAM_ITEMSPERBLOCK-1),      // and edx, NSEEL_RAM_ITEMSPERBLOCK-1
+  0x48,0x8D,0x04,0xD0,                                 // lea rax, [rax+rdx*8]
+  0xEB,0x27,                                           // jmp 0f
+  // 1:
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+#else
+  0x49,0x89,0xF7,                                      // mov r15, rsi
+  0x48,0xBF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rdi, context
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, g_closefact
+  0xF2,0x0F,0x58,0x00,                                 // addsd xmm0, [rax]
+  0xF2,0x0F,0x2C,0xF0,                                 // cvttsd2si esi, xmm0
+  0x48,0x85,0xFF,                                      // test rdi, rdi
+  0x74,0x2D,                                           // jz 1f
+  0x48,0x8B,0x07,                                      // mov rax, [rdi]
+  0x48,0x85,0xC0,                                      // test rax, rax
+  0x74,0x25,                                           // jz 1f
+  0x81,0xFE,X64_IMM32(NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK), // cmp esi, NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK
+  0x73,0x1D,                                           // jae 1f
+  0x89,0xF1,                                           // mov ecx, esi
+  0xC1,0xE9,0x10,                                      // shr ecx, 16
+  0x48,0x8B,0x04,0xC8,                                 // mov rax, [rax+rcx*8]
+  0x48,0x85,0xC0,                                      // test rax, rax
+  0x74,0x0F,                                           // jz 1f
+  0x81,0xE6,X64_IMM32(NSEEL_RAM_ITEMSPERBLOCK-1),      // and esi, NSEEL_RAM_ITEMSPERBLOCK-1
+  0x48,0x8D,0x04,0xF0,                                 // lea rax, [rax+rsi*8]
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+  0xEB,0x2A,                                           // jmp 0f
+  // 1:
+  0x48,0xB8,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,   // mov rax, function
+  0x48,0x83,0xEC,0x20,                                 // sub rsp, 32
+  0xFF,0xD0,                                           // call rax
+  0x48,0x83,0xC4,0x20,                                 // add rsp, 32
+  0x4C,0x89,0xFE,                                      // mov rsi, r15
+#endif
+  0x48,0x85,0xC0,                                      // test rax, rax
+  0x75,0x0E,                                           // jnz 0f
+  0x48,0x89,0xF0,                                      // mov rax, rsi
+  0x48,0xC7,0x06,0x00,0x00,0x00,0x00,                  // mov [rsi], 0
+  0x48,0x83,0xC6,0x08,                                 // add rsi, 8
+  // 0:
+  X64_GLUE_END
+};
+
@@ -1443,6 +1443,9 @@ void _asm_generic1parm_retd_end(void) {}
 
 
 // this gets its own stub because it's pretty crucial for performance :/
+#if NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK != 0x800000 || NSEEL_RAM_ITEMSPERBLOCK != 65536
+  #error the x86 megabuf lookup has these sizes built in
+#endif
 
 void _asm_megabuf(void)
 {
@@ -1500,6 +1503,24 @@ SAVE_STACK
     "fld" EEL_F_SUFFIX " (%eax)\n"
     "fadd" EEL_F_SUFFIX " (0xFFFFFFFF)\n"
     "fistpl (%esi)\n"
+    // the block is usually there already: look it up without the call (see nseel_ram_lookup())
+    "movl (%esi), %ecx\n"
+    "testl %edx, %edx\n"
+    "jz 1f\n"
+    "movl (%edx), %edi\n"
+    "testl %edi, %edi\n"
+    "jz 1f\n"
+    "cmpl $0x800000, %ecx\n" // NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK, negative indices too
+    "jae 1f\n"
+    "movl %ecx, %eax\n"
+    "shrl $16, %eax\n"
+    "movl (%edi,%eax,4), %edi\n"
+    "testl %edi, %edi\n"
+    "jz 1f\n"
+    "andl $0xFFFF, %ecx\n"
+    "leal (%edi,%ecx," EEL_F_SSTR "), %eax\n"
+    "jmp 0f\n"
+    "1:\n"
     "subl $8, %esp\n" // keep stack aligned
     "pushl (%esi)\n" // parameter
     "pushl %edx\n" // push context pointer
@@ -2299,6 +2299,9 @@ __declspec(naked) void _asm_generic1parm_retd_end(void) {}
 
 
 // this gets its own stub because it's pretty crucial for performance :/
+#if NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK != 0x800000 || NSEEL_RAM_ITEMSPERBLOCK != 65536
+  #error the x86 megabuf lookup has these sizes built in
+#endif
 
 __declspec(naked) void _asm_megabuf(void)
 {
@@ -2372,6 +2375,24 @@ _emit 0xFF;
 _emit 0xFF;
 #endif
     fistp dword ptr [esi];
+    // the block is usually there already: look it up without the call (see nseel_ram_lookup())
+    mov ecx, dword ptr [esi];
+    test edx, edx;
+    jz label_36;
+    mov edi, dword ptr [edx];
+    test edi, edi;
+    jz label_36;
+    cmp ecx, 0x800000; // NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK, negative indices too
+    jae label_36;
+    mov eax, ecx;
+    shr eax, 16;
+    mov edi, dword ptr [edi+eax*4];
+    test edi, edi;
+    jz label_36;
+    and ecx, 0xFFFF;
+    lea eax, [edi+ecx*EEL_F_SIZE];
+    jmp label_35;
+label_36:
     sub esp, 8; // keep stack aligned
     push dword ptr [esi]; // parameter
     push edx; // push context pointer
@@ -35,21 +35,24 @@ void NSEEL_PProc_RAM(void *data, int data_size, struct _compileContext *ctx);
 void NSEEL_PProc_THIS(void *data, int data_size, struct _compileContext *ctx);
 
 
-void _asm_generic3parm(void); // 3 double * parms, returning double *
-void _asm_generic3parm_end(void);
-void _asm_generic3parm_retd(void); // 3 double * parms, returning double
-void _asm_generic3parm_retd_end(void);
-void _asm_generic2parm(void); // 2 double * parms, returning double *
-void _asm_generic2parm_end(void);
-void _asm_generic2parm_retd(void); // 2 double * parms, returning double
-void _asm_generic2parm_retd_end(void);
-void _asm_generic1parm(void); // 1 double * parms, returning double *
-void _asm_generic1parm_end(void);
-void _asm_generic1parm_retd(void); // 1 double * parms, returning double 
-void _asm_generic1parm_retd_end(void);
-
-void _asm_megabuf(void);
-void _asm_megabuf_end(void);
+#if defined(EEL_TARGET_PORTABLE)
+// portable glue is bytecode templates (asm-nseel-portable.c)
+#define NSEEL_DECL_GLUE(x) extern INT_PTR x[], x##_end[];
+#elif defined(EEL_TARGET_X64)
+// x64 glue is machine code tables (asm-nseel-x64-sse.c), not functions
+#define NSEEL_DECL_GLUE(x) extern unsigned char x[], x##_end[];
+#else
+#define NSEEL_DECL_GLUE(x) void x(void); void x##_end(void);
+#endif
+
+NSEEL_DECL_GLUE(_asm_generic3parm) // 3 double * parms, returning double *
+NSEEL_DECL_GLUE(_asm_generic3parm_retd) // 3 double * parms, returning double
+NSEEL_DECL_GLUE(_asm_generic2parm) // 2 double * parms, returning double *
+NSEEL_DECL_GLUE(_asm_generic2parm_retd) // 2 double * parms, returning double
+NSEEL_DECL_GLUE(_asm_generic1parm) // 1 double * parms, returning double *
+NSEEL_DECL_GLUE(_asm_generic1parm_retd) // 1 double * parms, returning double 
+
+NSEEL_DECL_GLUE(_asm_megabuf)
 
 
 
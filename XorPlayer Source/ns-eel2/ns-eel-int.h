@@ -53,7 +53,7 @@ extern "C" {
 
 #define YYSTYPE INT_PTR
 
-#define NSEEL_CLOSEFACTOR 0.00001
+#define NSEEL_CLOSEFACTOR ((EEL_F)0.00001) // an EEL_F, so C code compares against what the glue does
 
 typedef struct
 {
@@ -61,11 +61,48 @@ typedef struct
 	int destByteCount;
 } lineRecItem;
 
+// NSEEL_VM_setbudget()
+typedef struct
+{
+  int limit; // 0 if there's no budget
+  volatile int left, over;
+  void (*onexhausted)(void *userctx, NSEEL_VMCTX ctx);
+  void *userctx;
+  NSEEL_VMCTX vm;
+  unsigned int loops; // iterations that x86/x64 code's loops asked for, see nseel_code_run()
+} eelBudget;
+
+int nseel_budget_take(eelBudget *b, int n); // returns how many of the n iterations are left to run
+
+// rand(): four xoshiro128** generators, stored word by word so a step of all four is a loop the compiler
+// can vectorize. rand() returns the four results of a step in turn, NSEEL_VM_randfill() takes whole steps.
+#define NSEEL_RNG_LANES 4
+typedef struct
+{
+  unsigned int s[4][NSEEL_RNG_LANES];
+  unsigned int out[NSEEL_RNG_LANES];
+  int pos; // next of out[] to return, NSEEL_RNG_LANES when it's used up
+} eelRng;
+
+void nseel_rng_seed(eelRng *r, unsigned int seed);
+
 typedef struct _compileContext
 {
-  EEL_F **varTable_Values;
-  char   **varTable_Names;
+  EEL_F **varTable_Values; // blocks of NSEEL_VARS_PER_BLOCK, so the values never move
+  char   **varTable_Names; // one per variable, in varTable_NameBlocks
   int varTable_numBlocks;
+  int varTable_numVars;
+  int *varTable_Hash; // index+1 of the variable with that (case-insensitive) name hash, 0 if empty
+  int varTable_HashSize; // power of two, at least twice varTable_numVars
+  void *varTable_NameBlocks;
+  unsigned int varTable_layout; // hash of the names, in order
+  int varTable_snapNumVars; // NSEEL_VM_snapshotvars(), 0 if none
+  unsigned int varTable_snapLayout;
+  EEL_F *varTable_snapValues;
+  int *varTable_snapHash;
+  int varTable_snapHashSize;
+  void *varTable_snapNameBlock; // the newest name block then, and how much of it was used
+  int varTable_snapNameUsed;
 
   int errVar;
   int colCount;
@@ -98,8 +135,16 @@ typedef struct _compileContext
   int ram_needfree;
 
   void *gram_blocks;
+  int ram_stats[2]; // NSEEL_VM_getstats()
 
   void *caller_this;
+
+  void *kernel; // set while NSEEL_code_compile_kernel() builds its tree, see nseel-kernel.c
+  void *cache_rec; // set while NSEEL_code_compile() parses into a transcript, see nseel-cache.c
+
+  eelBudget budget;
+  int loops_uncounted; // x86/x64 code compiled without a budget got a loop() or while()
+  eelRng rng;
 }
 compileContext;
 
@@ -117,11 +162,81 @@ typedef struct {
 
 extern functionType *nseel_getFunctionFromTable(int idx);
 
+// what parsing a piece of code did: the nseel_createCompiled*() calls each statement made, in order.
+// nseel-opt.c rewrites it, nseel-cache.c keeps it and builds code from it
+enum { EREC_VALUE, EREC_VAR, EREC_TEMP, EREC_FUNCTION1, EREC_FUNCTION2, EREC_FUNCTION3 };
+
+typedef struct
+{
+  int op;
+  int fntype;
+  INT_PTR fn;
+  int parms[3]; // earlier records of the same statement
+  EEL_F value; // EREC_VALUE
+  int name; // EREC_VAR: offset in names, EREC_TEMP: index of the temporary
+} eelRec;
+
+#define NSEEL_OPTSTATS 6 // see NSEEL_code_getoptstats()
+
+typedef struct
+{
+  eelRec *recs;
+  int nrecs, recs_alloc;
+  int *roots; // of each statement
+  int *stmtend; // records up to stmtend[i] belong to statements 0..i
+  int *srcoffs; // where each statement starts in the preprocessed source
+  int nstmts, stmts_alloc;
+  char *names; // EREC_VAR names
+  int names_size, names_alloc;
+  int ntemps; // values the code keeps for itself, see nseel-opt.c
+  int optstats[NSEEL_OPTSTATS];
+} eelTranscript;
+
 INT_PTR nseel_createCompiledValue(compileContext *ctx, EEL_F value, EEL_F *addrValue);
 INT_PTR nseel_createCompiledFunction1(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code);
 INT_PTR nseel_createCompiledFunction2(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2);
 INT_PTR nseel_createCompiledFunction3(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2, INT_PTR code3);
 
+// NSEEL_code_getprofile(). ramseen is the eelRamTable.allocs the megabuf blocks were counted up to
+typedef struct
+{
+  NSEEL_PROFILE p;
+  int ramseen;
+} eelProfile;
+
+unsigned int nseel_code_run(NSEEL_CODEHANDLE code); // NSEEL_code_execute(), not profiled. returns the loop iterations it ran
+
+// nseel-kernel.c
+void *nseel_kernel_alloc(EEL_F **lanevars, int nlanevars, int nuniform);
+INT_PTR nseel_kernel_value(compileContext *ctx, EEL_F value, EEL_F *addrValue);
+INT_PTR nseel_kernel_function(compileContext *ctx, int fntype, INT_PTR fn, int nparms, INT_PTR code1, INT_PTR code2, INT_PTR code3);
+void nseel_kernel_addstatement(void *kernel, INT_PTR code);
+void nseel_kernel_finish(void *kernel);
+unsigned int nseel_kernel_execute(void *kernel, NSEEL_CODEHANDLE code, EEL_F **lanes, int nlanes); // returns the loop iterations it ran
+int nseel_kernel_isvector(void *kernel);
+void *nseel_kernel_clone(void *kernel);
+unsigned int nseel_kernel_execute_clone(void *kernel, void *clone, EEL_F **lanes, int first, int nlanes);
+eelProfile *nseel_kernel_cloneprofile(void *clone); // what the clone ran since it was last merged
+void nseel_kernel_merge(void *kernel, void **clones, int nclones);
+void nseel_kernel_clone_free(void *clone);
+void nseel_kernel_free(void *kernel);
+
+// nseel-cache.c
+void *nseel_cache_lookup(compileContext *ctx, const char *src);
+void nseel_cache_release(void *ent);
+void *nseel_cache_beginrecord(compileContext *ctx, const char *src);
+INT_PTR nseel_cache_record(compileContext *ctx, int fntype, INT_PTR fn, int nparms, INT_PTR code1, INT_PTR code2, INT_PTR code3, EEL_F value, EEL_F *addrValue);
+void nseel_cache_newvar(compileContext *ctx, const char *name);
+void nseel_cache_statement(compileContext *ctx, INT_PTR code, int srcoffs);
+void nseel_cache_optimize(void *ent);
+void *nseel_cache_endrecord(void *ent, int success, int keep);
+eelTranscript *nseel_cache_transcript(void *ent);
+INT_PTR nseel_cache_replay(compileContext *ctx, void *ent, int stmt, EEL_F *temps);
+void nseel_cache_flush();
+
+// nseel-opt.c
+int nseel_optimize(eelTranscript *t);
+
 extern EEL_F nseel_globalregs[100];
 
 void nseel_resetVars(compileContext *ctx);
@@ -130,12 +245,49 @@ EEL_F *nseel_registerVar(compileContext *ctx, char *varName);
 
 INT_PTR *EEL_GLUE_set_immediate(void *_p, void *newv);
 
+#ifdef EEL_TARGET_PORTABLE
+
+// bytecode for the portable interpreter (asm-nseel-portable.c). each op is one INT_PTR followed by
+// its operands, in INT_PTR units. the registers mirror the x86 glue: r is the result pointer (eax),
+// a (ebx) and c (ecx) are the popped parameters, wt points into the temporary work table (esi).
+#define EEL_BC_OPS(X) \
+  X(END) /* end of template, never executed */ \
+  X(RET) X(SETWT) \
+  X(MOV) X(MOV2) X(MOVA) X(MOVAR) X(PUSH) X(POPA) X(POPC) \
+  X(UMINUS) X(ABS) X(SQR) X(SQRT) X(INVSQRT) X(SIGN) \
+  X(BNOT) X(EQUAL) X(NOTEQ) \
+  X(IF) X(BAND) X(BOR) X(LOOP) X(WHILE) \
+  X(CALL1) X(CALL2) X(CALL2S) X(CALL1P) X(CALL2P) \
+  X(GEN1) X(GEN1D) X(GEN2) X(GEN2D) X(GEN3) X(GEN3D) X(MEGABUF)
+
+// functions of a and r. each also has versions with the parameters built in, to save the
+// MOV2/MOVAR/MOVA in front of it: x_PP a_ptr r_ptr, x_RP r_ptr (a=r) and x_PR a_ptr
+#define EEL_BC_BINOPS(X) \
+  X(ASSIGN) X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) X(OR) X(AND) \
+  X(ADDOP) X(SUBOP) X(MULOP) X(DIVOP) X(MODOP) X(OROP) X(ANDOP) \
+  X(MIN) X(MAX) X(BELOW) X(BELOWEQ) X(ABOVE) X(ABOVEEQ)
+
+#define EEL_BC_ENUM(x) EEL_BC_##x,
+#define EEL_BC_ENUM_DIRECT(x) EEL_BC_##x##_PP, EEL_BC_##x##_RP, EEL_BC_##x##_PR,
+enum { EEL_BC_OPS(EEL_BC_ENUM) EEL_BC_BINOPS(EEL_BC_ENUM) EEL_BC_BINOPS(EEL_BC_ENUM_DIRECT) EEL_BC_NUMOPS };
+#undef EEL_BC_ENUM
+#undef EEL_BC_ENUM_DIRECT
+
+#define EEL_BC_ISBINOP(op) ((op) >= EEL_BC_ASSIGN && (op) < EEL_BC_ASSIGN_PP)
+#define EEL_BC_DIRECTOP(op,mode) (EEL_BC_ASSIGN_PP + ((op)-EEL_BC_ASSIGN)*3 + (mode)) // mode 0: PP, 1: RP, 2: PR
+
+unsigned int nseel_bc_exec(const INT_PTR *code, EEL_F **stack); // returns the loop iterations it ran
+
+#endif
+
 // other shat
 
 
 
 INT_PTR nseel_setVar(compileContext *ctx, INT_PTR varNum);
 INT_PTR nseel_getVar(compileContext *ctx, INT_PTR varNum);
+void nseel_freeVars(compileContext *ctx);
+const char *nseel_getVarName(compileContext *ctx, const EEL_F *p);
 void *nseel_compileExpression(compileContext *ctx, char *txt);
 
 #define	VALUE	258
@@ -173,12 +325,73 @@ struct  lextab {
 };
 extern struct lextab nseel_lextab;
 
+// what ram_blocks (and a GRAM context) points to. blocks has to come first, the glue indexes it
+// directly. blocks are installed with a compare-and-swap, see nseel-ram.c
+typedef struct
+{
+  EEL_F * volatile blocks[NSEEL_RAM_BLOCKS];
+  volatile int nblocks;
+  volatile int allocs; // blocks ever installed, for NSEEL_code_getprofile()
+} eelRamTable;
+
+#ifdef _WIN32
+  #define NSEEL_ATOMIC_CASPTR(p,newv,oldv) InterlockedCompareExchangePointer((void * volatile *)(p),(void *)(newv),(void *)(oldv))
+  #define NSEEL_ATOMIC_ADD(p,v) InterlockedExchangeAdd((volatile LONG *)(p),(LONG)(v))
+#else
+  #define NSEEL_ATOMIC_CASPTR(p,newv,oldv) __sync_val_compare_and_swap((void * volatile *)(p),(void *)(oldv),(void *)(newv))
+  #define NSEEL_ATOMIC_ADD(p,v) __sync_fetch_and_add((p),(v))
+#endif
+
+// megabuf()/gmegabuf() without a call when the block is already there, 0 otherwise. blocks is
+// what the glue is given, the address of a table pointer (or 0 for the shared gmegabuf)
+static __inline EEL_F *nseel_ram_lookup(EEL_F ***blocks, int w)
+{
+  EEL_F **t, *p;
+  if (!blocks || !(t=*blocks) || (unsigned int)w >= NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK) return 0;
+  p=t[w/NSEEL_RAM_ITEMSPERBLOCK];
+  return p ? p + (w&(NSEEL_RAM_ITEMSPERBLOCK-1)) : 0;
+}
+
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAlloc(EEL_F ***blocks, int w);
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAllocGMEM(EEL_F ***blocks, int w);
+void nseel_ram_getstats(int *stats); // bytes in use, bytes pooled, blocks reused, blocks allocated
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemSet(EEL_F ***blocks,EEL_F *dest, EEL_F *v, EEL_F *lenptr);
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemFree(EEL_F ***blocks, EEL_F *which);
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemCpy(EEL_F ***blocks,EEL_F *dest, EEL_F *src, EEL_F *lenptr);
 
+// the math builtins. everything that computes one (the function table, constant folding) goes
+// through these, so a float build gets the same results from each
+#if EEL_F_SIZE == 4
+  double nseel_fsin(double x);
+  double nseel_fcos(double x);
+  double nseel_fexp(double x);
+  double nseel_flog(double x);
+  double nseel_flog10(double x);
+  double nseel_fpow(double a, double b);
+  double nseel_fatan2(double y, double x);
+  #define EEL_SIN nseel_fsin
+  #define EEL_COS nseel_fcos
+  #define EEL_EXP nseel_fexp
+  #define EEL_LOG nseel_flog
+  #define EEL_LOG10 nseel_flog10
+  #define EEL_POW nseel_fpow
+  #define EEL_ATAN2 nseel_fatan2
+#else
+  #define EEL_SIN sin
+  #define EEL_COS cos
+  #define EEL_EXP exp
+  #define EEL_LOG log
+  #define EEL_LOG10 log10
+  #define EEL_POW pow
+  #define EEL_ATAN2 atan2
+#endif
+
+// lanes i to e of one of the above, for the kernel: d[x]=f(r[x]) or d[x]=f(a[x],r[x]). 0 if f
+// has no vector version
+typedef void (*eelVecFunc1)(EEL_F *d, const EEL_F *r, int i, int e);
+typedef void (*eelVecFunc2)(EEL_F *d, const EEL_F *a, const EEL_F *r, int i, int e);
+void *nseel_getvecfunc(void *f);
+
 
 
 #ifndef max
@@ -188,13 +401,9 @@ EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemCpy(EEL_F ***blocks,EEL_F *dest, EEL_F *s
 
 
 
-#ifdef __ppc__
-
-  #define EEL_F2int(x) ((int)(x))
-
-#elif defined (_WIN64)
+#if defined(__ppc__) || defined(EEL_TARGET_PORTABLE) || defined(EEL_TARGET_X64)
 
-  // todo: AMD64 version?
+  // truncates, same as the glue (cvttsd2si on x64, _RC_CHOP on x86)
   #define EEL_F2int(x) ((int)(x))
 
 #elif defined(_MSC_VER)
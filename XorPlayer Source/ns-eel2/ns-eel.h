@@ -40,6 +40,9 @@
 #define NSEEL_CGEN_CALL 
 #endif
 
+// 8 for doubles, 4 for floats. a float build runs everything on the portable interpreter (the native
+// glue only does doubles), the kernel's vectors hold twice as many lanes, and sin, cos, exp, log,
+// log10, pow and atan2 are the fast float versions in nseel-cfunc.c rather than the C library's
 #ifndef EEL_F_SIZE
 #define EEL_F_SIZE 8
 #endif
@@ -57,10 +60,9 @@ extern "C" {
 
 // host should implement these (can be empty stub functions if no VM will execute code in multiple threads at once)
 
-  // implement if you will be running the code in same VM from multiple threads, 
-  // or VMs that have the same GRAM pointer from different threads, or multiple
-  // VMs that have a NULL GRAM pointer from multiple threads.
-  // if you give each VM it's own unique GRAM and only run each VM in one thread, then you can leave it blank.
+  // implement if you will be compiling code from multiple threads (the compiled code cache is shared).
+  // megabuf/gmegabuf memory is allocated without them, so running code on several threads at once
+  // (VMs that share a GRAM pointer, or kernel clones) doesn't need them.
 
   // or if you're daring....
 
@@ -76,7 +78,8 @@ void NSEEL_addfunctionex2(const char *name, int nparms, char *code_startaddr, in
 
 void NSEEL_quit();
 
-int *NSEEL_getstats(); // returns a pointer to 5 ints... source bytes, static code bytes, call code bytes, data bytes, number of code handles
+int *NSEEL_getstats(); // returns a pointer to 9 ints... source bytes, static code bytes, call code bytes, data bytes, number of code handles,
+                       // megabuf bytes in use (all VMs), bytes of zeroed blocks kept for reuse, blocks reused, blocks allocated
 EEL_F *NSEEL_getglobalregs();
 
 typedef void *NSEEL_VMCTX;
@@ -87,12 +90,19 @@ void NSEEL_VM_free(NSEEL_VMCTX ctx); // free when done with a VM and ALL of its
 
 void NSEEL_VM_enumallvars(NSEEL_VMCTX ctx, int (*func)(const char *name, EEL_F *val, void *ctx), void *userctx); // return false from func to stop
 void NSEEL_VM_resetvars(NSEEL_VMCTX ctx); // clears all vars to 0.0.
+// snapshotvars() remembers the variables registered so far (the host's) and their values. restorevars()
+// drops the ones registered since and puts the values back, keeping the blocks and pointers of the rest;
+// it returns 0 if there's no snapshot (resetvars() discards it). free the code that uses the dropped ones first.
+void NSEEL_VM_snapshotvars(NSEEL_VMCTX ctx);
+int NSEEL_VM_restorevars(NSEEL_VMCTX ctx);
 
 EEL_F *NSEEL_VM_regvar(NSEEL_VMCTX ctx, const char *name); // register a variable (before compilation)
 
 void NSEEL_VM_freeRAM(NSEEL_VMCTX ctx); // clears and frees all (VM) RAM used
 void NSEEL_VM_freeRAMIfCodeRequested(NSEEL_VMCTX); // call after code to free the script-requested memory
 int NSEEL_VM_wantfreeRAM(NSEEL_VMCTX ctx); // want NSEEL_VM_freeRAMIfCodeRequested?
+void NSEEL_VM_prefaultRAM(NSEEL_VMCTX ctx, int items); // allocates (and touches) the megabuf blocks for items 0..items-1 now instead of on first use
+int *NSEEL_VM_getstats(NSEEL_VMCTX ctx); // returns a pointer to 2 ints... megabuf bytes, bytes of its GRAM context's gmegabuf (0 for the shared one)
 
 // if you set this, it uses a local GMEM context. 
 // Must be set before compilation. 
@@ -104,6 +114,19 @@ void NSEEL_VM_SetGRAM(NSEEL_VMCTX ctx, void **gram);
 void NSEEL_VM_FreeGRAM(void **ufd); // frees a gmem context.
 void NSEEL_VM_SetCustomFuncThis(NSEEL_VMCTX ctx, void *thisptr);
 
+// loop budget: code compiled while the VM has one checks it. every loop() iteration and every time a while()
+// goes around takes one from the budget, code that finds it empty stops looping (a loop() runs what's left).
+// onexhausted is called once when it runs out, maybe on a thread running a kernel clone. resetbudget() fills
+// it back up (once a frame, say) and returns nonzero if it ran out since the last time. setbudget() with 0
+// iterations means no budget for code compiled from then on.
+void NSEEL_VM_setbudget(NSEEL_VMCTX ctx, int iterations, void (*onexhausted)(void *userctx, NSEEL_VMCTX ctx), void *userctx);
+int NSEEL_VM_resetbudget(NSEEL_VMCTX ctx);
+
+// rand(): each VM has its own generator, which starts out with the same seed in every VM. randfill()
+// puts in out[] what n calls of rand(x) would return (and leaves the generator where they would).
+void NSEEL_VM_seedrand(NSEEL_VMCTX ctx, unsigned int seed);
+void NSEEL_VM_randfill(NSEEL_VMCTX ctx, EEL_F *out, int n, EEL_F x);
+
 
   // note that you shouldnt pass a C string directly, since it may need to 
   // fudge with the string during the compilation (it will always restore it to the 
@@ -118,6 +141,50 @@ char *NSEEL_code_getcodeerror(NSEEL_VMCTX ctx);
 void NSEEL_code_execute(NSEEL_CODEHANDLE code);
 void NSEEL_code_free(NSEEL_CODEHANDLE code);
 int *NSEEL_code_getstats(NSEEL_CODEHANDLE code); // 4 ints...source bytes, static code bytes, call code bytes, data bytes
+int *NSEEL_code_getoptstats(NSEEL_CODEHANDLE code); // 6 ints...ops parsed, ops left after optimizing, constants folded, expressions simplified, common subexpressions reused, dead stores removed
+
+// opt-in profiling: while NSEEL_code_profiling is nonzero, each run of a code handle (execute(), a kernel
+// run or a clone's band) is counted in the handle's NSEEL_PROFILE. cycles are the CPU's timestamp counter
+// (nanoseconds where there isn't one), clones' runs are added in as one call when they're merged. code built
+// for x86/x64 counts its loops through the VM's budget (NSEEL_VM_setbudget() below), so loops_uncounted is
+// set for its runs when it was compiled without one. getprofile() returns a pointer to the handle's, zero it
+// to start over
+typedef struct
+{
+  unsigned int calls;
+  unsigned int megabuf_blocks; // blocks the VM's megabuf got while the code ran
+  unsigned long long cycles;
+  unsigned long long loops; // loop iterations, each lane's counting for a kernel
+  int loops_uncounted;
+} NSEEL_PROFILE;
+extern int NSEEL_code_profiling;
+NSEEL_PROFILE *NSEEL_code_getprofile(NSEEL_CODEHANDLE code);
+
+// NSEEL_code_compile() keeps what parsing the code did, so the same code compiles faster the next
+// time, in any VM (see nseel-cache.c). the cache holds up to NSEEL_CODE_CACHE_SIZE bytes by default,
+// setlimit(0) turns it off. getstats() returns a pointer to 5 ints... hits, misses, entries, bytes, evictions
+void NSEEL_code_cache_setlimit(int bytes);
+int *NSEEL_code_cache_getstats();
+
+// code that is run once per item (a vertex, a particle) over arrays. lanevars are the VM variables
+// that differ per item, lanes[i][n] is lanevars[i] for item n. execute_kernel() runs the code for
+// each of the nlanes items in order, loading and storing the lane variables like a host loop would,
+// but can run many items side by side (see nseel-kernel.c). kernel_isvector() is zero if it can't.
+// the last nuniform lane variables start out the same for every item, which lets what the code
+// computes from them (and from variables it doesn't write) be computed once per run.
+NSEEL_CODEHANDLE NSEEL_code_compile_kernel(NSEEL_VMCTX ctx, char *code, int lineoffs, EEL_F **lanevars, int nlanevars, int nuniform);
+void NSEEL_code_execute_kernel(NSEEL_CODEHANDLE code, EEL_F **lanes, int nlanes);
+int NSEEL_code_kernel_isvector(NSEEL_CODEHANDLE code);
+
+// a clone has its own copy of everything running the kernel writes, so clones can run disjoint
+// lane ranges on different threads at once. kernel_clone() returns 0 for code that can't be
+// split up (not vector). once all the clones ran, kernel_merge() (with them in
+// lane order) leaves the VM's variables as execute_kernel() over all the lanes would have.
+typedef void *NSEEL_KERNELCLONE;
+NSEEL_KERNELCLONE NSEEL_code_kernel_clone(NSEEL_CODEHANDLE code);
+void NSEEL_code_execute_kernel_clone(NSEEL_CODEHANDLE code, NSEEL_KERNELCLONE clone, EEL_F **lanes, int firstlane, int nlanes);
+void NSEEL_code_kernel_merge(NSEEL_CODEHANDLE code, NSEEL_KERNELCLONE *clones, int nclones);
+void NSEEL_code_kernel_clone_free(NSEEL_KERNELCLONE clone);
   
 
 // global memory control/view
@@ -157,8 +224,32 @@ extern int NSEEL_RAM_memused_errors;
 #define NSEEL_RAM_ITEMSPERBLOCK 65536
 #define NSEEL_STACK_SIZE 4096 // about 64k overhead if the stack functions are used in a given code handle
 
-// arch neutral mode, runs about 1/8th speed or so
-#define EEL_TARGET_PORTABLE
+#define NSEEL_KERNEL_LANES 64 // items NSEEL_code_execute_kernel() runs side by side
+
+#define NSEEL_CODE_CACHE_SIZE (4*1024*1024) // default limit of the compiled code cache, in bytes
+
+// arch neutral mode: code is compiled to bytecode for a threaded interpreter (asm-nseel-portable.c)
+// instead of native glue. on by default where there is no native glue, in float builds, and in
+// sanitizer builds (they can't see into the generated code). define it here to force it.
+//#define EEL_TARGET_PORTABLE
+#ifndef EEL_TARGET_PORTABLE
+  #if !defined(__ppc__) && !defined(__i386__) && !defined(_M_IX86) && !defined(__x86_64__) && !defined(_M_X64)
+    #define EEL_TARGET_PORTABLE
+  #elif EEL_F_SIZE == 4
+    #define EEL_TARGET_PORTABLE
+  #elif defined(__SANITIZE_ADDRESS__)
+    #define EEL_TARGET_PORTABLE
+  #elif defined(__has_feature)
+    #if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+      #define EEL_TARGET_PORTABLE
+    #endif
+  #endif
+#endif
+
+// x86-64 (SysV and Win64) glue, SSE2 doubles. see asm-nseel-x64-sse.c
+#if !defined(EEL_TARGET_PORTABLE) && !defined(__ppc__) && (defined(_M_X64) || defined(__x86_64__))
+#define EEL_TARGET_X64
+#endif
 
 #ifdef NSEEL_EEL1_COMPAT_MODE
 double *NSEEL_getglobalregs();
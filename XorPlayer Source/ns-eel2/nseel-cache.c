@@ -0,0 +1,370 @@
+/*
+  Expression Evaluator Library (NS-EEL) v2
+  nseel-cache.c: transcripts of parsed code, and a cache of them keyed by the source
+
+  NSEEL_code_compile() doesn't build code while it parses. nseel_createCompiled*() only note each
+  call in a transcript, with variables by name, which nseel-opt.c then rewrites and which is
+  replayed through nseel_createCompiled*() to build the glue (and the kernel's tree).
+
+  The glue has the addresses of the VM's variables (and of its own constants and sub-functions)
+  built into it, encoded differently by every backend, so it can't be moved to another VM as it
+  is. The transcript can: a hit replays it against the new VM, which builds the same code as
+  compiling would have, but skips the lexer, the parser, the optimizer and all name lookups.
+
+  The key is the preprocessed source along with a hash of the names of the VM's variables at the
+  time (a variable can hide a function of the same name, so they affect the parse). Entries are
+  dropped least recently used first once the cache is over its limit.
+*/
+
+#include "ns-eel-int.h"
+#include <string.h>
+#include <stdio.h>
+
+#define CACHE_HASH_SIZE 1024 // buckets
+
+typedef struct cacheEnt
+{
+  struct cacheEnt *prev, *next; // most recently used first
+  struct cacheEnt *hnext;
+  unsigned int hash, layout;
+  int refcnt; // the table's reference, and those of compiles replaying it
+  int incache;
+  int bytes;
+
+  char *src;
+  eelTranscript t;
+  char *newvars; // variables compiling the code registers, in order
+  int newvars_size, newvars_alloc;
+
+  int broken; // ran out of memory while recording
+} cacheEnt;
+
+static cacheEnt *cache_hash[CACHE_HASH_SIZE];
+static cacheEnt *cache_head, *cache_tail;
+static int cache_limit=NSEEL_CODE_CACHE_SIZE;
+static int cache_stats[5]; // hits, misses, entries, bytes, evictions
+
+static unsigned int cache_strhash(const char *p, unsigned int h)
+{
+  while (*p) h=(h^(unsigned char)*p++)*16777619u;
+  return h;
+}
+
+static void cache_freeent(cacheEnt *e)
+{
+  free(e->src);
+  free(e->t.recs);
+  free(e->t.roots);
+  free(e->t.stmtend);
+  free(e->t.srcoffs);
+  free(e->t.names);
+  free(e->newvars);
+  free(e);
+}
+
+static void cache_unref(cacheEnt *e)
+{
+  if (--e->refcnt <= 0) cache_freeent(e);
+}
+
+// call with the mutex held
+static void cache_remove(cacheEnt *e)
+{
+  cacheEnt **p=&cache_hash[e->hash%CACHE_HASH_SIZE];
+  while (*p != e) p=&(*p)->hnext;
+  *p=e->hnext;
+
+  if (e->prev) e->prev->next=e->next;
+  else cache_head=e->next;
+  if (e->next) e->next->prev=e->prev;
+  else cache_tail=e->prev;
+
+  e->incache=0;
+  cache_stats[2]--;
+  cache_stats[3]-=e->bytes;
+  cache_unref(e);
+}
+
+static void cache_trim(int limit)
+{
+  while (cache_tail && cache_stats[3] > limit)
+  {
+    cache_remove(cache_tail);
+    cache_stats[4]++;
+  }
+}
+
+void *nseel_cache_lookup(compileContext *ctx, const char *src)
+{
+  unsigned int hash=cache_strhash(src,ctx->varTable_layout);
+  cacheEnt *e;
+
+  NSEEL_HOSTSTUB_EnterMutex();
+  for (e = cache_hash[hash%CACHE_HASH_SIZE]; e; e = e->hnext)
+  {
+    if (e->hash == hash && e->layout == ctx->varTable_layout && !strcmp(e->src,src)) break;
+  }
+  if (e)
+  {
+    // move to the front
+    if (e->prev)
+    {
+      e->prev->next=e->next;
+      if (e->next) e->next->prev=e->prev;
+      else cache_tail=e->prev;
+      e->prev=0;
+      e->next=cache_head;
+      cache_head->prev=e;
+      cache_head=e;
+    }
+    e->refcnt++;
+    cache_stats[0]++;
+  }
+  else cache_stats[1]++;
+  NSEEL_HOSTSTUB_LeaveMutex();
+
+  if (e)
+  {
+    // register the variables the code creates, in the order compiling it would have
+    const char *p=e->newvars;
+    while (p < e->newvars+e->newvars_size)
+    {
+      NSEEL_VM_regvar(ctx,p);
+      p+=strlen(p)+1;
+    }
+  }
+  return e;
+}
+
+void nseel_cache_release(void *ent)
+{
+  if (!ent) return;
+  NSEEL_HOSTSTUB_EnterMutex();
+  cache_unref((cacheEnt *)ent);
+  NSEEL_HOSTSTUB_LeaveMutex();
+}
+
+static int cache_grow(void **p, int *alloc, int need, int itemsize)
+{
+  if (need > *alloc)
+  {
+    int n=*alloc ? *alloc*2 : 64;
+    void *np;
+    while (n < need) n*=2;
+    if (!(np=realloc(*p,n*itemsize))) return 0;
+    *p=np;
+    *alloc=n;
+  }
+  return 1;
+}
+
+static int cache_addstr(cacheEnt *e, char **buf, int *size, int *alloc, const char *s)
+{
+  int len=strlen(s)+1, offs=*size;
+  if (!cache_grow((void **)buf,alloc,*size+len,1))
+  {
+    e->broken=1;
+    return -1;
+  }
+  memcpy(*buf+offs,s,len);
+  *size+=len;
+  return offs;
+}
+
+void *nseel_cache_beginrecord(compileContext *ctx, const char *src)
+{
+  cacheEnt *e=(cacheEnt *)calloc(1,sizeof(cacheEnt));
+  if (e && !(e->src=(char *)malloc(strlen(src)+1)))
+  {
+    free(e);
+    e=0;
+  }
+  if (e)
+  {
+    strcpy(e->src,src);
+    e->layout=ctx->varTable_layout;
+    e->hash=cache_strhash(src,e->layout);
+    e->refcnt=1;
+  }
+  ctx->cache_rec=e;
+  return e;
+}
+
+// the code a record stands for while parsing is its index+1
+INT_PTR nseel_cache_record(compileContext *ctx, int fntype, INT_PTR fn, int nparms, INT_PTR code1, INT_PTR code2, INT_PTR code3, EEL_F value, EEL_F *addrValue)
+{
+  cacheEnt *e=(cacheEnt *)ctx->cache_rec;
+  eelRec *r;
+  INT_PTR parms[3];
+  int x;
+
+  if (e->broken || !cache_grow((void **)&e->t.recs,&e->t.recs_alloc,e->t.nrecs+1,sizeof(eelRec)))
+  {
+    e->broken=1;
+    return 0;
+  }
+
+  r=&e->t.recs[e->t.nrecs];
+  memset(r,0,sizeof(eelRec));
+  r->fntype=fntype;
+  r->fn=fn;
+  if (nparms)
+  {
+    parms[0]=code1;
+    parms[1]=code2;
+    parms[2]=code3;
+    r->op=EREC_FUNCTION1+nparms-1;
+    for (x = 0; x < nparms; x ++)
+    {
+      if (parms[x] < 1 || parms[x] > e->t.nrecs) return 0; // after a parse error
+      r->parms[x]=(int)parms[x]-1;
+    }
+  }
+  else if (addrValue)
+  {
+    char buf[32];
+    const char *name;
+    if (addrValue >= nseel_globalregs && addrValue < nseel_globalregs+100)
+    {
+      sprintf(buf,"reg%02d",(int)(addrValue-nseel_globalregs));
+      name=buf;
+    }
+    else if (!(name=nseel_getVarName(ctx,addrValue)))
+    {
+      e->broken=1;
+      return 0;
+    }
+    r->op=EREC_VAR;
+    if ((r->name=cache_addstr(e,&e->t.names,&e->t.names_size,&e->t.names_alloc,name)) < 0) return 0;
+  }
+  else
+  {
+    r->op=EREC_VALUE;
+    r->value=value;
+  }
+  return ++e->t.nrecs;
+}
+
+void nseel_cache_newvar(compileContext *ctx, const char *name)
+{
+  cacheEnt *e=(cacheEnt *)ctx->cache_rec;
+  if (!e->broken) cache_addstr(e,&e->newvars,&e->newvars_size,&e->newvars_alloc,name);
+}
+
+void nseel_cache_statement(compileContext *ctx, INT_PTR code, int srcoffs)
+{
+  cacheEnt *e=(cacheEnt *)ctx->cache_rec;
+  int stmtend_alloc=e->t.stmts_alloc, srcoffs_alloc=e->t.stmts_alloc;
+  if (e->broken) return;
+  if (code < 1 || code > e->t.nrecs ||
+      !cache_grow((void **)&e->t.roots,&e->t.stmts_alloc,e->t.nstmts+1,sizeof(int)) ||
+      !cache_grow((void **)&e->t.stmtend,&stmtend_alloc,e->t.stmts_alloc,sizeof(int)) ||
+      !cache_grow((void **)&e->t.srcoffs,&srcoffs_alloc,e->t.stmts_alloc,sizeof(int)))
+  {
+    e->broken=1;
+    return;
+  }
+  e->t.roots[e->t.nstmts]=(int)code-1;
+  e->t.srcoffs[e->t.nstmts]=srcoffs;
+  e->t.stmtend[e->t.nstmts++]=e->t.nrecs;
+}
+
+void nseel_cache_optimize(void *ent)
+{
+  cacheEnt *e=(cacheEnt *)ent;
+  if (e && !e->broken) nseel_optimize(&e->t);
+}
+
+void *nseel_cache_endrecord(void *ent, int success, int keep)
+{
+  cacheEnt *e=(cacheEnt *)ent;
+  if (!e) return 0;
+
+  if (!success || e->broken)
+  {
+    cache_freeent(e);
+    return 0;
+  }
+  e->bytes=sizeof(cacheEnt)+strlen(e->src)+1+e->t.recs_alloc*sizeof(eelRec)+e->t.stmts_alloc*3*sizeof(int)+
+           e->t.names_alloc+e->newvars_alloc;
+
+  NSEEL_HOSTSTUB_EnterMutex();
+  if (e->bytes <= cache_limit)
+  {
+    cacheEnt **p=&cache_hash[e->hash%CACHE_HASH_SIZE];
+    e->hnext=*p;
+    *p=e;
+    e->next=cache_head;
+    if (cache_head) cache_head->prev=e;
+    else cache_tail=e;
+    cache_head=e;
+    e->incache=1;
+    e->refcnt++;
+    cache_stats[2]++;
+    cache_stats[3]+=e->bytes;
+    cache_trim(cache_limit);
+  }
+  if (!keep)
+  {
+    cache_unref(e);
+    e=0;
+  }
+  NSEEL_HOSTSTUB_LeaveMutex();
+  return e;
+}
+
+eelTranscript *nseel_cache_transcript(void *ent)
+{
+  return ent && !((cacheEnt *)ent)->broken ? &((cacheEnt *)ent)->t : 0;
+}
+
+INT_PTR nseel_cache_replay(compileContext *ctx, void *ent, int stmt, EEL_F *temps)
+{
+  const eelTranscript *t=&((cacheEnt *)ent)->t;
+  INT_PTR *codes, root;
+  int i, first;
+
+  if (stmt < 0 || stmt >= t->nstmts) return 0;
+  first=stmt ? t->stmtend[stmt-1] : 0;
+  codes=(INT_PTR *)malloc((t->stmtend[stmt]-first)*sizeof(INT_PTR));
+  if (!codes) return 0;
+
+  for (i = first; i < t->stmtend[stmt]; i ++)
+  {
+    const eelRec *r=&t->recs[i];
+    INT_PTR *c=codes-first, code;
+    switch (r->op)
+    {
+      case EREC_VALUE: code=nseel_createCompiledValue(ctx,r->value,NULL); break;
+      case EREC_VAR: code=nseel_createCompiledValue(ctx,0,NSEEL_VM_regvar(ctx,t->names+r->name)); break;
+      case EREC_TEMP: code=nseel_createCompiledValue(ctx,0,temps+r->name); break;
+      case EREC_FUNCTION1: code=nseel_createCompiledFunction1(ctx,r->fntype,r->fn,c[r->parms[0]]); break;
+      case EREC_FUNCTION2: code=nseel_createCompiledFunction2(ctx,r->fntype,r->fn,c[r->parms[0]],c[r->parms[1]]); break;
+      default: code=nseel_createCompiledFunction3(ctx,r->fntype,r->fn,c[r->parms[0]],c[r->parms[1]],c[r->parms[2]]); break;
+    }
+    codes[i-first]=code;
+  }
+  root=codes[t->roots[stmt]-first];
+  free(codes);
+  return root;
+}
+
+void NSEEL_code_cache_setlimit(int bytes)
+{
+  NSEEL_HOSTSTUB_EnterMutex();
+  cache_limit=bytes > 0 ? bytes : 0;
+  cache_trim(cache_limit);
+  NSEEL_HOSTSTUB_LeaveMutex();
+}
+
+void nseel_cache_flush()
+{
+  NSEEL_HOSTSTUB_EnterMutex();
+  while (cache_tail) cache_remove(cache_tail);
+  NSEEL_HOSTSTUB_LeaveMutex();
+}
+
+int *NSEEL_code_cache_getstats()
+{
+  return cache_stats;
+}
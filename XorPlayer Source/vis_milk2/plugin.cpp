@@ -625,6 +625,8 @@ SPOUT :
 #include <strsafe.h>
 #include <Windows.h>
 #include "AutoCharFn.h"
+#include "..\audio\spectrum.h"
+#include "..\audio\audioconv.h"
 
 #include <dwmapi.h>  // Link with Dwmapi.lib
 #pragma comment(lib, "dwmapi.lib")
@@ -1132,8 +1134,13 @@ void CPlugin::MyPreInitialize()
 	m_fTimeBetweenPresetsRand	= 10.0f;
 	m_bSequentialPresetOrder    = false;
 	m_bHardCutsDisabled			= true;
+	m_bHardCutFineBands			= false;
 	m_fHardCutLoudnessThresh	= 2.5f;
 	m_fHardCutHalflife			= 60.0f;
+	m_nSpectrumWindow			= SPECTRUM_DEFAULT_WINDOW;
+	m_nSpectrumHop				= SPECTRUM_DEFAULT_HOP;
+	m_bAudioConvBenchmark		= false;
+	m_nRandSeed					= 0;
     m_max_fps_w = 60;
 	//m_nWidth			= 1024;
 	//m_nHeight			= 768;
@@ -1252,6 +1259,9 @@ void CPlugin::MyPreInitialize()
     //m_nRatingReadProgress = -1;
 
     myfft.Init(576, MY_FFT_SAMPLES, -1);
+    // note: only look at bottom half of spectrum! (0-11,025 Hz, in 3 equal slices)
+    mybands.Init(MY_FFT_SAMPLES, 3, 0.0f, 0.5f, 1.0f, 0, 0);
+    myfinebands.Init(MY_FFT_SAMPLES, MY_FINE_BANDS, 100.0f, 11025.0f, 22050.0f, 1, 0);
 	memset(&mysound, 0, sizeof(mysound));
 
     for (int i=0; i<PRESET_HIST_LEN; i++)
@@ -1266,6 +1276,11 @@ void CPlugin::MyPreInitialize()
 	m_bShowRating		= false;
 	m_bShowPresetInfo	= false;
 	m_bShowDebugInfo	= false;
+	m_nCodeProfileLines	= 0;
+	m_fCodeProfileTime	= 0;
+	m_nCodeProfileFrame	= 0;
+	memset(m_nCodeOverBudget, 0, sizeof(m_nCodeOverBudget));
+	m_nCodeProfilePreset	= -1;
 	m_bShowSongTitle	= false;
 	m_bShowSongTime		= false;
 	m_bShowSongLen		= false;
@@ -1287,6 +1302,7 @@ void CPlugin::MyPreInitialize()
 	m_verts					= NULL;
 	m_verts_temp            = NULL;
 	m_vertinfo				= NULL;
+	m_pv_lanes				= NULL;
 	m_indices_list			= NULL;
 	m_indices_strip			= NULL;
 
@@ -1361,6 +1377,7 @@ void CPlugin::MyReadConfig()
 	m_bEnableRating = GetPrivateProfileBoolW(L"settings",L"bEnableRating",m_bEnableRating,pIni);
     //m_bInstaScan    = GetPrivateProfileBool("settings","bInstaScan",m_bInstaScan,pIni);
 	m_bHardCutsDisabled = GetPrivateProfileBoolW(L"settings",L"bHardCutsDisabled",m_bHardCutsDisabled,pIni);
+	m_bHardCutFineBands = GetPrivateProfileBoolW(L"settings",L"bHardCutFineBands",m_bHardCutFineBands,pIni);
 	g_bDebugOutput	= GetPrivateProfileBoolW(L"settings",L"bDebugOutput",g_bDebugOutput,pIni);
 	//m_bShowSongInfo = GetPrivateProfileBool("settings","bShowSongInfo",m_bShowSongInfo,pIni);
 	//m_bShowPresetInfo=GetPrivateProfileBool("settings","bShowPresetInfo",m_bShowPresetInfo,pIni);
@@ -1416,6 +1433,13 @@ void CPlugin::MyReadConfig()
 	m_fTimeBetweenRandomSongTitles = GetPrivateProfileFloatW(L"settings",L"fTimeBetweenRandomSongTitles" ,m_fTimeBetweenRandomSongTitles,pIni);
 	m_fTimeBetweenRandomCustomMsgs = GetPrivateProfileFloatW(L"settings",L"fTimeBetweenRandomCustomMsgs" ,m_fTimeBetweenRandomCustomMsgs,pIni);
     m_adapterId = GetPrivateProfileIntW(L"settings", L"nVideoAdapterIndex", 0, pIni);
+	m_nSpectrumWindow			= GetPrivateProfileIntW(L"settings",L"nSpectrumWindow"        ,m_nSpectrumWindow        ,pIni);
+	m_nSpectrumHop				= GetPrivateProfileIntW(L"settings",L"nSpectrumHop"           ,m_nSpectrumHop           ,pIni);
+	SetSpectrumConfig(m_nSpectrumWindow, m_nSpectrumHop);
+	m_bAudioConvBenchmark		= GetPrivateProfileBoolW(L"settings",L"bAudioConvBenchmark",m_bAudioConvBenchmark,pIni);
+	if (m_bAudioConvBenchmark)
+		BenchmarkAudioConv();  // results go to the debug output
+	m_nRandSeed					= GetPrivateProfileIntW(L"settings",L"nRandSeed"              ,m_nRandSeed              ,pIni);
 
     // --------
 
@@ -1473,6 +1497,7 @@ void CPlugin::MyWriteConfig()
 
 	WritePrivateProfileIntW(m_bSongTitleAnims,		L"bSongTitleAnims",		pIni, L"settings");
 	WritePrivateProfileIntW(m_bHardCutsDisabled,	    L"bHardCutsDisabled",	pIni, L"settings");
+	WritePrivateProfileIntW(m_bHardCutFineBands,	    L"bHardCutFineBands",	pIni, L"settings");
 	WritePrivateProfileIntW(m_bEnableRating,		    L"bEnableRating",		pIni, L"settings");
 	//WritePrivateProfileIntW(m_bInstaScan,            "bInstaScan",		    pIni, "settings");
 	WritePrivateProfileIntW(g_bDebugOutput,		    L"bDebugOutput",			pIni, L"settings");
@@ -1516,6 +1541,10 @@ void CPlugin::MyWriteConfig()
 	WritePrivateProfileFloatW(m_fTimeBetweenRandomCustomMsgs,L"fTimeBetweenRandomCustomMsgs",pIni, L"settings");
 
     WritePrivateProfileIntW(m_adapterId, L"nVideoAdapterIndex", pIni, L"settings");
+	WritePrivateProfileIntW(m_nSpectrumWindow, L"nSpectrumWindow", pIni, L"settings");
+	WritePrivateProfileIntW(m_nSpectrumHop,    L"nSpectrumHop",    pIni, L"settings");
+	WritePrivateProfileIntW(m_bAudioConvBenchmark, L"bAudioConvBenchmark", pIni, L"settings");
+	WritePrivateProfileIntW(m_nRandSeed,       L"nRandSeed",       pIni, L"settings");
 
 }
 
@@ -1638,6 +1667,9 @@ int CPlugin::AllocateMyNonDx9Stuff()
 	m_bMMX = CheckForMMX();
 	//m_bSSE = CheckForSSE();
 
+    // (if this fails, the per-vertex code just runs on fewer threads, or this one)
+    m_workerPool.Init();
+
 	m_pState->Default();
 	m_pOldState->Default();
     m_pNewState->Default();
@@ -1695,6 +1727,11 @@ void CPlugin::CleanUpMyNonDx9Stuff()
 
     CancelThread(1000);
 
+    m_workerPool.Finish();
+
+    // frees the compiled code cache (the states free their own code)
+    NSEEL_quit();
+
 	m_menuPreset  .Finish();
 	m_menuWave    .Finish();
 	m_menuAugment .Finish();
@@ -2323,9 +2360,10 @@ int CPlugin::AllocateMyDX9Stuff()
 	m_verts      = new MYVERTEX[(m_nGridX+1)*(m_nGridY+1)];
 	m_verts_temp = new MYVERTEX[(m_nGridX+2) * 4];
 	m_vertinfo   = new td_vertinfo[(m_nGridX+1)*(m_nGridY+1)];
+	m_pv_lanes   = new EEL_F[NUM_PV_LANES*(m_nGridX+1)*(m_nGridY+1)];
 	m_indices_strip = new int[(m_nGridX+2)*(m_nGridY*2)];
 	m_indices_list  = new int[m_nGridX*m_nGridY*6];
-	if (!m_verts || !m_vertinfo)
+	if (!m_verts || !m_vertinfo || !m_pv_lanes)
 	{
 		swprintf(buf, L"couldn't allocate mesh - out of memory");
 		dumpmsg(buf);
@@ -3927,6 +3965,12 @@ void CPlugin::CleanUpMyDX9Stuff(int final_cleanup)
 		m_vertinfo = NULL;
 	}
 
+	if (m_pv_lanes != NULL)
+	{
+		delete [] m_pv_lanes;
+		m_pv_lanes = NULL;
+	}
+
 	if (m_indices_list != NULL)
 	{
 		delete m_indices_list;
@@ -4164,6 +4208,71 @@ void CPlugin::ClearErrors(int category)  // 0=all categories
     }
 }
 
+// profiling the preset's code (see ns-eel.h) is on while the debug info is shown. once a second this turns
+// what each piece of code counted into a line of per-frame averages (and the megabuf blocks it got),
+// and starts the counts over.  it's called every frame, to count the frames the code ran out of loop budget on
+void CPlugin::UpdateCodeProfile()
+{
+    NSEEL_CODEHANDLE code[MAX_CODE_PROFILE_LINES];
+    wchar_t name[MAX_CODE_PROFILE_LINES][32];
+    bool bOverBudget[MAX_CODE_PROFILE_LINES];
+    int nCode = 0;
+    int i;
+
+    code[nCode] = m_pState->m_pf_codehandle; bOverBudget[nCode] = m_pState->m_bPfOverBudget; lstrcpyW(name[nCode++], L"per-frame");
+    code[nCode] = m_pState->m_pp_codehandle; bOverBudget[nCode] = m_pState->m_bPvOverBudget; lstrcpyW(name[nCode++], L"per-vertex");
+    for (i=0; i<MAX_CUSTOM_WAVES; i++)
+    {
+        code[nCode] = m_pState->m_wave[i].m_pf_codehandle; bOverBudget[nCode] = m_pState->m_wave[i].m_bPfOverBudget; swprintf(name[nCode++], L"wave %d per-frame", i);
+        code[nCode] = m_pState->m_wave[i].m_pp_codehandle; bOverBudget[nCode] = m_pState->m_wave[i].m_bPpOverBudget; swprintf(name[nCode++], L"wave %d per-point", i);
+    }
+    for (i=0; i<MAX_CUSTOM_SHAPES; i++)
+    {
+        code[nCode] = m_pState->m_shape[i].m_pf_codehandle; bOverBudget[nCode] = m_pState->m_shape[i].m_bPfOverBudget; swprintf(name[nCode++], L"shape %d per-frame", i);
+    }
+
+    for (i=0; i<nCode; i++)
+        if (code[i] && bOverBudget[i])
+            m_nCodeOverBudget[i]++;
+
+    bool bRestart = !NSEEL_code_profiling || m_nCodeProfilePreset != m_nPresetsLoadedTotal;
+    if (!bRestart && GetTime() < m_fCodeProfileTime + 1.0f)
+        return;
+
+    int nFrames = GetFrame() - m_nCodeProfileFrame;
+    if (bRestart || nFrames < 1)
+        m_nCodeProfileLines = 0;
+    else
+    {
+        m_nCodeProfileLines = 0;
+        for (i=0; i<nCode; i++)
+        {
+            NSEEL_PROFILE* p = code[i] ? NSEEL_code_getprofile(code[i]) : NULL;
+            if (!p || !p->calls)
+                continue;
+            wchar_t loops[32];
+            if (p->loops_uncounted)
+                lstrcpyW(loops, L"n/a");
+            else
+                swprintf(loops, L"%.0f", (double)p->loops/nFrames);
+            int n = swprintf(m_szCodeProfile[m_nCodeProfileLines], L" %s: %.1fk cycles, %.0f calls, %s loops per frame, %u new megabuf blocks ",
+                name[i], p->cycles/1000.0/nFrames, (double)p->calls/nFrames, loops, p->megabuf_blocks);
+            if (m_nCodeOverBudget[i] && n > 0)
+                swprintf(&m_szCodeProfile[m_nCodeProfileLines][n-1], L", over loop budget on %d frames ", m_nCodeOverBudget[i]);
+            m_nCodeProfileLines++;
+        }
+    }
+
+    for (i=0; i<nCode; i++)
+        if (code[i])
+            memset(NSEEL_code_getprofile(code[i]), 0, sizeof(NSEEL_PROFILE));
+    memset(m_nCodeOverBudget, 0, sizeof(m_nCodeOverBudget));
+    NSEEL_code_profiling = 1;
+    m_nCodeProfilePreset = m_nPresetsLoadedTotal;
+    m_fCodeProfileTime = GetTime();
+    m_nCodeProfileFrame = GetFrame();
+}
+
 void CPlugin::MyRenderUI(
                          int *upper_left_corner_y,  // increment me!
                          int *upper_right_corner_y, // increment me!
@@ -4247,6 +4356,10 @@ void CPlugin::MyRenderUI(
             SelectFont(SIMPLE_FONT);
 			swprintf(buf, L" %s: %6.4f ", wasabiApiLangString(IDS_PF_MONITOR), (float)(*m_pState->var_pf_monitor));
             MyTextOut_Shadow(buf, MTO_UPPER_RIGHT);
+
+            UpdateCodeProfile();
+            for (int i=0; i<m_nCodeProfileLines; i++)
+                MyTextOut_Shadow(m_szCodeProfile[i], MTO_UPPER_RIGHT);
 		}
 
         // NOTE: custom timed msg comes at the end!!
@@ -6404,6 +6517,7 @@ int CPlugin::HandleRegularKey(WPARAM wParam)
 	case 'n':
 	case 'N':
 		m_bShowDebugInfo = !m_bShowDebugInfo;
+		NSEEL_code_profiling = 0; // UpdateCodeProfile() turns it back on
 		return 0; // we processed (or absorbed) the key
 
 	case 'r':
@@ -8806,19 +8920,9 @@ void CPlugin::DoCustomSoundAnalysis()
 	myfft.time_to_frequency_domain(fWaveLeft, mysound.fSpecLeft);
 	//for (i=0; i<MY_FFT_SAMPLES; i++) fSpecLeft[i] = sqrtf(fSpecLeft[i]*fSpecLeft[i] + fSpecTemp[i]*fSpecTemp[i]);
 
-	// sum spectrum up into 3 bands
-	for (i=0; i<3; i++)
-	{
-		// note: only look at bottom half of spectrum!  (hence divide by 6 instead of 3)
-		int start = MY_FFT_SAMPLES*i/6;
-		int end   = MY_FFT_SAMPLES*(i+1)/6;
-		int j;
-
-		mysound.imm[i] = 0;
-
-		for (j=start; j<end; j++)
-			mysound.imm[i] += mysound.fSpecLeft[j];
-	}
+	// sum spectrum up into 3 bands, and into finer ones for the hard cut detector
+	mybands.SumBands(mysound.fSpecLeft, mysound.imm);
+	myfinebands.SumBands(mysound.fSpecLeft, mysound.imm_fine);
 
 	// do temporal blending to create attenuated and super-attenuated versions
 	for (i=0; i<3; i++)
@@ -8851,6 +8955,24 @@ void CPlugin::DoCustomSoundAnalysis()
 		else
 			mysound.avg_rel[i]  = mysound.avg[i] / mysound.long_avg[i];
 	}
+
+	// same long-term tracking for the finer bands
+	for (i=0; i<MY_FINE_BANDS; i++)
+	{
+        float rate;
+
+		if (GetFrame() < 50)
+			rate = 0.9f;
+		else
+			rate = 0.992f;
+        rate = AdjustRateToFPS(rate, 30.0f, GetFps());
+        mysound.long_avg_fine[i] = mysound.long_avg_fine[i]*rate + mysound.imm_fine[i]*(1-rate);
+
+		if (fabsf(mysound.long_avg_fine[i]) < 0.001f)
+			mysound.imm_fine_rel[i] = 1.0f;
+		else
+			mysound.imm_fine_rel[i] = mysound.imm_fine[i] / mysound.long_avg_fine[i];
+	}
 }
 
 void CPlugin::GenWarpPShaderText(char *szShaderText, float decay, bool bWrap)
@@ -57,6 +57,8 @@ typedef char* CHARPTR;
 LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
 
 #define MY_FFT_SAMPLES 512     // for old [pre-vms] milkdrop sound analysis
+#define MY_FINE_BANDS  8       // pitch-spaced bands of the same spectrum, for hard cut detection
+                               // (not preset variables: new built-in names would shadow what existing presets call their own variables)
 typedef struct
 {
 	float   imm[3];			// bass, mids, treble (absolute)
@@ -66,6 +68,9 @@ typedef struct
 	float	long_avg[3];	// bass, mids, treble (absolute)
     float   fWave[2][576];
     float   fSpecLeft[MY_FFT_SAMPLES];
+	float   imm_fine[MY_FINE_BANDS];		// finer bands, 100 Hz - 11 kHz (absolute)
+	float   long_avg_fine[MY_FINE_BANDS];	// finer bands (absolute)
+	float   imm_fine_rel[MY_FINE_BANDS];	// finer bands (relative to song; 1=avg)
 } td_mysounddata;
 
 typedef struct
@@ -303,9 +308,14 @@ public:
         float		m_fTimeBetweenPresetsRand;	// <- this is in addition to m_fTimeBetweenPresets
         bool        m_bSequentialPresetOrder;
         bool		m_bHardCutsDisabled;
+        bool		m_bHardCutFineBands;	// hard cuts go by the 8 fine bands instead of bass/mid/treb (fHardCutLoudnessThresh needs retuning)
         float		m_fHardCutLoudnessThresh;
         float		m_fHardCutHalflife;
         float		m_fHardCutThresh;
+        int         m_nSpectrumWindow;  // STFT window in samples (1024-8192), see audio\spectrum.h
+        int         m_nSpectrumHop;     // STFT hop in samples
+        bool        m_bAudioConvBenchmark; // log the cost of the sample conversion kernels once at startup, see audio\audioconv.h
+        int         m_nRandSeed;        // seeds rand() in the preset's code each time a preset loads; 0 = a different seed each time
         //int			m_nWidth;
         //int			m_nHeight;
         //int			m_nDispBits;
@@ -459,6 +469,8 @@ public:
         void        OnFinishedLoadingPreset();
 
         FFT            myfft;
+        BandLayout     mybands;        // bass/mids/treble of mysound.fSpecLeft
+        BandLayout     myfinebands;    // MY_FINE_BANDS bands of mysound.fSpecLeft
         td_mysounddata mysound;
 
         // stuff for displaying text to user:
@@ -471,6 +483,16 @@ public:
         bool		m_bShowSongLen;
         float		m_fShowRatingUntilThisTime;
 
+        // debug info: what each piece of the preset's code cost per frame, over the last second (see UpdateCodeProfile)
+        #define MAX_CODE_PROFILE_LINES (2 + MAX_CUSTOM_WAVES*2 + MAX_CUSTOM_SHAPES)
+        wchar_t     m_szCodeProfile[MAX_CODE_PROFILE_LINES][160];
+        int         m_nCodeProfileLines;
+        float       m_fCodeProfileTime;
+        int         m_nCodeProfileFrame;
+        int         m_nCodeOverBudget[MAX_CODE_PROFILE_LINES]; // frames each piece ran out of CODE_LOOP_BUDGET
+        int         m_nCodeProfilePreset; // m_nPresetsLoadedTotal when the counting started; a preset load starts it over
+        void        UpdateCodeProfile();
+
         #define ERR_ALL    0
         #define ERR_INIT   1  //specifically, loading a preset
         #define ERR_PRESET 2  //specifically, loading a preset
@@ -525,6 +547,8 @@ public:
         MYVERTEX          *m_verts;
         MYVERTEX          *m_verts_temp;
         td_vertinfo       *m_vertinfo;
+        EEL_F             *m_pv_lanes;      // NUM_PV_LANES arrays of one EEL_F per vertex, for the per-vertex code
+        CWorkerPool       m_workerPool;     // runs bands of the mesh through the per-vertex code at once
         int               *m_indices_strip;
         int               *m_indices_list;
 
@@ -143,8 +143,18 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <multimon.h>
 #include "AutoCharFn.h"
 #include <mmsystem.h>
+#include <emmintrin.h>
+#include "..\audio\audiobuf.h"
+#include "..\audio\spectrum.h"
 #pragma comment(lib,"winmm.lib")    // for timeGetTime
 
+#if (NUM_FREQUENCIES != SPECTRUM_BINS)
+#error NUM_FREQUENCIES must match SPECTRUM_BINS of the capture thread's spectrum analysis
+#endif
+
+// how long the last spectrum is shown when no new audio comes in (nothing playing, device lost):
+#define SPECTRUM_HOLD_TIME 0.25f
+
 // STATE VALUES & VERTEX FORMATS FOR HELP SCREEN TEXTURE:
 #define TEXT_SURFACE_NOT_READY  0
 #define TEXT_SURFACE_REQUESTED  1
@@ -299,7 +309,18 @@ char* CPluginShell::GetDriverDescription()
 int CPluginShell::InitNondx9Stuff()
 {
 	timeBeginPeriod(1);
-	m_fftobj.Init(576, NUM_FREQUENCIES);
+	// sum the spectrum up into 3 bands, equally spaced pitch-wise from 200 to 11,025 Hz.
+	// [note: the bins are mapped as if NUM_FREQUENCIES spanned 0-11,025 Hz, as always.]
+	//   old guesswork code for this:
+	//     float exp = 2.1f;
+	//     int start = (int)(NUM_FREQUENCIES*0.5f*powf(i/3.0f, exp));
+	//     int end   = (int)(NUM_FREQUENCIES*0.5f*powf((i+1)/3.0f, exp));
+	//   results:
+	//            old range:      new range (ideal):
+	//     bass:  0-1097          200-761
+	//     mids:  1097-4705       761-2897
+	//     treb:  4705-11025      2897-11025
+	m_bands.Init(NUM_FREQUENCIES, 3, 200.0f, 11025.0f, 11025.0f);
 	if (!InitGDIStuff()) return false;
 	return AllocateMyNonDx9Stuff();
 }
@@ -309,7 +330,7 @@ void CPluginShell::CleanUpNondx9Stuff()
 	timeEndPeriod(1);
 	CleanUpMyNonDx9Stuff();
 	CleanUpGDIStuff();
-	m_fftobj.CleanUp();
+	m_bands.CleanUp();
 }
 
 int CPluginShell::InitGDIStuff()
@@ -1066,9 +1087,9 @@ int CPluginShell::PluginPreInitialize(HWND hWinampWnd, HINSTANCE hWinampInstance
 	m_prev_end_of_frame.QuadPart = 0;
 
 	// PRIVATE AUDIO PROCESSING DATA
-	//(m_fftobj needs no init)
-	memset(m_oldwave[0], 0, sizeof(float)*576);
-	memset(m_oldwave[1], 0, sizeof(float)*576);
+	m_last_spectrum_time = 0;
+	memset(m_align_pyramid, 0, sizeof(m_align_pyramid));
+	m_align_cur = 0;
 	m_prev_align_offset[0] = 0;
 	m_prev_align_offset[1] = 0;
 	m_align_weights_ready = 0;
@@ -1319,7 +1340,7 @@ void CPluginShell::WriteConfig()
 //----------------------------------------------------------------------
 //----------------------------------------------------------------------
 
-int CPluginShell::PluginRender(unsigned char *pWaveL, unsigned char *pWaveR)//, unsigned char *pSpecL, unsigned char *pSpecR)
+int CPluginShell::PluginRender(const float *pWaveL, const float *pWaveR, const AudioBufView *pView)//, unsigned char *pSpecL, unsigned char *pSpecR)
 {
 	// return FALSE here to tell Winamp to terminate the plugin
 
@@ -1397,7 +1418,7 @@ int CPluginShell::PluginRender(unsigned char *pWaveL, unsigned char *pWaveR)//,
 	}
 
 	DoTime();
-	AnalyzeNewSound(pWaveL, pWaveR);
+	AnalyzeNewSound(pWaveL, pWaveR, pView);
 	AlignWaves();
 
 	DrawAndDisplay(0);
@@ -1732,70 +1753,47 @@ void CPluginShell::DoTime()
 	}
 }
 
-void CPluginShell::AnalyzeNewSound(unsigned char *pWaveL, unsigned char *pWaveR)
+void CPluginShell::AnalyzeNewSound(const float *pWaveL, const float *pWaveR, const AudioBufView *pView)
 {
-	// we get 576 samples in from winamp.
-	// the output of the fft has 'num_frequencies' samples,
-	//   and represents the frequency range 0 hz - 22,050 hz.
+	// we get 576 float samples in [-1..1] range from the capture ring buffer.
+	// the spectrum is not computed here: the capture thread runs an overlapped
+	//   STFT (see audio\spectrum.cpp) and we just pick up its latest hop.
+	//   it has 'num_frequencies' samples, and represents the frequency range 0 hz - 22,050 hz.
 	// usually, plugins only use half of this output (the range 0 hz - 11,025 hz),
 	//   since >10 khz doesn't usually contribute much.
 
 	int i;
 
-	float temp_wave[2][576];
-
-	int old_i = 0;
 	for (i=0; i<576; i++)
 	{
-		m_sound.fWaveform[0][i] = (float)((pWaveL[i] ^ 128) - 128);
-		m_sound.fWaveform[1][i] = (float)((pWaveR[i] ^ 128) - 128);
+		// scaled to the old 8-bit range [-128..127] that the rest of the analysis (and the presets) expect,
+		// but without quantization, so quiet material keeps its detail:
+		m_sound.fWaveform[0][i] = pWaveL[i] * 128.0f;
+		m_sound.fWaveform[1][i] = pWaveR[i] * 128.0f;
 
 		// simulating single frequencies from 200 to 11,025 Hz:
 		//float freq = 1.0f + 11050*(GetFrame() % 100)*0.01f;
 		//m_sound.fWaveform[0][i] = 10*sinf(i*freq*6.28f/44100.0f);
-
-		// damp the input into the FFT a bit, to reduce high-frequency noise:
-		temp_wave[0][i] = 0.5f*(m_sound.fWaveform[0][i] + m_sound.fWaveform[0][old_i]);
-		temp_wave[1][i] = 0.5f*(m_sound.fWaveform[1][i] + m_sound.fWaveform[1][old_i]);
-		old_i = i;
 	}
 
-	m_fftobj.time_to_frequency_domain(temp_wave[0], m_sound.fSpectrum[0]);
-	m_fftobj.time_to_frequency_domain(temp_wave[1], m_sound.fSpectrum[1]);
-
-	// sum (left channel) spectrum up into 3 bands
-	// [note: the new ranges do it so that the 3 bands are equally spaced, pitch-wise]
-	float min_freq = 200.0f;
-	float max_freq = 11025.0f;
-	float net_octaves = (logf(max_freq/min_freq) / logf(2.0f));     // 5.7846348455575205777914165223593
-	float octaves_per_band = net_octaves / 3.0f;                    // 1.9282116151858401925971388407864
-	float mult = powf(2.0f, octaves_per_band); // each band's highest freq. divided by its lowest freq.; 3.805831305510122517035102576162
-	// [to verify: min_freq * mult * mult * mult should equal max_freq.]
-	for (int ch=0; ch<2; ch++)
+	// the samples were read straight out of the capture ring; if the capture thread lapped it
+	//   meanwhile (a device reset between taking the view and getting here can take that long),
+	//   some of them are newer than the rest, so use silence like GetAudioBuf() does.
+	if (pView && !IsAudioBufViewValid(pView))
+		memset(m_sound.fWaveform, 0, sizeof(m_sound.fWaveform));
+
+	if (GetSpectrum(m_sound.fSpectrum[0], m_sound.fSpectrum[1]))
+		m_last_spectrum_time = m_time;
+	else if (m_time - m_last_spectrum_time > SPECTRUM_HOLD_TIME)
 	{
-		for (i=0; i<3; i++)
-		{
-			// old guesswork code for this:
-			//   float exp = 2.1f;
-			//   int start = (int)(NUM_FREQUENCIES*0.5f*powf(i/3.0f, exp));
-			//   int end   = (int)(NUM_FREQUENCIES*0.5f*powf((i+1)/3.0f, exp));
-			// results:
-			//          old range:      new range (ideal):
-			//   bass:  0-1097          200-761
-			//   mids:  1097-4705       761-2897
-			//   treb:  4705-11025      2897-11025
-			int start = (int)(NUM_FREQUENCIES * min_freq*powf(mult, (float)i)/11025.0f);
-			int end   = (int)(NUM_FREQUENCIES * min_freq*powf(mult, (float)(i+1))/11025.0f);
-			if (start < 0) start = 0;
-			if (end > NUM_FREQUENCIES) end = NUM_FREQUENCIES;
-
-			m_sound.imm[ch][i] = 0;
-			for (int j=start; j<end; j++)
-				m_sound.imm[ch][i] += m_sound.fSpectrum[ch][j];
-			m_sound.imm[ch][i] /= (float)(end-start);
-		}
+		// no audio coming in; decay to silence like the old per-frame fft did
+		memset(m_sound.fSpectrum, 0, sizeof(m_sound.fSpectrum));
 	}
 
+	// sum spectrum up into 3 bands (layout set up in InitNondx9Stuff)
+	for (int ch=0; ch<2; ch++)
+		m_bands.SumBands(m_sound.fSpectrum[ch], m_sound.imm[ch]);
+
 	// multiply by long-term, empirically-determined inverse averages:
 	// (for a trial of 244 songs, 10 seconds each, somewhere in the 2nd or 3rd minute,
 	//  the average levels were: 0.326781557	0.38087377	0.199888934
@@ -2448,6 +2446,23 @@ LRESULT CPluginShell::PluginShellDesktopWndProc(HWND hWnd, unsigned uMsg, WPARAM
 	return DefWindowProc(hWnd, uMsg, wParam, lParam);
 }
 
+#if (NUM_WAVEFORM_SAMPLES < 576)
+// weighted sum of absolute differences between old[first..last] and cur[] at
+// 4 consecutive offsets at once: err[j] = sum of |cur[i+j] - old[i]| * weight[i].
+// (weights are never negative, so |x|*w == |x*w|.)
+static inline void WeightedSAD4(const float *cur, const float *old, const float *weight, int first, int last, float *err)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 acc = _mm_setzero_ps();
+	for (int i=first; i<=last; i++)
+	{
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(&cur[i]), _mm_set1_ps(old[i]));
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_and_ps(d, abs_mask), _mm_set1_ps(weight[i])));
+	}
+	_mm_storeu_ps(err, acc);
+}
+#endif
+
 void CPluginShell::AlignWaves()
 {
 	// align waves, using recursive (mipmap-style) least-error matching
@@ -2459,39 +2474,54 @@ void CPluginShell::AlignWaves()
 
 	int nSamples = NUM_WAVEFORM_SAMPLES;
 
-#define MAX_OCTAVES 10
-
 	int octaves = (int)floorf(logf((float)(576-nSamples))/logf(2.0f));
 	if (octaves < 4)
 		return;
-	if (octaves > MAX_OCTAVES)
-		octaves = MAX_OCTAVES;
+	if (octaves > MAX_ALIGN_OCTAVES)
+		octaves = MAX_ALIGN_OCTAVES;
+
+	int cur  = m_align_cur;
+	int prev = m_align_cur ^ 1;
+	m_align_cur = prev;
 
 	for (int ch=0; ch<2; ch++)
 	{
 		// only worry about matching the lower 'nSamples' samples
-		float temp_new[MAX_OCTAVES][576];
-		float temp_old[MAX_OCTAVES][576];
-		static float temp_weight[MAX_OCTAVES][576];
-		static int   first_nonzero_weight[MAX_OCTAVES];
-		static int   last_nonzero_weight[MAX_OCTAVES];
-		int spls[MAX_OCTAVES];
-		int space[MAX_OCTAVES];
+		// this frame's mip levels are kept, to be next frame's 'old' wave:
+		float (*temp_new)[576] = m_align_pyramid[cur][ch];
+		float temp_old_buf[MAX_ALIGN_OCTAVES][576];
+		const float *temp_old[MAX_ALIGN_OCTAVES];
+		static float temp_weight[MAX_ALIGN_OCTAVES][576];
+		static int   first_nonzero_weight[MAX_ALIGN_OCTAVES];
+		static int   last_nonzero_weight[MAX_ALIGN_OCTAVES];
+		int spls[MAX_ALIGN_OCTAVES];
+		int space[MAX_ALIGN_OCTAVES];
 
 		memcpy(temp_new[0], m_sound.fWaveform[ch], sizeof(float)*576);
-		memcpy(temp_old[0], &m_oldwave[ch][m_prev_align_offset[ch]], sizeof(float)*nSamples);
 		spls[0] = 576;
 		space[0] = 576 - nSamples;
 
-		// potential optimization: could reuse (instead of recompute) mip levels for m_oldwave[2][]?
+		// the old wave is last frame's waveform, from its aligned offset on.  its
+		//   mip levels are just slices of last frame's levels, as long as that
+		//   offset is a multiple of the level's step (2^octave); only the levels
+		//   above that get recomputed, and only over the samples compared.
+		int old_offset = m_prev_align_offset[ch];
+		temp_old[0] = &m_align_pyramid[prev][ch][0][old_offset];
+
 		for (int octave=1; octave<octaves; octave++)
 		{
 			spls[octave] = spls[octave-1]/2;
 			space[octave] = space[octave-1]/2;
 			for (int n=0; n<spls[octave]; n++)
-			{
 				temp_new[octave][n] = 0.5f*(temp_new[octave-1][n*2] + temp_new[octave-1][n*2+1]);
-				temp_old[octave][n] = 0.5f*(temp_old[octave-1][n*2] + temp_old[octave-1][n*2+1]);
+
+			if ((old_offset & ((1<<octave)-1)) == 0)
+				temp_old[octave] = &m_align_pyramid[prev][ch][octave][old_offset >> octave];
+			else
+			{
+				for (int n=0; n<spls[octave]-space[octave]; n++)
+					temp_old_buf[octave][n] = 0.5f*(temp_old[octave-1][n*2] + temp_old[octave-1][n*2+1]);
+				temp_old[octave] = temp_old_buf[octave];
 			}
 		}
 
@@ -2541,24 +2571,27 @@ void CPluginShell::AlignWaves()
 
 			int lowest_err_offset = -1;
 			float lowest_err_amount = 0;
-			for (int n=n1; n<n2; n++)
+			for (int n=n1; n<n2; )
 			{
-				float err_sum = 0;
-				//for (int i=0; i<compare_samples; i++)
-				for (int i=first_nonzero_weight[octave]; i<=last_nonzero_weight[octave]; i++)
+				// test 4 offsets per pass while they fit, then one at a time
+				float err_sum[4];
+				int count = (n2 - n >= 4) ? 4 : 1;
+				if (count == 4)
+					WeightedSAD4(&temp_new[octave][n], temp_old[octave], temp_weight[octave], first_nonzero_weight[octave], last_nonzero_weight[octave], err_sum);
+				else
 				{
-					float x = (temp_new[octave][i+n] - temp_old[octave][i]) * temp_weight[octave][i];
-					if (x>0)
-						err_sum += x;
-					else
-						err_sum -= x;
+					err_sum[0] = 0;
+					//for (int i=0; i<compare_samples; i++)
+					for (int i=first_nonzero_weight[octave]; i<=last_nonzero_weight[octave]; i++)
+						err_sum[0] += fabsf(temp_new[octave][i+n] - temp_old[octave][i]) * temp_weight[octave][i];
 				}
 
-				if (lowest_err_offset == -1 || err_sum < lowest_err_amount)
-				{
-					lowest_err_offset = n;
-					lowest_err_amount = err_sum;
-				}
+				for (int j=0; j<count; j++, n++)
+					if (lowest_err_offset == -1 || err_sum[j] < lowest_err_amount)
+					{
+						lowest_err_offset = n;
+						lowest_err_amount = err_sum[j];
+					}
 			}
 
 			// now use 'lowest_err_offset' to guide bounds of search in next octave:
@@ -2580,8 +2613,6 @@ void CPluginShell::AlignWaves()
 		}
 	}
 #endif
-	memcpy(m_oldwave[0], m_sound.fWaveform[0], sizeof(float)*576);
-	memcpy(m_oldwave[1], m_sound.fWaveform[1], sizeof(float)*576);
 	m_prev_align_offset[0] = align_offset[0];
 	m_prev_align_offset[1] = align_offset[1];
 
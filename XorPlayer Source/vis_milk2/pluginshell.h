@@ -43,6 +43,7 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define TIME_HIST_SLOTS 128     // # of slots used if fps > 60.  half this many if fps==30.
 #define MAX_SONGS_PER_PAGE 40
+#define MAX_ALIGN_OCTAVES 10    // # of mip levels AlignWaves() may search
 
 typedef struct
 {
@@ -64,6 +65,8 @@ typedef struct
     float fSpectrum[2][NUM_FREQUENCIES];    // NUM_FREQUENCIES samples for each channel (note: NUM_FREQUENCIES is declared in shell_defines.h)
 } td_soundinfo;                             // ...range is 0 Hz to 22050 Hz, evenly spaced.
 
+struct AudioBufView;                        // see audio\audiobuf.h
+
 class CPluginShell
 {
 public:
@@ -217,8 +220,10 @@ private:
     LARGE_INTEGER m_prev_end_of_frame;
 
     // PRIVATE AUDIO PROCESSING DATA
-    FFT   m_fftobj;
-    float m_oldwave[2][576];        // for wave alignment
+    BandLayout m_bands;             // bass/mids/treble band edges within m_sound.fSpectrum
+    double m_last_spectrum_time;    // m_time of the last new spectrum from the capture thread
+    float m_align_pyramid[2][2][MAX_ALIGN_OCTAVES][576]; // for wave alignment: [this/last frame][ch][octave] mip levels of the waveform
+    int   m_align_cur;              // for wave alignment: which half of m_align_pyramid is this frame's
     int   m_prev_align_offset[2];   // for wave alignment
     int   m_align_weights_ready;
 
@@ -232,7 +237,7 @@ public:
 	// SPOUT - DX9EX
 	int PluginInitialize(LPDIRECT3DDEVICE9EX device, D3DPRESENT_PARAMETERS* d3dpp, HWND hwnd, int iWidth, int iHeight);
     
-    int  PluginRender(unsigned char *pWaveL, unsigned char *pWaveR);
+    int  PluginRender(const float *pWaveL, const float *pWaveR, const AudioBufView *pView=NULL); // pView: the samples are a view of the capture ring
     void PluginQuit();
 
     void ToggleHelp();
@@ -255,7 +260,7 @@ private:
     void ReadConfig();
     void WriteConfig();
     void DoTime();
-    void AnalyzeNewSound(unsigned char *pWaveL, unsigned char *pWaveR);
+    void AnalyzeNewSound(const float *pWaveL, const float *pWaveR, const AudioBufView *pView);
     void AlignWaves();
 	
 	// SPOUT - DX9EX
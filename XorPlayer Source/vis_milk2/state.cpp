@@ -34,6 +34,7 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "utility.h"
 #include <windows.h>
 #include <locale.h>
+#include <ctype.h>
 #include "resource.h"
 #include <vector>
 #include <assert.h>
@@ -223,18 +224,24 @@ CState::CState()
 	// it is a SUBSET of the per-vertex calculation variable list.
 	m_pf_codehandle = NULL;
 	m_pp_codehandle = NULL;
+	m_nPpClones = 0;
+	m_bPfOverBudget = false;
+	m_bPvOverBudget = false;
 	m_pf_eel = NSEEL_VM_alloc();
 	m_pv_eel = NSEEL_VM_alloc();
     for (int i=0; i<MAX_CUSTOM_WAVES; i++)
     {
         m_wave[i].m_pf_codehandle = NULL;
         m_wave[i].m_pp_codehandle = NULL;
+        m_wave[i].m_bPfOverBudget = false;
+        m_wave[i].m_bPpOverBudget = false;
 				m_wave[i].m_pf_eel=NSEEL_VM_alloc();
 				m_wave[i].m_pp_eel=NSEEL_VM_alloc();
     }
     for (i=0; i<MAX_CUSTOM_SHAPES; i++)
     {
         m_shape[i].m_pf_codehandle = NULL;
+        m_shape[i].m_bPfOverBudget = false;
 				m_shape[i].m_pf_eel=NSEEL_VM_alloc();
         //m_shape[i].m_pp_codehandle = NULL;
     }
@@ -259,202 +266,276 @@ CState::~CState()
 
 //--------------------------------------------------------------------------------
 
-void CState::RegisterBuiltInVariables(int flags)
+static void OnLoopBudgetExhausted(void* pbOverBudget, NSEEL_VMCTX ctx)
 {
-    if (flags & RECOMPILE_PRESET_CODE)
-    {
-	    NSEEL_VM_resetvars(m_pf_eel);
-        var_pf_zoom		= NSEEL_VM_regvar(m_pf_eel, "zoom");		// i/o
-	    var_pf_zoomexp  = NSEEL_VM_regvar(m_pf_eel, "zoomexp");	// i/o
-	    var_pf_rot		= NSEEL_VM_regvar(m_pf_eel, "rot");		// i/o
-	    var_pf_warp		= NSEEL_VM_regvar(m_pf_eel, "warp");		// i/o
-	    var_pf_cx		= NSEEL_VM_regvar(m_pf_eel, "cx");		// i/o
-	    var_pf_cy		= NSEEL_VM_regvar(m_pf_eel, "cy");		// i/o
-	    var_pf_dx		= NSEEL_VM_regvar(m_pf_eel, "dx");		// i/o
-	    var_pf_dy		= NSEEL_VM_regvar(m_pf_eel, "dy");		// i/o
-	    var_pf_sx		= NSEEL_VM_regvar(m_pf_eel, "sx");		// i/o
-	    var_pf_sy		= NSEEL_VM_regvar(m_pf_eel, "sy");		// i/o
-	    var_pf_time		= NSEEL_VM_regvar(m_pf_eel, "time");		// i
-	    var_pf_fps      = NSEEL_VM_regvar(m_pf_eel, "fps");       // i
-	    var_pf_bass		= NSEEL_VM_regvar(m_pf_eel, "bass");		// i
-	    var_pf_mid		= NSEEL_VM_regvar(m_pf_eel, "mid");		// i
-	    var_pf_treb		= NSEEL_VM_regvar(m_pf_eel, "treb");		// i
-	    var_pf_bass_att	= NSEEL_VM_regvar(m_pf_eel, "bass_att");	// i
-	    var_pf_mid_att	= NSEEL_VM_regvar(m_pf_eel, "mid_att");	// i
-	    var_pf_treb_att	= NSEEL_VM_regvar(m_pf_eel, "treb_att");	// i
-	    var_pf_frame    = NSEEL_VM_regvar(m_pf_eel, "frame");
-	    var_pf_decay	= NSEEL_VM_regvar(m_pf_eel, "decay");
-	    var_pf_wave_a	= NSEEL_VM_regvar(m_pf_eel, "wave_a");
-	    var_pf_wave_r	= NSEEL_VM_regvar(m_pf_eel, "wave_r");
-	    var_pf_wave_g	= NSEEL_VM_regvar(m_pf_eel, "wave_g");
-	    var_pf_wave_b	= NSEEL_VM_regvar(m_pf_eel, "wave_b");
-	    var_pf_wave_x	= NSEEL_VM_regvar(m_pf_eel, "wave_x");
-	    var_pf_wave_y	= NSEEL_VM_regvar(m_pf_eel, "wave_y");
-	    var_pf_wave_mystery = NSEEL_VM_regvar(m_pf_eel, "wave_mystery");
-	    var_pf_wave_mode = NSEEL_VM_regvar(m_pf_eel, "wave_mode");
-        for (int vi=0; vi<NUM_Q_VAR; vi++)
-        {
-            char buf[16];
-            sprintf(buf, "q%d", vi+1);
-            var_pf_q[vi] = NSEEL_VM_regvar(m_pf_eel, buf);
-        }
-	    var_pf_progress = NSEEL_VM_regvar(m_pf_eel, "progress");
-	    var_pf_ob_size	= NSEEL_VM_regvar(m_pf_eel, "ob_size");
-	    var_pf_ob_r		= NSEEL_VM_regvar(m_pf_eel, "ob_r");
-	    var_pf_ob_g		= NSEEL_VM_regvar(m_pf_eel, "ob_g");
-	    var_pf_ob_b		= NSEEL_VM_regvar(m_pf_eel, "ob_b");
-	    var_pf_ob_a		= NSEEL_VM_regvar(m_pf_eel, "ob_a");
-	    var_pf_ib_size	= NSEEL_VM_regvar(m_pf_eel, "ib_size");
-	    var_pf_ib_r		= NSEEL_VM_regvar(m_pf_eel, "ib_r");
-	    var_pf_ib_g		= NSEEL_VM_regvar(m_pf_eel, "ib_g");
-	    var_pf_ib_b		= NSEEL_VM_regvar(m_pf_eel, "ib_b");
-	    var_pf_ib_a		= NSEEL_VM_regvar(m_pf_eel, "ib_a");
-	    var_pf_mv_x		= NSEEL_VM_regvar(m_pf_eel, "mv_x");
-	    var_pf_mv_y		= NSEEL_VM_regvar(m_pf_eel, "mv_y");
-	    var_pf_mv_dx	= NSEEL_VM_regvar(m_pf_eel, "mv_dx");
-	    var_pf_mv_dy	= NSEEL_VM_regvar(m_pf_eel, "mv_dy");
-	    var_pf_mv_l		= NSEEL_VM_regvar(m_pf_eel, "mv_l");
-	    var_pf_mv_r		= NSEEL_VM_regvar(m_pf_eel, "mv_r");
-	    var_pf_mv_g		= NSEEL_VM_regvar(m_pf_eel, "mv_g");
-	    var_pf_mv_b		= NSEEL_VM_regvar(m_pf_eel, "mv_b");
-	    var_pf_mv_a		= NSEEL_VM_regvar(m_pf_eel, "mv_a");
-	    var_pf_monitor  = NSEEL_VM_regvar(m_pf_eel, "monitor");
-	    var_pf_echo_zoom   = NSEEL_VM_regvar(m_pf_eel, "echo_zoom");
-	    var_pf_echo_alpha  = NSEEL_VM_regvar(m_pf_eel, "echo_alpha");
-	    var_pf_echo_orient = NSEEL_VM_regvar(m_pf_eel, "echo_orient");
-        var_pf_wave_usedots  = NSEEL_VM_regvar(m_pf_eel, "wave_usedots");
-        var_pf_wave_thick    = NSEEL_VM_regvar(m_pf_eel, "wave_thick");
-        var_pf_wave_additive = NSEEL_VM_regvar(m_pf_eel, "wave_additive");
-        var_pf_wave_brighten = NSEEL_VM_regvar(m_pf_eel, "wave_brighten");
-        var_pf_darken_center = NSEEL_VM_regvar(m_pf_eel, "darken_center");
-        var_pf_gamma         = NSEEL_VM_regvar(m_pf_eel, "gamma");
-        var_pf_wrap          = NSEEL_VM_regvar(m_pf_eel, "wrap");
-        var_pf_invert        = NSEEL_VM_regvar(m_pf_eel, "invert");
-        var_pf_brighten      = NSEEL_VM_regvar(m_pf_eel, "brighten");
-        var_pf_darken        = NSEEL_VM_regvar(m_pf_eel, "darken");
-        var_pf_solarize      = NSEEL_VM_regvar(m_pf_eel, "solarize");
-        var_pf_meshx         = NSEEL_VM_regvar(m_pf_eel, "meshx");
-        var_pf_meshy         = NSEEL_VM_regvar(m_pf_eel, "meshy");
-        var_pf_pixelsx       = NSEEL_VM_regvar(m_pf_eel, "pixelsx");
-        var_pf_pixelsy       = NSEEL_VM_regvar(m_pf_eel, "pixelsy");
-        var_pf_aspectx       = NSEEL_VM_regvar(m_pf_eel, "aspectx");
-        var_pf_aspecty       = NSEEL_VM_regvar(m_pf_eel, "aspecty");
-        var_pf_blur1min      = NSEEL_VM_regvar(m_pf_eel, "blur1_min");
-        var_pf_blur2min      = NSEEL_VM_regvar(m_pf_eel, "blur2_min");
-        var_pf_blur3min      = NSEEL_VM_regvar(m_pf_eel, "blur3_min");
-        var_pf_blur1max      = NSEEL_VM_regvar(m_pf_eel, "blur1_max");
-        var_pf_blur2max      = NSEEL_VM_regvar(m_pf_eel, "blur2_max");
-        var_pf_blur3max      = NSEEL_VM_regvar(m_pf_eel, "blur3_max");
-        var_pf_blur1_edge_darken = NSEEL_VM_regvar(m_pf_eel, "blur1_edge_darken");
+    // may be called from one of the threads running per-vertex code; it only sets the flag.
+    *(bool*)pbOverBudget = true;
+}
 
-	    // this is the list of variables that can be used for a PER-VERTEX calculation:
-	    // ('vertex' meaning a vertex on the mesh) (as opposed to a once-per-frame calculation)
+void CState::SetLoopBudget(NSEEL_VMCTX ctx, bool* pbOverBudget)
+{
+    // code compiled on 'ctx' from here on checks the budget; init code is compiled without one.
+    *pbOverBudget = false;
+    NSEEL_VM_setbudget(ctx, CODE_LOOP_BUDGET, OnLoopBudgetExhausted, pbOverBudget);
+}
 
-        NSEEL_VM_resetvars(m_pv_eel);
-
-        var_pv_zoom		= NSEEL_VM_regvar(m_pv_eel, "zoom");		// i/o
-	    var_pv_zoomexp  = NSEEL_VM_regvar(m_pv_eel, "zoomexp");	// i/o
-	    var_pv_rot		= NSEEL_VM_regvar(m_pv_eel, "rot");		// i/o
-	    var_pv_warp		= NSEEL_VM_regvar(m_pv_eel, "warp");		// i/o
-	    var_pv_cx		= NSEEL_VM_regvar(m_pv_eel, "cx");		// i/o
-	    var_pv_cy		= NSEEL_VM_regvar(m_pv_eel, "cy");		// i/o
-	    var_pv_dx		= NSEEL_VM_regvar(m_pv_eel, "dx");		// i/o
-	    var_pv_dy		= NSEEL_VM_regvar(m_pv_eel, "dy");		// i/o
-	    var_pv_sx		= NSEEL_VM_regvar(m_pv_eel, "sx");		// i/o
-	    var_pv_sy		= NSEEL_VM_regvar(m_pv_eel, "sy");		// i/o
-	    var_pv_time		= NSEEL_VM_regvar(m_pv_eel, "time");		// i
-	    var_pv_fps 		= NSEEL_VM_regvar(m_pv_eel, "fps");		// i
-	    var_pv_bass		= NSEEL_VM_regvar(m_pv_eel, "bass");		// i
-	    var_pv_mid		= NSEEL_VM_regvar(m_pv_eel, "mid");		// i
-	    var_pv_treb		= NSEEL_VM_regvar(m_pv_eel, "treb");		// i
-	    var_pv_bass_att	= NSEEL_VM_regvar(m_pv_eel, "bass_att");	// i
-	    var_pv_mid_att	= NSEEL_VM_regvar(m_pv_eel, "mid_att");	// i
-	    var_pv_treb_att	= NSEEL_VM_regvar(m_pv_eel, "treb_att");	// i
-	    var_pv_frame    = NSEEL_VM_regvar(m_pv_eel, "frame");
-	    var_pv_x		= NSEEL_VM_regvar(m_pv_eel, "x");			// i
-	    var_pv_y		= NSEEL_VM_regvar(m_pv_eel, "y");			// i
-	    var_pv_rad		= NSEEL_VM_regvar(m_pv_eel, "rad");		// i
-	    var_pv_ang		= NSEEL_VM_regvar(m_pv_eel, "ang");		// i
-        for (vi=0; vi<NUM_Q_VAR; vi++)
-        {
-            char buf[16];
-            sprintf(buf, "q%d", vi+1);
-            var_pv_q[vi] = NSEEL_VM_regvar(m_pv_eel, buf);
-        }
-	    var_pv_progress = NSEEL_VM_regvar(m_pv_eel, "progress");
-        var_pv_meshx    = NSEEL_VM_regvar(m_pv_eel, "meshx");
-        var_pv_meshy    = NSEEL_VM_regvar(m_pv_eel, "meshy");
-        var_pv_pixelsx  = NSEEL_VM_regvar(m_pv_eel, "pixelsx");
-        var_pv_pixelsy  = NSEEL_VM_regvar(m_pv_eel, "pixelsy");
-        var_pv_aspectx  = NSEEL_VM_regvar(m_pv_eel, "aspectx");
-        var_pv_aspecty  = NSEEL_VM_regvar(m_pv_eel, "aspecty");
-    }
+void CState::ResetLoopBudget(NSEEL_VMCTX ctx, bool* pbOverBudget)
+{
+    NSEEL_VM_resetbudget(ctx);
+    *pbOverBudget = false;
+}
+
+//--------------------------------------------------------------------------------
 
+// every VM has its own rand() generator.  with nRandSeed set in the ini, a preset's code gets
+// the same random numbers every time it loads (so runs can be compared); otherwise they differ.
+void CState::SeedRand(int flags)
+{
+    unsigned int seed = g_plugin.m_nRandSeed ? (unsigned int)g_plugin.m_nRandSeed : GetTickCount();
+
+    if (flags & RECOMPILE_PRESET_CODE)
+    {
+        NSEEL_VM_seedrand(m_pf_eel, seed);
+        NSEEL_VM_seedrand(m_pv_eel, seed + 1);
+    }
     if (flags & RECOMPILE_WAVE_CODE)
     {
         for (int i=0; i<MAX_CUSTOM_WAVES; i++)
         {
-	        NSEEL_VM_resetvars(m_wave[i].m_pf_eel);
-	        m_wave[i].var_pf_time		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "time");		// i
-	        m_wave[i].var_pf_fps 		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "fps");		// i
-	        m_wave[i].var_pf_frame      = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "frame");     // i
-	        m_wave[i].var_pf_progress   = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "progress");  // i
+            NSEEL_VM_seedrand(m_wave[i].m_pf_eel, seed + 2 + i*2);
+            NSEEL_VM_seedrand(m_wave[i].m_pp_eel, seed + 3 + i*2);
+        }
+    }
+    if (flags & RECOMPILE_SHAPE_CODE)
+    {
+        for (int i=0; i<MAX_CUSTOM_SHAPES; i++)
+            NSEEL_VM_seedrand(m_shape[i].m_pf_eel, seed + 2 + MAX_CUSTOM_WAVES*2 + i);
+    }
+}
+
+//--------------------------------------------------------------------------------
+
+// the first time, each VM gets the built-in variables registered and then snapshotted (see
+// NSEEL_VM_snapshotvars); after that, re-arming it for a preset just drops the preset's own
+// variables and copies the built-ins' values back, and the var_ pointers stay valid.
+// the VM's megabuf is freed too (its blocks go back to the pool), so every preset starts with
+// a zeroed one instead of whatever the last preset left in it.
+void CState::RegisterBuiltInVariables(int flags)
+{
+    if (flags & RECOMPILE_PRESET_CODE)
+    {
+	    NSEEL_VM_freeRAM(m_pf_eel);
+	    if (!NSEEL_VM_restorevars(m_pf_eel))
+	    {
+	        NSEEL_VM_resetvars(m_pf_eel);
+            var_pf_zoom		= NSEEL_VM_regvar(m_pf_eel, "zoom");		// i/o
+	        var_pf_zoomexp  = NSEEL_VM_regvar(m_pf_eel, "zoomexp");	// i/o
+	        var_pf_rot		= NSEEL_VM_regvar(m_pf_eel, "rot");		// i/o
+	        var_pf_warp		= NSEEL_VM_regvar(m_pf_eel, "warp");		// i/o
+	        var_pf_cx		= NSEEL_VM_regvar(m_pf_eel, "cx");		// i/o
+	        var_pf_cy		= NSEEL_VM_regvar(m_pf_eel, "cy");		// i/o
+	        var_pf_dx		= NSEEL_VM_regvar(m_pf_eel, "dx");		// i/o
+	        var_pf_dy		= NSEEL_VM_regvar(m_pf_eel, "dy");		// i/o
+	        var_pf_sx		= NSEEL_VM_regvar(m_pf_eel, "sx");		// i/o
+	        var_pf_sy		= NSEEL_VM_regvar(m_pf_eel, "sy");		// i/o
+	        var_pf_time		= NSEEL_VM_regvar(m_pf_eel, "time");		// i
+	        var_pf_fps      = NSEEL_VM_regvar(m_pf_eel, "fps");       // i
+	        var_pf_bass		= NSEEL_VM_regvar(m_pf_eel, "bass");		// i
+	        var_pf_mid		= NSEEL_VM_regvar(m_pf_eel, "mid");		// i
+	        var_pf_treb		= NSEEL_VM_regvar(m_pf_eel, "treb");		// i
+	        var_pf_bass_att	= NSEEL_VM_regvar(m_pf_eel, "bass_att");	// i
+	        var_pf_mid_att	= NSEEL_VM_regvar(m_pf_eel, "mid_att");	// i
+	        var_pf_treb_att	= NSEEL_VM_regvar(m_pf_eel, "treb_att");	// i
+	        var_pf_frame    = NSEEL_VM_regvar(m_pf_eel, "frame");
+	        var_pf_decay	= NSEEL_VM_regvar(m_pf_eel, "decay");
+	        var_pf_wave_a	= NSEEL_VM_regvar(m_pf_eel, "wave_a");
+	        var_pf_wave_r	= NSEEL_VM_regvar(m_pf_eel, "wave_r");
+	        var_pf_wave_g	= NSEEL_VM_regvar(m_pf_eel, "wave_g");
+	        var_pf_wave_b	= NSEEL_VM_regvar(m_pf_eel, "wave_b");
+	        var_pf_wave_x	= NSEEL_VM_regvar(m_pf_eel, "wave_x");
+	        var_pf_wave_y	= NSEEL_VM_regvar(m_pf_eel, "wave_y");
+	        var_pf_wave_mystery = NSEEL_VM_regvar(m_pf_eel, "wave_mystery");
+	        var_pf_wave_mode = NSEEL_VM_regvar(m_pf_eel, "wave_mode");
             for (int vi=0; vi<NUM_Q_VAR; vi++)
             {
                 char buf[16];
                 sprintf(buf, "q%d", vi+1);
-                m_wave[i].var_pf_q[vi] = NSEEL_VM_regvar(m_wave[i].m_pf_eel, buf);
+                var_pf_q[vi] = NSEEL_VM_regvar(m_pf_eel, buf);
             }
-            for (vi=0; vi<NUM_T_VAR; vi++)
-            {
-                char buf[16];
-                sprintf(buf, "t%d", vi+1);
-                m_wave[i].var_pf_t[vi] = NSEEL_VM_regvar(m_wave[i].m_pf_eel, buf);
-            }
-	        m_wave[i].var_pf_bass		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "bass");		// i
-	        m_wave[i].var_pf_mid		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "mid");		// i
-	        m_wave[i].var_pf_treb		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "treb");		// i
-	        m_wave[i].var_pf_bass_att	= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "bass_att");	// i
-	        m_wave[i].var_pf_mid_att	= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "mid_att");	// i
-	        m_wave[i].var_pf_treb_att	= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "treb_att");	// i
-	        m_wave[i].var_pf_r          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "r");         // i/o
-	        m_wave[i].var_pf_g          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "g");         // i/o
-	        m_wave[i].var_pf_b          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "b");         // i/o
-	        m_wave[i].var_pf_a          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "a");         // i/o
-            m_wave[i].var_pf_samples    = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "samples");   // i/o
-
-	        NSEEL_VM_resetvars(m_wave[i].m_pp_eel);
-	        m_wave[i].var_pp_time		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "time");		// i
-	        m_wave[i].var_pp_fps 		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "fps");		// i
-	        m_wave[i].var_pp_frame      = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "frame");     // i
-	        m_wave[i].var_pp_progress   = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "progress");  // i
-            for (vi=0; vi<NUM_Q_VAR; vi++)
+	        var_pf_progress = NSEEL_VM_regvar(m_pf_eel, "progress");
+	        var_pf_ob_size	= NSEEL_VM_regvar(m_pf_eel, "ob_size");
+	        var_pf_ob_r		= NSEEL_VM_regvar(m_pf_eel, "ob_r");
+	        var_pf_ob_g		= NSEEL_VM_regvar(m_pf_eel, "ob_g");
+	        var_pf_ob_b		= NSEEL_VM_regvar(m_pf_eel, "ob_b");
+	        var_pf_ob_a		= NSEEL_VM_regvar(m_pf_eel, "ob_a");
+	        var_pf_ib_size	= NSEEL_VM_regvar(m_pf_eel, "ib_size");
+	        var_pf_ib_r		= NSEEL_VM_regvar(m_pf_eel, "ib_r");
+	        var_pf_ib_g		= NSEEL_VM_regvar(m_pf_eel, "ib_g");
+	        var_pf_ib_b		= NSEEL_VM_regvar(m_pf_eel, "ib_b");
+	        var_pf_ib_a		= NSEEL_VM_regvar(m_pf_eel, "ib_a");
+	        var_pf_mv_x		= NSEEL_VM_regvar(m_pf_eel, "mv_x");
+	        var_pf_mv_y		= NSEEL_VM_regvar(m_pf_eel, "mv_y");
+	        var_pf_mv_dx	= NSEEL_VM_regvar(m_pf_eel, "mv_dx");
+	        var_pf_mv_dy	= NSEEL_VM_regvar(m_pf_eel, "mv_dy");
+	        var_pf_mv_l		= NSEEL_VM_regvar(m_pf_eel, "mv_l");
+	        var_pf_mv_r		= NSEEL_VM_regvar(m_pf_eel, "mv_r");
+	        var_pf_mv_g		= NSEEL_VM_regvar(m_pf_eel, "mv_g");
+	        var_pf_mv_b		= NSEEL_VM_regvar(m_pf_eel, "mv_b");
+	        var_pf_mv_a		= NSEEL_VM_regvar(m_pf_eel, "mv_a");
+	        var_pf_monitor  = NSEEL_VM_regvar(m_pf_eel, "monitor");
+	        var_pf_echo_zoom   = NSEEL_VM_regvar(m_pf_eel, "echo_zoom");
+	        var_pf_echo_alpha  = NSEEL_VM_regvar(m_pf_eel, "echo_alpha");
+	        var_pf_echo_orient = NSEEL_VM_regvar(m_pf_eel, "echo_orient");
+            var_pf_wave_usedots  = NSEEL_VM_regvar(m_pf_eel, "wave_usedots");
+            var_pf_wave_thick    = NSEEL_VM_regvar(m_pf_eel, "wave_thick");
+            var_pf_wave_additive = NSEEL_VM_regvar(m_pf_eel, "wave_additive");
+            var_pf_wave_brighten = NSEEL_VM_regvar(m_pf_eel, "wave_brighten");
+            var_pf_darken_center = NSEEL_VM_regvar(m_pf_eel, "darken_center");
+            var_pf_gamma         = NSEEL_VM_regvar(m_pf_eel, "gamma");
+            var_pf_wrap          = NSEEL_VM_regvar(m_pf_eel, "wrap");
+            var_pf_invert        = NSEEL_VM_regvar(m_pf_eel, "invert");
+            var_pf_brighten      = NSEEL_VM_regvar(m_pf_eel, "brighten");
+            var_pf_darken        = NSEEL_VM_regvar(m_pf_eel, "darken");
+            var_pf_solarize      = NSEEL_VM_regvar(m_pf_eel, "solarize");
+            var_pf_meshx         = NSEEL_VM_regvar(m_pf_eel, "meshx");
+            var_pf_meshy         = NSEEL_VM_regvar(m_pf_eel, "meshy");
+            var_pf_pixelsx       = NSEEL_VM_regvar(m_pf_eel, "pixelsx");
+            var_pf_pixelsy       = NSEEL_VM_regvar(m_pf_eel, "pixelsy");
+            var_pf_aspectx       = NSEEL_VM_regvar(m_pf_eel, "aspectx");
+            var_pf_aspecty       = NSEEL_VM_regvar(m_pf_eel, "aspecty");
+            var_pf_blur1min      = NSEEL_VM_regvar(m_pf_eel, "blur1_min");
+            var_pf_blur2min      = NSEEL_VM_regvar(m_pf_eel, "blur2_min");
+            var_pf_blur3min      = NSEEL_VM_regvar(m_pf_eel, "blur3_min");
+            var_pf_blur1max      = NSEEL_VM_regvar(m_pf_eel, "blur1_max");
+            var_pf_blur2max      = NSEEL_VM_regvar(m_pf_eel, "blur2_max");
+            var_pf_blur3max      = NSEEL_VM_regvar(m_pf_eel, "blur3_max");
+            var_pf_blur1_edge_darken = NSEEL_VM_regvar(m_pf_eel, "blur1_edge_darken");
+	        NSEEL_VM_snapshotvars(m_pf_eel);
+	    }
+
+	    // this is the list of variables that can be used for a PER-VERTEX calculation:
+	    // ('vertex' meaning a vertex on the mesh) (as opposed to a once-per-frame calculation)
+
+        NSEEL_VM_freeRAM(m_pv_eel);
+        if (!NSEEL_VM_restorevars(m_pv_eel))
+        {
+            NSEEL_VM_resetvars(m_pv_eel);
+
+            var_pv_zoom		= NSEEL_VM_regvar(m_pv_eel, "zoom");		// i/o
+	        var_pv_zoomexp  = NSEEL_VM_regvar(m_pv_eel, "zoomexp");	// i/o
+	        var_pv_rot		= NSEEL_VM_regvar(m_pv_eel, "rot");		// i/o
+	        var_pv_warp		= NSEEL_VM_regvar(m_pv_eel, "warp");		// i/o
+	        var_pv_cx		= NSEEL_VM_regvar(m_pv_eel, "cx");		// i/o
+	        var_pv_cy		= NSEEL_VM_regvar(m_pv_eel, "cy");		// i/o
+	        var_pv_dx		= NSEEL_VM_regvar(m_pv_eel, "dx");		// i/o
+	        var_pv_dy		= NSEEL_VM_regvar(m_pv_eel, "dy");		// i/o
+	        var_pv_sx		= NSEEL_VM_regvar(m_pv_eel, "sx");		// i/o
+	        var_pv_sy		= NSEEL_VM_regvar(m_pv_eel, "sy");		// i/o
+	        var_pv_time		= NSEEL_VM_regvar(m_pv_eel, "time");		// i
+	        var_pv_fps 		= NSEEL_VM_regvar(m_pv_eel, "fps");		// i
+	        var_pv_bass		= NSEEL_VM_regvar(m_pv_eel, "bass");		// i
+	        var_pv_mid		= NSEEL_VM_regvar(m_pv_eel, "mid");		// i
+	        var_pv_treb		= NSEEL_VM_regvar(m_pv_eel, "treb");		// i
+	        var_pv_bass_att	= NSEEL_VM_regvar(m_pv_eel, "bass_att");	// i
+	        var_pv_mid_att	= NSEEL_VM_regvar(m_pv_eel, "mid_att");	// i
+	        var_pv_treb_att	= NSEEL_VM_regvar(m_pv_eel, "treb_att");	// i
+	        var_pv_frame    = NSEEL_VM_regvar(m_pv_eel, "frame");
+	        var_pv_x		= NSEEL_VM_regvar(m_pv_eel, "x");			// i
+	        var_pv_y		= NSEEL_VM_regvar(m_pv_eel, "y");			// i
+	        var_pv_rad		= NSEEL_VM_regvar(m_pv_eel, "rad");		// i
+	        var_pv_ang		= NSEEL_VM_regvar(m_pv_eel, "ang");		// i
+            for (int vi=0; vi<NUM_Q_VAR; vi++)
             {
                 char buf[16];
                 sprintf(buf, "q%d", vi+1);
-                m_wave[i].var_pp_q[vi] = NSEEL_VM_regvar(m_wave[i].m_pp_eel, buf);
-            }
-            for (vi=0; vi<NUM_T_VAR; vi++)
-            {
-                char buf[16];
-                sprintf(buf, "t%d", vi+1);
-                m_wave[i].var_pp_t[vi] = NSEEL_VM_regvar(m_wave[i].m_pp_eel, buf);
+                var_pv_q[vi] = NSEEL_VM_regvar(m_pv_eel, buf);
             }
-	        m_wave[i].var_pp_bass		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "bass");		// i
-	        m_wave[i].var_pp_mid		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "mid");		// i
-	        m_wave[i].var_pp_treb		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "treb");		// i
-	        m_wave[i].var_pp_bass_att	= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "bass_att");	// i
-	        m_wave[i].var_pp_mid_att	= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "mid_att");	// i
-	        m_wave[i].var_pp_treb_att	= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "treb_att");	// i
-            m_wave[i].var_pp_sample     = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "sample");    // i
-            m_wave[i].var_pp_value1     = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "value1");    // i
-            m_wave[i].var_pp_value2     = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "value2");    // i
-	        m_wave[i].var_pp_x          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "x");         // i/o
-	        m_wave[i].var_pp_y          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "y");         // i/o
-	        m_wave[i].var_pp_r          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "r");         // i/o
-	        m_wave[i].var_pp_g          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "g");         // i/o
-	        m_wave[i].var_pp_b          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "b");         // i/o
-	        m_wave[i].var_pp_a          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "a");         // i/o
+	        var_pv_progress = NSEEL_VM_regvar(m_pv_eel, "progress");
+            var_pv_meshx    = NSEEL_VM_regvar(m_pv_eel, "meshx");
+            var_pv_meshy    = NSEEL_VM_regvar(m_pv_eel, "meshy");
+            var_pv_pixelsx  = NSEEL_VM_regvar(m_pv_eel, "pixelsx");
+            var_pv_pixelsy  = NSEEL_VM_regvar(m_pv_eel, "pixelsy");
+            var_pv_aspectx  = NSEEL_VM_regvar(m_pv_eel, "aspectx");
+            var_pv_aspecty  = NSEEL_VM_regvar(m_pv_eel, "aspecty");
+            NSEEL_VM_snapshotvars(m_pv_eel);
+        }
+    }
+
+    if (flags & RECOMPILE_WAVE_CODE)
+    {
+        for (int i=0; i<MAX_CUSTOM_WAVES; i++)
+        {
+	        NSEEL_VM_freeRAM(m_wave[i].m_pf_eel);
+	        if (!NSEEL_VM_restorevars(m_wave[i].m_pf_eel))
+	        {
+	            NSEEL_VM_resetvars(m_wave[i].m_pf_eel);
+	            m_wave[i].var_pf_time		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "time");		// i
+	            m_wave[i].var_pf_fps 		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "fps");		// i
+	            m_wave[i].var_pf_frame      = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "frame");     // i
+	            m_wave[i].var_pf_progress   = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "progress");  // i
+                for (int vi=0; vi<NUM_Q_VAR; vi++)
+                {
+                    char buf[16];
+                    sprintf(buf, "q%d", vi+1);
+                    m_wave[i].var_pf_q[vi] = NSEEL_VM_regvar(m_wave[i].m_pf_eel, buf);
+                }
+                for (vi=0; vi<NUM_T_VAR; vi++)
+                {
+                    char buf[16];
+                    sprintf(buf, "t%d", vi+1);
+                    m_wave[i].var_pf_t[vi] = NSEEL_VM_regvar(m_wave[i].m_pf_eel, buf);
+                }
+	            m_wave[i].var_pf_bass		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "bass");		// i
+	            m_wave[i].var_pf_mid		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "mid");		// i
+	            m_wave[i].var_pf_treb		= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "treb");		// i
+	            m_wave[i].var_pf_bass_att	= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "bass_att");	// i
+	            m_wave[i].var_pf_mid_att	= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "mid_att");	// i
+	            m_wave[i].var_pf_treb_att	= NSEEL_VM_regvar(m_wave[i].m_pf_eel, "treb_att");	// i
+	            m_wave[i].var_pf_r          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "r");         // i/o
+	            m_wave[i].var_pf_g          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "g");         // i/o
+	            m_wave[i].var_pf_b          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "b");         // i/o
+	            m_wave[i].var_pf_a          = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "a");         // i/o
+                m_wave[i].var_pf_samples    = NSEEL_VM_regvar(m_wave[i].m_pf_eel, "samples");   // i/o
+	            NSEEL_VM_snapshotvars(m_wave[i].m_pf_eel);
+	        }
+
+	        NSEEL_VM_freeRAM(m_wave[i].m_pp_eel);
+	        if (!NSEEL_VM_restorevars(m_wave[i].m_pp_eel))
+	        {
+	            NSEEL_VM_resetvars(m_wave[i].m_pp_eel);
+	            m_wave[i].var_pp_time		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "time");		// i
+	            m_wave[i].var_pp_fps 		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "fps");		// i
+	            m_wave[i].var_pp_frame      = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "frame");     // i
+	            m_wave[i].var_pp_progress   = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "progress");  // i
+                for (int vi=0; vi<NUM_Q_VAR; vi++)
+                {
+                    char buf[16];
+                    sprintf(buf, "q%d", vi+1);
+                    m_wave[i].var_pp_q[vi] = NSEEL_VM_regvar(m_wave[i].m_pp_eel, buf);
+                }
+                for (vi=0; vi<NUM_T_VAR; vi++)
+                {
+                    char buf[16];
+                    sprintf(buf, "t%d", vi+1);
+                    m_wave[i].var_pp_t[vi] = NSEEL_VM_regvar(m_wave[i].m_pp_eel, buf);
+                }
+	            m_wave[i].var_pp_bass		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "bass");		// i
+	            m_wave[i].var_pp_mid		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "mid");		// i
+	            m_wave[i].var_pp_treb		= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "treb");		// i
+	            m_wave[i].var_pp_bass_att	= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "bass_att");	// i
+	            m_wave[i].var_pp_mid_att	= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "mid_att");	// i
+	            m_wave[i].var_pp_treb_att	= NSEEL_VM_regvar(m_wave[i].m_pp_eel, "treb_att");	// i
+                m_wave[i].var_pp_sample     = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "sample");    // i
+                m_wave[i].var_pp_value1     = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "value1");    // i
+                m_wave[i].var_pp_value2     = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "value2");    // i
+	            m_wave[i].var_pp_x          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "x");         // i/o
+	            m_wave[i].var_pp_y          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "y");         // i/o
+	            m_wave[i].var_pp_r          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "r");         // i/o
+	            m_wave[i].var_pp_g          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "g");         // i/o
+	            m_wave[i].var_pp_b          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "b");         // i/o
+	            m_wave[i].var_pp_a          = NSEEL_VM_regvar(m_wave[i].m_pp_eel, "a");         // i/o
+	            NSEEL_VM_snapshotvars(m_wave[i].m_pp_eel);
+	        }
         }
     }
 
@@ -462,53 +543,58 @@ void CState::RegisterBuiltInVariables(int flags)
     {
         for (int i=0; i<MAX_CUSTOM_SHAPES; i++)
         {
-	        NSEEL_VM_resetvars(m_shape[i].m_pf_eel);
-	        m_shape[i].var_pf_time		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "time");		// i
-	        m_shape[i].var_pf_fps 		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "fps");		// i
-	        m_shape[i].var_pf_frame      = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "frame");     // i
-	        m_shape[i].var_pf_progress   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "progress");  // i
-            for (int vi=0; vi<NUM_Q_VAR; vi++)
-            {
-                char buf[16];
-                sprintf(buf, "q%d", vi+1);
-                m_shape[i].var_pf_q[vi] = NSEEL_VM_regvar(m_shape[i].m_pf_eel, buf);
-            }
-            for (vi=0; vi<NUM_T_VAR; vi++)
-            {
-                char buf[16];
-                sprintf(buf, "t%d", vi+1);
-                m_shape[i].var_pf_t[vi] = NSEEL_VM_regvar(m_shape[i].m_pf_eel, buf);
-            }
-	        m_shape[i].var_pf_bass		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "bass");		// i
-	        m_shape[i].var_pf_mid		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "mid");		// i
-	        m_shape[i].var_pf_treb		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "treb");		// i
-	        m_shape[i].var_pf_bass_att	= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "bass_att");	// i
-	        m_shape[i].var_pf_mid_att	= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "mid_att");	// i
-	        m_shape[i].var_pf_treb_att	= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "treb_att");	// i
-	        m_shape[i].var_pf_x          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "x");         // i/o
-	        m_shape[i].var_pf_y          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "y");         // i/o
-	        m_shape[i].var_pf_rad        = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "rad");         // i/o
-	        m_shape[i].var_pf_ang        = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "ang");         // i/o
-	        m_shape[i].var_pf_tex_ang    = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "tex_ang");         // i/o
-	        m_shape[i].var_pf_tex_zoom   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "tex_zoom");         // i/o
-	        m_shape[i].var_pf_sides      = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "sides");         // i/o
-	        m_shape[i].var_pf_textured   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "textured");         // i/o
-	        m_shape[i].var_pf_instance   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "instance");         // i/o
-	        m_shape[i].var_pf_instances  = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "num_inst");         // i/o
-	        m_shape[i].var_pf_additive   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "additive");         // i/o
-	        m_shape[i].var_pf_thick      = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "thick");         // i/o
-	        m_shape[i].var_pf_r          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "r");         // i/o
-	        m_shape[i].var_pf_g          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "g");         // i/o
-	        m_shape[i].var_pf_b          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "b");         // i/o
-	        m_shape[i].var_pf_a          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "a");         // i/o
-	        m_shape[i].var_pf_r2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "r2");         // i/o
-	        m_shape[i].var_pf_g2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "g2");         // i/o
-	        m_shape[i].var_pf_b2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "b2");         // i/o
-	        m_shape[i].var_pf_a2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "a2");         // i/o
-	        m_shape[i].var_pf_border_r   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_r");         // i/o
-	        m_shape[i].var_pf_border_g   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_g");         // i/o
-	        m_shape[i].var_pf_border_b   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_b");         // i/o
-	        m_shape[i].var_pf_border_a   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_a");         // i/o
+	        NSEEL_VM_freeRAM(m_shape[i].m_pf_eel);
+	        if (!NSEEL_VM_restorevars(m_shape[i].m_pf_eel))
+	        {
+	            NSEEL_VM_resetvars(m_shape[i].m_pf_eel);
+	            m_shape[i].var_pf_time		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "time");		// i
+	            m_shape[i].var_pf_fps 		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "fps");		// i
+	            m_shape[i].var_pf_frame      = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "frame");     // i
+	            m_shape[i].var_pf_progress   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "progress");  // i
+                for (int vi=0; vi<NUM_Q_VAR; vi++)
+                {
+                    char buf[16];
+                    sprintf(buf, "q%d", vi+1);
+                    m_shape[i].var_pf_q[vi] = NSEEL_VM_regvar(m_shape[i].m_pf_eel, buf);
+                }
+                for (vi=0; vi<NUM_T_VAR; vi++)
+                {
+                    char buf[16];
+                    sprintf(buf, "t%d", vi+1);
+                    m_shape[i].var_pf_t[vi] = NSEEL_VM_regvar(m_shape[i].m_pf_eel, buf);
+                }
+	            m_shape[i].var_pf_bass		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "bass");		// i
+	            m_shape[i].var_pf_mid		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "mid");		// i
+	            m_shape[i].var_pf_treb		= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "treb");		// i
+	            m_shape[i].var_pf_bass_att	= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "bass_att");	// i
+	            m_shape[i].var_pf_mid_att	= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "mid_att");	// i
+	            m_shape[i].var_pf_treb_att	= NSEEL_VM_regvar(m_shape[i].m_pf_eel, "treb_att");	// i
+	            m_shape[i].var_pf_x          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "x");         // i/o
+	            m_shape[i].var_pf_y          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "y");         // i/o
+	            m_shape[i].var_pf_rad        = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "rad");         // i/o
+	            m_shape[i].var_pf_ang        = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "ang");         // i/o
+	            m_shape[i].var_pf_tex_ang    = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "tex_ang");         // i/o
+	            m_shape[i].var_pf_tex_zoom   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "tex_zoom");         // i/o
+	            m_shape[i].var_pf_sides      = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "sides");         // i/o
+	            m_shape[i].var_pf_textured   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "textured");         // i/o
+	            m_shape[i].var_pf_instance   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "instance");         // i/o
+	            m_shape[i].var_pf_instances  = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "num_inst");         // i/o
+	            m_shape[i].var_pf_additive   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "additive");         // i/o
+	            m_shape[i].var_pf_thick      = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "thick");         // i/o
+	            m_shape[i].var_pf_r          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "r");         // i/o
+	            m_shape[i].var_pf_g          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "g");         // i/o
+	            m_shape[i].var_pf_b          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "b");         // i/o
+	            m_shape[i].var_pf_a          = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "a");         // i/o
+	            m_shape[i].var_pf_r2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "r2");         // i/o
+	            m_shape[i].var_pf_g2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "g2");         // i/o
+	            m_shape[i].var_pf_b2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "b2");         // i/o
+	            m_shape[i].var_pf_a2         = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "a2");         // i/o
+	            m_shape[i].var_pf_border_r   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_r");         // i/o
+	            m_shape[i].var_pf_border_g   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_g");         // i/o
+	            m_shape[i].var_pf_border_b   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_b");         // i/o
+	            m_shape[i].var_pf_border_a   = NSEEL_VM_regvar(m_shape[i].m_pf_eel, "border_a");         // i/o
+	            NSEEL_VM_snapshotvars(m_shape[i].m_pf_eel);
+	        }
         }
     }
 }
@@ -1469,6 +1555,37 @@ void CState::GenDefaultCompShader()
         g_plugin.GenCompPShaderText(m_szCompShadersText, m_fGammaAdj.eval(-1), m_fVideoEchoAlpha.eval(-1), m_fVideoEchoZoom.eval(-1), m_nVideoEchoOrientation, m_fShader.eval(-1), m_bBrighten, m_bDarken, m_bSolarize, m_bInvert);
 }
 
+int CState::AllocPpClones(int nWanted)
+{
+    // the clones are made the first time they're needed, and live as long as the code.
+    // code that is stateful from one vertex to the next (or writes megabuf) gets none.
+    if (!m_pp_codehandle || m_nPpClones < 0)
+        return 0;
+    nWanted = min(nWanted, MAX_WORKER_THREADS);
+    while (m_nPpClones < nWanted)
+    {
+        NSEEL_KERNELCLONE clone = NSEEL_code_kernel_clone(m_pp_codehandle);
+        if (!clone)
+            break;
+        m_pp_clone[m_nPpClones++] = clone;
+    }
+    if (m_nPpClones == 0)
+    {
+        m_nPpClones = -1;
+        return 0;
+    }
+    return min(nWanted, m_nPpClones);
+}
+
+void CState::FreePpClones(bool bFree)
+{
+    // (bFree is false when the clones belong to the CState this one was copied from)
+    if (bFree)
+        for (int i=0; i<m_nPpClones; i++)
+            NSEEL_code_kernel_clone_free(m_pp_clone[i]);
+    m_nPpClones = 0;
+}
+
 void CState::FreeVarsAndCode(bool bFree)
 {
 	// free the compiled expressions
@@ -1480,6 +1597,7 @@ void CState::FreeVarsAndCode(bool bFree)
 	}
 	if (m_pp_codehandle)
 	{
+        FreePpClones(bFree);
         if (bFree)
     		NSEEL_code_free(m_pp_codehandle);
 		m_pp_codehandle = NULL;
@@ -1551,6 +1669,25 @@ void CState::StripLinefeedCharsAndComments(char *src, char *dest)
 	dest[i2] = 0;
 }
 
+// true if the code (with its comments stripped) calls the VM's own megabuf().  EEL function names
+// aren't case sensitive, and gmegabuf() is the shared one, so a plain strstr() won't do.
+static bool CallsMegabuf(const char *code)
+{
+    for (const char *p = code; *p; p++)
+    {
+        if (_strnicmp(p, "megabuf", 7) != 0)
+            continue;
+        if (p > code && (isalnum((unsigned char)p[-1]) || p[-1] == '_' || p[-1] == '.'))
+            continue;
+        const char *q = p + 7;
+        while (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n')
+            q++;
+        if (*q == '(')
+            return true;
+    }
+    return false;
+}
+
 void CState::RecompileExpressions(int flags, int bReInit)
 {
     // before we get started, if we redo the init code for the preset, we have to redo
@@ -1571,6 +1708,7 @@ void CState::RecompileExpressions(int flags, int bReInit)
 	    }
 	    if (m_pp_codehandle)
 	    {
+		    FreePpClones();
 		    NSEEL_code_free(m_pp_codehandle);
 		    m_pp_codehandle = NULL;
 	    }
@@ -1612,6 +1750,7 @@ void CState::RecompileExpressions(int flags, int bReInit)
 	if (bReInit)
 	{
 		RegisterBuiltInVariables(flags);
+		SeedRand(flags);
 	}
 
 	// QUICK FIX: if the code strings ONLY have spaces and linefeeds, erase them,
@@ -1663,12 +1802,19 @@ void CState::RecompileExpressions(int flags, int bReInit)
 
         if (flags & RECOMPILE_PRESET_CODE)
         {
+            // megabuf blocks are otherwise allocated (and paged in) the first time the code
+            // touches them, which would be in the middle of the first frames.  the VMs' blocks
+            // were just freed (RegisterBuiltInVariables), so these usually come back from the pool.
+
             // 1. compile AND EXECUTE preset init code
 		    StripLinefeedCharsAndComments(m_szPerFrameInit, buf);
+            if (bReInit && CallsMegabuf(buf))
+                NSEEL_VM_prefaultRAM(m_pf_eel, NSEEL_RAM_ITEMSPERBLOCK);
 	        if (buf[0] && bReInit)
 	        {
 		        NSEEL_CODEHANDLE	pf_codehandle_init;
 
+                NSEEL_VM_setbudget(m_pf_eel, 0, NULL, NULL);
 			    if ( ! (pf_codehandle_init = NSEEL_code_compile(m_pf_eel, buf)))
 			    {
                     wchar_t buf[1024];
@@ -1698,8 +1844,11 @@ void CState::RecompileExpressions(int flags, int bReInit)
 
             // 2. compile preset per-frame code
             StripLinefeedCharsAndComments(m_szPerFrameExpr, buf);
+            if (bReInit && CallsMegabuf(buf))
+                NSEEL_VM_prefaultRAM(m_pf_eel, NSEEL_RAM_ITEMSPERBLOCK);
 	        if (buf[0])
 	        {
+                SetLoopBudget(m_pf_eel, &m_bPfOverBudget);
 			    if ( ! (m_pf_codehandle = NSEEL_code_compile(m_pf_eel, buf)))
 			    {
                     wchar_t buf[1024];
@@ -1710,9 +1859,16 @@ void CState::RecompileExpressions(int flags, int bReInit)
 
             // 3. compile preset per-pixel code
 		    StripLinefeedCharsAndComments(m_szPerPixelExpr, buf);
+            if (bReInit && CallsMegabuf(buf))
+                NSEEL_VM_prefaultRAM(m_pv_eel, NSEEL_RAM_ITEMSPERBLOCK);
 	        if (buf[0])
 	        {
-			    if ( ! (m_pp_codehandle = NSEEL_code_compile(m_pv_eel, buf)))
+			    EEL_F *lanevars[NUM_PV_LANES] = {
+				    var_pv_x, var_pv_y, var_pv_rad, var_pv_ang,
+				    var_pv_zoom, var_pv_zoomexp, var_pv_rot, var_pv_warp,
+				    var_pv_cx, var_pv_cy, var_pv_dx, var_pv_dy, var_pv_sx, var_pv_sy };
+                SetLoopBudget(m_pv_eel, &m_bPvOverBudget);
+			    if ( ! (m_pp_codehandle = NSEEL_code_compile_kernel(m_pv_eel, buf, 0, lanevars, NUM_PV_LANES, NUM_PV_LANES - PV_LANE_ZOOM)))
 			    {
                     wchar_t buf[1024];
 				    swprintf(buf, wasabiApiLangString(IDS_WARNING_PRESET_X_ERROR_IN_PER_VERTEX_CODE), m_szDesc);
@@ -1734,6 +1890,7 @@ void CState::RecompileExpressions(int flags, int bReInit)
 		            #ifndef _NO_EXPR_
 		            {
 		                NSEEL_CODEHANDLE	codehandle_temp;
+                        NSEEL_VM_setbudget(m_wave[i].m_pf_eel, 0, NULL, NULL);
 			            if ( ! (codehandle_temp = NSEEL_code_compile(m_wave[i].m_pf_eel, buf)))
 			            {
                             wchar_t buf[1024];
@@ -1771,6 +1928,7 @@ void CState::RecompileExpressions(int flags, int bReInit)
 	            if (buf[0])
                 {
 		            #ifndef _NO_EXPR_
+                        SetLoopBudget(m_wave[i].m_pf_eel, &m_wave[i].m_bPfOverBudget);
 			            if ( ! (m_wave[i].m_pf_codehandle = NSEEL_code_compile(m_wave[i].m_pf_eel, buf)))
 			            {
                             wchar_t buf[1024];
@@ -1784,6 +1942,7 @@ void CState::RecompileExpressions(int flags, int bReInit)
 		        StripLinefeedCharsAndComments(m_wave[i].m_szPerPoint, buf);
 	            if (buf[0])
                 {
+                    SetLoopBudget(m_wave[i].m_pp_eel, &m_wave[i].m_bPpOverBudget);
 			        if ( ! (m_wave[i].m_pp_codehandle = NSEEL_code_compile(m_wave[i].m_pp_eel, buf)))
 			        {
                         wchar_t buf[1024];
@@ -1805,6 +1964,7 @@ void CState::RecompileExpressions(int flags, int bReInit)
 		            #ifndef _NO_EXPR_
 		            {
 		                NSEEL_CODEHANDLE	codehandle_temp;
+                        NSEEL_VM_setbudget(m_shape[i].m_pf_eel, 0, NULL, NULL);
 			            if ( ! (codehandle_temp = NSEEL_code_compile(m_shape[i].m_pf_eel, buf)))
 			            {
                             wchar_t buf[1024];
@@ -1842,6 +2002,7 @@ void CState::RecompileExpressions(int flags, int bReInit)
 	            if (buf[0])
                 {
 		            #ifndef _NO_EXPR_
+                        SetLoopBudget(m_shape[i].m_pf_eel, &m_shape[i].m_bPfOverBudget);
 			            if ( ! (m_shape[i].m_pf_codehandle = NSEEL_code_compile(m_shape[i].m_pf_eel, buf)))
 			            {
                             wchar_t buf[1024];
@@ -40,6 +40,7 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //#include "evallib/eval.h"
 #include "../ns-eel2/ns-eel.h"
 #include "md_defines.h"
+#include "workerpool.h"
 
 // flags for CState::RecompileExpressions():
 #define RECOMPILE_PRESET_CODE  1
@@ -49,6 +50,21 @@ OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define NUM_Q_VAR 32
 #define NUM_T_VAR 8
 
+// loop iterations (see NSEEL_VM_setbudget) that each piece of a preset's code - the per-frame code, the
+// per-vertex code, one custom wave's per-point code, etc. - gets per frame. init code isn't limited.
+#define CODE_LOOP_BUDGET 1000000
+
+// per-vertex variables that differ from vertex to vertex, in the order they're
+// passed to NSEEL_code_compile_kernel() (see CPlugin::ComputeGridAlphaValues).
+// PV_LANE_ZOOM and up start out as the per-frame values, the same for every vertex.
+enum
+{
+    PV_LANE_X, PV_LANE_Y, PV_LANE_RAD, PV_LANE_ANG,
+    PV_LANE_ZOOM, PV_LANE_ZOOMEXP, PV_LANE_ROT, PV_LANE_WARP,
+    PV_LANE_CX, PV_LANE_CY, PV_LANE_DX, PV_LANE_DY, PV_LANE_SX, PV_LANE_SY,
+    NUM_PV_LANES
+};
+
 #define MAX_BIGSTRING_LEN    32768
 
 class CBlendableFloat
@@ -117,41 +133,42 @@ public:
     //char  m_szPerPoint[MAX_BIGSTRING_LEN];
     NSEEL_CODEHANDLE m_pf_codehandle;
     //int   m_pp_codehandle;
+    bool  m_bPfOverBudget;  // ran out of CODE_LOOP_BUDGET this frame
 
 
 	// for per-frame expression evaluation:
 		NSEEL_VMCTX m_pf_eel;
-	double *var_pf_time, *var_pf_fps;
-	double *var_pf_frame;
-	double *var_pf_progress;
+	EEL_F *var_pf_time, *var_pf_fps;
+	EEL_F *var_pf_frame;
+	EEL_F *var_pf_progress;
 	//double *var_pf_q1, *var_pf_q2, *var_pf_q3, *var_pf_q4, *var_pf_q5, *var_pf_q6, *var_pf_q7, *var_pf_q8;
 	//double *var_pf_t1, *var_pf_t2, *var_pf_t3, *var_pf_t4, *var_pf_t5, *var_pf_t6, *var_pf_t7, *var_pf_t8;
-    double* var_pf_q[NUM_Q_VAR];
-    double* var_pf_t[NUM_T_VAR];
-	double *var_pf_bass, *var_pf_mid, *var_pf_treb, *var_pf_bass_att, *var_pf_mid_att, *var_pf_treb_att;
-	double *var_pf_r, *var_pf_g, *var_pf_b, *var_pf_a;
-	double *var_pf_r2, *var_pf_g2, *var_pf_b2, *var_pf_a2;
-	double *var_pf_border_r, *var_pf_border_g, *var_pf_border_b, *var_pf_border_a;
-    double *var_pf_x, *var_pf_y, *var_pf_rad, *var_pf_ang;
-    double *var_pf_sides, *var_pf_textured, *var_pf_additive, *var_pf_thick, *var_pf_instances, *var_pf_instance;
-    double *var_pf_tex_zoom, *var_pf_tex_ang;
+    EEL_F* var_pf_q[NUM_Q_VAR];
+    EEL_F* var_pf_t[NUM_T_VAR];
+	EEL_F *var_pf_bass, *var_pf_mid, *var_pf_treb, *var_pf_bass_att, *var_pf_mid_att, *var_pf_treb_att;
+	EEL_F *var_pf_r, *var_pf_g, *var_pf_b, *var_pf_a;
+	EEL_F *var_pf_r2, *var_pf_g2, *var_pf_b2, *var_pf_a2;
+	EEL_F *var_pf_border_r, *var_pf_border_g, *var_pf_border_b, *var_pf_border_a;
+    EEL_F *var_pf_x, *var_pf_y, *var_pf_rad, *var_pf_ang;
+    EEL_F *var_pf_sides, *var_pf_textured, *var_pf_additive, *var_pf_thick, *var_pf_instances, *var_pf_instance;
+    EEL_F *var_pf_tex_zoom, *var_pf_tex_ang;
 
 	// for per-point expression evaluation:
     /*
 		NSEEL_VMCTX m_pp_eel;
-	double *var_pp_time, *var_pp_fps;
-	double *var_pp_frame;
-	double *var_pp_progress;
-	double *var_pp_q1, *var_pp_q2, *var_pp_q3, *var_pp_q4, *var_pp_q5, *var_pp_q6, *var_pp_q7, *var_pp_q8;
-	double *var_pp_t1, *var_pp_t2, *var_pp_t3, *var_pp_t4, *var_pp_t5, *var_pp_t6, *var_pp_t7, *var_pp_t8;
-	double *var_pp_bass, *var_pp_mid, *var_pp_treb, *var_pp_bass_att, *var_pp_mid_att, *var_pp_treb_att;
-	double *var_pp_r, *var_pp_g, *var_pp_b, *var_pp_a;
-	double *var_pp_r2, *var_pp_g2, *var_pp_b2, *var_pp_a2;
-	double *var_pp_border_r, *var_pp_border_g, *var_pp_border_b, *var_pp_border_a;
-    double *var_pp_x, *var_pp_y, *var_pp_rad, *var_pp_ang, *var_pp_sides;
+	EEL_F *var_pp_time, *var_pp_fps;
+	EEL_F *var_pp_frame;
+	EEL_F *var_pp_progress;
+	EEL_F *var_pp_q1, *var_pp_q2, *var_pp_q3, *var_pp_q4, *var_pp_q5, *var_pp_q6, *var_pp_q7, *var_pp_q8;
+	EEL_F *var_pp_t1, *var_pp_t2, *var_pp_t3, *var_pp_t4, *var_pp_t5, *var_pp_t6, *var_pp_t7, *var_pp_t8;
+	EEL_F *var_pp_bass, *var_pp_mid, *var_pp_treb, *var_pp_bass_att, *var_pp_mid_att, *var_pp_treb_att;
+	EEL_F *var_pp_r, *var_pp_g, *var_pp_b, *var_pp_a;
+	EEL_F *var_pp_r2, *var_pp_g2, *var_pp_b2, *var_pp_a2;
+	EEL_F *var_pp_border_r, *var_pp_border_g, *var_pp_border_b, *var_pp_border_a;
+    EEL_F *var_pp_x, *var_pp_y, *var_pp_rad, *var_pp_ang, *var_pp_sides;
     */
 
-	double t_values_after_init_code[NUM_T_VAR];
+	EEL_F t_values_after_init_code[NUM_T_VAR];
 };
 
 class CWave
@@ -176,34 +193,36 @@ public:
     char  m_szPerPoint[MAX_BIGSTRING_LEN];
     NSEEL_CODEHANDLE   m_pf_codehandle;
     NSEEL_CODEHANDLE   m_pp_codehandle;
+    bool               m_bPfOverBudget;  // ran out of CODE_LOOP_BUDGET this frame
+    bool               m_bPpOverBudget;
 
 	// for per-frame expression evaluation:
 		NSEEL_VMCTX m_pf_eel;
-	double *var_pf_time, *var_pf_fps;
-	double *var_pf_frame;
-	double *var_pf_progress;
+	EEL_F *var_pf_time, *var_pf_fps;
+	EEL_F *var_pf_frame;
+	EEL_F *var_pf_progress;
 	//double *var_pf_q1, *var_pf_q2, *var_pf_q3, *var_pf_q4, *var_pf_q5, *var_pf_q6, *var_pf_q7, *var_pf_q8;
 	//double *var_pf_t1, *var_pf_t2, *var_pf_t3, *var_pf_t4, *var_pf_t5, *var_pf_t6, *var_pf_t7, *var_pf_t8;
-    double* var_pf_q[NUM_Q_VAR];
-    double* var_pf_t[NUM_T_VAR];
-	double *var_pf_bass, *var_pf_mid, *var_pf_treb, *var_pf_bass_att, *var_pf_mid_att, *var_pf_treb_att;
-	double *var_pf_r, *var_pf_g, *var_pf_b, *var_pf_a;
-    double *var_pf_samples;
+    EEL_F* var_pf_q[NUM_Q_VAR];
+    EEL_F* var_pf_t[NUM_T_VAR];
+	EEL_F *var_pf_bass, *var_pf_mid, *var_pf_treb, *var_pf_bass_att, *var_pf_mid_att, *var_pf_treb_att;
+	EEL_F *var_pf_r, *var_pf_g, *var_pf_b, *var_pf_a;
+    EEL_F *var_pf_samples;
 
 	// for per-point expression evaluation:
 		NSEEL_VMCTX m_pp_eel;
-	double *var_pp_time, *var_pp_fps;
-	double *var_pp_frame;
-	double *var_pp_progress;
+	EEL_F *var_pp_time, *var_pp_fps;
+	EEL_F *var_pp_frame;
+	EEL_F *var_pp_progress;
 	//double *var_pp_q1, *var_pp_q2, *var_pp_q3, *var_pp_q4, *var_pp_q5, *var_pp_q6, *var_pp_q7, *var_pp_q8;
 	//double *var_pp_t1, *var_pp_t2, *var_pp_t3, *var_pp_t4, *var_pp_t5, *var_pp_t6, *var_pp_t7, *var_pp_t8;
-    double* var_pp_q[NUM_Q_VAR];
-    double* var_pp_t[NUM_T_VAR];
-	double *var_pp_bass, *var_pp_mid, *var_pp_treb, *var_pp_bass_att, *var_pp_mid_att, *var_pp_treb_att;
-    double *var_pp_sample, *var_pp_value1, *var_pp_value2;
-	double *var_pp_x, *var_pp_y, *var_pp_r, *var_pp_g, *var_pp_b, *var_pp_a;
+    EEL_F* var_pp_q[NUM_Q_VAR];
+    EEL_F* var_pp_t[NUM_T_VAR];
+	EEL_F *var_pp_bass, *var_pp_mid, *var_pp_treb, *var_pp_bass_att, *var_pp_mid_att, *var_pp_treb_att;
+    EEL_F *var_pp_sample, *var_pp_value1, *var_pp_value2;
+	EEL_F *var_pp_x, *var_pp_y, *var_pp_r, *var_pp_g, *var_pp_b, *var_pp_a;
 
-	double t_values_after_init_code[NUM_T_VAR];
+	EEL_F t_values_after_init_code[NUM_T_VAR];
 };
 
 typedef struct
@@ -370,13 +389,22 @@ public:
 	// for arbitrary function evaluation:
     NSEEL_CODEHANDLE				m_pf_codehandle;
     NSEEL_CODEHANDLE				m_pp_codehandle;
+    NSEEL_KERNELCLONE				m_pp_clone[MAX_WORKER_THREADS];	// for running bands of the mesh on different threads, see CPlugin::ComputeGridAlphaValues
+    int								m_nPpClones;					// -1 if m_pp_codehandle can't be split up
+    bool							m_bPfOverBudget;				// ran out of CODE_LOOP_BUDGET this frame (see ResetLoopBudget)
+    bool							m_bPvOverBudget;
     char			m_szPerFrameInit[MAX_BIGSTRING_LEN];
     char			m_szPerFrameExpr[MAX_BIGSTRING_LEN];
     char			m_szPerPixelExpr[MAX_BIGSTRING_LEN];
     char            m_szWarpShadersText[MAX_BIGSTRING_LEN]; // pixel shader code
     char            m_szCompShadersText[MAX_BIGSTRING_LEN]; // pixel shader code
 	void			FreeVarsAndCode(bool bFree = true);
+	int				AllocPpClones(int nWanted);
+	void			FreePpClones(bool bFree = true);
 	void			RegisterBuiltInVariables(int flags);
+	void			SeedRand(int flags);
+	static void		SetLoopBudget(NSEEL_VMCTX ctx, bool* pbOverBudget);	// before compiling the code that's limited
+	static void		ResetLoopBudget(NSEEL_VMCTX ctx, bool* pbOverBudget);	// every frame, before running it
 	void			StripLinefeedCharsAndComments(char *src, char *dest);
 
 	bool  m_bBlending;
@@ -386,59 +414,59 @@ public:
 
 	// for once-per-frame expression evaluation: [although, these vars are also shared w/preset init expr eval]
 		NSEEL_VMCTX m_pf_eel;
-    double *var_pf_zoom, *var_pf_zoomexp, *var_pf_rot, *var_pf_warp, *var_pf_cx, *var_pf_cy, *var_pf_dx, *var_pf_dy, *var_pf_sx, *var_pf_sy;
-	double *var_pf_time, *var_pf_fps;
-	double *var_pf_bass, *var_pf_mid, *var_pf_treb, *var_pf_bass_att, *var_pf_mid_att, *var_pf_treb_att;
-	double *var_pf_wave_a, *var_pf_wave_r, *var_pf_wave_g, *var_pf_wave_b, *var_pf_wave_x, *var_pf_wave_y, *var_pf_wave_mystery, *var_pf_wave_mode;
-	double *var_pf_decay;
-	double *var_pf_frame;
+    EEL_F *var_pf_zoom, *var_pf_zoomexp, *var_pf_rot, *var_pf_warp, *var_pf_cx, *var_pf_cy, *var_pf_dx, *var_pf_dy, *var_pf_sx, *var_pf_sy;
+	EEL_F *var_pf_time, *var_pf_fps;
+	EEL_F *var_pf_bass, *var_pf_mid, *var_pf_treb, *var_pf_bass_att, *var_pf_mid_att, *var_pf_treb_att;
+	EEL_F *var_pf_wave_a, *var_pf_wave_r, *var_pf_wave_g, *var_pf_wave_b, *var_pf_wave_x, *var_pf_wave_y, *var_pf_wave_mystery, *var_pf_wave_mode;
+	EEL_F *var_pf_decay;
+	EEL_F *var_pf_frame;
 	//double *var_pf_q1, *var_pf_q2, *var_pf_q3, *var_pf_q4, *var_pf_q5, *var_pf_q6, *var_pf_q7, *var_pf_q8;
-    double* var_pf_q[NUM_Q_VAR];
-	double *var_pf_progress;
-	double *var_pf_ob_size, *var_pf_ob_r, *var_pf_ob_g, *var_pf_ob_b, *var_pf_ob_a;
-	double *var_pf_ib_size, *var_pf_ib_r, *var_pf_ib_g, *var_pf_ib_b, *var_pf_ib_a;
-	double *var_pf_mv_x;
-	double *var_pf_mv_y;
-	double *var_pf_mv_dx;
-	double *var_pf_mv_dy;
-	double *var_pf_mv_l;
-	double *var_pf_mv_r;
-	double *var_pf_mv_g;
-	double *var_pf_mv_b;
-	double *var_pf_mv_a;
-	double *var_pf_monitor;
-	double *var_pf_echo_zoom, *var_pf_echo_alpha, *var_pf_echo_orient;
+    EEL_F* var_pf_q[NUM_Q_VAR];
+	EEL_F *var_pf_progress;
+	EEL_F *var_pf_ob_size, *var_pf_ob_r, *var_pf_ob_g, *var_pf_ob_b, *var_pf_ob_a;
+	EEL_F *var_pf_ib_size, *var_pf_ib_r, *var_pf_ib_g, *var_pf_ib_b, *var_pf_ib_a;
+	EEL_F *var_pf_mv_x;
+	EEL_F *var_pf_mv_y;
+	EEL_F *var_pf_mv_dx;
+	EEL_F *var_pf_mv_dy;
+	EEL_F *var_pf_mv_l;
+	EEL_F *var_pf_mv_r;
+	EEL_F *var_pf_mv_g;
+	EEL_F *var_pf_mv_b;
+	EEL_F *var_pf_mv_a;
+	EEL_F *var_pf_monitor;
+	EEL_F *var_pf_echo_zoom, *var_pf_echo_alpha, *var_pf_echo_orient;
     // new in v1.04:
-	double *var_pf_wave_usedots, *var_pf_wave_thick, *var_pf_wave_additive, *var_pf_wave_brighten;
-    double *var_pf_darken_center, *var_pf_gamma, *var_pf_wrap;
-    double *var_pf_invert, *var_pf_brighten, *var_pf_darken, *var_pf_solarize;
-    double *var_pf_meshx, *var_pf_meshy;
-    double *var_pf_pixelsx, *var_pf_pixelsy;
-    double *var_pf_aspectx, *var_pf_aspecty;
-    double *var_pf_blur1min;
-    double *var_pf_blur2min;
-    double *var_pf_blur3min;
-    double *var_pf_blur1max;
-    double *var_pf_blur2max;
-    double *var_pf_blur3max;
-    double *var_pf_blur1_edge_darken;
+	EEL_F *var_pf_wave_usedots, *var_pf_wave_thick, *var_pf_wave_additive, *var_pf_wave_brighten;
+    EEL_F *var_pf_darken_center, *var_pf_gamma, *var_pf_wrap;
+    EEL_F *var_pf_invert, *var_pf_brighten, *var_pf_darken, *var_pf_solarize;
+    EEL_F *var_pf_meshx, *var_pf_meshy;
+    EEL_F *var_pf_pixelsx, *var_pf_pixelsy;
+    EEL_F *var_pf_aspectx, *var_pf_aspecty;
+    EEL_F *var_pf_blur1min;
+    EEL_F *var_pf_blur2min;
+    EEL_F *var_pf_blur3min;
+    EEL_F *var_pf_blur1max;
+    EEL_F *var_pf_blur2max;
+    EEL_F *var_pf_blur3max;
+    EEL_F *var_pf_blur1_edge_darken;
 
 	// for per-vertex expression evaluation:
 		NSEEL_VMCTX m_pv_eel;
-    double *var_pv_zoom, *var_pv_zoomexp, *var_pv_rot, *var_pv_warp, *var_pv_cx, *var_pv_cy, *var_pv_dx, *var_pv_dy, *var_pv_sx, *var_pv_sy;
-	double *var_pv_time, *var_pv_fps;
-	double *var_pv_bass, *var_pv_mid, *var_pv_treb, *var_pv_bass_att, *var_pv_mid_att, *var_pv_treb_att;
-	double *var_pv_x, *var_pv_y, *var_pv_rad, *var_pv_ang;
-	double *var_pv_frame;
+    EEL_F *var_pv_zoom, *var_pv_zoomexp, *var_pv_rot, *var_pv_warp, *var_pv_cx, *var_pv_cy, *var_pv_dx, *var_pv_dy, *var_pv_sx, *var_pv_sy;
+	EEL_F *var_pv_time, *var_pv_fps;
+	EEL_F *var_pv_bass, *var_pv_mid, *var_pv_treb, *var_pv_bass_att, *var_pv_mid_att, *var_pv_treb_att;
+	EEL_F *var_pv_x, *var_pv_y, *var_pv_rad, *var_pv_ang;
+	EEL_F *var_pv_frame;
 	//double *var_pv_q1, *var_pv_q2, *var_pv_q3, *var_pv_q4, *var_pv_q5, *var_pv_q6, *var_pv_q7, *var_pv_q8;
-    double* var_pv_q[NUM_Q_VAR];
-	double *var_pv_progress;
-    double *var_pv_meshx, *var_pv_meshy;
-    double *var_pv_pixelsx, *var_pv_pixelsy;
-    double *var_pv_aspectx, *var_pv_aspecty;
-
-	double q_values_after_init_code[NUM_Q_VAR];
-    double monitor_after_init_code;
+    EEL_F* var_pv_q[NUM_Q_VAR];
+	EEL_F *var_pv_progress;
+    EEL_F *var_pv_meshx, *var_pv_meshy;
+    EEL_F *var_pv_pixelsx, *var_pv_pixelsy;
+    EEL_F *var_pv_aspectx, *var_pv_aspecty;
+
+	EEL_F q_values_after_init_code[NUM_Q_VAR];
+    EEL_F monitor_after_init_code;
 
     float GetPresetStartTime() { return m_fPresetStartTime; }
     float m_fPresetStartTime;
@@ -75,15 +75,15 @@ typedef struct
 	char            m_szExpr[8192];         // for expression eval
     NSEEL_CODEHANDLE				m_codehandle;	        // for expression eval
 	// input variables for expression eval
-    double          *var_time, *var_frame, *var_fps, *var_progress;
-	double          *var_bass, *var_bass_att, *var_mid, *var_mid_att, *var_treb, *var_treb_att;
+    EEL_F          *var_time, *var_frame, *var_fps, *var_progress;
+	EEL_F          *var_bass, *var_bass_att, *var_mid, *var_mid_att, *var_treb, *var_treb_att;
 	// output variables for expression eval
-	double          *var_x, *var_y;
-	double          *var_sx, *var_sy, *var_rot, *var_flipx, *var_flipy;
-	double          *var_r, *var_g, *var_b, *var_a;
-	double          *var_blendmode;
-	double          *var_repeatx, *var_repeaty;
-	double          *var_done, *var_burn;
+	EEL_F          *var_x, *var_y;
+	EEL_F          *var_sx, *var_sy, *var_rot, *var_flipx, *var_flipy;
+	EEL_F          *var_r, *var_g, *var_b, *var_a;
+	EEL_F          *var_blendmode;
+	EEL_F          *var_repeatx, *var_repeaty;
+	EEL_F          *var_done, *var_burn;
 	NSEEL_VMCTX	tex_eel_ctx;
 }
 td_tex;
@@ -0,0 +1,145 @@
+// workerpool.cpp
+
+#include "workerpool.h"
+
+CWorkerPool::CWorkerPool()
+{
+    m_nWorkers = 0;
+    for (int i=0; i<MAX_WORKER_THREADS-1; i++)
+    {
+        m_worker[i].pPool = this;
+        m_worker[i].hThread = NULL;
+        m_worker[i].hStartEvent = NULL;
+    }
+    m_hDoneEvent = NULL;
+    m_bQuit = false;
+    m_pFunc = NULL;
+    m_pContext = NULL;
+    m_nTasks = 0;
+    m_nNextTask = 0;
+    m_nBusy = 0;
+}
+
+CWorkerPool::~CWorkerPool()
+{
+    Finish();
+}
+
+bool CWorkerPool::Init(int nThreads)
+{
+    Finish();
+
+    if (nThreads <= 0)
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        nThreads = (int)si.dwNumberOfProcessors;
+    }
+    if (nThreads > MAX_WORKER_THREADS)
+        nThreads = MAX_WORKER_THREADS;
+    if (nThreads <= 1)
+        return true;
+
+    m_hDoneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!m_hDoneEvent)
+        return false;
+
+    m_bQuit = false;
+    while (m_nWorkers < nThreads-1)
+    {
+        Worker* w = &m_worker[m_nWorkers];
+        w->hStartEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (!w->hStartEvent)
+            break;
+        w->hThread = CreateThread(NULL, 0, ThreadProc, w, 0, NULL);
+        if (!w->hThread)
+        {
+            CloseHandle(w->hStartEvent);
+            w->hStartEvent = NULL;
+            break;
+        }
+        m_nWorkers++;
+    }
+
+    // whatever did start still gets used
+    return m_nWorkers == nThreads-1;
+}
+
+void CWorkerPool::Finish()
+{
+    int i;
+
+    m_bQuit = true;
+    for (i=0; i<m_nWorkers; i++)
+        SetEvent(m_worker[i].hStartEvent);
+
+    for (i=0; i<m_nWorkers; i++)
+    {
+        WaitForSingleObject(m_worker[i].hThread, INFINITE);
+        CloseHandle(m_worker[i].hThread);
+        CloseHandle(m_worker[i].hStartEvent);
+        m_worker[i].hThread = NULL;
+        m_worker[i].hStartEvent = NULL;
+    }
+    m_nWorkers = 0;
+
+    if (m_hDoneEvent)
+        CloseHandle(m_hDoneEvent);
+    m_hDoneEvent = NULL;
+}
+
+DWORD WINAPI CWorkerPool::ThreadProc(LPVOID lpParameter)
+{
+    Worker* w = (Worker*)lpParameter;
+    CWorkerPool* pPool = w->pPool;
+
+    while (1)
+    {
+        WaitForSingleObject(w->hStartEvent, INFINITE);
+        if (pPool->m_bQuit)
+            break;
+        pPool->DoTasks();
+        if (InterlockedDecrement(&pPool->m_nBusy) == 0)
+            SetEvent(pPool->m_hDoneEvent);
+    }
+
+    return 0;
+}
+
+void CWorkerPool::DoTasks()
+{
+    while (1)
+    {
+        int nTask = (int)InterlockedIncrement(&m_nNextTask) - 1;
+        if (nTask >= m_nTasks)
+            break;
+        m_pFunc(m_pContext, nTask);
+    }
+}
+
+void CWorkerPool::Run(TaskFunc pFunc, void *pContext, int nTasks)
+{
+    if (nTasks <= 0)
+        return;
+
+    // no point waking up more workers than there are tasks left for them
+    int nWake = min(m_nWorkers, nTasks-1);
+    if (nWake <= 0)
+    {
+        for (int i=0; i<nTasks; i++)
+            pFunc(pContext, i);
+        return;
+    }
+
+    m_pFunc = pFunc;
+    m_pContext = pContext;
+    m_nTasks = nTasks;
+    m_nNextTask = 0;
+    m_nBusy = nWake;
+    for (int i=0; i<nWake; i++)
+        SetEvent(m_worker[i].hStartEvent);  // (a full barrier, so the workers see the above)
+
+    DoTasks();
+
+    WaitForSingleObject(m_hDoneEvent, INFINITE);
+}
@@ -0,0 +1,54 @@
+// workerpool.h
+
+#ifndef _MILKDROP_WORKERPOOL_H_
+#define _MILKDROP_WORKERPOOL_H_ 1
+
+#include <windows.h>
+
+#define MAX_WORKER_THREADS 8    // including the thread that calls Run()
+
+// A few threads that are kept around for splitting up per-frame work. Run() hands out the tasks
+// 0..nTasks-1 to the workers and the calling thread, and returns once all of them are done.
+class CWorkerPool
+{
+public:
+    typedef void (*TaskFunc)(void *pContext, int nTask);
+
+    CWorkerPool();
+    ~CWorkerPool();
+
+    // Start nThreads-1 workers, or one fewer than there are processors if nThreads is 0.
+    // With a single processor (or on failure) there are none, and Run() does all the work itself
+    bool Init(int nThreads = 0);
+    void Finish();
+
+    // Threads that take part in Run(), including the caller
+    int  GetThreads() const { return m_nWorkers + 1; }
+
+    void Run(TaskFunc pFunc, void *pContext, int nTasks);
+
+private:
+    struct Worker
+    {
+        CWorkerPool* pPool;
+        HANDLE       hThread;
+        HANDLE       hStartEvent;   // auto-reset
+    };
+
+    static DWORD WINAPI ThreadProc(LPVOID lpParameter);
+    void DoTasks();
+
+    int            m_nWorkers;
+    Worker         m_worker[MAX_WORKER_THREADS-1];
+    HANDLE         m_hDoneEvent;    // auto-reset, set by the last worker to finish
+    volatile bool  m_bQuit;
+
+    // the current Run()
+    TaskFunc       m_pFunc;
+    void*          m_pContext;
+    int            m_nTasks;
+    volatile LONG  m_nNextTask;
+    volatile LONG  m_nBusy;     // workers that haven't finished yet
+};
+
+#endif